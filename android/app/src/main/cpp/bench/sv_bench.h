@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_BENCH_H
+#define AOS_AUDIO_RECORD_SV_BENCH_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "sv_common.h"
+
+namespace sv_recorder {
+
+// Host benchmarks for sv_core. Each suite prints one JSON object per line on stdout
+// so results can be diffed or collected by a script.
+struct SVBenchOptions {
+    int iterations = 200;
+    // Audio seconds per real-time run of the pipeline suite.
+    int seconds = 2;
+    std::string filter;
+};
+
+void SVBenchConvert(const SVBenchOptions& options);
+void SVBenchCodec(const SVBenchOptions& options);
+void SVBenchPipeline(const SVBenchOptions& options);
+void SVBenchResample(const SVBenchOptions& options);
+void SVBenchVad(const SVBenchOptions& options);
+void SVBenchRecovery(const SVBenchOptions& options);
+void SVBenchFanout(const SVBenchOptions& options);
+void SVBenchSegments(const SVBenchOptions& options);
+void SVBenchIndex(const SVBenchOptions& options);
+void SVBenchLatency(const SVBenchOptions& options);
+void SVBenchStartup(const SVBenchOptions& options);
+
+// Heap allocations made by the process so far, counted by sv_bench's operator new.
+uint64_t SVBenchAllocations();
+
+// Runs |fn| |iterations| times and returns the best wall time of one run in ns.
+template <typename Fn>
+int64_t SVBenchBestOf(int iterations, Fn fn) {
+  int64_t best = INT64_MAX;
+  for(int i = 0; i < iterations; i++) {
+    int64_t begin = SVNowNs();
+    fn();
+    int64_t elapsed = SVNowNs() - begin;
+    if(elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best;
+}
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_BENCH_H
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "sv_bench.h"
+
+// Replaces the global allocator of sv_bench so suites can count heap allocations
+// made anywhere in sv_core, e.g. on the audio thread while recording.
+static std::atomic<uint64_t> g_allocations(0);
+
+void* operator new(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  void* ptr = malloc(size ? size : 1);
+  if(!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+  return operator new(size, tag);
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+namespace sv_recorder {
+
+uint64_t SVBenchAllocations() {
+  return g_allocations.load(std::memory_order_relaxed);
+}
+
+}
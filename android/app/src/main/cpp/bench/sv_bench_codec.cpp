@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_bench.h"
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <vector>
+#include "sv_flac_writer.h"
+#include "sv_opus_writer.h"
+
+namespace sv_recorder {
+
+const int SV_BENCH_CODEC_SECONDS = 30;
+
+enum SV_BENCH_SIGNAL {
+    SV_BENCH_TONE,
+    SV_BENCH_NOISE,
+    SV_BENCH_QUIET
+};
+
+static const char* SignalName(SV_BENCH_SIGNAL signal) {
+  switch (signal) {
+    case SV_BENCH_TONE: return "tone";
+    case SV_BENCH_NOISE: return "noise";
+    default: return "quiet";
+  }
+}
+
+static int64_t ThreadCpuNs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static void Generate(SV_BENCH_SIGNAL signal, int sample_rate, int channels, int bits,
+                     std::vector<int32_t>& samples) {
+  const double full_scale = static_cast<double>(1 << (bits - 1)) - 1.0;
+  const size_t frames = samples.size() / channels;
+  uint32_t state = 0x9E3779B9u;
+  for(size_t i = 0; i < frames; i++) {
+    for(int ch = 0; ch < channels; ch++) {
+      state = state * 1664525u + 1013904223u;
+      double noise = static_cast<int32_t>(state) / 2147483648.0;
+      double value;
+      if(signal == SV_BENCH_TONE) {
+        // Two partials per channel plus a noise floor, roughly music at moderate level.
+        double t = static_cast<double>(i) / sample_rate;
+        value = 0.3 * sin(2.0 * M_PI * (220.0 + 110.0 * ch) * t) +
+                0.1 * sin(2.0 * M_PI * 1375.0 * t) + 0.002 * noise;
+      } else if(signal == SV_BENCH_NOISE) {
+        value = 0.9 * noise;
+      } else {
+        value = 0.0005 * noise;
+      }
+      samples[i * channels + ch] = static_cast<int32_t>(lrint(value * full_scale));
+    }
+  }
+}
+
+static void RunFlac(SV_BENCH_SIGNAL signal, int sample_rate, int channels, int bits) {
+  const size_t frames = static_cast<size_t>(sample_rate) * SV_BENCH_CODEC_SECONDS;
+  std::vector<int32_t> samples(frames * channels);
+  Generate(signal, sample_rate, channels, bits, samples);
+
+  SVFlacEncoder encoder;
+  encoder.Init(sample_rate, channels, bits);
+  int64_t cpu_begin = ThreadCpuNs();
+  int64_t wall_begin = SVNowNs();
+  for(size_t offset = 0; offset < frames; offset += SV_FLAC_BLOCK_FRAMES) {
+    int32_t block = static_cast<int32_t>(std::min<size_t>(SV_FLAC_BLOCK_FRAMES, frames - offset));
+    encoder.EncodeBlock(samples.data() + offset * channels, block);
+  }
+  int64_t wall_ns = SVNowNs() - wall_begin;
+  int64_t cpu_ns = ThreadCpuNs() - cpu_begin;
+
+  const SVFlacEncoderStats& stats = encoder.stats();
+  const double audio_ns = SV_BENCH_CODEC_SECONDS * 1e9;
+  printf("{\"suite\":\"codec\",\"codec\":\"flac\",\"signal\":\"%s\",\"sample_rate\":%d,\"channels\":%d,"
+         "\"bits\":%d,\"seconds\":%d,\"ratio\":%.3f,\"kbps\":%.1f,\"realtime_factor\":%.1f,\"cpu_percent\":%.3f}\n",
+         SignalName(signal), sample_rate, channels, bits, SV_BENCH_CODEC_SECONDS,
+         static_cast<double>(stats.output_bytes) / stats.input_bytes,
+         stats.output_bytes * 8.0 / 1000.0 / SV_BENCH_CODEC_SECONDS,
+         wall_ns > 0 ? audio_ns / wall_ns : 0.0, cpu_ns * 100.0 / audio_ns);
+}
+
+static void RunOpus(SV_BENCH_SIGNAL signal, int sample_rate, int channels, int32_t bitrate) {
+  SVOpusEncoder encoder;
+  if(encoder.Init(sample_rate, channels, bitrate) != SV_NO_ERROR) {
+    printf("{\"suite\":\"codec\",\"codec\":\"opus\",\"error\":\"unavailable\"}\n");
+    return;
+  }
+  const size_t frames = static_cast<size_t>(sample_rate) * SV_BENCH_CODEC_SECONDS;
+  std::vector<int32_t> generated(frames * channels);
+  Generate(signal, sample_rate, channels, 16, generated);
+  std::vector<int16_t> samples(generated.begin(), generated.end());
+
+  const size_t frame_length = static_cast<size_t>(encoder.frame_length());
+  int64_t cpu_begin = ThreadCpuNs();
+  int64_t wall_begin = SVNowNs();
+  for(size_t offset = 0; offset + frame_length <= frames; offset += frame_length) {
+    encoder.EncodeFrame(samples.data() + offset * channels);
+  }
+  int64_t wall_ns = SVNowNs() - wall_begin;
+  int64_t cpu_ns = ThreadCpuNs() - cpu_begin;
+
+  const SVOpusEncoderStats& stats = encoder.stats();
+  const double audio_ns = SV_BENCH_CODEC_SECONDS * 1e9;
+  printf("{\"suite\":\"codec\",\"codec\":\"opus\",\"signal\":\"%s\",\"sample_rate\":%d,\"channels\":%d,"
+         "\"bitrate\":%d,\"seconds\":%d,\"ratio\":%.3f,\"kbps\":%.1f,\"realtime_factor\":%.1f,"
+         "\"cpu_percent\":%.3f}\n",
+         SignalName(signal), sample_rate, channels, bitrate, SV_BENCH_CODEC_SECONDS,
+         stats.input_bytes ? static_cast<double>(stats.output_bytes) / stats.input_bytes : 0.0,
+         stats.output_bytes * 8.0 / 1000.0 / SV_BENCH_CODEC_SECONDS,
+         wall_ns > 0 ? audio_ns / wall_ns : 0.0, cpu_ns * 100.0 / audio_ns);
+}
+
+void SVBenchCodec(const SVBenchOptions& options) {
+  const SV_BENCH_SIGNAL signals[] = {SV_BENCH_TONE, SV_BENCH_NOISE, SV_BENCH_QUIET};
+  for(SV_BENCH_SIGNAL signal : signals) {
+    RunFlac(signal, 48000, 2, 16);
+    RunFlac(signal, 48000, 1, 24);
+    RunOpus(signal, 48000, 2, SV_OPUS_DEFAULT_BITRATE);
+    RunOpus(signal, 16000, 1, 16000);
+  }
+}
+
+}
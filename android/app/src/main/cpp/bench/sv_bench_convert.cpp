@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_bench.h"
+#include <vector>
+#include "sv_sample_convert.h"
+
+namespace sv_recorder {
+
+// 100ms of 48kHz stereo, the largest buffer a backend hands to the pipeline.
+const size_t SV_BENCH_CONVERT_FRAMES = 4800;
+const int SV_BENCH_CONVERT_CHANNELS = 2;
+
+static void Report(const SVConvertKernels& kernels, const char* kernel, int64_t best_ns, size_t samples) {
+  double samples_per_us = best_ns > 0 ? samples * 1000.0 / best_ns : 0.0;
+  printf("{\"suite\":\"convert\",\"kernel\":\"%s\",\"isa\":\"%s\",\"samples\":%zu,"
+         "\"best_ns\":%lld,\"msamples_per_s\":%.1f}\n",
+         kernel, kernels.name, samples, (long long) best_ns, samples_per_us);
+}
+
+void SVBenchConvert(const SVBenchOptions& options) {
+  const size_t samples = SV_BENCH_CONVERT_FRAMES * SV_BENCH_CONVERT_CHANNELS;
+  std::vector<float> f32(samples);
+  std::vector<float> f32_out(samples);
+  std::vector<int16_t> i16(samples);
+  std::vector<uint8_t> i24(samples * 3);
+  std::vector<float> planes(samples);
+  float* plane_ptrs[SV_BENCH_CONVERT_CHANNELS];
+  for(int ch = 0; ch < SV_BENCH_CONVERT_CHANNELS; ch++) {
+    plane_ptrs[ch] = planes.data() + ch * SV_BENCH_CONVERT_FRAMES;
+  }
+  uint32_t state = 0x2545F491u;
+  for(size_t i = 0; i < samples; i++) {
+    state = state * 1664525u + 1013904223u;
+    f32[i] = static_cast<float>(state) / 4294967296.0f * 2.0f - 1.0f;
+  }
+
+  const SV_SIMD_LEVEL levels[] = {SV_SIMD_SCALAR, SV_SIMD_SSE2, SV_SIMD_AVX2, SV_SIMD_NEON};
+  for(SV_SIMD_LEVEL level : levels) {
+    const SVConvertKernels* kernels = SVGetConvertKernels(level);
+    if(!kernels) {
+      continue;
+    }
+    int64_t best = SVBenchBestOf(options.iterations, [&] {
+      kernels->f32_to_i16(f32.data(), i16.data(), samples);
+    });
+    Report(*kernels, "f32_to_i16", best, samples);
+    best = SVBenchBestOf(options.iterations, [&] {
+      kernels->i16_to_f32(i16.data(), f32_out.data(), samples);
+    });
+    Report(*kernels, "i16_to_f32", best, samples);
+    best = SVBenchBestOf(options.iterations, [&] {
+      kernels->f32_to_i24(f32.data(), i24.data(), samples);
+    });
+    Report(*kernels, "f32_to_i24", best, samples);
+    best = SVBenchBestOf(options.iterations, [&] {
+      kernels->i24_to_f32(i24.data(), f32_out.data(), samples);
+    });
+    Report(*kernels, "i24_to_f32", best, samples);
+    best = SVBenchBestOf(options.iterations, [&] {
+      kernels->deinterleave(f32.data(), plane_ptrs, SV_BENCH_CONVERT_FRAMES, SV_BENCH_CONVERT_CHANNELS);
+    });
+    Report(*kernels, "deinterleave", best, samples);
+    best = SVBenchBestOf(options.iterations, [&] {
+      kernels->interleave(plane_ptrs, f32_out.data(), SV_BENCH_CONVERT_FRAMES, SV_BENCH_CONVERT_CHANNELS);
+    });
+    Report(*kernels, "interleave", best, samples);
+  }
+  printf("{\"suite\":\"convert\",\"selected\":\"%s\"}\n", SVConvert().name);
+}
+
+}
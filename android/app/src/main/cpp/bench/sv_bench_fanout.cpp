@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_bench.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "sv_synthetic_recorder.h"
+
+namespace sv_recorder {
+
+const int SV_BENCH_FANOUT_RATE = 48000;
+const int SV_BENCH_FANOUT_CHANNELS = 2;
+// Queue of the stalling sink, it blocks far longer than this covers.
+const int SV_BENCH_SLOW_QUEUE_BLOCKS = 10;
+const int SV_BENCH_SLOW_BLOCK_MS = 100;
+const char* const SV_BENCH_FANOUT_PATH = "/tmp/sv_bench_fanout.out";
+
+// Counts blocks and checks the sequence for holes, optionally stalling on every block.
+class SVBenchCountingSink : public ISVBlockSink {
+
+public:
+    explicit SVBenchCountingSink(int stall_ms) : stall_ms_(stall_ms), blocks_(0), holes_(0), next_(0) {}
+
+    const char* name() const override { return stall_ms_ > 0 ? "slow" : "fast"; }
+    int Prepare(const SVAudioFormat& format) override { return SV_NO_ERROR; }
+    void OnBlock(const SVAudioBlock& block, uint64_t sequence) override {
+      holes_ += sequence != next_;
+      next_ = sequence + 1;
+      blocks_++;
+      if(stall_ms_ > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(stall_ms_));
+      }
+    }
+
+    uint64_t blocks() const { return blocks_; }
+    uint64_t holes() const { return holes_; }
+
+private:
+    int stall_ms_;
+    uint64_t blocks_;
+    uint64_t holes_;
+    uint64_t next_;
+};
+
+// Capture cost and per-sink delivery with |fast_sinks| keeping up and optionally one
+// sink that stalls on every block.
+static void RunFanout(const SVBenchOptions& options, int fast_sinks, bool slow_sink) {
+  std::vector<std::shared_ptr<SVBenchCountingSink>> sinks;
+  int64_t callback_p50 = 0;
+  int64_t callback_p99 = 0;
+  int64_t callback_max = 0;
+  SVSinkStats slow_stats = {0, 0, 0, 0, 0};
+  uint64_t fast_holes = 0;
+  uint64_t fast_min_blocks = UINT64_MAX;
+  {
+    SVSyntheticRecorder recorder(SV_BENCH_FANOUT_PATH, SV_SOURCE_NOISE);
+    for(int i = 0; i < fast_sinks; i++) {
+      sinks.push_back(std::make_shared<SVBenchCountingSink>(0));
+      recorder.pipeline().AddSink(sinks.back());
+    }
+    if(slow_sink) {
+      sinks.push_back(std::make_shared<SVBenchCountingSink>(SV_BENCH_SLOW_BLOCK_MS));
+      recorder.pipeline().AddSink(sinks.back(), SV_BENCH_SLOW_QUEUE_BLOCKS);
+    }
+    if(recorder.InitRecording(SV_BENCH_FANOUT_RATE, SV_BENCH_FANOUT_CHANNELS, SV_SAMPLE_I16) != SV_NO_ERROR) {
+      return;
+    }
+    recorder.StartRecording();
+    std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+    recorder.StopRecording();
+    const SVHistogram& callback_us = recorder.pipeline().metrics().duration_us();
+    callback_p50 = callback_us.Percentile(50);
+    callback_p99 = callback_us.Percentile(99);
+    callback_max = callback_us.max();
+    if(slow_sink) {
+      slow_stats = recorder.pipeline().sinks().GetStats(sinks.size() - 1);
+    }
+  }
+  for(int i = 0; i < fast_sinks; i++) {
+    fast_holes += sinks[i]->holes();
+    fast_min_blocks = std::min(fast_min_blocks, sinks[i]->blocks());
+  }
+  printf("{\"suite\":\"fanout\",\"fast_sinks\":%d,\"slow_sink\":%s,\"callback_us\":{\"p50\":%lld,\"p99\":%lld,"
+         "\"max\":%lld},\"fast_min_blocks\":%llu,\"fast_holes\":%llu,\"slow_blocks\":%llu,\"slow_dropped\":%llu,"
+         "\"slow_holes\":%llu}\n",
+         fast_sinks, slow_sink ? "true" : "false", (long long) callback_p50,
+         (long long) callback_p99, (long long) callback_max,
+         (unsigned long long) (fast_sinks > 0 ? fast_min_blocks : 0), (unsigned long long) fast_holes,
+         (unsigned long long) slow_stats.blocks_delivered, (unsigned long long) slow_stats.blocks_dropped,
+         (unsigned long long) (slow_sink ? sinks.back()->holes() : 0));
+  remove(SV_BENCH_FANOUT_PATH);
+  remove((std::string(SV_BENCH_FANOUT_PATH) + SV_INDEX_SUFFIX).c_str());
+}
+
+void SVBenchFanout(const SVBenchOptions& options) {
+  for(int fast_sinks : {0, 1, 4}) {
+    RunFanout(options, fast_sinks, false);
+  }
+  RunFanout(options, 4, true);
+}
+
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_bench.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include "sv_recording_reader.h"
+#include "sv_synthetic_recorder.h"
+
+namespace sv_recorder {
+
+const int SV_BENCH_INDEX_RATE = 48000;
+const int SV_BENCH_INDEX_CHANNELS = 2;
+const int SV_BENCH_INDEX_OUTAGE_MS = 200;
+const int SV_BENCH_INDEX_WINDOW_MS = 100;
+const int SV_BENCH_INDEX_WINDOWS = 1000;
+const size_t SV_BENCH_INDEX_COLUMNS = 800;
+const char* const SV_BENCH_INDEX_PATH = "/tmp/sv_bench_index";
+
+struct SVBenchIndexFile {
+    SV_CONTAINER_TYPE container;
+    const char* extension;
+};
+
+// Records with one stream outage in the middle, so the index has a gap to report.
+static bool RecordFile(const SVBenchOptions& options, const SVBenchIndexFile& file, const std::string& path,
+                       const SVAudioFormat& format) {
+  SVSyntheticRecorder recorder(path, SV_SOURCE_NOISE);
+  recorder.SetOption(SV_OPTION_CONTAINER, file.container);
+  if(recorder.InitRecording(format.sample_rate, format.channels, format.sample_format) != SV_NO_ERROR) {
+    return false;
+  }
+  const auto half = std::chrono::milliseconds(options.seconds * 500);
+  recorder.StartRecording();
+  std::this_thread::sleep_for(half);
+  recorder.InjectDisconnect(SV_BENCH_INDEX_OUTAGE_MS, 0);
+  std::this_thread::sleep_for(half);
+  recorder.StopRecording();
+  return true;
+}
+
+// Open cost with the written index and without it, window extraction at random positions
+// and a full-length overview.
+static void RunIndex(const SVBenchOptions& options, const SVBenchIndexFile& file) {
+  const SVAudioFormat format = {SV_BENCH_INDEX_RATE, SV_BENCH_INDEX_CHANNELS, SV_SAMPLE_I16};
+  const std::string path = std::string(SV_BENCH_INDEX_PATH) + file.extension;
+  const std::string index_path = path + SV_INDEX_SUFFIX;
+  if(!RecordFile(options, file, path, format)) {
+    return;
+  }
+  SVRecordingReader reader;
+  int64_t begin_ns = SVNowNs();
+  if(reader.Open(path, format) != SV_NO_ERROR) {
+    printf("{\"suite\":\"index\",\"container\":\"%s\",\"error\":\"open\"}\n", file.extension + 1);
+    return;
+  }
+  const int64_t open_us = (SVNowNs() - begin_ns) / 1000;
+  const std::vector<SVIndexSummary> written = reader.index().summaries();
+  uint64_t gap_frames = 0;
+  for(const SVIndexGap& gap : reader.index().gaps()) {
+    gap_frames += gap.frames;
+  }
+
+  // Random windows, with the seek offset and skip of each one as a player would need them.
+  const size_t window_frames = static_cast<size_t>(SV_BENCH_INDEX_RATE) * SV_BENCH_INDEX_WINDOW_MS / 1000;
+  std::vector<uint8_t> window(window_frames * format.BytesPerFrame());
+  std::mt19937 random(1);
+  uint64_t copied = 0;
+  uint64_t max_skip = 0;
+  begin_ns = SVNowNs();
+  for(int i = 0; i < SV_BENCH_INDEX_WINDOWS; i++) {
+    const uint64_t frame = random() % reader.frames();
+    uint64_t skip;
+    reader.SeekOffset(frame, &skip);
+    max_skip = std::max(max_skip, skip);
+    copied += reader.ReadFrames(frame, window_frames, window.data());
+  }
+  const double window_us = (SVNowNs() - begin_ns) / 1e3 / SV_BENCH_INDEX_WINDOWS;
+
+  std::vector<SVIndexSummary> columns(SV_BENCH_INDEX_COLUMNS);
+  const int64_t overview_ns = SVBenchBestOf(options.iterations, [&]() {
+    reader.Overview(0, reader.frames(), columns.size(), columns.data());
+  });
+
+  // A crash leaves no index behind, the reader has to rebuild the same one from the file.
+  int64_t rebuild_us = -1;
+  size_t mismatches = 0;
+  if(reader.has_samples()) {
+    remove(index_path.c_str());
+    begin_ns = SVNowNs();
+    SVRecordingReader rebuilt;
+    if(rebuilt.Open(path, format) == SV_NO_ERROR) {
+      rebuild_us = (SVNowNs() - begin_ns) / 1000;
+      const std::vector<SVIndexSummary>& summaries = rebuilt.index().summaries();
+      mismatches = summaries.size() != written.size() ? written.size() : 0;
+      for(size_t i = 0; mismatches == 0 && i < written.size(); i++) {
+        mismatches += summaries[i].peak != written[i].peak || summaries[i].rms != written[i].rms;
+      }
+    }
+  }
+  printf("{\"suite\":\"index\",\"container\":\"%s\",\"seconds\":%.3f,\"index_seconds\":%zu,\"summaries\":%zu,"
+         "\"levels\":%zu,\"gaps\":%zu,\"gap_ms\":%.1f,\"open_us\":%lld,\"window_us\":%.2f,\"windows_frames\":%llu,"
+         "\"max_skip_frames\":%llu,\"overview_us\":%.1f,\"rebuild_us\":%lld,\"rebuild_mismatches\":%zu}\n",
+         file.extension + 1, reader.frames() / static_cast<double>(format.sample_rate),
+         reader.index().second_offsets().size(), written.size(), reader.level_count(), reader.index().gaps().size(),
+         gap_frames * 1000.0 / format.sample_rate, (long long) open_us, window_us, (unsigned long long) copied,
+         (unsigned long long) max_skip, overview_ns / 1e3, (long long) rebuild_us, mismatches);
+  reader.Close();
+  remove(path.c_str());
+  remove(index_path.c_str());
+}
+
+void SVBenchIndex(const SVBenchOptions& options) {
+  const SVBenchIndexFile files[] = {
+          {SV_CONTAINER_RAW, ".pcm"},
+          {SV_CONTAINER_WAV, ".wav"},
+          {SV_CONTAINER_FLAC, ".flac"},
+  };
+  for(const SVBenchIndexFile& file : files) {
+    RunIndex(options, file);
+  }
+}
+
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_bench.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include "sv_latency_tuner.h"
+#include "sv_synthetic_recorder.h"
+
+namespace sv_recorder {
+
+const int SV_BENCH_LATENCY_RATE = 48000;
+const int32_t SV_BENCH_LATENCY_BURST = 480;
+const int32_t SV_BENCH_LATENCY_MAX_MS = 200;
+const int64_t SV_BENCH_LATENCY_CALLBACK_NS = 200000;
+const char* const SV_BENCH_LATENCY_PATH = "/tmp/sv_bench_latency.pcm";
+
+struct SVBenchLatencyPhase {
+    const char* name;
+    int seconds;
+    SVSyntheticJitter jitter;
+};
+
+struct SVBenchLatencyConfig {
+    const char* name;
+    bool tuned;
+    bool low_latency;
+    bool adaptive;
+    // The backend has no xrun counter, the tuner infers overflows.
+    bool inferred;
+};
+
+// The synthetic device in virtual time: captures on its own clock into a buffer of the
+// tuned size, the callback wakes late by the phase's jitter and takes whole bursts.
+class SVBenchLatencyDevice {
+
+public:
+    explicit SVBenchLatencyDevice(const SVBenchLatencyConfig& config)
+      : config_(config), now_ns_(1000000000LL), start_ns_(now_ns_), consumed_(0), xruns_(0), random_(1) {
+      SVLatencyConfig latency;
+      latency.adaptive = config.adaptive;
+      latency.max_latency_ms = config.adaptive ? SV_BENCH_LATENCY_MAX_MS : 0;
+      tuner_.Configure(latency, SV_BENCH_LATENCY_RATE);
+      const int32_t capacity = SV_BENCH_LATENCY_BURST * SV_SYNTHETIC_CAPACITY_BURSTS;
+      tuner_.Init(config.tuned ? SV_BENCH_LATENCY_BURST : 0, capacity,
+                  config.low_latency ? SV_BENCH_LATENCY_BURST * SV_LOW_LATENCY_INITIAL_BURSTS : capacity);
+    }
+
+    void Run(const SVBenchLatencyPhase& phase) {
+      const int64_t end_ns = now_ns_ + phase.seconds * 1000000000LL;
+      const int32_t xruns_before = xruns_;
+      const uint32_t grows_before = tuner_.grows();
+      const uint32_t shrinks_before = tuner_.shrinks();
+      double buffer_sum = 0.0;
+      int64_t callbacks = 0;
+      int32_t max_buffer = 0;
+      int64_t next_stall_ns = 0;
+      while(now_ns_ < end_ns) {
+        const int64_t ready_ns = start_ns_ + (consumed_ + SV_BENCH_LATENCY_BURST) * 1000000000LL / SV_BENCH_LATENCY_RATE;
+        int64_t delay_ns = phase.jitter.jitter_ms > 0 ? random_() % (phase.jitter.jitter_ms * 1000000LL) : 0;
+        if(phase.jitter.stall_interval_ms > 0 && ready_ns >= next_stall_ns) {
+          delay_ns += phase.jitter.stall_ms * 1000000LL;
+          next_stall_ns = ready_ns + phase.jitter.stall_interval_ms * 1000000LL;
+        }
+        now_ns_ = std::max(now_ns_, ready_ns + delay_ns);
+        int64_t available = (now_ns_ - start_ns_) * SV_BENCH_LATENCY_RATE / 1000000000LL - consumed_;
+        if(available > tuner_.buffer_size()) {
+          consumed_ += available - tuner_.buffer_size();
+          available = tuner_.buffer_size();
+          xruns_++;
+        }
+        while(available >= SV_BENCH_LATENCY_BURST) {
+          const int32_t next = tuner_.OnCallback(now_ns_, SV_BENCH_LATENCY_BURST, config_.inferred ? -1 : xruns_);
+          if(next > 0) {
+            tuner_.SetBufferSize(next);
+          }
+          buffer_sum += tuner_.buffer_size();
+          max_buffer = std::max(max_buffer, tuner_.buffer_size());
+          callbacks++;
+          consumed_ += SV_BENCH_LATENCY_BURST;
+          available -= SV_BENCH_LATENCY_BURST;
+          now_ns_ += SV_BENCH_LATENCY_CALLBACK_NS;
+        }
+      }
+      const double frames_per_ms = SV_BENCH_LATENCY_RATE / 1000.0;
+      printf("{\"suite\":\"latency\",\"mode\":\"simulated\",\"config\":\"%s\",\"phase\":\"%s\",\"seconds\":%d,"
+             "\"xruns\":%d,\"mean_buffer_ms\":%.1f,\"max_buffer_ms\":%.1f,\"end_buffer_ms\":%.1f,\"grows\":%u,"
+             "\"shrinks\":%u,\"jitter_ms\":%.1f,\"writer_batch_ms\":%d}\n",
+             config_.name, phase.name, phase.seconds, xruns_ - xruns_before,
+             callbacks > 0 ? buffer_sum / callbacks / frames_per_ms : 0.0, max_buffer / frames_per_ms,
+             tuner_.buffer_size() / frames_per_ms, tuner_.grows() - grows_before, tuner_.shrinks() - shrinks_before,
+             tuner_.jitter_frames() / frames_per_ms, tuner_.WriterBatchMs());
+    }
+
+private:
+    SVBenchLatencyConfig config_;
+    SVLatencyTuner tuner_;
+    int64_t now_ns_;
+    int64_t start_ns_;
+    int64_t consumed_;
+    int32_t xruns_;
+    std::mt19937 random_;
+};
+
+// Minutes of calm, jitter and calm again in virtual time: how many xruns each sizing
+// takes and how much latency it pays for them.
+static void RunSimulated() {
+  const SVBenchLatencyPhase phases[] = {
+          {"calm", 30, {1, 0, 0}},
+          {"jitter", 30, {8, 60, 2000}},
+          {"calm", 60, {1, 0, 0}},
+  };
+  const SVBenchLatencyConfig configs[] = {
+          {"default", false, false, false, false},
+          {"low_latency", true, true, false, false},
+          {"adaptive", true, true, true, false},
+          {"adaptive_default", true, false, true, false},
+          {"adaptive_inferred", true, true, true, true},
+  };
+  for(const SVBenchLatencyConfig& config : configs) {
+    SVBenchLatencyDevice device(config);
+    for(const SVBenchLatencyPhase& phase : phases) {
+      device.Run(phase);
+    }
+  }
+}
+
+// The same through the whole pipeline on the synthetic backend, in real time.
+static void RunRealTime(const SVBenchOptions& options) {
+  SVSyntheticRecorder recorder(SV_BENCH_LATENCY_PATH, SV_SOURCE_NOISE);
+  recorder.SetOption(SV_OPTION_LOW_LATENCY, 1);
+  recorder.SetOption(SV_OPTION_ADAPTIVE_BUFFER, 1);
+  recorder.SetOption(SV_OPTION_MAX_LATENCY_MS, SV_BENCH_LATENCY_MAX_MS);
+  recorder.SetOption(SV_OPTION_FILE_INDEX, 0);
+  if(recorder.InitRecording(SV_BENCH_LATENCY_RATE, 2, SV_SAMPLE_I16) != SV_NO_ERROR) {
+    return;
+  }
+  const SVBenchLatencyPhase phases[] = {
+          {"calm", options.seconds, {1, 0, 0}},
+          {"jitter", options.seconds, {5, 60, 500}},
+          {"jitter_settled", options.seconds, {5, 60, 500}},
+  };
+  const SVLatencyTuner& tuner = recorder.pipeline().latency_tuner();
+  recorder.StartRecording();
+  for(const SVBenchLatencyPhase& phase : phases) {
+    const uint32_t xruns_before = recorder.xruns();
+    const uint32_t grows_before = tuner.grows();
+    recorder.SetJitter(phase.jitter);
+    std::this_thread::sleep_for(std::chrono::seconds(phase.seconds));
+    printf("{\"suite\":\"latency\",\"mode\":\"realtime\",\"config\":\"adaptive\",\"phase\":\"%s\",\"seconds\":%d,"
+           "\"xruns\":%u,\"buffer_ms\":%.1f,\"grows\":%u,\"writer_batch_ms\":%d}\n",
+           phase.name, phase.seconds, recorder.xruns() - xruns_before,
+           tuner.buffer_size() * 1000.0 / SV_BENCH_LATENCY_RATE, tuner.grows() - grows_before,
+           tuner.WriterBatchMs());
+  }
+  recorder.StopRecording();
+  remove(SV_BENCH_LATENCY_PATH);
+}
+
+void SVBenchLatency(const SVBenchOptions& options) {
+  RunSimulated();
+  RunRealTime(options);
+}
+
+}
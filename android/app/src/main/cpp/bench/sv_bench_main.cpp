@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include <cstdlib>
+#include <cstring>
+#include "sv_bench.h"
+
+using namespace sv_recorder;
+
+struct SVBenchSuite {
+    const char* name;
+    void (*run)(const SVBenchOptions& options);
+};
+
+static const SVBenchSuite kSuites[] = {
+        {"convert", SVBenchConvert},
+        {"codec", SVBenchCodec},
+        {"pipeline", SVBenchPipeline},
+        {"resample", SVBenchResample},
+        {"vad", SVBenchVad},
+        {"recovery", SVBenchRecovery},
+        {"fanout", SVBenchFanout},
+        {"segments", SVBenchSegments},
+        {"index", SVBenchIndex},
+        {"latency", SVBenchLatency},
+        {"startup", SVBenchStartup},
+};
+
+// Usage: sv_bench [--iterations N] [--seconds N] [suite]
+int main(int argc, char** argv) {
+  SVBenchOptions options;
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      options.iterations = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      options.seconds = atoi(argv[++i]);
+    } else {
+      options.filter = argv[i];
+    }
+  }
+
+  int ran = 0;
+  for(const SVBenchSuite& suite : kSuites) {
+    if(options.filter.empty() || options.filter == suite.name) {
+      suite.run(options);
+      ran++;
+    }
+  }
+  if(ran == 0) {
+    fprintf(stderr, "unknown suite: %s\n", options.filter.c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_bench.h"
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <vector>
+#include "sv_synthetic_recorder.h"
+
+namespace sv_recorder {
+
+const int SV_BENCH_PIPELINE_RATE = 48000;
+const int SV_BENCH_PIPELINE_CHANNELS = 2;
+const int SV_BENCH_WARMUP_MS = 200;
+const char* const SV_BENCH_PIPELINE_PATH = "/tmp/sv_bench_pipeline.out";
+
+// Only the callback size of a backend is mimicked: 10ms OpenSL buffers, an AAudio MMAP
+// burst and Oboe's low-latency burst at 48kHz.
+struct SVBenchProfile {
+    const char* name;
+    int32_t frames_per_callback;
+};
+
+static const SVBenchProfile kOpenSL = {"opensl", SV_BENCH_PIPELINE_RATE / SV_BUFFERS_PER_SECOND};
+static const SVBenchProfile kAAudio = {"aaudio", 192};
+static const SVBenchProfile kOboe = {"oboe", 96};
+
+struct SVBenchSink {
+    SV_CONTAINER_TYPE container;
+    SV_FILE_OUTPUT_TYPE output;
+    SV_SAMPLE_FORMAT format;
+};
+
+static const char* ContainerName(SV_CONTAINER_TYPE container) {
+  switch (container) {
+    case SV_CONTAINER_WAV: return "wav";
+    case SV_CONTAINER_FLAC: return "flac";
+    default: return "raw";
+  }
+}
+
+static const char* FormatName(SV_SAMPLE_FORMAT format) {
+  switch (format) {
+    case SV_SAMPLE_F32: return "f32";
+    case SV_SAMPLE_I24: return "i24";
+    default: return "i16";
+  }
+}
+
+static int64_t ProcessCpuNs() {
+  timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static void PrintConfig(const char* mode, const SVBenchProfile& profile, const SVBenchSink& sink) {
+  printf("{\"suite\":\"pipeline\",\"mode\":\"%s\",\"profile\":\"%s\",\"callback_frames\":%d,"
+         "\"container\":\"%s\",\"output\":\"%s\",\"format\":\"%s\",\"sample_rate\":%d,\"channels\":%d",
+         mode, profile.name, profile.frames_per_callback, ContainerName(sink.container),
+         sink.output == SV_OUTPUT_MMAP ? "mmap" : "stdio", FormatName(sink.format),
+         SV_BENCH_PIPELINE_RATE, SV_BENCH_PIPELINE_CHANNELS);
+}
+
+static void PrintPercentiles(const char* name, const SVHistogram& histogram) {
+  printf(",\"%s\":{\"p50\":%lld,\"p90\":%lld,\"p99\":%lld,\"max\":%lld}", name,
+         (long long) histogram.Percentile(50), (long long) histogram.Percentile(90),
+         (long long) histogram.Percentile(99), (long long) histogram.max());
+}
+
+// Real-time run: the synthetic backend's clock drives the pipeline like a device would.
+// Reports callback-to-disk latency, CPU per audio second and allocations after warm-up.
+static void RunRealtime(const SVBenchOptions& options, const SVBenchProfile& profile, const SVBenchSink& sink) {
+  uint64_t allocs_begin = SVBenchAllocations();
+  uint64_t allocs_steady;
+  int64_t cpu_ns;
+  int64_t wall_ns;
+  {
+    SVSyntheticRecorder recorder(SV_BENCH_PIPELINE_PATH, SV_SOURCE_NOISE);
+    recorder.SetFramesPerCallback(profile.frames_per_callback);
+    recorder.SetOption(SV_OPTION_OUTPUT_TYPE, sink.output);
+    recorder.SetOption(SV_OPTION_CONTAINER, sink.container);
+    if(recorder.InitRecording(SV_BENCH_PIPELINE_RATE, SV_BENCH_PIPELINE_CHANNELS, sink.format) != SV_NO_ERROR) {
+      return;
+    }
+
+    int64_t cpu_begin = ProcessCpuNs();
+    int64_t wall_begin = SVNowNs();
+    recorder.StartRecording();
+    std::this_thread::sleep_for(std::chrono::milliseconds(SV_BENCH_WARMUP_MS));
+    uint64_t steady_begin = SVBenchAllocations();
+    std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+    allocs_steady = SVBenchAllocations() - steady_begin;
+    recorder.StopRecording();
+    wall_ns = SVNowNs() - wall_begin;
+    cpu_ns = ProcessCpuNs() - cpu_begin;
+
+    SVCapturePipeline& pipeline = recorder.pipeline();
+    const SVRecorderMetrics& metrics = pipeline.metrics();
+    SVDiskWriterStats writer = pipeline.GetWriterStats();
+    SVFileOutputStats output = pipeline.GetOutputStats();
+    double audio_seconds = static_cast<double>(metrics.frames_delivered()) / SV_BENCH_PIPELINE_RATE;
+
+    PrintConfig("realtime", profile, sink);
+    printf(",\"seconds\":%.2f,\"callbacks\":%llu", audio_seconds, (unsigned long long) metrics.callbacks());
+    PrintPercentiles("latency_us", metrics.sink_latency_us());
+    PrintPercentiles("callback_us", metrics.duration_us());
+    printf(",\"mb_per_s\":%.3f,\"io_calls\":%llu,\"file_bytes\":%llu,\"cpu_ms_per_audio_s\":%.3f,"
+           "\"overruns\":%llu,\"allocs_setup\":%llu,\"allocs_steady\":%llu}\n",
+           writer.bytes_written / 1e6 / (wall_ns * 1e-9), (unsigned long long) output.io_calls,
+           (unsigned long long) output.bytes_written,
+           audio_seconds > 0 ? cpu_ns / 1e6 / audio_seconds : 0.0,
+           (unsigned long long) writer.overrun_count,
+           (unsigned long long) (steady_begin - allocs_begin), (unsigned long long) allocs_steady);
+  }
+  remove(SV_BENCH_PIPELINE_PATH);
+  remove((std::string(SV_BENCH_PIPELINE_PATH) + SV_INDEX_SUFFIX).c_str());
+}
+
+// Throughput run: pushes audio as fast as the sink drains it, keeping at most half the
+// writer ring in flight so nothing is dropped. Reports the sustained sink rate.
+static void RunThroughput(const SVBenchOptions& options, const SVBenchProfile& profile, const SVBenchSink& sink) {
+  const SVAudioFormat format = {SV_BENCH_PIPELINE_RATE, SV_BENCH_PIPELINE_CHANNELS, sink.format};
+  const size_t callback_bytes = profile.frames_per_callback * format.BytesPerFrame();
+  const size_t max_in_flight = format.BytesPerSecond() * SV_WRITER_RING_SECONDS / 2;
+  std::vector<uint8_t> audio(callback_bytes);
+  uint32_t state = 0x2545F491u;
+  for(uint8_t& byte : audio) {
+    state = state * 1664525u + 1013904223u;
+    byte = static_cast<uint8_t>(state >> 24);
+  }
+  if(sink.format == SV_SAMPLE_F32) {
+    // Random bytes are mostly NaN/huge as floats, keep samples in [-1, 1).
+    float* samples = reinterpret_cast<float*>(audio.data());
+    for(size_t i = 0; i < callback_bytes / sizeof(float); i++) {
+      samples[i] = static_cast<int16_t>(i * 2654435761u >> 16) / 32768.0f;
+    }
+  }
+
+  {
+    SVCapturePipeline pipeline(SV_BENCH_PIPELINE_PATH);
+    pipeline.SetOption(SV_OPTION_OUTPUT_TYPE, sink.output);
+    pipeline.SetOption(SV_OPTION_CONTAINER, sink.container);
+    if(pipeline.Prepare(format) != SV_NO_ERROR) {
+      return;
+    }
+    int64_t cpu_begin = ProcessCpuNs();
+    int64_t wall_begin = SVNowNs();
+    const int64_t wall_end = wall_begin + options.seconds * 1000000000LL;
+    pipeline.Start();
+    uint64_t produced = 0;
+    while(SVNowNs() < wall_end) {
+      if(produced - pipeline.GetWriterStats().bytes_written > max_in_flight) {
+        std::this_thread::yield();
+        continue;
+      }
+      pipeline.OnAudioData(audio.data(), profile.frames_per_callback);
+      produced += callback_bytes;
+    }
+    pipeline.Stop();
+    int64_t wall_ns = SVNowNs() - wall_begin;
+    int64_t cpu_ns = ProcessCpuNs() - cpu_begin;
+
+    SVDiskWriterStats writer = pipeline.GetWriterStats();
+    double audio_seconds = static_cast<double>(writer.bytes_written) / format.BytesPerSecond();
+    PrintConfig("throughput", profile, sink);
+    printf(",\"seconds\":%.2f,\"mb_per_s\":%.3f,\"realtime_factor\":%.1f,\"cpu_ms_per_audio_s\":%.3f,"
+           "\"overruns\":%llu}\n",
+           audio_seconds, writer.bytes_written / 1e6 / (wall_ns * 1e-9), audio_seconds / (wall_ns * 1e-9),
+           audio_seconds > 0 ? cpu_ns / 1e6 / audio_seconds : 0.0, (unsigned long long) writer.overrun_count);
+  }
+  remove(SV_BENCH_PIPELINE_PATH);
+  remove((std::string(SV_BENCH_PIPELINE_PATH) + SV_INDEX_SUFFIX).c_str());
+}
+
+void SVBenchPipeline(const SVBenchOptions& options) {
+  // Backend callback sizes against the same sink.
+  const SVBenchSink wav = {SV_CONTAINER_WAV, SV_OUTPUT_STDIO, SV_SAMPLE_I16};
+  for(const SVBenchProfile* profile : {&kOpenSL, &kAAudio, &kOboe}) {
+    RunRealtime(options, *profile, wav);
+  }
+
+  // Every sink/encoder configuration at the OpenSL callback size.
+  const SVBenchSink sinks[] = {
+          {SV_CONTAINER_RAW, SV_OUTPUT_STDIO, SV_SAMPLE_I16},
+          {SV_CONTAINER_RAW, SV_OUTPUT_MMAP, SV_SAMPLE_I16},
+          {SV_CONTAINER_WAV, SV_OUTPUT_MMAP, SV_SAMPLE_I16},
+          {SV_CONTAINER_WAV, SV_OUTPUT_STDIO, SV_SAMPLE_F32},
+          {SV_CONTAINER_FLAC, SV_OUTPUT_STDIO, SV_SAMPLE_I16},
+          {SV_CONTAINER_FLAC, SV_OUTPUT_STDIO, SV_SAMPLE_F32},
+  };
+  for(const SVBenchSink& sink : sinks) {
+    RunRealtime(options, kOpenSL, sink);
+  }
+  RunThroughput(options, kOpenSL, wav);
+  for(const SVBenchSink& sink : sinks) {
+    RunThroughput(options, kOpenSL, sink);
+  }
+}
+
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_bench.h"
+#include <chrono>
+#include <thread>
+#include "sv_synthetic_recorder.h"
+
+namespace sv_recorder {
+
+const int SV_BENCH_RECOVERY_RATE = 48000;
+const int SV_BENCH_RECOVERY_CHANNELS = 2;
+const int SV_BENCH_RECOVERY_POLL_MS = 5;
+const char* const SV_BENCH_RECOVERY_PATH = "/tmp/sv_bench_recovery.out";
+
+struct SVBenchFault {
+    int32_t outage_ms;
+    int32_t failed_reopens;
+};
+
+static long FileSize(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if(!file) {
+    return 0;
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fclose(file);
+  return size;
+}
+
+// One disconnect in the middle of a real-time run. The file has to last as long as the
+// recording did, with the outage filled by silence.
+static void RunFault(const SVBenchOptions& options, const SVBenchFault& fault) {
+  const SVAudioFormat format = {SV_BENCH_RECOVERY_RATE, SV_BENCH_RECOVERY_CHANNELS, SV_SAMPLE_I16};
+  remove(SV_BENCH_RECOVERY_PATH);
+  SVRecoveryStats stats;
+  int64_t wall_ns;
+  {
+    SVSyntheticRecorder recorder(SV_BENCH_RECOVERY_PATH);
+    if(recorder.InitRecording(format.sample_rate, format.channels, format.sample_format) != SV_NO_ERROR) {
+      return;
+    }
+    const auto half = std::chrono::milliseconds(options.seconds * 500);
+    int64_t wall_begin = SVNowNs();
+    recorder.StartRecording();
+    std::this_thread::sleep_for(half);
+    recorder.InjectDisconnect(fault.outage_ms, fault.failed_reopens);
+    SVStreamRecovery& recovery = recorder.pipeline().recovery();
+    do {
+      std::this_thread::sleep_for(std::chrono::milliseconds(SV_BENCH_RECOVERY_POLL_MS));
+    } while(recovery.state() == SV_STREAM_DISCONNECTED || recovery.state() == SV_STREAM_RECOVERING ||
+            recovery.GetStats().disconnects == 0);
+    std::this_thread::sleep_for(half);
+    recorder.StopRecording();
+    wall_ns = SVNowNs() - wall_begin;
+    stats = recovery.GetStats();
+  }
+  const double file_seconds = static_cast<double>(FileSize(SV_BENCH_RECOVERY_PATH)) / format.BytesPerSecond();
+  printf("{\"suite\":\"recovery\",\"outage_ms\":%d,\"failed_reopens\":%d,\"recovered\":%s,\"attempts\":%llu,"
+         "\"recovery_ms\":%.1f,\"gap_ms\":%.1f,\"wall_s\":%.3f,\"file_s\":%.3f,\"drift_ms\":%.1f}\n",
+         fault.outage_ms, fault.failed_reopens, stats.recoveries == 1 ? "true" : "false",
+         (unsigned long long) stats.attempts, stats.last_recovery_us / 1000.0,
+         stats.gap_frames * 1000.0 / format.sample_rate, wall_ns * 1e-9, file_seconds,
+         (file_seconds - wall_ns * 1e-9) * 1000);
+  remove(SV_BENCH_RECOVERY_PATH);
+  remove((std::string(SV_BENCH_RECOVERY_PATH) + SV_INDEX_SUFFIX).c_str());
+}
+
+void SVBenchRecovery(const SVBenchOptions& options) {
+  // A route change reopens at once, an unplugged device only after it is back.
+  const SVBenchFault faults[] = {{0, 0}, {0, 2}, {200, 0}, {500, 1}};
+  for(const SVBenchFault& fault : faults) {
+    RunFault(options, fault);
+  }
+}
+
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_bench.h"
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <vector>
+#include "sv_resampler.h"
+
+namespace sv_recorder {
+
+const int SV_BENCH_RESAMPLE_SECONDS = 10;
+// Callback-sized chunks, like the writer thread sees them.
+const size_t SV_BENCH_RESAMPLE_CHUNK = 480;
+const double SV_BENCH_TONE_AMPLITUDE = 0.5;
+
+static const char* QualityName(SV_RESAMPLE_QUALITY quality) {
+  switch (quality) {
+    case SV_RESAMPLE_LOW: return "low";
+    case SV_RESAMPLE_HIGH: return "high";
+    default: return "medium";
+  }
+}
+
+static int64_t ThreadCpuNs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static void Tone(double hz, int rate, std::vector<float>& samples) {
+  for(size_t i = 0; i < samples.size(); i++) {
+    samples[i] = static_cast<float>(SV_BENCH_TONE_AMPLITUDE * sin(2.0 * M_PI * hz * i / rate));
+  }
+}
+
+static std::vector<float> Resample(SVResampler& resampler, const std::vector<float>& in) {
+  resampler.Reset();
+  std::vector<float> out(resampler.MaxOutputFrames(in.size()) + 1);
+  size_t produced = 0;
+  for(size_t offset = 0; offset < in.size(); offset += SV_BENCH_RESAMPLE_CHUNK) {
+    size_t frames = std::min(SV_BENCH_RESAMPLE_CHUNK, in.size() - offset);
+    produced += resampler.Process(in.data() + offset, frames, out.data() + produced);
+  }
+  out.resize(produced);
+  return out;
+}
+
+// Least-squares fit of a sinusoid at |hz| to the output past the filter transient,
+// returns the residual relative to the tone in dB.
+static double ToneErrorDb(const std::vector<float>& out, double hz, int rate, size_t skip) {
+  double cc = 0, ss = 0, cs = 0, yc = 0, ys = 0;
+  for(size_t i = skip; i < out.size(); i++) {
+    double c = cos(2.0 * M_PI * hz * i / rate);
+    double s = sin(2.0 * M_PI * hz * i / rate);
+    cc += c * c; ss += s * s; cs += c * s;
+    yc += out[i] * c; ys += out[i] * s;
+  }
+  double det = cc * ss - cs * cs;
+  double a = (yc * ss - ys * cs) / det;
+  double b = (ys * cc - yc * cs) / det;
+  double residual = 0, signal = 0;
+  for(size_t i = skip; i < out.size(); i++) {
+    double fit = a * cos(2.0 * M_PI * hz * i / rate) + b * sin(2.0 * M_PI * hz * i / rate);
+    residual += (out[i] - fit) * (out[i] - fit);
+    signal += fit * fit;
+  }
+  return 10.0 * log10(std::max(residual, 1e-30) / std::max(signal, 1e-30));
+}
+
+static double RmsDb(const std::vector<float>& out, size_t skip) {
+  double energy = 0;
+  for(size_t i = skip; i < out.size(); i++) {
+    energy += static_cast<double>(out[i]) * out[i];
+  }
+  double rms = sqrt(energy / std::max<size_t>(1, out.size() - skip));
+  return 20.0 * log10(std::max(rms, 1e-15) / (SV_BENCH_TONE_AMPLITUDE / sqrt(2.0)));
+}
+
+static void RunResample(int in_rate, int out_rate, SV_RESAMPLE_QUALITY quality) {
+  SVResampler resampler;
+  if(resampler.Init(in_rate, out_rate, 1, quality) != SV_NO_ERROR) {
+    return;
+  }
+  const size_t frames = static_cast<size_t>(in_rate) * SV_BENCH_RESAMPLE_SECONDS;
+  // The filter ramps up from silence over its length, measured in output frames.
+  const size_t skip = static_cast<size_t>(resampler.taps() * std::max(1.0, static_cast<double>(out_rate) / in_rate));
+  std::vector<float> in(frames);
+
+  Tone(1000.0, in_rate, in);
+  int64_t cpu_begin = ThreadCpuNs();
+  int64_t wall_begin = SVNowNs();
+  std::vector<float> out = Resample(resampler, in);
+  int64_t wall_ns = SVNowNs() - wall_begin;
+  int64_t cpu_ns = ThreadCpuNs() - cpu_begin;
+  double passband_error = ToneErrorDb(out, 1000.0, out_rate, skip);
+
+  // Tones between the output Nyquist and the input Nyquist must not fold back.
+  double worst_alias = -INFINITY;
+  const double low = 0.5 * out_rate * 1.02;
+  const double high = 0.5 * in_rate * 0.98;
+  std::vector<float> shorter(in_rate);
+  for(int k = 0; k < 8 && low < high; k++) {
+    Tone(low + (high - low) * k / 7.0, in_rate, shorter);
+    worst_alias = std::max(worst_alias, RmsDb(Resample(resampler, shorter), skip));
+  }
+
+  const double audio_ns = SV_BENCH_RESAMPLE_SECONDS * 1e9;
+  printf("{\"suite\":\"resample\",\"in_rate\":%d,\"out_rate\":%d,\"quality\":\"%s\",\"taps\":%d,\"simd\":\"%s\","
+         "\"realtime_factor\":%.1f,\"cpu_percent\":%.4f,\"passband_error_db\":%.1f",
+         in_rate, out_rate, QualityName(quality), resampler.taps(), SVConvert().name,
+         wall_ns > 0 ? audio_ns / wall_ns : 0.0, cpu_ns * 100.0 / audio_ns, passband_error);
+  if(low < high) {
+    printf(",\"alias_rejection_db\":%.1f}\n", -worst_alias);
+  } else {
+    printf(",\"alias_rejection_db\":null}\n");
+  }
+}
+
+void SVBenchResample(const SVBenchOptions& options) {
+  const int rates[][2] = {{48000, 16000}, {44100, 16000}, {44100, 48000}, {16000, 48000}};
+  const SV_RESAMPLE_QUALITY qualities[] = {SV_RESAMPLE_LOW, SV_RESAMPLE_MEDIUM, SV_RESAMPLE_HIGH};
+  for(const auto& rate : rates) {
+    for(SV_RESAMPLE_QUALITY quality : qualities) {
+      RunResample(rate[0], rate[1], quality);
+    }
+  }
+}
+
+}
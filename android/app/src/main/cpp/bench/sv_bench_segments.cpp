@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_bench.h"
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include "sv_synthetic_recorder.h"
+
+namespace sv_recorder {
+
+const int SV_BENCH_SEGMENT_RATE = 48000;
+const int SV_BENCH_SEGMENT_CHANNELS = 2;
+const int SV_BENCH_SEGMENT_SECONDS = 1;
+// The killed run stops between two syncs, in the middle of its last segment.
+const int SV_BENCH_CRASH_MS = 2700;
+const char* const SV_BENCH_SEGMENT_DIR = "/tmp/sv_bench_segments";
+
+struct SVBenchSeries {
+    SV_CONTAINER_TYPE container;
+    SV_FILE_OUTPUT_TYPE output;
+    const char* extension;
+};
+
+static std::string SeriesPath(const SVBenchSeries& series) {
+  return std::string(SV_BENCH_SEGMENT_DIR) + "/session" + series.extension;
+}
+
+// Removes the manifest and every segment of the series.
+static void RemoveSeries(const std::string& path) {
+  SVSegmentManifest manifest;
+  if(manifest.Load(path + SV_SEGMENT_MANIFEST_SUFFIX) == SV_NO_ERROR) {
+    for(const SVSegmentInfo& info : manifest.segments) {
+      const std::string segment_path = std::string(SV_BENCH_SEGMENT_DIR) + "/" + info.name;
+      remove(segment_path.c_str());
+      remove((segment_path + SV_INDEX_SUFFIX).c_str());
+    }
+  }
+  remove((path + SV_SEGMENT_MANIFEST_SUFFIX).c_str());
+}
+
+static int InitSeries(SVSyntheticRecorder& recorder, const SVBenchSeries& series) {
+  recorder.SetOption(SV_OPTION_CONTAINER, series.container);
+  recorder.SetOption(SV_OPTION_OUTPUT_TYPE, series.output);
+  recorder.SetOption(SV_OPTION_SEGMENT_SECONDS, SV_BENCH_SEGMENT_SECONDS);
+  return recorder.InitRecording(SV_BENCH_SEGMENT_RATE, SV_BENCH_SEGMENT_CHANNELS, SV_SAMPLE_I16);
+}
+
+// Records like a session that is killed without any chance to close its files.
+static void CrashedRun(const SVBenchSeries& series) {
+  SVSyntheticRecorder recorder(SeriesPath(series), SV_SOURCE_NOISE);
+  if(InitSeries(recorder, series) != SV_NO_ERROR) {
+    _exit(1);
+  }
+  recorder.StartRecording();
+  std::this_thread::sleep_for(std::chrono::milliseconds(SV_BENCH_CRASH_MS));
+  kill(getpid(), SIGKILL);
+}
+
+// Rotation cost on the writer thread, then what the next start recovers from a killed run.
+static void RunSeries(const SVBenchOptions& options, const SVBenchSeries& series) {
+  const std::string path = SeriesPath(series);
+  RemoveSeries(path);
+  uint64_t rotations;
+  int64_t max_rotate_us;
+  uint64_t sync_opens;
+  uint64_t overruns;
+  {
+    SVSyntheticRecorder recorder(path, SV_SOURCE_NOISE);
+    if(InitSeries(recorder, series) != SV_NO_ERROR) {
+      return;
+    }
+    recorder.StartRecording();
+    std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+    recorder.StopRecording();
+    const SVSegmentCounters& counters = recorder.pipeline().segment_counters();
+    rotations = counters.segments() - 1;
+    max_rotate_us = counters.max_rotate_us();
+    sync_opens = counters.sync_opens();
+    overruns = recorder.pipeline().GetWriterStats().overrun_count;
+  }
+  RemoveSeries(path);
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == 0) {
+    CrashedRun(series);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  uint64_t recovered;
+  uint64_t truncated_bytes;
+  {
+    SVSyntheticRecorder recorder(path, SV_SOURCE_NOISE);
+    if(InitSeries(recorder, series) != SV_NO_ERROR) {
+      return;
+    }
+    recovered = recorder.pipeline().segment_counters().recovered();
+    truncated_bytes = recorder.pipeline().segment_counters().truncated_bytes();
+  }
+  SVSegmentManifest manifest;
+  manifest.Load(path + SV_SEGMENT_MANIFEST_SUFFIX);
+  uint64_t frames = 0;
+  for(const SVSegmentInfo& info : manifest.segments) {
+    frames += info.frames;
+  }
+  printf("{\"suite\":\"segments\",\"container\":\"%s\",\"output\":\"%s\",\"rotations\":%llu,"
+         "\"max_rotate_us\":%lld,\"sync_opens\":%llu,\"overruns\":%llu,\"killed\":%s,\"recovered\":%llu,"
+         "\"truncated_bytes\":%llu,\"segments\":%zu,\"recovered_ms\":%.1f,\"killed_after_ms\":%d}\n",
+         series.extension + 1, series.output == SV_OUTPUT_MMAP ? "mmap" : "stdio",
+         (unsigned long long) rotations, (long long) max_rotate_us, (unsigned long long) sync_opens,
+         (unsigned long long) overruns, WIFSIGNALED(status) ? "true" : "false",
+         (unsigned long long) recovered, (unsigned long long) truncated_bytes, manifest.segments.size(),
+         frames * 1000.0 / SV_BENCH_SEGMENT_RATE, SV_BENCH_CRASH_MS);
+  RemoveSeries(path);
+}
+
+void SVBenchSegments(const SVBenchOptions& options) {
+  mkdir(SV_BENCH_SEGMENT_DIR, 0755);
+  const SVBenchSeries series[] = {
+          {SV_CONTAINER_RAW, SV_OUTPUT_STDIO, ".pcm"},
+          {SV_CONTAINER_RAW, SV_OUTPUT_MMAP, ".pcm"},
+          {SV_CONTAINER_WAV, SV_OUTPUT_STDIO, ".wav"},
+          {SV_CONTAINER_FLAC, SV_OUTPUT_STDIO, ".flac"},
+  };
+  for(const SVBenchSeries& item : series) {
+    RunSeries(options, item);
+  }
+}
+
+}
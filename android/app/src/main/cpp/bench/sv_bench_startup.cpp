@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_bench.h"
+#include <chrono>
+#include <thread>
+#include "sv_backend_context.h"
+#include "sv_synthetic_recorder.h"
+
+namespace sv_recorder {
+
+const int SV_BENCH_STARTUP_RATE = 48000;
+const int SV_BENCH_STARTUP_SESSIONS = 8;
+const int SV_BENCH_STARTUP_TIMEOUT_MS = 1000;
+const char* const SV_BENCH_STARTUP_PATH = "/tmp/sv_bench_startup.pcm";
+
+// One short session from a new recorder, as an app records clip after clip.
+static void RunSession(int session) {
+  SVSyntheticRecorder recorder(SV_BENCH_STARTUP_PATH, SV_SOURCE_NOISE);
+  recorder.SetOption(SV_OPTION_FILE_INDEX, 0);
+  const uint64_t allocations = SVBenchAllocations();
+  if(recorder.InitRecording(SV_BENCH_STARTUP_RATE, 2, SV_SAMPLE_I16) != SV_NO_ERROR) {
+    return;
+  }
+  const uint64_t init_allocations = SVBenchAllocations() - allocations;
+  recorder.StartRecording();
+  const SVCapturePipeline& pipeline = recorder.pipeline();
+  for(int i = 0; i < SV_BENCH_STARTUP_TIMEOUT_MS && pipeline.first_frame_us() < 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  // Read before Stop(), the next Start() would reset it.
+  const std::string stats = pipeline.GetStatsJson();
+  const size_t begin = stats.find("\"startup\":");
+  const size_t end = stats.find('}', begin);
+  recorder.StopRecording();
+  printf("{\"suite\":\"startup\",\"session\":%d,\"init_allocations\":%llu,%s}}\n", session,
+         (unsigned long long) init_allocations,
+         begin != std::string::npos ? stats.substr(begin, end - begin).c_str() : "\"startup\":{");
+  remove(SV_BENCH_STARTUP_PATH);
+}
+
+// The first session of the process is cold, the later ones find the backend and its pools
+// ready. Run the suite alone for a cold first session, other suites warm the backend.
+void SVBenchStartup(const SVBenchOptions& options) {
+  for(int i = 0; i < SV_BENCH_STARTUP_SESSIONS; i++) {
+    RunSession(i);
+  }
+  printf("{\"suite\":\"startup\",\"context\":%s}\n", SVBackendContext::Instance().GetJson().c_str());
+}
+
+}
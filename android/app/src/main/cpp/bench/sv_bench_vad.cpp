@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_bench.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include "sv_disk_writer.h"
+#include "sv_vad.h"
+
+namespace sv_recorder {
+
+const int SV_BENCH_VAD_SECONDS = 60;
+const char* const SV_BENCH_VAD_PATH = "/tmp/sv_bench_vad.out";
+const double SV_BENCH_BACKGROUND_DBFS = -65.0;
+const double SV_BENCH_VOICED_DBFS = -22.0;
+const double SV_BENCH_FRICATIVE_DBFS = -38.0;
+
+// Counts what would have reached the file.
+class SVBenchNullOutput : public ISVFileOutput {
+
+public:
+    int Open(const std::string& file_path) override { return SV_NO_ERROR; }
+    size_t Write(const void* data, size_t len) override {
+      size_ += len;
+      writes_++;
+      return len;
+    }
+    int WriteAt(uint64_t offset, const void* data, size_t len) override { return SV_NO_ERROR; }
+    int Flush() override { return SV_NO_ERROR; }
+    int Close() override { return SV_NO_ERROR; }
+    uint64_t Size() const override { return size_; }
+    SVFileOutputStats GetStats() const override { return SVFileOutputStats{size_, writes_, 0}; }
+
+private:
+    uint64_t size_ = 0;
+    uint64_t writes_ = 0;
+};
+
+// Synthetic speech/silence corpus: utterances of voiced syllables (a harmonic series on a
+// gliding pitch) and fricatives (differentiated noise) separated by seconds of background
+// noise. |speech| marks the 10ms frames inside an utterance as ground truth.
+struct SVBenchCorpus {
+    int sample_rate;
+    int channels;
+    std::vector<float> samples;
+    std::vector<bool> speech;
+};
+
+class SVBenchRandom {
+
+public:
+    explicit SVBenchRandom(uint32_t seed) : state_(seed) {}
+
+    double Uniform() {
+      state_ = state_ * 1664525u + 1013904223u;
+      return (state_ >> 8) / 16777216.0;
+    }
+    double Uniform(double min, double max) { return min + (max - min) * Uniform(); }
+    // Sum of uniforms, close enough to Gaussian with unit variance.
+    double Noise() { return (Uniform() + Uniform() + Uniform() + Uniform() - 2.0) * sqrt(3.0); }
+
+private:
+    uint32_t state_;
+};
+
+static double DbToAmplitude(double db) {
+  return pow(10.0, db / 20.0);
+}
+
+static SVBenchCorpus MakeCorpus(int sample_rate, int channels) {
+  SVBenchCorpus corpus;
+  corpus.sample_rate = sample_rate;
+  corpus.channels = channels;
+  const size_t frames = static_cast<size_t>(sample_rate) * SV_BENCH_VAD_SECONDS;
+  const size_t frame_length = sample_rate * SV_VAD_FRAME_MS / 1000;
+  std::vector<float> mono(frames, 0.0f);
+  std::vector<bool> speech_sample(frames, false);
+  SVBenchRandom random(0x5EED1234u);
+
+  size_t pos = static_cast<size_t>(random.Uniform(1.0, 3.0) * sample_rate);
+  while(pos < frames) {
+    const size_t utterance_end =
+            std::min(frames, pos + static_cast<size_t>(random.Uniform(1.0, 4.0) * sample_rate));
+    const size_t utterance_begin = pos;
+    while(pos < utterance_end) {
+      const bool fricative = random.Uniform() < 0.3;
+      const double seconds = fricative ? random.Uniform(0.06, 0.12) : random.Uniform(0.12, 0.25);
+      const size_t length = static_cast<size_t>(seconds * sample_rate);
+      const double f0 = random.Uniform(100.0, 220.0);
+      const double glide = random.Uniform(-0.3, 0.3);
+      double phase = 0.0;
+      float previous = 0.0f;
+      for(size_t i = 0; i < length && pos + i < utterance_end; i++) {
+        const double t = static_cast<double>(i) / length;
+        const double envelope = sin(M_PI * t);
+        double value;
+        if(fricative) {
+          float white = static_cast<float>(random.Noise());
+          value = (white - previous) / sqrt(2.0) * DbToAmplitude(SV_BENCH_FRICATIVE_DBFS);
+          previous = white;
+        } else {
+          phase += 2.0 * M_PI * f0 * (1.0 + glide * t) / sample_rate;
+          value = 0.0;
+          for(int k = 1; k <= 20 && k * f0 < 0.45 * sample_rate; k++) {
+            value += sin(k * phase) / k;
+          }
+          // The 1/k series has about 0.9 rms.
+          value *= DbToAmplitude(SV_BENCH_VOICED_DBFS) / 0.9;
+        }
+        mono[pos + i] = static_cast<float>(value * envelope);
+      }
+      pos += length + static_cast<size_t>(random.Uniform(0.03, 0.08) * sample_rate);
+    }
+    std::fill(speech_sample.begin() + utterance_begin, speech_sample.begin() + std::min(pos, frames), true);
+    pos += static_cast<size_t>(random.Uniform(1.5, 6.0) * sample_rate);
+  }
+
+  corpus.samples.resize(frames * channels);
+  const double background = DbToAmplitude(SV_BENCH_BACKGROUND_DBFS);
+  for(size_t i = 0; i < frames; i++) {
+    for(int ch = 0; ch < channels; ch++) {
+      // The second microphone hears the talker a little quieter, the noise is uncorrelated.
+      const double gain = ch == 0 ? 1.0 : 0.7;
+      corpus.samples[i * channels + ch] = static_cast<float>(mono[i] * gain + random.Noise() * background);
+    }
+  }
+  corpus.speech.resize(frames / frame_length);
+  for(size_t f = 0; f < corpus.speech.size(); f++) {
+    corpus.speech[f] = speech_sample[f * frame_length + frame_length / 2];
+  }
+  return corpus;
+}
+
+static std::vector<uint8_t> Encode(const SVBenchCorpus& corpus, const SVAudioFormat& format) {
+  std::vector<uint8_t> bytes(corpus.samples.size() * format.BytesPerSample());
+  if(format.sample_format == SV_SAMPLE_F32) {
+    memcpy(bytes.data(), corpus.samples.data(), bytes.size());
+  } else {
+    SVConvert().f32_to_i16(corpus.samples.data(), reinterpret_cast<int16_t*>(bytes.data()), corpus.samples.size());
+  }
+  return bytes;
+}
+
+static int64_t ThreadCpuNs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static void RunVad(const SVBenchCorpus& corpus, SV_SAMPLE_FORMAT sample_format, int hangover_ms) {
+  const SVAudioFormat format = {corpus.sample_rate, corpus.channels, sample_format};
+  const std::vector<uint8_t> audio = Encode(corpus, format);
+  // The writer hands over 100ms batches.
+  const size_t batch = format.BytesPerSecond() * SV_WRITER_BATCH_MS / 1000;
+  SVVadConfig config;
+  config.hangover_ms = hangover_ms;
+  SVVadCounters counters;
+  auto* null_output = new SVBenchNullOutput();
+  SVVadFileOutput vad(ISVFileOutput::Ptr(null_output), format, config, &counters);
+  if(vad.Open(SV_BENCH_VAD_PATH) != SV_NO_ERROR) {
+    return;
+  }
+
+  int64_t cpu_begin = ThreadCpuNs();
+  for(size_t offset = 0; offset < audio.size(); offset += batch) {
+    vad.Write(audio.data() + offset, std::min(batch, audio.size() - offset));
+  }
+  int64_t cpu_ns = ThreadCpuNs() - cpu_begin;
+  vad.Close();
+  remove((std::string(SV_BENCH_VAD_PATH) + SV_VAD_INDEX_SUFFIX).c_str());
+
+  // Frame-level agreement with the ground truth.
+  const size_t frame_length = corpus.sample_rate * SV_VAD_FRAME_MS / 1000;
+  std::vector<bool> kept(corpus.speech.size(), false);
+  for(const SVVadSegment& segment : vad.index().segments()) {
+    for(uint64_t f = segment.source_frame / frame_length;
+         f < (segment.source_frame + segment.frames) / frame_length && f < kept.size(); f++) {
+      kept[f] = true;
+    }
+  }
+  size_t speech = 0, speech_kept = 0, silence = 0, silence_dropped = 0;
+  for(size_t f = 0; f < kept.size(); f++) {
+    if(corpus.speech[f]) {
+      speech++;
+      speech_kept += kept[f];
+    } else {
+      silence++;
+      silence_dropped += !kept[f];
+    }
+  }
+
+  const double audio_seconds = SV_BENCH_VAD_SECONDS;
+  printf("{\"suite\":\"vad\",\"sample_rate\":%d,\"channels\":%d,\"format\":\"%s\",\"hangover_ms\":%d,"
+         "\"simd\":\"%s\",\"speech_fraction\":%.3f,\"bytes_in\":%llu,\"bytes_written\":%llu,"
+         "\"bytes_saved_percent\":%.1f,\"write_calls\":%llu,\"segments\":%llu,\"speech_kept_percent\":%.1f,"
+         "\"silence_dropped_percent\":%.1f,\"cpu_us_per_channel_s\":%.2f,\"realtime_factor\":%.0f}\n",
+         corpus.sample_rate, corpus.channels, sample_format == SV_SAMPLE_F32 ? "f32" : "i16", hangover_ms,
+         SVConvert().name, static_cast<double>(speech) / std::max<size_t>(1, kept.size()),
+         (unsigned long long) counters.bytes_in(), (unsigned long long) null_output->Size(),
+         100.0 * (1.0 - static_cast<double>(null_output->Size()) / std::max<uint64_t>(1, counters.bytes_in())),
+         (unsigned long long) null_output->GetStats().io_calls, (unsigned long long) counters.segments(),
+         100.0 * speech_kept / std::max<size_t>(1, speech), 100.0 * silence_dropped / std::max<size_t>(1, silence),
+         cpu_ns / 1e3 / corpus.channels / audio_seconds, cpu_ns > 0 ? audio_seconds * 1e9 / cpu_ns : 0.0);
+}
+
+void SVBenchVad(const SVBenchOptions& options) {
+  for(int rate : {16000, 48000}) {
+    for(int channels : {1, 2}) {
+      SVBenchCorpus corpus = MakeCorpus(rate, channels);
+      RunVad(corpus, SV_SAMPLE_I16, SV_VAD_DEFAULT_HANGOVER_MS);
+      RunVad(corpus, SV_SAMPLE_F32, SV_VAD_DEFAULT_HANGOVER_MS);
+    }
+  }
+  // Hangover trades saved bytes for fewer, longer segments.
+  SVBenchCorpus corpus = MakeCorpus(48000, 1);
+  for(int hangover_ms : {0, 100, 1000}) {
+    RunVad(corpus, SV_SAMPLE_I16, hangover_ms);
+  }
+}
+
+}
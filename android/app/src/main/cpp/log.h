@@ -9,13 +9,63 @@
 #ifndef AOS_AUDIO_RECORD_LOG_H
 #define AOS_AUDIO_RECORD_LOG_H
 
-#include <android/log.h>
+#include "sv_log.h"
+
 #define TAG "av_native_record"
 
-#define AV_LOGD(...) __android_log_print(ANDROID_LOG_DEBUG,TAG,__VA_ARGS__)
-#define AV_LOGI(...) __android_log_print(ANDROID_LOG_INFO,TAG,__VA_ARGS__)
-#define AV_LOGW(...) __android_log_print(ANDROID_LOG_WARN,TAG,__VA_ARGS__)
-#define AV_LOGE(...) __android_log_print(ANDROID_LOG_ERROR,TAG,__VA_ARGS__)
-#define AV_LOGF(...) __android_log_print(ANDROID_LOG_FATAL,TAG,__VA_ARGS__)
+// Lines below SV_LOG_MIN_LEVEL are removed at compile time: the condition is a constant,
+// so only the dead branch remains and the arguments are never evaluated.
+#ifndef SV_LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define SV_LOG_MIN_LEVEL 1
+#else
+#define SV_LOG_MIN_LEVEL 0
+#endif
+#endif
+
+#define AV_LOG_AT(level, ...) do { \
+    if((level) >= SV_LOG_MIN_LEVEL) sv_recorder::SVLogPrint(level, TAG, __VA_ARGS__); \
+  } while(0)
+
+#define AV_LOGD(...) AV_LOG_AT(sv_recorder::SV_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define AV_LOGI(...) AV_LOG_AT(sv_recorder::SV_LOG_LEVEL_INFO, __VA_ARGS__)
+#define AV_LOGW(...) AV_LOG_AT(sv_recorder::SV_LOG_LEVEL_WARN, __VA_ARGS__)
+#define AV_LOGE(...) AV_LOG_AT(sv_recorder::SV_LOG_LEVEL_ERROR, __VA_ARGS__)
+#define AV_LOGF(...) AV_LOG_AT(sv_recorder::SV_LOG_LEVEL_FATAL, __VA_ARGS__)
+
+// At most one line per |interval_ms| from this call site, followed by how many were dropped.
+#define AV_LOG_RATELIMIT(level, interval_ms, ...) do { \
+    if((level) >= SV_LOG_MIN_LEVEL) { \
+      static sv_recorder::SVLogRateLimiter sv_log_limiter; \
+      uint32_t sv_log_suppressed = 0; \
+      if(sv_log_limiter.Allow(interval_ms, &sv_log_suppressed)) { \
+        sv_recorder::SVLogPrint(level, TAG, __VA_ARGS__); \
+        if(sv_log_suppressed) { \
+          sv_recorder::SVLogPrint(level, TAG, "(%u similar lines suppressed)", sv_log_suppressed); \
+        } \
+      } \
+    } \
+  } while(0)
+
+#define AV_LOGW_RATELIMIT(interval_ms, ...) AV_LOG_RATELIMIT(sv_recorder::SV_LOG_LEVEL_WARN, interval_ms, __VA_ARGS__)
+#define AV_LOGE_RATELIMIT(interval_ms, ...) AV_LOG_RATELIMIT(sv_recorder::SV_LOG_LEVEL_ERROR, interval_ms, __VA_ARGS__)
+
+// Safe on the audio thread: queues the format and arguments for SVDeferredLog's thread.
+// %s arguments must be string literals. The dead SVLogPrint keeps printf format checking.
+#define AV_LOG_RT(level, ...) do { \
+    if((level) >= SV_LOG_MIN_LEVEL) sv_recorder::SVDeferredLog::Instance().Log(level, __VA_ARGS__); \
+    if(false) sv_recorder::SVLogPrint(level, TAG, __VA_ARGS__); \
+  } while(0)
+
+#define AV_LOGD_RT(...) AV_LOG_RT(sv_recorder::SV_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define AV_LOGW_RT(...) AV_LOG_RT(sv_recorder::SV_LOG_LEVEL_WARN, __VA_ARGS__)
+#define AV_LOGE_RT(...) AV_LOG_RT(sv_recorder::SV_LOG_LEVEL_ERROR, __VA_ARGS__)
+
+// Per-callback messages are only built with -DSV_LOG_CALLBACKS=1.
+#if SV_LOG_CALLBACKS
+#define AV_LOG_CALLBACK(...) AV_LOGD_RT(__VA_ARGS__)
+#else
+#define AV_LOG_CALLBACK(...) do {} while(0)
+#endif
 
 #endif //AOS_AUDIO_RECORD_LOG_H
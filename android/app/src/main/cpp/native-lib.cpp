@@ -7,73 +7,290 @@
  */
 
 #include <jni.h>
+#include <algorithm>
+#include <atomic>
 #include <string>
+#include <vector>
 #include "sv_opensl_recorder.h"
 #include "sv_aaudio_recorder.h"
 #include "sv_oboe_recorder.h"
+#include "sv_synthetic_recorder.h"
+#include "sv_backend_context.h"
+#include "sv_recording_reader.h"
+#include "sv_session_registry.h"
+#include "sv_jni_stream.h"
 
-SV_RECORD_TYPE g_record_type_ = UNDEFINED;
-ISVNativeRecorder::Ptr g_recorder = nullptr;
+using sv_recorder::SVSessionRegistry;
+using sv_recorder::SVSessionRef;
 
-void nativeSetRecordType(JNIEnv* env, jobject obj, jint type, jstring file_path) {
+// Session used by the legacy single-recorder methods below.
+std::atomic<int32_t> g_default_session(sv_recorder::SV_INVALID_SESSION);
 
-  if(g_record_type_ == UNDEFINED && g_recorder) {
-    AV_LOGW("Please release pre g_recorder.");
-    return;
+// Copies |value| into |out|, false for a null string or when the conversion fails, which
+// leaves an OutOfMemoryError pending.
+static bool GetString(JNIEnv* env, jstring value, std::string* out) {
+  if(!value) {
+    return false;
+  }
+  const char* chars = env->GetStringUTFChars(value, nullptr);
+  if(!chars) {
+    return false;
   }
+  out->assign(chars);
+  env->ReleaseStringUTFChars(value, chars);
+  return true;
+}
 
-  if(g_record_type_ != UNDEFINED) {
-    AV_LOGW("Please call release from Kotlin.");
-    return ;
+static ISVNativeRecorder::Ptr CreateRecorder(jint type, std::string path) {
+  if (type == SV_RECORD_TYPE::OPEN_SL) {
+    return std::make_shared<sv_recorder::SVOpenSLRecorder>(std::move(path));
+  } else if (type == SV_RECORD_TYPE::AAUDIO) {
+    return std::make_shared<sv_recorder::SVAAudioRecorder>(std::move(path));
+  } else if (type == SV_RECORD_TYPE::OBOE) {
+    return std::make_shared<sv_recorder::SVOboeRecorder>(std::move(path));
+  } else if (type == SV_RECORD_TYPE::SYNTHETIC) {
+    return std::make_shared<sv_recorder::SVSyntheticRecorder>(std::move(path));
+  }
+  AV_LOGW("Unknown record type: %d", type);
+  return nullptr;
+}
+
+jint nativeCreateSession(JNIEnv* env, jobject obj, jint type, jstring file_path) {
+  std::string path;
+  if(!GetString(env, file_path, &path)) {
+    return sv_recorder::SV_INVALID_SESSION;
   }
 
-  const char* c_path = env->GetStringUTFChars(file_path, nullptr);
-  std::string path(c_path);
+  auto recorder = CreateRecorder(type, std::move(path));
+  if(!recorder) {
+    return sv_recorder::SV_INVALID_SESSION;
+  }
+  return SVSessionRegistry::Instance().Create(static_cast<SV_RECORD_TYPE>(type), std::move(recorder));
+}
+
+jint nativeSessionSetOption(JNIEnv* env, jobject obj, jint handle, jint option, jint value) {
+  SVSessionRef recorder = SVSessionRegistry::Instance().Acquire(handle);
+  return recorder ? recorder->SetOption(option, value) : JNI_ERR;
+}
+
+jint nativeSessionSetThreadPolicy(JNIEnv* env, jobject obj, jint handle, jint role, jint cpu_mask, jint nice,
+                                  jint fifo_priority) {
+  SVSessionRef recorder = SVSessionRegistry::Instance().Acquire(handle);
+  if(!recorder || role < 0 || role >= sv_recorder::SV_THREAD_ROLE_COUNT) {
+    return JNI_ERR;
+  }
+  sv_recorder::SVThreadPolicy policy;
+  policy.cpu_mask = static_cast<uint32_t>(cpu_mask);
+  policy.nice = nice;
+  policy.fifo_priority = fifo_priority;
+  return recorder->pipeline().SetThreadPolicy(static_cast<sv_recorder::SV_THREAD_ROLE>(role), policy);
+}
+
+jint nativeSessionAddFileSink(JNIEnv* env, jobject obj, jint handle, jstring file_path, jint container) {
+  SVSessionRef recorder = SVSessionRegistry::Instance().Acquire(handle);
+  std::string path;
+  if(!recorder || !GetString(env, file_path, &path)) {
+    return JNI_ERR;
+  }
+  return recorder->pipeline().AddFileSink(path, static_cast<sv_recorder::SV_CONTAINER_TYPE>(container));
+}
+
+jint nativeSessionInit(JNIEnv* env, jobject obj, jint handle, jint sample_rate, jint channels, jint format) {
+  SVSessionRef recorder = SVSessionRegistry::Instance().Acquire(handle);
+  if(format < SV_SAMPLE_I16 || format > SV_SAMPLE_I24) {
+    AV_LOGW("Unsupported sample format: %d", format);
+    return SV_INIT_ERROR;
+  }
+  return recorder ? recorder->InitRecording(sample_rate, channels, static_cast<SV_SAMPLE_FORMAT>(format)) : JNI_ERR;
+}
+
+jint nativeSessionStart(JNIEnv* env, jobject obj, jint handle) {
+  SVSessionRef recorder = SVSessionRegistry::Instance().Acquire(handle);
+  return recorder ? recorder->StartRecording() : JNI_ERR;
+}
+
+jint nativeSessionStop(JNIEnv* env, jobject obj, jint handle) {
+  SVSessionRef recorder = SVSessionRegistry::Instance().Acquire(handle);
+  return recorder ? recorder->StopRecording() : JNI_ERR;
+}
+
+jint nativeSessionOpenStream(JNIEnv* env, jobject obj, jint handle, jobject listener, jint chunk_ms,
+                             jint chunk_count) {
+  SVSessionRef recorder = SVSessionRegistry::Instance().Acquire(handle);
+  if(!recorder) {
+    return JNI_ERR;
+  }
+  auto stream_listener = sv_recorder::SVJniStreamListener::Create(env, listener);
+  if(listener && !stream_listener) {
+    return SV_INIT_ERROR;
+  }
+  return recorder->pipeline().OpenStream(std::move(stream_listener), chunk_ms, chunk_count);
+}
+
+jint nativeSessionCommit(JNIEnv* env, jobject obj, jint handle, jstring file_path, jint post_roll_ms) {
+  SVSessionRef recorder = SVSessionRegistry::Instance().Acquire(handle);
+  std::string path;
+  if(!recorder || !GetString(env, file_path, &path)) {
+    return JNI_ERR;
+  }
+  return recorder->pipeline().Commit(path, post_roll_ms);
+}
+
+jint nativeSessionEndCommit(JNIEnv* env, jobject obj, jint handle) {
+  SVSessionRef recorder = SVSessionRegistry::Instance().Acquire(handle);
+  return recorder ? recorder->pipeline().EndCommit() : JNI_ERR;
+}
+
+jstring nativeSessionGetLevels(JNIEnv* env, jobject obj, jint handle) {
+  SVSessionRef recorder = SVSessionRegistry::Instance().Acquire(handle);
+  if(!recorder) {
+    return nullptr;
+  }
+  return env->NewStringUTF(recorder->pipeline().analyzer().GetLevelsJson().c_str());
+}
+
+jint nativeSessionGetSpectrum(JNIEnv* env, jobject obj, jint handle, jfloatArray magnitudes) {
+  SVSessionRef recorder = SVSessionRegistry::Instance().Acquire(handle);
+  if(!recorder || !magnitudes) {
+    return JNI_ERR;
+  }
+  sv_recorder::SVSpectrumReport report;
+  if(!recorder->pipeline().analyzer().GetSpectrum(&report)) {
+    return 0;
+  }
+  jsize bins = std::min<jsize>(report.bins, env->GetArrayLength(magnitudes));
+  env->SetFloatArrayRegion(magnitudes, 0, bins, report.magnitude_db);
+  return bins;
+}
+
+// |sample_rate|, |channels| and |format| describe raw files, WAV, FLAC and Opus ignore them.
+static bool OpenRecording(JNIEnv* env, jstring file_path, jint sample_rate, jint channels, jint format,
+                          sv_recorder::SVRecordingReader* reader) {
+  std::string path;
+  if(!GetString(env, file_path, &path)) {
+    return false;
+  }
+  const SVAudioFormat raw_format = {sample_rate, channels, static_cast<SV_SAMPLE_FORMAT>(format)};
+  return reader->Open(path, raw_format) == SV_NO_ERROR;
+}
+
+jint nativeFileGetOverview(JNIEnv* env, jobject obj, jstring file_path, jint sample_rate, jint channels,
+                           jint format, jint start_ms, jint duration_ms, jfloatArray peaks, jfloatArray rms) {
+  sv_recorder::SVRecordingReader reader;
+  if(!peaks || !rms || !OpenRecording(env, file_path, sample_rate, channels, format, &reader)) {
+    return JNI_ERR;
+  }
+  const uint64_t first_frame = reader.FrameAt(start_ms);
+  const uint64_t frames = duration_ms > 0 ? reader.FrameAt(duration_ms) : reader.frames();
+  std::vector<sv_recorder::SVIndexSummary> summaries(std::min(env->GetArrayLength(peaks), env->GetArrayLength(rms)));
+  const size_t columns = reader.Overview(first_frame, frames, summaries.size(), summaries.data());
+  std::vector<jfloat> values(columns);
+  for(size_t i = 0; i < columns; i++) {
+    values[i] = summaries[i].peak / 65535.0f;
+  }
+  env->SetFloatArrayRegion(peaks, 0, static_cast<jsize>(columns), values.data());
+  for(size_t i = 0; i < columns; i++) {
+    values[i] = summaries[i].rms / 65535.0f;
+  }
+  env->SetFloatArrayRegion(rms, 0, static_cast<jsize>(columns), values.data());
+  return static_cast<jint>(columns);
+}
+
+jint nativeFileReadFrames(JNIEnv* env, jobject obj, jstring file_path, jint sample_rate, jint channels,
+                          jint format, jint start_ms, jbyteArray pcm) {
+  sv_recorder::SVRecordingReader reader;
+  if(!pcm || !OpenRecording(env, file_path, sample_rate, channels, format, &reader)) {
+    return JNI_ERR;
+  }
+  const uint64_t first_frame = reader.FrameAt(start_ms);
+  const uint8_t* src = reader.FramePointer(first_frame);
+  if(!src) {
+    return reader.has_samples() ? 0 : JNI_ERR;
+  }
+  // Straight from the mapping into the Java array, no intermediate copy.
+  const size_t frame_bytes = reader.format().BytesPerFrame();
+  const uint64_t frames = std::min<uint64_t>(env->GetArrayLength(pcm) / frame_bytes, reader.frames() - first_frame);
+  env->SetByteArrayRegion(pcm, 0, static_cast<jsize>(frames * frame_bytes), reinterpret_cast<const jbyte*>(src));
+  return static_cast<jint>(frames);
+}
+
+jint nativeBackendPrewarm(JNIEnv* env, jobject obj, jint type, jint sample_rate, jint channels, jint format) {
+  if(sample_rate <= 0 || channels <= 0 || format < SV_SAMPLE_I16 || format > SV_SAMPLE_I24) {
+    AV_LOGW("Prewarm error, invalid format: %d/%d/%d", sample_rate, channels, format);
+    return JNI_ERR;
+  }
+  const SVAudioFormat audio_format = {sample_rate, channels, static_cast<SV_SAMPLE_FORMAT>(format)};
   if (type == SV_RECORD_TYPE::OPEN_SL) {
-    g_recorder = std::make_shared<sv_recorder::SVOpenSLRecorder>(std::move(path));
-    g_record_type_ = SV_RECORD_TYPE::OPEN_SL;
+    return sv_recorder::SVOpenSLRecorder::Prewarm(audio_format);
   } else if (type == SV_RECORD_TYPE::AAUDIO) {
-    g_recorder = std::make_shared<sv_recorder::SVAAudioRecorder>(std::move(path));
-    g_record_type_ = SV_RECORD_TYPE::AAUDIO;
+    return sv_recorder::SVAAudioRecorder::Prewarm(audio_format);
   } else if (type == SV_RECORD_TYPE::OBOE) {
-    g_recorder = std::make_shared<sv_recorder::SVOboeRecorder>(std::move(path));
-    g_record_type_ = SV_RECORD_TYPE::OBOE;
+    return sv_recorder::SVOboeRecorder::Prewarm(audio_format);
+  } else if (type == SV_RECORD_TYPE::SYNTHETIC) {
+    return sv_recorder::SVSyntheticRecorder::Prewarm(audio_format);
   }
-  env->ReleaseStringUTFChars(file_path, c_path);
+  AV_LOGW("Unknown record type: %d", type);
+  return JNI_ERR;
 }
 
-jint nativeInitRecording(JNIEnv* env, jobject obj, jint sample_rate, jint channels) {
-  jint result = JNI_ERR;
-  if(g_recorder) {
-    result = g_recorder->InitRecording(sample_rate, channels);
+jstring nativeBackendGetInfo(JNIEnv* env, jobject obj) {
+  return env->NewStringUTF(sv_recorder::SVBackendContext::Instance().GetJson().c_str());
+}
+
+jstring nativeSessionGetStats(JNIEnv* env, jobject obj, jint handle) {
+  SVSessionRef recorder = SVSessionRegistry::Instance().Acquire(handle);
+  if(!recorder) {
+    return nullptr;
   }
-  return result;
+  return env->NewStringUTF(recorder->pipeline().GetStatsJson().c_str());
 }
 
-jint nativeStartRecording(JNIEnv* env, jobject obj) {
-  jint result = JNI_ERR;
-  if(g_recorder) {
-    result = g_recorder->StartRecording();
+jstring nativeSessionGetStreamInfo(JNIEnv* env, jobject obj, jint handle) {
+  SVSessionRef recorder = SVSessionRegistry::Instance().Acquire(handle);
+  if(!recorder) {
+    return nullptr;
   }
-  return result;
+  return env->NewStringUTF(recorder->pipeline().GetStreamInfoJson().c_str());
 }
 
-jint nativeStopRecording(JNIEnv* env, jobject obj) {
-  jint result = JNI_ERR;
-  if(g_recorder) {
-    result = g_recorder->StopRecording();
+jint nativeSessionRelease(JNIEnv* env, jobject obj, jint handle) {
+  auto recorder = SVSessionRegistry::Instance().Remove(handle);
+  return recorder ? recorder->Release() : JNI_ERR;
+}
+
+void nativeSetRecordType(JNIEnv* env, jobject obj, jint type, jstring file_path) {
+
+  if(g_default_session.load() != sv_recorder::SV_INVALID_SESSION) {
+    AV_LOGW("Please call release from Kotlin.");
+    return ;
+  }
+
+  jint handle = nativeCreateSession(env, obj, type, file_path);
+  int32_t expected = sv_recorder::SV_INVALID_SESSION;
+  if(!g_default_session.compare_exchange_strong(expected, handle)) {
+    AV_LOGW("Please release pre g_recorder.");
+    nativeSessionRelease(env, obj, handle);
   }
-  return result;
+}
+
+jint nativeSetRecordOption(JNIEnv* env, jobject obj, jint option, jint value) {
+  return nativeSessionSetOption(env, obj, g_default_session.load(), option, value);
+}
+
+jint nativeInitRecording(JNIEnv* env, jobject obj, jint sample_rate, jint channels) {
+  return nativeSessionInit(env, obj, g_default_session.load(), sample_rate, channels, SV_SAMPLE_I16);
+}
+
+jint nativeStartRecording(JNIEnv* env, jobject obj) {
+  return nativeSessionStart(env, obj, g_default_session.load());
+}
+
+jint nativeStopRecording(JNIEnv* env, jobject obj) {
+  return nativeSessionStop(env, obj, g_default_session.load());
 }
 
 jint nativeReleaseRecording(JNIEnv* env, jobject obj) {
-  jint result = JNI_ERR;
-  if(g_recorder) {
-    result = g_recorder->Release();
-  }
-  g_recorder = nullptr;
-  g_record_type_ = UNDEFINED;
-  return result;
+  return nativeSessionRelease(env, obj, g_default_session.exchange(sv_recorder::SV_INVALID_SESSION));
 }
 
 static JNINativeMethod gMethods[] = {
@@ -82,6 +299,26 @@ static JNINativeMethod gMethods[] = {
 {"start_recording", "()I", (void*) nativeStartRecording},
 {"stop_recording", "()I", (void*) nativeStopRecording},
 {"release_recording", "()I", (void*) nativeReleaseRecording},
+{"set_record_option", "(II)I", (void*) nativeSetRecordOption},
+{"create_session", "(ILjava/lang/String;)I", (void*) nativeCreateSession},
+{"session_set_option", "(III)I", (void*) nativeSessionSetOption},
+{"session_set_thread_policy", "(IIIII)I", (void*) nativeSessionSetThreadPolicy},
+{"session_add_file_sink", "(ILjava/lang/String;I)I", (void*) nativeSessionAddFileSink},
+{"session_init", "(IIII)I", (void*) nativeSessionInit},
+{"session_start", "(I)I", (void*) nativeSessionStart},
+{"session_stop", "(I)I", (void*) nativeSessionStop},
+{"session_release", "(I)I", (void*) nativeSessionRelease},
+{"session_get_stats", "(I)Ljava/lang/String;", (void*) nativeSessionGetStats},
+{"session_get_stream_info", "(I)Ljava/lang/String;", (void*) nativeSessionGetStreamInfo},
+{"session_open_stream", "(ILcom/soundvision/aos_audio_record/common/SVAudioStreamListener;II)I", (void*) nativeSessionOpenStream},
+{"session_get_levels", "(I)Ljava/lang/String;", (void*) nativeSessionGetLevels},
+{"session_get_spectrum", "(I[F)I", (void*) nativeSessionGetSpectrum},
+{"session_commit", "(ILjava/lang/String;I)I", (void*) nativeSessionCommit},
+{"session_end_commit", "(I)I", (void*) nativeSessionEndCommit},
+{"file_get_overview", "(Ljava/lang/String;IIIII[F[F)I", (void*) nativeFileGetOverview},
+{"file_read_frames", "(Ljava/lang/String;IIII[B)I", (void*) nativeFileReadFrames},
+{"backend_prewarm", "(IIII)I", (void*) nativeBackendPrewarm},
+{"backend_get_info", "()Ljava/lang/String;", (void*) nativeBackendGetInfo},
 };
 
 static const char* className = "com/soundvision/aos_audio_record/SVNativeRecorder";
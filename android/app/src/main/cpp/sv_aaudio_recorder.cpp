@@ -6,51 +6,186 @@
  * tree.
  */
 #include "sv_aaudio_recorder.h"
-#include <cassert>
 #include "log.h"
 
 namespace sv_recorder {
 
+SVAAudioBuilderPool& SVAAudioBuilderPool::Instance() {
+  static SVAAudioBuilderPool pool;
+  return pool;
+}
+
+AAudioStreamBuilder* SVAAudioBuilderPool::Acquire() {
+  AAudioStreamBuilder* builder = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!idle_.empty()) {
+      builder = idle_.back();
+      idle_.pop_back();
+    }
+  }
+  const bool reused = builder != nullptr;
+  if(!reused) {
+    aaudio_result_t result = AAudio_createStreamBuilder(&builder);
+    if(result != AAUDIO_OK) {
+      AV_LOGW("AAudio_createStreamBuilder error:%d, reason:%s", result, AAudio_convertResultToText(result));
+      return nullptr;
+    }
+  }
+  SVBackendContext::Instance().OnResource(SV_RESOURCE_BUILDER, reused);
+  return builder;
+}
+
+void SVAAudioBuilderPool::Release(AAudioStreamBuilder* builder) {
+  if(!builder) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(idle_.size() < SV_AAUDIO_MAX_IDLE_BUILDERS) {
+      idle_.push_back(builder);
+      return;
+    }
+  }
+  AAudioStreamBuilder_delete(builder);
+}
+
 SVAAudioRecorder::SVAAudioRecorder(std::string file_path)
-  : builder_(nullptr), stream_(nullptr), initialized_(false), recording_(false) {
+  : builder_(nullptr), stream_(nullptr), initialized_(false), recording_(false), pipeline_(file_path) {
   AV_LOGI("=== SVAAudioRecorder CreateBuilder ===");
-  file_ = fopen( file_path.c_str(), "wb");
-  assert(AAudio_createStreamBuilder(&builder_) == AAUDIO_OK);
+  builder_ = SVAAudioBuilderPool::Instance().Acquire();
+  pipeline_.recovery().SetHandler(this);
 }
 
 SVAAudioRecorder::~SVAAudioRecorder() {
   AV_LOGI("=== SVAAudioRecorder Release Recorder ====");
   DestroyRecorder();
-  if(file_) {
-    fclose(file_);
-    file_ = nullptr;
-  }
+  SVAAudioBuilderPool::Instance().Release(builder_);
 }
 
-int SVAAudioRecorder::InitRecording(int sample_rate, int channel) {
+int SVAAudioRecorder::InitRecording(int sample_rate, int channel, SV_SAMPLE_FORMAT format) {
 
+  if(!builder_) {
+    AV_LOGW("InitRecording error, no stream builder.");
+    return SV_INIT_ERROR;
+  }
+  pipeline_.BeginInit(AAUDIO);
+  const SVRecordOptions& options = pipeline_.options();
   //step1: set configure.
-  AAudioStreamBuilder_setDeviceId(builder_, AAUDIO_UNSPECIFIED);
+  AAudioStreamBuilder_setDeviceId(builder_, options.device_id > 0 ? options.device_id : AAUDIO_UNSPECIFIED);
   AAudioStreamBuilder_setSampleRate(builder_, sample_rate);
   AAudioStreamBuilder_setChannelCount(builder_, channel);
-  AAudioStreamBuilder_setFormat(builder_, AAUDIO_FORMAT_PCM_I16);
-  AAudioStreamBuilder_setSharingMode(builder_, AAUDIO_SHARING_MODE_SHARED);
+  AAudioStreamBuilder_setFormat(builder_, ToAAudioFormat(format));
+  // Exclusive access is what gets an input stream onto the MMAP path.
+  AAudioStreamBuilder_setSharingMode(builder_, options.low_latency ? AAUDIO_SHARING_MODE_EXCLUSIVE
+                                                                   : AAUDIO_SHARING_MODE_SHARED);
   AAudioStreamBuilder_setDirection(builder_, AAUDIO_DIRECTION_INPUT);
   AAudioStreamBuilder_setPerformanceMode(builder_, AAUDIO_PERFORMANCE_MODE_LOW_LATENCY);
   AAudioStreamBuilder_setDataCallback(builder_, AVDataCallback, this);
   AAudioStreamBuilder_setErrorCallback(builder_, AVErrorCallback, this);
 
   //step2: open stream.
-  auto result = AAudioStreamBuilder_openStream(builder_, &stream_);
-  if (result != AAUDIO_OK) {
-    AV_LOGW("InitRecording error: %d, reason: %s", result, AAudio_convertResultToText(result));
+  if (OpenStreamWithFallback() != SV_NO_ERROR) {
     return SV_INIT_ERROR;
   }
 
+  SV_SAMPLE_FORMAT actual_format;
+  if (!FromAAudioFormat(AAudioStream_getFormat(stream_), &actual_format)) {
+    AV_LOGW("InitRecording error, unsupported stream format: %d", AAudioStream_getFormat(stream_));
+    DestroyRecorder();
+    return SV_INIT_ERROR;
+  }
+  int result = pipeline_.Prepare({AAudioStream_getSampleRate(stream_), AAudioStream_getChannelCount(stream_),
+                                  actual_format});
+  if (result != SV_NO_ERROR) {
+    AV_LOGW("InitRecording error, pipeline prepare failed: %d", result);
+    DestroyRecorder();
+    return result;
+  }
+  ConfigureStream();
+  pipeline_.EndInit();
   initialized_ = true;
   return SV_NO_ERROR;
 }
 
+int SVAAudioRecorder::Prewarm(const SVAudioFormat& format) {
+  const int64_t begin_ns = SVNowNs();
+  SVBackendContext& context = SVBackendContext::Instance();
+  AAudioStreamBuilder* builder = SVAAudioBuilderPool::Instance().Acquire();
+  int result = builder ? SV_NO_ERROR : SV_CRATE_ERROR;
+  if(builder) {
+    AAudioStreamBuilder_setDeviceId(builder, AAUDIO_UNSPECIFIED);
+    AAudioStreamBuilder_setSampleRate(builder, format.sample_rate);
+    AAudioStreamBuilder_setChannelCount(builder, format.channels);
+    AAudioStreamBuilder_setFormat(builder, ToAAudioFormat(format.sample_format));
+    AAudioStreamBuilder_setSharingMode(builder, AAUDIO_SHARING_MODE_SHARED);
+    AAudioStreamBuilder_setDirection(builder, AAUDIO_DIRECTION_INPUT);
+    AAudioStreamBuilder_setPerformanceMode(builder, AAUDIO_PERFORMANCE_MODE_LOW_LATENCY);
+    // Never started, a stream without callbacks is enough.
+    AAudioStreamBuilder_setDataCallback(builder, nullptr, nullptr);
+    AAudioStreamBuilder_setErrorCallback(builder, nullptr, nullptr);
+    AAudioStream* stream = nullptr;
+    aaudio_result_t opened = AAudioStreamBuilder_openStream(builder, &stream);
+    if(opened == AAUDIO_OK) {
+      AAudioStream_close(stream);
+    } else {
+      AV_LOGW("Prewarm openStream error:%d, reason:%s", opened, AAudio_convertResultToText(opened));
+      result = SV_INIT_ERROR;
+    }
+    SVAAudioBuilderPool::Instance().Release(builder);
+  }
+  if(result == SV_NO_ERROR) {
+    context.MarkWarm(AAUDIO);
+  }
+  context.OnPrewarm(AAUDIO, SVNowNs() - begin_ns, result);
+  return result;
+}
+
+int SVAAudioRecorder::OpenStreamWithFallback() {
+  AAudioStream* stream = nullptr;
+  auto result = AAudioStreamBuilder_openStream(builder_, &stream);
+  if (result != AAUDIO_OK && pipeline_.options().low_latency) {
+    AV_LOGW("Exclusive stream denied: %s, falling back to shared.", AAudio_convertResultToText(result));
+    AAudioStreamBuilder_setSharingMode(builder_, AAUDIO_SHARING_MODE_SHARED);
+    result = AAudioStreamBuilder_openStream(builder_, &stream);
+    // A later reopen tries exclusive again, the device may be free by then.
+    AAudioStreamBuilder_setSharingMode(builder_, AAUDIO_SHARING_MODE_EXCLUSIVE);
+  }
+  if (result != AAUDIO_OK) {
+    AV_LOGW("OpenStream error: %d, reason: %s", result, AAudio_convertResultToText(result));
+    stream_.store(nullptr, std::memory_order_release);
+    return SV_INIT_ERROR;
+  }
+  stream_.store(stream, std::memory_order_release);
+  return SV_NO_ERROR;
+}
+
+void SVAAudioRecorder::ConfigureStream() {
+  const bool low_latency = pipeline_.options().low_latency;
+  SVStreamInfo info;
+  info.backend = "aaudio";
+  info.sharing_mode = AAudioStream_getSharingMode(stream_) == AAUDIO_SHARING_MODE_EXCLUSIVE
+                      ? SV_SHARING_EXCLUSIVE : SV_SHARING_SHARED;
+  // Exclusive streams always run on MMAP, the NDK has no public query for shared ones.
+  info.mmap = info.sharing_mode == SV_SHARING_EXCLUSIVE;
+  info.fallback = low_latency && info.sharing_mode != SV_SHARING_EXCLUSIVE;
+  info.device_id = AAudioStream_getDeviceId(stream_);
+  info.frames_per_burst = AAudioStream_getFramesPerBurst(stream_);
+  info.buffer_capacity = AAudioStream_getBufferCapacityInFrames(stream_);
+
+  SVLatencyTuner& tuner = pipeline_.latency_tuner();
+  if (low_latency || tuner.adaptive()) {
+    // The adaptive mode starts from the device default and sizes from there.
+    tuner.Init(info.frames_per_burst, info.buffer_capacity,
+               low_latency ? info.frames_per_burst * SV_LOW_LATENCY_INITIAL_BURSTS
+                           : AAudioStream_getBufferSizeInFrames(stream_));
+    tuner.SetBufferSize(AAudioStream_setBufferSizeInFrames(stream_, tuner.buffer_size()));
+  } else {
+    tuner.Init(0, info.buffer_capacity, AAudioStream_getBufferSizeInFrames(stream_));
+  }
+  pipeline_.SetStreamInfo(info);
+}
+
 int SVAAudioRecorder::StartRecording() {
 
   if(!initialized_) {
@@ -64,9 +199,16 @@ int SVAAudioRecorder::StartRecording() {
     return SV_START_RECORDING_ERROR;
   }
 
+  int started = pipeline_.Start();
+  if (started != SV_NO_ERROR) {
+    AV_LOGW("StartRecording error, pipeline start failed: %d", started);
+    pipeline_.Stop();
+    return started;
+  }
   aaudio_result_t result = AAudioStream_requestStart(stream_);
   if (result != AAUDIO_OK) {
     AV_LOGW("StartRecording error:%d, reason:%s", result, AAudio_convertResultToText(result));
+    pipeline_.Stop();
     return SV_START_RECORDING_ERROR;
   }
   recording_ = true;
@@ -80,23 +222,87 @@ int SVAAudioRecorder::StopRecording() {
     return SV_STATE_ERROR;
   }
 
-  aaudio_result_t result = AAudioStream_requestStop(stream_);
-  if (result != AAUDIO_OK) {
-    AV_LOGW("StopRecording error: %d, reason:%s", result, AAudio_convertResultToText(result));
-    return SV_STOP_ERROR;
+  // Waits for a recovery in flight, afterwards |stream_| is ours again, or null if it failed.
+  pipeline_.recovery().Stop();
+  AAudioStream* stream = stream_.load(std::memory_order_acquire);
+  if(stream) {
+    aaudio_result_t result = AAudioStream_requestStop(stream);
+    if (result != AAUDIO_OK) {
+      AV_LOGW("StopRecording error: %d, reason:%s", result, AAudio_convertResultToText(result));
+      return SV_STOP_ERROR;
+    }
+    // requestStop() only asks, a data callback may still be running until the stream is STOPPED.
+    aaudio_stream_state_t state = AAUDIO_STREAM_STATE_STOPPING;
+    while (state != AAUDIO_STREAM_STATE_STOPPED) {
+      aaudio_stream_state_t next = AAUDIO_STREAM_STATE_UNINITIALIZED;
+      result = AAudioStream_waitForStateChange(stream, state, &next, SV_AAUDIO_STOP_TIMEOUT_NS);
+      if (result != AAUDIO_OK) {
+        AV_LOGW("StopRecording wait error: %d, reason:%s", result, AAudio_convertResultToText(result));
+        return SV_STOP_ERROR;
+      }
+      state = next;
+    }
   }
+  // No callback runs from here on, the pipeline may flush from this thread.
+  pipeline_.Stop();
   recording_ = false;
   initialized_ = false;
   return SV_NO_ERROR;
 }
 
 void SVAAudioRecorder::DestroyRecorder() {
-  AAudioStream_close(stream_);
-  stream_ = nullptr;
+  pipeline_.recovery().Stop();
+  AAudioStream* stream = stream_.exchange(nullptr, std::memory_order_acq_rel);
+  if(stream) {
+    AAudioStream_close(stream);
+  }
   recording_ = false;
   initialized_ = false;
 }
 
+void SVAAudioRecorder::CloseStream() {
+  // Unpublished first, a late error callback of this stream no longer matches.
+  AAudioStream* stream = stream_.exchange(nullptr, std::memory_order_acq_rel);
+  if(!stream) {
+    return;
+  }
+  // The disconnected stream is already stopped by the service, the result is irrelevant.
+  AAudioStream_requestStop(stream);
+  AAudioStream_close(stream);
+}
+
+int SVAAudioRecorder::OpenStream() {
+  if (OpenStreamWithFallback() != SV_NO_ERROR) {
+    return SV_INIT_ERROR;
+  }
+  // The new route may offer a different format, the file cannot change format midway.
+  const SVAudioFormat& format = pipeline_.format();
+  SV_SAMPLE_FORMAT actual_format;
+  if (!FromAAudioFormat(AAudioStream_getFormat(stream_), &actual_format) || actual_format != format.sample_format ||
+      AAudioStream_getSampleRate(stream_) != format.sample_rate ||
+      AAudioStream_getChannelCount(stream_) != format.channels) {
+    AV_LOGW("OpenStream error, format changed to %d/%d/%d", AAudioStream_getSampleRate(stream_),
+            AAudioStream_getChannelCount(stream_), AAudioStream_getFormat(stream_));
+    CloseStream();
+    return SV_INIT_ERROR;
+  }
+  ConfigureStream();
+  return SV_NO_ERROR;
+}
+
+int SVAAudioRecorder::StartStream() {
+  aaudio_result_t result = AAudioStream_requestStart(stream_);
+  if (result != AAUDIO_OK) {
+    AV_LOGW("StartStream error:%d, reason:%s", result, AAudio_convertResultToText(result));
+    return SV_START_RECORDING_ERROR;
+  }
+  return SV_NO_ERROR;
+}
+
+int SVAAudioRecorder::SetOption(int32_t option, int32_t value) {
+  return pipeline_.SetOption(option, value);
+}
+
 int SVAAudioRecorder::Release() {
 
   if(!initialized_) {
@@ -108,20 +314,55 @@ int SVAAudioRecorder::Release() {
   return SV_NO_ERROR;
 }
 
+aaudio_format_t SVAAudioRecorder::ToAAudioFormat(SV_SAMPLE_FORMAT format) {
+  switch (format) {
+    case SV_SAMPLE_F32:
+      return AAUDIO_FORMAT_PCM_FLOAT;
+    case SV_SAMPLE_I24:
+      return AAUDIO_FORMAT_PCM_I24_PACKED;
+    default:
+      return AAUDIO_FORMAT_PCM_I16;
+  }
+}
+
+bool SVAAudioRecorder::FromAAudioFormat(aaudio_format_t aaudio_format, SV_SAMPLE_FORMAT* format) {
+  switch (aaudio_format) {
+    case AAUDIO_FORMAT_PCM_I16:
+      *format = SV_SAMPLE_I16;
+      return true;
+    case AAUDIO_FORMAT_PCM_FLOAT:
+      *format = SV_SAMPLE_F32;
+      return true;
+    case AAUDIO_FORMAT_PCM_I24_PACKED:
+      *format = SV_SAMPLE_I24;
+      return true;
+    default:
+      return false;
+  }
+}
+
 aaudio_data_callback_result_t SVAAudioRecorder::AVDataCallback(AAudioStream *stream, void *userData, void *audioData, int32_t numFrames) {
-  AV_LOGI("==== onDataCallback ====, numFrames:%d", numFrames);
+  AV_LOG_CALLBACK("==== onDataCallback ====, numFrames:%d", numFrames);
   auto recorder = reinterpret_cast<SVAAudioRecorder *>(userData);
 
-  int32_t data_len = AAudioStream_getChannelCount(stream) * numFrames * 2;
-  if(recorder->file_) {
-    size_t write_len = fwrite(audioData, 1, data_len, recorder->file_);
-    AV_LOGI("Write into file data len:%d", write_len);
+  recorder->pipeline_.OnAudioData(audioData, numFrames);
+  int32_t xruns = AAudioStream_getXRunCount(stream);
+  recorder->pipeline_.metrics().SetXRunCount(xruns);
+  SVLatencyTuner& tuner = recorder->pipeline_.latency_tuner();
+  int32_t buffer_size = tuner.OnCallback(SVNowNs(), numFrames, xruns);
+  if (buffer_size > 0) {
+    tuner.SetBufferSize(AAudioStream_setBufferSizeInFrames(stream, buffer_size));
   }
   return AAUDIO_CALLBACK_RESULT_CONTINUE;
 }
 
 void SVAAudioRecorder::AVErrorCallback(AAudioStream *stream, void *userData, aaudio_result_t error) {
   AV_LOGI("=== onErrorCallback ====, error:%d", error);
+  auto recorder = reinterpret_cast<SVAAudioRecorder *>(userData);
+  // The stream must not be closed from this callback, the recovery thread does that.
+  if (error == AAUDIO_ERROR_DISCONNECTED && stream == recorder->stream_.load(std::memory_order_acquire)) {
+    recorder->pipeline_.recovery().OnDisconnected(AAudio_convertResultToText(error));
+  }
 }
 
 } //namespace av_recorder
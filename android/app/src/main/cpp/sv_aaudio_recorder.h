@@ -8,23 +8,67 @@
 #ifndef AOS_AUDIO_RECORD_SV_AAUDIO_RECORDER_H
 #define AOS_AUDIO_RECORD_SV_AAUDIO_RECORDER_H
 
+#include <atomic>
+#include <mutex>
+#include <vector>
 #include "sv_common.h"
+#include "sv_capture_pipeline.h"
 #include <aaudio/AAudio.h>
 
 namespace sv_recorder {
 
-class SVAAudioRecorder : public ISVNativeRecorder{
+const size_t SV_AAUDIO_MAX_IDLE_BUILDERS = 4;
+// How long StopRecording() waits for the stream to reach STOPPED.
+const int64_t SV_AAUDIO_STOP_TIMEOUT_NS = 2000000000LL;
+
+// AAudio stream builders of the process. A recorder borrows one for its lifetime, the
+// next session gets it back instead of creating another; InitRecording() sets every field
+// the recorders use, so nothing carries over from the previous owner.
+class SVAAudioBuilderPool {
+
+public:
+    static SVAAudioBuilderPool& Instance();
+
+    // nullptr when AAudio cannot create a builder.
+    AAudioStreamBuilder* Acquire();
+    void Release(AAudioStreamBuilder* builder);
+
+private:
+    SVAAudioBuilderPool() = default;
+
+private:
+    std::mutex mutex_;
+    std::vector<AAudioStreamBuilder*> idle_;
+};
+
+class SVAAudioRecorder : public ISVNativeRecorder, public ISVStreamHandler {
 
 public:
     explicit SVAAudioRecorder(std::string file_path);
     ~SVAAudioRecorder();
-    int InitRecording(int sample_rate, int channel) override;
+    int InitRecording(int sample_rate, int channel, SV_SAMPLE_FORMAT format) override;
     int StartRecording() override;
     int StopRecording() override;
     int Release() override;
+    int SetOption(int32_t option, int32_t value) override;
+    SVCapturePipeline& pipeline() override { return pipeline_; }
+    // Opens and closes a shared input stream of |format|, so the AAudio client and service
+    // are up before the first session. Needs the RECORD_AUDIO permission.
+    static int Prewarm(const SVAudioFormat& format);
+
+    // ISVStreamHandler, reopens |builder_| after a disconnect.
+    void CloseStream() override;
+    int OpenStream() override;
+    int StartStream() override;
 
 private:
+    // Opens |stream_| from |builder_|, an exclusive request that is refused is retried shared.
+    int OpenStreamWithFallback();
+    // Reports the negotiated configuration and sizes the buffer of a freshly opened stream.
+    void ConfigureStream();
     void DestroyRecorder();
+    static aaudio_format_t ToAAudioFormat(SV_SAMPLE_FORMAT format);
+    static bool FromAAudioFormat(aaudio_format_t aaudio_format, SV_SAMPLE_FORMAT* format);
 
 public:
     static aaudio_data_callback_result_t AVDataCallback(AAudioStream *stream, void *userData, void *audioData, int32_t numFrames);
@@ -32,10 +76,12 @@ public:
 
 private:
     AAudioStreamBuilder *builder_;
-    AAudioStream* stream_;
+    // Swapped by the recovery thread while the error callback of the old stream may run,
+    // the callback only acts on the stream that is currently published here.
+    std::atomic<AAudioStream*> stream_;
     bool initialized_;
     bool recording_;
-    FILE* file_;
+    SVCapturePipeline pipeline_;
 };
 
 }
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_analysis.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "log.h"
+
+namespace sv_recorder {
+
+// Frames converted to float per pass, bounds the work buffers.
+const size_t SV_ANALYSIS_BLOCK_FRAMES = 512;
+
+static float ToDb(float linear) {
+  return linear > 0.0f ? std::max(SV_ANALYSIS_FLOOR_DB, 20.0f * log10f(linear)) : SV_ANALYSIS_FLOOR_DB;
+}
+
+// Largest magnitude a sample of |format| reaches, anything at or above it counts as clipped.
+static float ClipLevel(SV_SAMPLE_FORMAT format) {
+  switch (format) {
+    case SV_SAMPLE_F32: return 1.0f;
+    case SV_SAMPLE_I24: return 8388607.0f / 8388608.0f;
+    default: return 32767.0f / 32768.0f;
+  }
+}
+
+SVLevelAnalyzer::SVLevelAnalyzer()
+  : format_{0, 0, SV_SAMPLE_I16}, interval_frames_(0), partial_bytes_(0), frames_(0), frame_position_(0),
+    history_pos_(0) {
+  memset(&level_report_, 0, sizeof(level_report_));
+  memset(&spectrum_report_, 0, sizeof(spectrum_report_));
+}
+
+int SVLevelAnalyzer::Init(const SVAudioFormat& format, const SVAnalysisConfig& config) {
+  interval_frames_ = 0;
+  if(config.interval_ms == 0) {
+    return SV_NO_ERROR;
+  }
+  if(format.channels <= 0 || format.channels > SV_MAX_CONVERT_CHANNELS) {
+    AV_LOGW("SVLevelAnalyzer unsupported channels: %d", format.channels);
+    return SV_INIT_ERROR;
+  }
+  format_ = format;
+  config_ = config;
+  interval_frames_ = std::max<size_t>(1, static_cast<size_t>(format.sample_rate) * config.interval_ms / 1000);
+  partial_bytes_ = 0;
+  interleaved_.resize(SV_ANALYSIS_BLOCK_FRAMES * format.channels);
+  planar_.resize(SV_ANALYSIS_BLOCK_FRAMES * format.channels);
+  channel_ptrs_.resize(format.channels);
+  for(int ch = 0; ch < format.channels; ch++) {
+    channel_ptrs_[ch] = planar_.data() + ch * SV_ANALYSIS_BLOCK_FRAMES;
+  }
+  frames_ = 0;
+  frame_position_ = 0;
+  std::fill(peak_, peak_ + SV_MAX_CONVERT_CHANNELS, 0.0f);
+  std::fill(sum_squares_, sum_squares_ + SV_MAX_CONVERT_CHANNELS, 0.0);
+  std::fill(sum_, sum_ + SV_MAX_CONVERT_CHANNELS, 0.0);
+  std::fill(clip_count_, clip_count_ + SV_MAX_CONVERT_CHANNELS, 0);
+
+  const size_t n = static_cast<size_t>(config.fft_size);
+  history_.assign(n, 0.0f);
+  history_pos_ = 0;
+  window_.resize(n);
+  twiddles_.resize(n / 2);
+  fft_.resize(n);
+  bit_reverse_.resize(n);
+  int bits = 0;
+  while((static_cast<size_t>(1) << bits) < n) {
+    bits++;
+  }
+  for(size_t i = 0; i < n; i++) {
+    window_[i] = static_cast<float>(0.5 - 0.5 * cos(2.0 * M_PI * i / n));
+    uint32_t reversed = 0;
+    for(int b = 0; b < bits; b++) {
+      reversed |= ((i >> b) & 1u) << (bits - 1 - b);
+    }
+    bit_reverse_[i] = reversed;
+  }
+  for(size_t i = 0; i < n / 2; i++) {
+    twiddles_[i] = std::polar(1.0f, static_cast<float>(-2.0 * M_PI * i / n));
+  }
+  AV_LOGI("SVLevelAnalyzer every %d ms, fft size:%d", config.interval_ms, config.fft_size);
+  return SV_NO_ERROR;
+}
+
+void SVLevelAnalyzer::OnCapture(const uint8_t* data, size_t len) {
+  if(!IsEnabled()) {
+    return;
+  }
+  const size_t frame_bytes = format_.BytesPerFrame();
+  if(partial_bytes_ > 0) {
+    size_t take = std::min(frame_bytes - partial_bytes_, len);
+    memcpy(partial_ + partial_bytes_, data, take);
+    partial_bytes_ += take;
+    data += take;
+    len -= take;
+    if(partial_bytes_ < frame_bytes) {
+      return;
+    }
+    partial_bytes_ = 0;
+    ProcessFrames(partial_, 1);
+  }
+  ProcessFrames(data, len / frame_bytes);
+  partial_bytes_ = len % frame_bytes;
+  memcpy(partial_, data + len - partial_bytes_, partial_bytes_);
+}
+
+void SVLevelAnalyzer::ProcessFrames(const uint8_t* data, size_t frames) {
+  const SVConvertKernels& kernels = SVConvert();
+  const int channels = format_.channels;
+  const float clip_level = ClipLevel(format_.sample_format);
+  const size_t history_size = history_.size();
+
+  while(frames > 0) {
+    // Blocks never straddle an interval, so every report covers exactly its frames.
+    const size_t block = std::min(std::min(frames, SV_ANALYSIS_BLOCK_FRAMES), interval_frames_ - frames_);
+    const size_t samples = block * channels;
+    float* interleaved = interleaved_.data();
+    if(format_.sample_format == SV_SAMPLE_F32) {
+      memcpy(interleaved, data, samples * sizeof(float));
+    } else if(format_.sample_format == SV_SAMPLE_I24) {
+      kernels.i24_to_f32(data, interleaved, samples);
+    } else {
+      kernels.i16_to_f32(reinterpret_cast<const int16_t*>(data), interleaved, samples);
+    }
+    // Mono needs no planar copy.
+    float* const* planar = &interleaved;
+    if(channels > 1) {
+      kernels.deinterleave(interleaved, channel_ptrs_.data(), block, channels);
+      planar = channel_ptrs_.data();
+    }
+
+    for(int ch = 0; ch < channels; ch++) {
+      const float* x = planar[ch];
+      float peak = peak_[ch];
+      float sum = 0.0f;
+      uint64_t clips = 0;
+      for(size_t i = 0; i < block; i++) {
+        const float magnitude = fabsf(x[i]);
+        peak = std::max(peak, magnitude);
+        sum += x[i];
+        clips += magnitude >= clip_level;
+      }
+      peak_[ch] = peak;
+      sum_[ch] += sum;
+      sum_squares_[ch] += kernels.dot(x, x, block);
+      clip_count_[ch] += clips;
+    }
+
+    if(history_size > 0) {
+      const float scale = 1.0f / channels;
+      for(size_t i = 0; i < block; i++) {
+        float mix = 0.0f;
+        for(int ch = 0; ch < channels; ch++) {
+          mix += planar[ch][i];
+        }
+        history_[history_pos_] = mix * scale;
+        history_pos_ = history_pos_ + 1 == history_size ? 0 : history_pos_ + 1;
+      }
+    }
+
+    data += block * format_.BytesPerFrame();
+    frames -= block;
+    frames_ += block;
+    frame_position_ += block;
+    if(frames_ == interval_frames_) {
+      Publish();
+    }
+  }
+}
+
+void SVLevelAnalyzer::Publish() {
+  level_report_.frame_position = frame_position_;
+  level_report_.channels = format_.channels;
+  for(int ch = 0; ch < format_.channels; ch++) {
+    SVChannelLevels& levels = level_report_.levels[ch];
+    levels.peak = peak_[ch];
+    levels.rms = static_cast<float>(sqrt(sum_squares_[ch] / frames_));
+    levels.dc_offset = static_cast<float>(sum_[ch] / frames_);
+    levels.clip_count = clip_count_[ch];
+    peak_[ch] = 0.0f;
+    sum_squares_[ch] = 0.0;
+    sum_[ch] = 0.0;
+  }
+  frames_ = 0;
+  levels_.Store(level_report_);
+
+  if(!history_.empty()) {
+    ComputeSpectrum();
+    spectrum_.Store(spectrum_report_);
+  }
+}
+
+void SVLevelAnalyzer::ComputeSpectrum() {
+  const size_t n = history_.size();
+  // Oldest sample first, windowed, in bit-reversed order for the in-place FFT.
+  for(size_t i = 0; i < n; i++) {
+    size_t pos = history_pos_ + i < n ? history_pos_ + i : history_pos_ + i - n;
+    fft_[bit_reverse_[i]] = std::complex<float>(history_[pos] * window_[i], 0.0f);
+  }
+  for(size_t half = 1; half < n; half <<= 1) {
+    const size_t stride = n / (half * 2);
+    for(size_t start = 0; start < n; start += half * 2) {
+      for(size_t k = 0; k < half; k++) {
+        const std::complex<float> odd = fft_[start + k + half] * twiddles_[k * stride];
+        fft_[start + k + half] = fft_[start + k] - odd;
+        fft_[start + k] += odd;
+      }
+    }
+  }
+
+  // A full scale sine reads 0 dB: the Hann window has a coherent gain of 1/2.
+  const float scale = 4.0f / n;
+  const size_t bins = n / 2 + 1;
+  spectrum_report_.frame_position = frame_position_;
+  spectrum_report_.sample_rate = format_.sample_rate;
+  spectrum_report_.bins = static_cast<int32_t>(bins);
+  for(size_t k = 0; k < bins; k++) {
+    spectrum_report_.magnitude_db[k] = ToDb(std::abs(fft_[k]) * scale);
+  }
+}
+
+std::string SVLevelAnalyzer::GetLevelsJson() const {
+  SVLevelReport report;
+  if(!GetLevels(&report)) {
+    return "{}";
+  }
+  std::string json;
+  json.reserve(128 + 160 * report.channels);
+  char text[192];
+  snprintf(text, sizeof(text), "{\"frame_position\":%llu,\"channels\":[",
+           (unsigned long long) report.frame_position);
+  json.append(text);
+  for(int ch = 0; ch < report.channels; ch++) {
+    const SVChannelLevels& levels = report.levels[ch];
+    snprintf(text, sizeof(text), "%s{\"peak_dbfs\":%.1f,\"rms_dbfs\":%.1f,\"dc_offset\":%.6f,\"clips\":%llu}",
+             ch > 0 ? "," : "", ToDb(levels.peak), ToDb(levels.rms), levels.dc_offset,
+             (unsigned long long) levels.clip_count);
+    json.append(text);
+  }
+  json.append("]}");
+  return json;
+}
+
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_ANALYSIS_H
+#define AOS_AUDIO_RECORD_SV_ANALYSIS_H
+
+#include <complex>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "sv_common.h"
+#include "sv_disk_writer.h"
+#include "sv_sample_convert.h"
+#include "sv_seqlock.h"
+
+namespace sv_recorder {
+
+const int SV_MIN_ANALYSIS_INTERVAL_MS = 10;
+const int SV_MAX_ANALYSIS_INTERVAL_MS = 1000;
+const int SV_MIN_FFT_SIZE = 256;
+const int SV_MAX_FFT_SIZE = 4096;
+const int SV_MAX_SPECTRUM_BINS = SV_MAX_FFT_SIZE / 2 + 1;
+// Reported for silence instead of -inf.
+const float SV_ANALYSIS_FLOOR_DB = -120.0f;
+
+struct SVAnalysisConfig {
+    // 0 turns the analysis off.
+    int interval_ms = 0;
+    // Power of two in SV_MIN_FFT_SIZE..SV_MAX_FFT_SIZE, 0 skips the spectrum.
+    int fft_size = 0;
+};
+
+struct SVChannelLevels {
+    // Linear full scale values over the last interval.
+    float peak;
+    float rms;
+    float dc_offset;
+    // Samples at full scale since Prepare().
+    uint64_t clip_count;
+};
+
+struct SVLevelReport {
+    // Capture position at the end of the interval, in frames.
+    uint64_t frame_position;
+    int32_t channels;
+    SVChannelLevels levels[SV_MAX_CONVERT_CHANNELS];
+};
+
+// Hann-windowed magnitude of the channel mix over the newest fft_size frames.
+struct SVSpectrumReport {
+    uint64_t frame_position;
+    int32_t sample_rate;
+    int32_t bins;
+    float magnitude_db[SV_MAX_SPECTRUM_BINS];
+};
+
+// Analysis tap on the disk writer thread: reads the drained ring regions in place,
+// keeps running per-channel sums and publishes a report every interval through seqlocks,
+// so UI and QA readers poll without ever touching the audio thread.
+class SVLevelAnalyzer : public ISVCaptureTap {
+
+public:
+    SVLevelAnalyzer();
+
+    int Init(const SVAudioFormat& format, const SVAnalysisConfig& config);
+    bool IsEnabled() const { return interval_frames_ > 0; }
+    const SVAnalysisConfig& config() const { return config_; }
+
+    // Writer thread.
+    void OnCapture(const uint8_t* data, size_t len) override;
+
+    // Any thread, false until the first interval completed.
+    bool GetLevels(SVLevelReport* report) const { return levels_.Load(report); }
+    bool GetSpectrum(SVSpectrumReport* report) const { return spectrum_.Load(report); }
+    // Levels in dBFS as a JSON object.
+    std::string GetLevelsJson() const;
+
+private:
+    void ProcessFrames(const uint8_t* data, size_t frames);
+    void Publish();
+    void ComputeSpectrum();
+
+private:
+    SVAudioFormat format_;
+    SVAnalysisConfig config_;
+    size_t interval_frames_;
+    // A frame split across two ring regions waits here for its remaining bytes.
+    uint8_t partial_[SV_MAX_CONVERT_CHANNELS * sizeof(float)];
+    size_t partial_bytes_;
+    std::vector<float> interleaved_;
+    std::vector<float> planar_;
+    std::vector<float*> channel_ptrs_;
+    // Running sums of the current interval.
+    size_t frames_;
+    float peak_[SV_MAX_CONVERT_CHANNELS];
+    double sum_squares_[SV_MAX_CONVERT_CHANNELS];
+    double sum_[SV_MAX_CONVERT_CHANNELS];
+    uint64_t clip_count_[SV_MAX_CONVERT_CHANNELS];
+    uint64_t frame_position_;
+    // Channel mix of the newest fft_size frames, circular.
+    std::vector<float> history_;
+    size_t history_pos_;
+    std::vector<float> window_;
+    std::vector<std::complex<float>> twiddles_;
+    std::vector<std::complex<float>> fft_;
+    std::vector<uint32_t> bit_reverse_;
+    SVLevelReport level_report_;
+    SVSpectrumReport spectrum_report_;
+    SVSeqlock<SVLevelReport> levels_;
+    SVSeqlock<SVSpectrumReport> spectrum_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_ANALYSIS_H
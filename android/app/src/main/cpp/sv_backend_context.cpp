@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_backend_context.h"
+#include <algorithm>
+#include "log.h"
+
+namespace sv_recorder {
+
+static const char* const SV_RESOURCE_NAMES[SV_RESOURCE_COUNT] = {"engines", "builders", "pools"};
+
+SVBackendContext& SVBackendContext::Instance() {
+  static SVBackendContext context;
+  return context;
+}
+
+SVBackendContext::SVBackendContext() : prewarms_(0), prewarm_us_(0) {
+  for(int32_t i = 0; i < SV_BACKEND_TYPES; i++) {
+    warm_[i].store(false, std::memory_order_relaxed);
+  }
+  for(int32_t i = 0; i < SV_RESOURCE_COUNT; i++) {
+    created_[i].store(0, std::memory_order_relaxed);
+    reused_[i].store(0, std::memory_order_relaxed);
+  }
+  for(StartupStats* stats : {&cold_starts_, &warm_starts_}) {
+    stats->starts.store(0, std::memory_order_relaxed);
+    stats->total_us.store(0, std::memory_order_relaxed);
+    stats->last_us.store(0, std::memory_order_relaxed);
+    stats->max_us.store(0, std::memory_order_relaxed);
+  }
+}
+
+std::shared_ptr<SVBufferPool> SVBackendContext::AcquirePool(size_t block_bytes, uint32_t block_count) {
+  std::shared_ptr<SVBufferPool> pool;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!pools_.empty()) {
+      // A fitting slab first, otherwise the one Reserve() grows anyway.
+      auto it = std::find_if(pools_.begin(), pools_.end(), [&](const std::shared_ptr<SVBufferPool>& idle) {
+        return idle->Fits(block_bytes, block_count);
+      });
+      if(it == pools_.end()) {
+        it = pools_.begin();
+      }
+      pool = std::move(*it);
+      pools_.erase(it);
+    }
+  }
+  OnResource(SV_RESOURCE_POOL, pool != nullptr);
+  if(!pool) {
+    pool = std::make_shared<SVBufferPool>();
+  }
+  return pool;
+}
+
+void SVBackendContext::ReleasePool(std::shared_ptr<SVBufferPool> pool) {
+  if(!pool || pool.use_count() > 1 || pool->GetStats().in_use != 0) {
+    // Still used elsewhere, such a pool dies with its last owner.
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(pools_.size() < SV_BACKEND_MAX_IDLE_POOLS) {
+    pools_.push_back(std::move(pool));
+  }
+}
+
+int SVBackendContext::PrewarmPool(size_t block_bytes, uint32_t block_count) {
+  std::shared_ptr<SVBufferPool> pool = AcquirePool(block_bytes, block_count);
+  const int result = pool->Reserve(block_bytes, block_count);
+  ReleasePool(std::move(pool));
+  return result;
+}
+
+void SVBackendContext::OnResource(SV_BACKEND_RESOURCE resource, bool reused) {
+  (reused ? reused_ : created_)[resource].fetch_add(1, std::memory_order_relaxed);
+}
+
+bool SVBackendContext::MarkWarm(SV_RECORD_TYPE type) {
+  if(type < 0 || type >= SV_BACKEND_TYPES) {
+    return false;
+  }
+  return warm_[type].exchange(true, std::memory_order_relaxed);
+}
+
+bool SVBackendContext::IsWarm(SV_RECORD_TYPE type) const {
+  return type >= 0 && type < SV_BACKEND_TYPES && warm_[type].load(std::memory_order_relaxed);
+}
+
+void SVBackendContext::OnPrewarm(SV_RECORD_TYPE type, int64_t elapsed_ns, int result) {
+  AV_LOGI("SVBackendContext prewarm type:%d, result:%d, %lldus.", type, result, (long long) (elapsed_ns / 1000));
+  prewarms_.fetch_add(1, std::memory_order_relaxed);
+  prewarm_us_.fetch_add(elapsed_ns / 1000, std::memory_order_relaxed);
+}
+
+void SVBackendContext::OnFirstFrame(bool warm, int64_t first_frame_us) {
+  StartupStats& stats = warm ? warm_starts_ : cold_starts_;
+  stats.starts.fetch_add(1, std::memory_order_relaxed);
+  stats.total_us.fetch_add(first_frame_us, std::memory_order_relaxed);
+  stats.last_us.store(first_frame_us, std::memory_order_relaxed);
+  int64_t max_us = stats.max_us.load(std::memory_order_relaxed);
+  while(first_frame_us > max_us &&
+        !stats.max_us.compare_exchange_weak(max_us, first_frame_us, std::memory_order_relaxed)) {
+  }
+}
+
+void SVBackendContext::AppendStartup(const char* name, const StartupStats& stats, std::string* out) {
+  const uint64_t starts = stats.starts.load(std::memory_order_relaxed);
+  char text[192];
+  snprintf(text, sizeof(text), "\"%s\":{\"starts\":%llu,\"mean_us\":%lld,\"last_us\":%lld,\"max_us\":%lld}",
+           name, (unsigned long long) starts,
+           (long long) (starts > 0 ? stats.total_us.load(std::memory_order_relaxed) / (int64_t) starts : 0),
+           (long long) stats.last_us.load(std::memory_order_relaxed),
+           (long long) stats.max_us.load(std::memory_order_relaxed));
+  out->append(text);
+}
+
+std::string SVBackendContext::GetJson() const {
+  std::string json = "{";
+  char text[128];
+  for(int32_t i = 0; i < SV_RESOURCE_COUNT; i++) {
+    snprintf(text, sizeof(text), "\"%s_created\":%llu,\"%s_reused\":%llu,", SV_RESOURCE_NAMES[i],
+             (unsigned long long) created_[i].load(std::memory_order_relaxed), SV_RESOURCE_NAMES[i],
+             (unsigned long long) reused_[i].load(std::memory_order_relaxed));
+    json.append(text);
+  }
+  size_t idle_pools;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_pools = pools_.size();
+  }
+  snprintf(text, sizeof(text), "\"idle_pools\":%zu,\"prewarms\":%llu,\"prewarm_us\":%lld,\"warm_backends\":[",
+           idle_pools, (unsigned long long) prewarms_.load(std::memory_order_relaxed),
+           (long long) prewarm_us_.load(std::memory_order_relaxed));
+  json.append(text);
+  for(int32_t i = 0; i < SV_BACKEND_TYPES; i++) {
+    json.append(i > 0 ? "," : "");
+    json.append(warm_[i].load(std::memory_order_relaxed) ? "true" : "false");
+  }
+  json.append("],");
+  AppendStartup("cold", cold_starts_, &json);
+  json.append(",");
+  AppendStartup("warm", warm_starts_, &json);
+  json.append("}");
+  return json;
+}
+
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_BACKEND_CONTEXT_H
+#define AOS_AUDIO_RECORD_SV_BACKEND_CONTEXT_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "sv_common.h"
+#include "sv_buffer_pool.h"
+
+namespace sv_recorder {
+
+// Idle pools kept for the next session, more are freed on release.
+const size_t SV_BACKEND_MAX_IDLE_POOLS = 4;
+const int32_t SV_BACKEND_TYPES = SYNTHETIC + 1;
+
+// What a backend keeps across sessions instead of creating it per recorder.
+enum SV_BACKEND_RESOURCE : int32_t {
+    SV_RESOURCE_ENGINE = 0,
+    SV_RESOURCE_BUILDER = 1,
+    SV_RESOURCE_POOL = 2,
+    SV_RESOURCE_COUNT = 3
+};
+
+// Process-wide state shared by the recorders of all sessions, so the second session does
+// not pay again for what the first one set up: idle buffer pools with their slabs, which
+// backends have already opened a stream, and the counters of both. The platform objects
+// themselves (OpenSL ES engine, AAudio builders) live next to their backend and report
+// here. Time to first frame is collected per warm and cold start.
+class SVBackendContext {
+
+public:
+    static SVBackendContext& Instance();
+
+    // An idle pool whose slab fits |block_bytes| x |block_count|, or a new one. The caller
+    // still calls Reserve(), which does not allocate for a fitting slab.
+    std::shared_ptr<SVBufferPool> AcquirePool(size_t block_bytes, uint32_t block_count);
+    // Hands a pool back for the next session, once nothing holds it or its blocks.
+    void ReleasePool(std::shared_ptr<SVBufferPool> pool);
+    // Reserves an idle pool ahead of the first session.
+    int PrewarmPool(size_t block_bytes, uint32_t block_count);
+
+    // Counted by the backends whenever they create or reuse one of their resources.
+    void OnResource(SV_BACKEND_RESOURCE resource, bool reused);
+    // Marks |type| warm, true when it already was: a backend's first stream in the process
+    // loads and connects the platform service, later ones find it running.
+    bool MarkWarm(SV_RECORD_TYPE type);
+    bool IsWarm(SV_RECORD_TYPE type) const;
+    // Prewarm() of a backend, with how long it took.
+    void OnPrewarm(SV_RECORD_TYPE type, int64_t elapsed_ns, int result);
+    // Audio thread, once per recording: InitRecording() plus Start() to the first frame.
+    void OnFirstFrame(bool warm, int64_t first_frame_us);
+
+    // {"engines_created":..,"prewarms":..,"warm_backends":[..],"cold":{"starts":..,"mean_us":..},"warm":{..}}
+    std::string GetJson() const;
+
+private:
+    SVBackendContext();
+
+    struct StartupStats {
+        std::atomic<uint64_t> starts;
+        std::atomic<int64_t> total_us;
+        std::atomic<int64_t> last_us;
+        std::atomic<int64_t> max_us;
+    };
+
+    static void AppendStartup(const char* name, const StartupStats& stats, std::string* out);
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<SVBufferPool>> pools_;
+    std::atomic<bool> warm_[SV_BACKEND_TYPES];
+    std::atomic<uint64_t> created_[SV_RESOURCE_COUNT];
+    std::atomic<uint64_t> reused_[SV_RESOURCE_COUNT];
+    std::atomic<uint64_t> prewarms_;
+    std::atomic<int64_t> prewarm_us_;
+    StartupStats cold_starts_;
+    StartupStats warm_starts_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_BACKEND_CONTEXT_H
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_buffer_pool.h"
+#include <utility>
+#include "log.h"
+#include "sv_common.h"
+
+namespace sv_recorder {
+
+const uint32_t SV_POOL_EMPTY = 0xFFFFFFFFu;
+
+static inline uint64_t PackHead(uint64_t tag, uint32_t index) {
+  return tag << 32 | index;
+}
+
+static inline size_t Stride(size_t block_bytes) {
+  return (block_bytes + SV_CACHE_LINE_SIZE - 1) & ~(SV_CACHE_LINE_SIZE - 1);
+}
+
+size_t SVAudioBlock::capacity() const {
+  return pool_->block_bytes();
+}
+
+SVBlockRef::SVBlockRef(const SVBlockRef& other) : block_(other.block_) {
+  if(block_) {
+    block_->refs_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+SVBlockRef& SVBlockRef::operator=(SVBlockRef other) noexcept {
+  std::swap(block_, other.block_);
+  return *this;
+}
+
+void SVBlockRef::reset() {
+  if(block_ && block_->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    block_->pool_->Recycle(block_);
+  }
+  block_ = nullptr;
+}
+
+SVBufferPool::SVBufferPool()
+  : slab_bytes_(0), block_bytes_(0), block_count_(0), block_capacity_(0),
+    free_head_(PackHead(0, SV_POOL_EMPTY)), hits_(0), misses_(0), in_use_(0), high_water_(0),
+    slab_allocations_(0) {
+}
+
+SVBufferPool::~SVBufferPool() {
+  if(in_use_.load() != 0) {
+    AV_LOGE("SVBufferPool destroyed with %u blocks in use.", in_use_.load());
+  }
+}
+
+int SVBufferPool::Reserve(size_t block_bytes, uint32_t block_count) {
+  if(block_bytes == 0 || block_count == 0 || block_count > SV_POOL_MAX_BLOCKS) {
+    AV_LOGW("SVBufferPool invalid geometry: %zu x %u", block_bytes, block_count);
+    return SV_INIT_ERROR;
+  }
+  if(in_use_.load(std::memory_order_acquire) != 0) {
+    AV_LOGW("SVBufferPool Reserve error, %u blocks in use.", in_use_.load());
+    return SV_STATE_ERROR;
+  }
+
+  const size_t stride = Stride(block_bytes);
+  const size_t needed = stride * block_count + SV_CACHE_LINE_SIZE;
+  if(needed > slab_bytes_) {
+    slab_.reset(new uint8_t[needed]);
+    slab_bytes_ = needed;
+    slab_allocations_++;
+  }
+  if(block_count > block_capacity_) {
+    blocks_.reset(new SVAudioBlock[block_count]);
+    block_capacity_ = block_count;
+    slab_allocations_++;
+  }
+
+  uintptr_t base = (reinterpret_cast<uintptr_t>(slab_.get()) + SV_CACHE_LINE_SIZE - 1) &
+                   ~static_cast<uintptr_t>(SV_CACHE_LINE_SIZE - 1);
+  for(uint32_t i = 0; i < block_count; i++) {
+    SVAudioBlock& block = blocks_[i];
+    block.pool_ = this;
+    block.data_ = reinterpret_cast<uint8_t*>(base + i * stride);
+    block.index_ = i;
+    block.size = 0;
+    block.timestamp_ns = 0;
+    block.refs_.store(0, std::memory_order_relaxed);
+    block.next_.store(i + 1 < block_count ? i + 1 : SV_POOL_EMPTY, std::memory_order_relaxed);
+  }
+  block_bytes_ = block_bytes;
+  block_count_ = block_count;
+  uint64_t tag = free_head_.load(std::memory_order_relaxed) >> 32;
+  free_head_.store(PackHead(tag + 1, 0), std::memory_order_release);
+  return SV_NO_ERROR;
+}
+
+bool SVBufferPool::Fits(size_t block_bytes, uint32_t block_count) const {
+  return Stride(block_bytes) * block_count + SV_CACHE_LINE_SIZE <= slab_bytes_ && block_count <= block_capacity_;
+}
+
+SVBlockRef SVBufferPool::Acquire() {
+  uint64_t head = free_head_.load(std::memory_order_acquire);
+  for(;;) {
+    uint32_t index = static_cast<uint32_t>(head);
+    if(index == SV_POOL_EMPTY) {
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      return SVBlockRef();
+    }
+    uint32_t next = blocks_[index].next_.load(std::memory_order_relaxed);
+    if(free_head_.compare_exchange_weak(head, PackHead((head >> 32) + 1, next),
+                                        std::memory_order_acq_rel, std::memory_order_acquire)) {
+      break;
+    }
+  }
+
+  SVAudioBlock* block = &blocks_[static_cast<uint32_t>(head)];
+  block->refs_.store(1, std::memory_order_relaxed);
+  block->size = 0;
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  uint32_t in_use = in_use_.fetch_add(1, std::memory_order_relaxed) + 1;
+  uint32_t high_water = high_water_.load(std::memory_order_relaxed);
+  while(in_use > high_water &&
+        !high_water_.compare_exchange_weak(high_water, in_use, std::memory_order_relaxed)) {
+  }
+  return SVBlockRef(block);
+}
+
+void SVBufferPool::Recycle(SVAudioBlock* block) {
+  in_use_.fetch_sub(1, std::memory_order_relaxed);
+  uint64_t head = free_head_.load(std::memory_order_relaxed);
+  do {
+    block->next_.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+  } while(!free_head_.compare_exchange_weak(head, PackHead((head >> 32) + 1, block->index_),
+                                            std::memory_order_release, std::memory_order_relaxed));
+}
+
+SVBufferPoolStats SVBufferPool::GetStats() const {
+  SVBufferPoolStats stats;
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  stats.capacity = block_count_;
+  stats.in_use = in_use_.load(std::memory_order_relaxed);
+  stats.high_water = high_water_.load(std::memory_order_relaxed);
+  stats.slab_allocations = slab_allocations_;
+  return stats;
+}
+
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_BUFFER_POOL_H
+#define AOS_AUDIO_RECORD_SV_BUFFER_POOL_H
+
+#include <atomic>
+#include <memory>
+#include "sv_ring_buffer.h"
+
+namespace sv_recorder {
+
+const uint32_t SV_POOL_MAX_BLOCKS = 1024;
+
+struct SVBufferPoolStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint32_t capacity;
+    uint32_t in_use;
+    uint32_t high_water;
+    // Heap allocations made by Reserve(), stays put across restarts with the same geometry.
+    uint32_t slab_allocations;
+};
+
+class SVBufferPool;
+
+// One fixed-size, cache-line aligned audio block owned by an SVBufferPool.
+class SVAudioBlock {
+
+public:
+    uint8_t* data() const { return data_; }
+    size_t capacity() const;
+    uint32_t index() const { return index_; }
+
+    // Producer filled bytes and capture time, set by whoever acquired the block.
+    size_t size;
+    int64_t timestamp_ns;
+
+private:
+    friend class SVBufferPool;
+    friend class SVBlockRef;
+
+    SVBufferPool* pool_;
+    uint8_t* data_;
+    uint32_t index_;
+    std::atomic<uint32_t> next_;
+    std::atomic<int32_t> refs_;
+};
+
+// Shared ownership of a pooled block. Copies only touch the reference count, so one
+// captured block can be handed to several consumers; the last release recycles it.
+class SVBlockRef {
+
+public:
+    SVBlockRef() : block_(nullptr) {}
+    explicit SVBlockRef(SVAudioBlock* block) : block_(block) {}
+    SVBlockRef(const SVBlockRef& other);
+    SVBlockRef(SVBlockRef&& other) noexcept : block_(other.block_) { other.block_ = nullptr; }
+    SVBlockRef& operator=(SVBlockRef other) noexcept;
+    ~SVBlockRef() { reset(); }
+
+    void reset();
+    explicit operator bool() const { return block_ != nullptr; }
+    SVAudioBlock* operator->() const { return block_; }
+    SVAudioBlock* get() const { return block_; }
+
+private:
+    SVAudioBlock* block_;
+};
+
+// Fixed-capacity pool of equally sized blocks carved from one aligned slab.
+// Acquire() and the final release are a lock-free freelist pop/push, safe on the audio
+// thread. The freelist head carries a tag against ABA.
+class SVBufferPool {
+
+public:
+    SVBufferPool();
+    ~SVBufferPool();
+
+    // Sizes the pool, only while no block is in use. Keeps the current slab when it is
+    // already large enough, so re-initializing a recording does not touch the heap.
+    int Reserve(size_t block_bytes, uint32_t block_count);
+    // Whether Reserve() of that geometry would keep the current slab.
+    bool Fits(size_t block_bytes, uint32_t block_count) const;
+    // Empty ref when the pool is exhausted.
+    SVBlockRef Acquire();
+
+    size_t block_bytes() const { return block_bytes_; }
+    uint32_t block_count() const { return block_count_; }
+    SVBufferPoolStats GetStats() const;
+
+private:
+    friend class SVBlockRef;
+    void Recycle(SVAudioBlock* block);
+
+private:
+    std::unique_ptr<uint8_t[]> slab_;
+    std::unique_ptr<SVAudioBlock[]> blocks_;
+    size_t slab_bytes_;
+    size_t block_bytes_;
+    uint32_t block_count_;
+    uint32_t block_capacity_;
+    // tag << 32 | index of the first free block
+    alignas(SV_CACHE_LINE_SIZE) std::atomic<uint64_t> free_head_;
+    alignas(SV_CACHE_LINE_SIZE) std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint32_t> in_use_;
+    std::atomic<uint32_t> high_water_;
+    uint32_t slab_allocations_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_BUFFER_POOL_H
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_CALLBACK_STATS_H
+#define AOS_AUDIO_RECORD_SV_CALLBACK_STATS_H
+
+#include <cmath>
+#include <cstdint>
+
+namespace sv_recorder {
+
+// An interval above this many periods counts as a late callback.
+const double SV_CALLBACK_LATE_FACTOR = 1.5;
+
+// Timing of a periodic audio callback: interval jitter against the nominal period and the
+// time spent inside the callback. Updated only by the callback thread, read once it stopped.
+class SVCallbackStats {
+
+public:
+    SVCallbackStats() { Reset(0); }
+
+    void Reset(int64_t period_ns) {
+      period_ns_ = period_ns;
+      count_ = 0;
+      late_count_ = 0;
+      last_ns_ = 0;
+      min_interval_ns_ = INT64_MAX;
+      max_interval_ns_ = 0;
+      max_process_ns_ = 0;
+      mean_ = 0.0;
+      m2_ = 0.0;
+    }
+
+    // |begin_ns| when the callback was entered, |end_ns| when it returned.
+    void Update(int64_t begin_ns, int64_t end_ns) {
+      if(last_ns_ != 0) {
+        int64_t interval = begin_ns - last_ns_;
+        if(interval < min_interval_ns_) min_interval_ns_ = interval;
+        if(interval > max_interval_ns_) max_interval_ns_ = interval;
+        if(period_ns_ > 0 && interval > period_ns_ * SV_CALLBACK_LATE_FACTOR) late_count_++;
+        // Welford's running variance, no history kept.
+        count_++;
+        double delta = interval - mean_;
+        mean_ += delta / count_;
+        m2_ += delta * (interval - mean_);
+      }
+      last_ns_ = begin_ns;
+      if(end_ns - begin_ns > max_process_ns_) max_process_ns_ = end_ns - begin_ns;
+    }
+
+    int64_t period_ns() const { return period_ns_; }
+    uint64_t intervals() const { return count_; }
+    uint64_t late_count() const { return late_count_; }
+    int64_t min_interval_ns() const { return count_ ? min_interval_ns_ : 0; }
+    int64_t max_interval_ns() const { return max_interval_ns_; }
+    int64_t max_process_ns() const { return max_process_ns_; }
+    double mean_interval_ns() const { return mean_; }
+    double jitter_ns() const { return count_ > 1 ? std::sqrt(m2_ / (count_ - 1)) : 0.0; }
+
+private:
+    int64_t period_ns_;
+    uint64_t count_;
+    uint64_t late_count_;
+    int64_t last_ns_;
+    int64_t min_interval_ns_;
+    int64_t max_interval_ns_;
+    int64_t max_process_ns_;
+    double mean_;
+    double m2_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_CALLBACK_STATS_H
@@ -0,0 +1,535 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_capture_pipeline.h"
+#include <algorithm>
+#include <cstdio>
+#include "log.h"
+
+namespace sv_recorder {
+
+SVCapturePipeline::SVCapturePipeline(const std::string& file_path)
+  : file_path_(file_path), format_{0, 0, SV_SAMPLE_I16}, prepared_(false), recovery_(this),
+    gap_armed_(false), last_callback_ns_(0), batch_buffer_size_(0), backend_type_(UNDEFINED), init_begin_ns_(0),
+    init_us_(0), init_warm_(false), start_ns_(0), start_init_us_(0), start_warm_(false), first_frame_us_(-1) {
+  writer_.SetMetrics(&metrics_);
+  writer_.SetThreadManager(&threads_);
+  stream_.SetThreadManager(&threads_);
+  sinks_.SetThreadManager(&threads_);
+  // The audio callbacks log through the deferred logger, make sure it drains.
+  SVDeferredLog::Instance().Start();
+}
+
+SVCapturePipeline::~SVCapturePipeline() {
+  Stop();
+}
+
+// Opus is only there when libopus was found at build time.
+static bool IsContainerSupported(int32_t container) {
+  if(container == SV_CONTAINER_OPUS) {
+    return SVOpusAvailable();
+  }
+  return container >= SV_CONTAINER_RAW && container <= SV_CONTAINER_FLAC;
+}
+
+int SVCapturePipeline::SetOption(int32_t option, int32_t value) {
+  if(prepared_) {
+    AV_LOGW("SetOption %d error, pipeline already prepared.", option);
+    return SV_STATE_ERROR;
+  }
+
+  switch (option) {
+    case SV_OPTION_OUTPUT_TYPE:
+      if(value != SV_OUTPUT_STDIO && value != SV_OUTPUT_MMAP) {
+        return SV_INIT_ERROR;
+      }
+      options_.output_type = static_cast<SV_FILE_OUTPUT_TYPE>(value);
+      break;
+    case SV_OPTION_CONTAINER:
+      if(!IsContainerSupported(value)) {
+        AV_LOGW("SetOption container %d is not supported by this build.", value);
+        return SV_INIT_ERROR;
+      }
+      options_.container = static_cast<SV_CONTAINER_TYPE>(value);
+      break;
+    case SV_OPTION_OUTPUT_SAMPLE_RATE:
+      if(value != 0 && (value < SV_MIN_OUTPUT_SAMPLE_RATE || value > SV_MAX_OUTPUT_SAMPLE_RATE)) {
+        return SV_INIT_ERROR;
+      }
+      options_.output_sample_rate = value;
+      break;
+    case SV_OPTION_RESAMPLE_QUALITY:
+      if(value < SV_RESAMPLE_LOW || value > SV_RESAMPLE_HIGH) {
+        return SV_INIT_ERROR;
+      }
+      options_.resample_quality = static_cast<SV_RESAMPLE_QUALITY>(value);
+      break;
+    case SV_OPTION_PREROLL_MS:
+      if(value < 0 || value > SV_MAX_PREROLL_MS) {
+        return SV_INIT_ERROR;
+      }
+      options_.preroll_ms = value;
+      break;
+    case SV_OPTION_VAD:
+      if(value != 0 && value != 1) {
+        return SV_INIT_ERROR;
+      }
+      options_.vad = value == 1;
+      break;
+    case SV_OPTION_VAD_THRESHOLD_DB:
+      if(value < SV_VAD_MIN_THRESHOLD_DB || value > 0) {
+        return SV_INIT_ERROR;
+      }
+      options_.vad_config.threshold_db = value;
+      break;
+    case SV_OPTION_VAD_HANGOVER_MS:
+      if(value < 0 || value > SV_VAD_MAX_HANGOVER_MS) {
+        return SV_INIT_ERROR;
+      }
+      options_.vad_config.hangover_ms = value;
+      break;
+    case SV_OPTION_ANALYSIS_INTERVAL_MS:
+      if(value != 0 && (value < SV_MIN_ANALYSIS_INTERVAL_MS || value > SV_MAX_ANALYSIS_INTERVAL_MS)) {
+        return SV_INIT_ERROR;
+      }
+      options_.analysis.interval_ms = value;
+      break;
+    case SV_OPTION_ANALYSIS_FFT_SIZE:
+      if(value != 0 && (value < SV_MIN_FFT_SIZE || value > SV_MAX_FFT_SIZE || (value & (value - 1)) != 0)) {
+        return SV_INIT_ERROR;
+      }
+      options_.analysis.fft_size = value;
+      break;
+    case SV_OPTION_AUTO_RECOVERY:
+      if(value != 0 && value != 1) {
+        return SV_INIT_ERROR;
+      }
+      options_.auto_recovery = value == 1;
+      break;
+    case SV_OPTION_LOW_LATENCY:
+      if(value != 0 && value != 1) {
+        return SV_INIT_ERROR;
+      }
+      options_.low_latency = value == 1;
+      break;
+    case SV_OPTION_INPUT_DEVICE_ID:
+      if(value < 0) {
+        return SV_INIT_ERROR;
+      }
+      options_.device_id = value;
+      break;
+    case SV_OPTION_SEGMENT_SECONDS:
+      if(value < 0 || value > SV_SEGMENT_MAX_SECONDS) {
+        return SV_INIT_ERROR;
+      }
+      options_.segment.seconds = value;
+      break;
+    case SV_OPTION_SEGMENT_KB:
+      if(value != 0 && value < SV_SEGMENT_MIN_KB) {
+        return SV_INIT_ERROR;
+      }
+      options_.segment.size_kb = value;
+      break;
+    case SV_OPTION_FILE_INDEX:
+      if(value != 0 && value != 1) {
+        return SV_INIT_ERROR;
+      }
+      options_.file_index = value == 1;
+      break;
+    case SV_OPTION_ADAPTIVE_BUFFER:
+      if(value != 0 && value != 1) {
+        return SV_INIT_ERROR;
+      }
+      options_.latency.adaptive = value == 1;
+      break;
+    case SV_OPTION_MIN_LATENCY_MS:
+      if(value < 0 || value > SV_MAX_LATENCY_MS) {
+        return SV_INIT_ERROR;
+      }
+      options_.latency.min_latency_ms = value;
+      break;
+    case SV_OPTION_OPUS_BITRATE:
+      if(value != 0 && (value < SV_OPUS_MIN_BITRATE || value > SV_OPUS_MAX_BITRATE)) {
+        return SV_INIT_ERROR;
+      }
+      options_.opus_bitrate = value != 0 ? value : SV_OPUS_DEFAULT_BITRATE;
+      break;
+    case SV_OPTION_MAX_LATENCY_MS:
+      if(value < 0 || value > SV_MAX_LATENCY_MS) {
+        return SV_INIT_ERROR;
+      }
+      options_.latency.max_latency_ms = value;
+      break;
+    default:
+      AV_LOGW("Unsupported option: %d", option);
+      return SV_INIT_ERROR;
+  }
+  return SV_NO_ERROR;
+}
+
+void SVCapturePipeline::BeginInit(SV_RECORD_TYPE type) {
+  backend_type_ = type;
+  init_warm_ = SVBackendContext::Instance().IsWarm(type);
+  init_begin_ns_ = SVNowNs();
+}
+
+void SVCapturePipeline::EndInit() {
+  if(init_begin_ns_ == 0) {
+    return;
+  }
+  init_us_ = (SVNowNs() - init_begin_ns_) / 1000;
+  init_begin_ns_ = 0;
+  SVBackendContext::Instance().MarkWarm(backend_type_);
+}
+
+int SVCapturePipeline::Prepare(const SVAudioFormat& format) {
+  if(format.sample_rate <= 0 || format.channels <= 0 || format.sample_format < SV_SAMPLE_I16 ||
+     format.sample_format > SV_SAMPLE_I24) {
+    AV_LOGW("SVCapturePipeline Prepare error, invalid format: %d/%d/%d",
+            format.sample_rate, format.channels, format.sample_format);
+    return SV_INIT_ERROR;
+  }
+  format_ = format;
+  latency_tuner_.Configure(options_.latency, format_.sample_rate);
+  vad_counters_.Reset();
+  int result;
+  if(options_.preroll_ms > 0) {
+    // Whole frames only, so a committed file never starts inside a frame.
+    size_t frames = static_cast<size_t>(format_.sample_rate) * options_.preroll_ms / 1000;
+    result = writer_.EnablePreroll(frames * format_.BytesPerFrame());
+  } else {
+    result = OpenOutput();
+  }
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  result = writer_.Prepare(format_.BytesPerSecond());
+  if(result == SV_NO_ERROR) {
+    result = analyzer_.Init(format_, options_.analysis);
+  }
+  if(result == SV_NO_ERROR) {
+    result = writer_.SetTap(analyzer_.IsEnabled() ? &analyzer_ : nullptr, options_.analysis.interval_ms);
+  }
+  if(result == SV_NO_ERROR) {
+    result = sinks_.Prepare(format_);
+  }
+  prepared_ = result == SV_NO_ERROR;
+  return result;
+}
+
+int SVCapturePipeline::OpenOutput() {
+  // Backends may be re-initialized between recordings, keep appending to the same file.
+  if(writer_.HasOutput()) {
+    return SV_NO_ERROR;
+  }
+  ISVFileOutput::Ptr output;
+  int result = CreateOutput(file_path_, options_.segment.IsEnabled(), &output);
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  return writer_.SetOutput(std::move(output));
+}
+
+ISVFileOutput::Ptr SVCapturePipeline::CreateContainer(const SVAudioFormat& container_format) const {
+  ISVFileOutput::Ptr output = ISVFileOutput::Create(options_.output_type);
+  if(options_.container == SV_CONTAINER_WAV) {
+    output.reset(new SVWavFileOutput(std::move(output), container_format));
+  } else if(options_.container == SV_CONTAINER_FLAC) {
+    output.reset(new SVFlacFileOutput(std::move(output), container_format));
+  } else if(options_.container == SV_CONTAINER_OPUS) {
+    output.reset(new SVOpusFileOutput(std::move(output), container_format, options_.opus_bitrate));
+  }
+  if(options_.file_index) {
+    // Right on the container, so every segment and commit file gets an index of its own.
+    output.reset(new SVIndexFileOutput(std::move(output), container_format, options_.container));
+  }
+  return output;
+}
+
+int SVCapturePipeline::CreateOutput(const std::string& file_path, bool segmented, ISVFileOutput::Ptr* output_ptr) {
+  // The container is written at the output rate, the resampler sits in front of it.
+  SVAudioFormat container_format = format_;
+  container_format.sample_rate = OutputSampleRate();
+  ISVFileOutput::Ptr output;
+  if(segmented) {
+    // Each segment gets a container of its own, the VAD index still covers the whole series.
+    output.reset(new SVSegmentFileOutput([this, container_format]() { return CreateContainer(container_format); },
+                                         container_format, options_.container, options_.output_type,
+                                         options_.segment, &segment_counters_, &threads_));
+  } else {
+    output = CreateContainer(container_format);
+  }
+  if(options_.vad) {
+    // After the resampler, so the segment index counts frames of the written file.
+    output.reset(new SVVadFileOutput(std::move(output), container_format, options_.vad_config, &vad_counters_));
+  }
+  if(container_format.sample_rate != format_.sample_rate) {
+    AV_LOGI("SVCapturePipeline device rate %d Hz, writing %d Hz.", format_.sample_rate, container_format.sample_rate);
+    output.reset(new SVResampleFileOutput(std::move(output), format_, container_format.sample_rate,
+                                          options_.resample_quality));
+  }
+  int result = output->Open(file_path);
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  *output_ptr = std::move(output);
+  return SV_NO_ERROR;
+}
+
+int SVCapturePipeline::AddSink(std::shared_ptr<ISVBlockSink> sink, int queue_blocks) {
+  if(prepared_) {
+    AV_LOGW("AddSink error, pipeline already prepared.");
+    return SV_STATE_ERROR;
+  }
+  return sinks_.AddSink(std::move(sink), queue_blocks);
+}
+
+int SVCapturePipeline::AddFileSink(const std::string& file_path, SV_CONTAINER_TYPE container) {
+  if(!IsContainerSupported(container)) {
+    AV_LOGW("AddFileSink container %d is not supported by this build.", container);
+    return SV_INIT_ERROR;
+  }
+  return AddSink(std::make_shared<SVFileBlockSink>(file_path, container, options_.output_type,
+                                                   options_.opus_bitrate));
+}
+
+int SVCapturePipeline::OpenStream(std::shared_ptr<ISVStreamListener> listener, int chunk_ms,
+                                  int chunk_count) {
+  if(!listener) {
+    return stream_.SetListener(nullptr, 0, 0);
+  }
+  if(!prepared_) {
+    AV_LOGW("OpenStream error, pipeline not prepared.");
+    return SV_STATE_ERROR;
+  }
+  if(chunk_ms <= 0) {
+    return SV_INIT_ERROR;
+  }
+  size_t chunk_frames = static_cast<size_t>(format_.sample_rate) * chunk_ms / 1000;
+  return stream_.SetListener(std::move(listener), chunk_frames * format_.BytesPerFrame(), chunk_count);
+}
+
+int SVCapturePipeline::Start() {
+  metrics_.Reset(format_.sample_rate);
+  threads_.Reset();
+  gap_armed_.store(false, std::memory_order_relaxed);
+  last_callback_ns_.store(0, std::memory_order_relaxed);
+  batch_buffer_size_ = 0;
+  // A restart without a new InitRecording() finds everything in place.
+  start_init_us_ = init_us_;
+  start_warm_ = init_warm_;
+  init_us_ = 0;
+  init_warm_ = true;
+  first_frame_us_.store(-1, std::memory_order_relaxed);
+  start_ns_ = SVNowNs();
+  int result = writer_.Start();
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  result = stream_.Start();
+  if(result == SV_NO_ERROR) {
+    result = sinks_.Start();
+  }
+  if(result == SV_NO_ERROR) {
+    recovery_.SetEnabled(options_.auto_recovery);
+    recovery_.Start();
+  }
+  return result;
+}
+
+int SVCapturePipeline::Stop() {
+  // A recovery in flight owns the backend stream, it has to end before the writer does.
+  recovery_.Stop();
+  int result = writer_.Stop();
+  stream_.Stop();
+  sinks_.Stop();
+  return result;
+}
+
+void SVCapturePipeline::OnAudioData(const void* data, int32_t num_frames) {
+  const int64_t begin_ns = SVNowNs();
+  const size_t len = num_frames * format_.BytesPerFrame();
+  threads_.Tick(SV_THREAD_CAPTURE);
+  if(gap_armed_.load(std::memory_order_acquire)) {
+    FillGap(begin_ns, num_frames);
+  }
+  last_callback_ns_.store(begin_ns, std::memory_order_relaxed);
+  if(first_frame_us_.load(std::memory_order_relaxed) < 0) {
+    OnFirstFrame(begin_ns);
+  }
+  const int32_t buffer_size = latency_tuner_.buffer_size();
+  if(buffer_size != batch_buffer_size_) {
+    UpdateWriterBatch(buffer_size);
+  }
+  writer_.Write(data, len);
+  if(stream_.IsEnabled()) {
+    stream_.Write(data, len);
+  }
+  if(sinks_.IsEnabled()) {
+    sinks_.Write(data, len);
+  }
+  metrics_.OnCallback(begin_ns, SVNowNs(), num_frames);
+}
+
+void SVCapturePipeline::UpdateWriterBatch(int32_t buffer_size) {
+  // With a latency bound the writer gets what the device buffer leaves of it.
+  batch_buffer_size_ = buffer_size;
+  const size_t batch_ms = static_cast<size_t>(latency_tuner_.WriterBatchMs());
+  writer_.SetBatchLimit(format_.BytesPerSecond() * batch_ms / 1000);
+}
+
+void SVCapturePipeline::OnFirstFrame(int64_t begin_ns) {
+  const int64_t first_frame_us = start_init_us_ + (begin_ns - start_ns_) / 1000;
+  first_frame_us_.store(first_frame_us, std::memory_order_relaxed);
+  SVBackendContext::Instance().OnFirstFrame(start_warm_, first_frame_us);
+  AV_LOGD_RT("SVCapturePipeline first frame after %lldus (init %lldus), %s start.", (long long) first_frame_us,
+             (long long) start_init_us_, start_warm_ ? "warm" : "cold");
+}
+
+void SVCapturePipeline::ArmGap() {
+  gap_armed_.store(true, std::memory_order_release);
+}
+
+void SVCapturePipeline::FillGap(int64_t begin_ns, int32_t num_frames) {
+  gap_armed_.store(false, std::memory_order_relaxed);
+  const int64_t last_ns = last_callback_ns_.load(std::memory_order_relaxed);
+  int64_t missing = 0;
+  if(last_ns > 0) {
+    // The last callback covered its own frames and this one covers |num_frames|,
+    // everything the device captured in between is lost.
+    missing = (begin_ns - last_ns) * format_.sample_rate / 1000000000LL - num_frames;
+    const int64_t max_frames = static_cast<int64_t>(format_.sample_rate) * SV_MAX_GAP_SECONDS;
+    missing = std::max<int64_t>(0, std::min(missing, max_frames));
+  }
+  if(missing > 0 && !writer_.QueueSilence(static_cast<size_t>(missing) * format_.BytesPerFrame())) {
+    AV_LOGW_RT("SVCapturePipeline gap of %lld frames not filled, previous gap pending.", (long long) missing);
+    missing = 0;
+  }
+  recovery_.OnGapFilled(static_cast<uint64_t>(missing), begin_ns);
+}
+
+int SVCapturePipeline::Commit(const std::string& file_path, int post_roll_ms) {
+  if(!prepared_ || !writer_.IsPreroll()) {
+    AV_LOGW("Commit error, pre-roll is not enabled.");
+    return SV_STATE_ERROR;
+  }
+  if(post_roll_ms < 0) {
+    return SV_INIT_ERROR;
+  }
+  // Opening the file is the slow part, it happens before the writer is interrupted.
+  ISVFileOutput::Ptr output;
+  int result = CreateOutput(file_path, false, &output);
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  size_t post_roll_frames = static_cast<size_t>(format_.sample_rate) * post_roll_ms / 1000;
+  return writer_.Commit(std::move(output), post_roll_frames * format_.BytesPerFrame());
+}
+
+int SVCapturePipeline::EndCommit() {
+  return writer_.EndCommit();
+}
+
+void SVCapturePipeline::SetStreamInfo(const SVStreamInfo& info) {
+  AV_LOGI("SVCapturePipeline %s stream, %s%s%s, device:%d, burst:%d, capacity:%d, buffer:%d", info.backend,
+          info.sharing_mode == SV_SHARING_EXCLUSIVE ? "exclusive" : "shared", info.mmap ? " mmap" : "",
+          info.fallback ? " (fallback)" : "", info.device_id, info.frames_per_burst, info.buffer_capacity,
+          latency_tuner_.buffer_size());
+  std::lock_guard<std::mutex> lock(stream_info_mutex_);
+  stream_info_ = info;
+}
+
+SVStreamInfo SVCapturePipeline::GetStreamInfo() const {
+  std::lock_guard<std::mutex> lock(stream_info_mutex_);
+  return stream_info_;
+}
+
+std::string SVCapturePipeline::GetStreamInfoJson() const {
+  SVStreamInfo info = GetStreamInfo();
+  char text[640];
+  snprintf(text, sizeof(text), "{\"backend\":\"%s\",\"low_latency\":%s,\"sharing\":\"%s\",\"mmap\":%s,"
+           "\"fallback\":%s,\"device_id\":%d,\"sample_rate\":%d,\"channels\":%d,\"sample_format\":%d,"
+           "\"frames_per_burst\":%d,\"buffer_capacity\":%d,\"buffer_size\":%d,\"buffer_adjustments\":%u,"
+           "\"adaptive\":%s,\"buffer_min\":%d,\"buffer_max\":%d,\"buffer_grows\":%u,\"buffer_shrinks\":%u,"
+           "\"tuner_xruns\":%u,\"jitter_frames\":%d,\"writer_batch_ms\":%d}",
+           info.backend, options_.low_latency ? "true" : "false",
+           info.sharing_mode == SV_SHARING_EXCLUSIVE ? "exclusive" : "shared", info.mmap ? "true" : "false",
+           info.fallback ? "true" : "false", info.device_id, format_.sample_rate, format_.channels,
+           format_.sample_format, info.frames_per_burst, info.buffer_capacity, latency_tuner_.buffer_size(),
+           latency_tuner_.adjustments(), options_.latency.adaptive ? "true" : "false", latency_tuner_.min_size(),
+           latency_tuner_.max_size(), latency_tuner_.grows(), latency_tuner_.shrinks(), latency_tuner_.xruns(),
+           latency_tuner_.jitter_frames(), latency_tuner_.WriterBatchMs());
+  return text;
+}
+
+int SVCapturePipeline::OutputSampleRate() const {
+  if(options_.output_sample_rate > 0) {
+    return options_.output_sample_rate;
+  }
+  if(options_.container == SV_CONTAINER_OPUS && !SVOpusSupportsRate(format_.sample_rate)) {
+    return SV_OPUS_GRANULE_RATE;
+  }
+  return format_.sample_rate;
+}
+
+std::string SVCapturePipeline::GetStatsJson() const {
+  std::string json;
+  json.reserve(2048);
+  char text[384];
+  snprintf(text, sizeof(text), "{\"sample_rate\":%d,\"output_sample_rate\":%d,\"channels\":%d,"
+           "\"sample_format\":%d,", format_.sample_rate, OutputSampleRate(), format_.channels,
+           format_.sample_format);
+  json.append(text);
+  metrics_.AppendJson(&json);
+
+  SVDiskWriterStats writer = writer_.GetStats();
+  snprintf(text, sizeof(text), ",\"writer\":{\"bytes_written\":%llu,\"overruns\":%llu,"
+           "\"overrun_bytes\":%llu,\"max_fill_bytes\":%zu,\"preroll_ms\":%d,\"preroll_bytes\":%zu,"
+           "\"commits\":%llu}",
+           (unsigned long long) writer.bytes_written, (unsigned long long) writer.overrun_count,
+           (unsigned long long) writer.overrun_bytes, writer.max_fill_bytes, options_.preroll_ms,
+           writer.preroll_bytes, (unsigned long long) writer.commit_count);
+  json.append(text);
+
+  snprintf(text, sizeof(text), ",\"vad\":{\"enabled\":%s,\"bytes_in\":%llu,\"bytes_kept\":%llu,"
+           "\"segments\":%llu}", options_.vad ? "true" : "false",
+           (unsigned long long) vad_counters_.bytes_in(), (unsigned long long) vad_counters_.bytes_kept(),
+           (unsigned long long) vad_counters_.segments());
+  json.append(text);
+
+  snprintf(text, sizeof(text), ",\"segments\":{\"seconds\":%d,\"size_kb\":%d,\"count\":%llu,"
+           "\"sync_opens\":%llu,\"syncs\":%llu,\"recovered\":%llu,\"truncated_bytes\":%llu,"
+           "\"max_rotate_us\":%lld}", options_.segment.seconds, options_.segment.size_kb,
+           (unsigned long long) segment_counters_.segments(), (unsigned long long) segment_counters_.sync_opens(),
+           (unsigned long long) segment_counters_.syncs(), (unsigned long long) segment_counters_.recovered(),
+           (unsigned long long) segment_counters_.truncated_bytes(), (long long) segment_counters_.max_rotate_us());
+  json.append(text);
+
+  json.append(",");
+  sinks_.AppendJson(&json);
+  json.append(",");
+  threads_.AppendJson(&json);
+  // first_frame_us stays -1 until the recording delivered.
+  snprintf(text, sizeof(text), ",\"startup\":{\"warm\":%s,\"init_us\":%lld,\"first_frame_us\":%lld}",
+           start_warm_ ? "true" : "false", (long long) start_init_us_,
+           (long long) first_frame_us_.load(std::memory_order_relaxed));
+  json.append(text);
+  json.append(",\"device\":");
+  json.append(GetStreamInfoJson());
+  json.append(",");
+  recovery_.AppendJson(&json);
+
+  SVStreamStats stream = stream_.GetStats();
+  snprintf(text, sizeof(text), ",\"stream\":{\"enabled\":%s,\"chunks_delivered\":%llu,"
+           "\"overruns\":%llu,\"overrun_bytes\":%llu}}",
+           stream_.IsEnabled() ? "true" : "false", (unsigned long long) stream.chunks_delivered,
+           (unsigned long long) stream.overrun_count, (unsigned long long) stream.overrun_bytes);
+  json.append(text);
+  return json;
+}
+
+}
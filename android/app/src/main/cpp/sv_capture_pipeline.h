@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_CAPTURE_PIPELINE_H
+#define AOS_AUDIO_RECORD_SV_CAPTURE_PIPELINE_H
+
+#include "sv_analysis.h"
+#include "sv_backend_context.h"
+#include "sv_common.h"
+#include "sv_disk_writer.h"
+#include "sv_file_index.h"
+#include "sv_flac_writer.h"
+#include "sv_latency_tuner.h"
+#include "sv_metrics.h"
+#include "sv_opus_writer.h"
+#include "sv_resampler.h"
+#include "sv_segment_writer.h"
+#include "sv_sink_graph.h"
+#include "sv_stream_recovery.h"
+#include "sv_stream_sink.h"
+#include "sv_thread_manager.h"
+#include "sv_vad.h"
+#include "sv_wav_writer.h"
+
+namespace sv_recorder {
+
+struct SVRecordOptions {
+    SV_FILE_OUTPUT_TYPE output_type = SV_OUTPUT_STDIO;
+    SV_CONTAINER_TYPE container = SV_CONTAINER_RAW;
+    int32_t opus_bitrate = SV_OPUS_DEFAULT_BITRATE;
+    // 0 writes at the device rate, or at 48kHz for Opus when it cannot code the device rate.
+    int32_t output_sample_rate = 0;
+    SV_RESAMPLE_QUALITY resample_quality = SV_RESAMPLE_MEDIUM;
+    // 0 records everything to the session file.
+    int32_t preroll_ms = 0;
+    bool vad = false;
+    SVVadConfig vad_config;
+    SVAnalysisConfig analysis;
+    bool auto_recovery = true;
+    bool low_latency = false;
+    int32_t device_id = 0;
+    SVSegmentConfig segment;
+    bool file_index = true;
+    SVLatencyConfig latency;
+};
+
+enum SV_SHARING_MODE : int32_t {
+    SV_SHARING_SHARED = 0,
+    SV_SHARING_EXCLUSIVE = 1
+};
+
+// What the backend actually negotiated, which can differ from what was requested.
+struct SVStreamInfo {
+    const char* backend = "";
+    SV_SHARING_MODE sharing_mode = SV_SHARING_SHARED;
+    bool mmap = false;
+    // The low-latency profile was requested but the stream runs without exclusive access.
+    bool fallback = false;
+    int32_t device_id = 0;
+    int32_t frames_per_burst = 0;
+    int32_t buffer_capacity = 0;
+};
+
+const int32_t SV_MAX_PREROLL_MS = 60000;
+// Longest outage filled with silence, a longer one is cut to this length.
+const int32_t SV_MAX_GAP_SECONDS = 30;
+
+// Backend-agnostic part of a recorder: format, buffering and file output.
+// Every ISVNativeRecorder backend owns one and feeds it from its data callback.
+class SVCapturePipeline {
+
+public:
+    explicit SVCapturePipeline(const std::string& file_path);
+    ~SVCapturePipeline();
+
+    // Must be called before Prepare().
+    int SetOption(int32_t option, int32_t value);
+
+    // Time to first frame: backends call BeginInit() first thing in InitRecording() and
+    // EndInit() when it succeeded, the first callback after Start() completes the measure.
+    // A |type| that already opened a stream in this process counts as a warm start.
+    void BeginInit(SV_RECORD_TYPE type);
+    void EndInit();
+    // Called once the backend knows the actual stream format.
+    int Prepare(const SVAudioFormat& format);
+    // Extra consumers of the captured audio, each fed by reference on a queue and thread of
+    // its own so a slow one only drops its own blocks. Must be called before Prepare().
+    int AddSink(std::shared_ptr<ISVBlockSink> sink, int queue_blocks = SV_SINK_DEFAULT_QUEUE_BLOCKS);
+    // A second file at the capture format next to the main one, e.g. FLAC plus WAV.
+    int AddFileSink(const std::string& file_path, SV_CONTAINER_TYPE container);
+    // Live delivery of the captured audio in |chunk_ms| chunks, after Prepare() and before Start().
+    int OpenStream(std::shared_ptr<ISVStreamListener> listener, int chunk_ms, int chunk_count);
+    int Start();
+    // Only once the backend's stream has stopped, no OnAudioData() may run concurrently: the
+    // partial blocks and chunks are flushed from the calling thread.
+    int Stop();
+
+    // Real-time callback contract: |data| holds |num_frames| interleaved frames
+    // in the prepared format. Never blocks.
+    void OnAudioData(const void* data, int32_t num_frames);
+    // Recovery thread, before a restarted stream delivers: the next callback fills the time
+    // since the last one with silence.
+    void ArmGap();
+
+    // Pre-roll mode: persists the buffered window plus |post_roll_ms| of the following audio
+    // to |file_path|, post_roll_ms 0 keeps writing until EndCommit() or Stop().
+    // Uses the container and output rate options like the session file.
+    int Commit(const std::string& file_path, int post_roll_ms);
+    int EndCommit();
+
+    const SVAudioFormat& format() const { return format_; }
+    const SVRecordOptions& options() const { return options_; }
+    // Rate of the written file, differs from format().sample_rate when resampling.
+    int OutputSampleRate() const;
+    SVDiskWriterStats GetWriterStats() const { return writer_.GetStats(); }
+    SVFileOutputStats GetOutputStats() const { return writer_.GetOutputStats(); }
+    SVStreamStats GetStreamStats() const { return stream_.GetStats(); }
+    // Backends report the opened stream here, again after every reopen.
+    void SetStreamInfo(const SVStreamInfo& info);
+    SVStreamInfo GetStreamInfo() const;
+    // Negotiated stream configuration plus the current buffer size as one JSON object.
+    std::string GetStreamInfoJson() const;
+    // Low-latency buffer sizing, driven from the backend's data callback.
+    SVLatencyTuner& latency_tuner() { return latency_tuner_; }
+    // CPU set, nice value and SCHED_FIFO priority of the writer or stream thread, before Start().
+    int SetThreadPolicy(SV_THREAD_ROLE role, const SVThreadPolicy& policy) { return threads_.SetPolicy(role, policy); }
+    SVThreadStats GetThreadStats(SV_THREAD_ROLE role) const { return threads_.GetStats(role); }
+    const SVVadCounters& vad_counters() const { return vad_counters_; }
+    const SVSegmentCounters& segment_counters() const { return segment_counters_; }
+    // Published by the writer thread, readable from any thread without blocking it.
+    const SVLevelAnalyzer& analyzer() const { return analyzer_; }
+    SVRecorderMetrics& metrics() { return metrics_; }
+    const SVSinkGraph& sinks() const { return sinks_; }
+    // Backends register their stream handler and report disconnects here.
+    SVStreamRecovery& recovery() { return recovery_; }
+    // InitRecording() plus Start() to the first frame of the current recording, -1 before it.
+    int64_t first_frame_us() const { return first_frame_us_.load(std::memory_order_relaxed); }
+    // Metrics plus writer and stream counters as one JSON object, callable while recording.
+    std::string GetStatsJson() const;
+
+private:
+    int OpenOutput();
+    ISVFileOutput::Ptr CreateContainer(const SVAudioFormat& container_format) const;
+    int CreateOutput(const std::string& file_path, bool segmented, ISVFileOutput::Ptr* output);
+    void FillGap(int64_t begin_ns, int32_t num_frames);
+    void UpdateWriterBatch(int32_t buffer_size);
+    void OnFirstFrame(int64_t begin_ns);
+
+private:
+    std::string file_path_;
+    SVRecordOptions options_;
+    SVAudioFormat format_;
+    bool prepared_;
+    SVRecorderMetrics metrics_;
+    SVThreadManager threads_;
+    SVVadCounters vad_counters_;
+    SVSegmentCounters segment_counters_;
+    SVLevelAnalyzer analyzer_;
+    SVDiskWriter writer_;
+    SVStreamSink stream_;
+    SVSinkGraph sinks_;
+    SVStreamRecovery recovery_;
+    SVLatencyTuner latency_tuner_;
+    mutable std::mutex stream_info_mutex_;
+    SVStreamInfo stream_info_;
+    std::atomic<bool> gap_armed_;
+    // Start of the last callback, where the outage of a recovered stream begins.
+    std::atomic<int64_t> last_callback_ns_;
+    // Audio thread, the buffer size the writer batch was last sized for.
+    int32_t batch_buffer_size_;
+    // Startup of the last recording, -1 until its first frame arrived.
+    SV_RECORD_TYPE backend_type_;
+    int64_t init_begin_ns_;
+    int64_t init_us_;
+    bool init_warm_;
+    int64_t start_ns_;
+    int64_t start_init_us_;
+    bool start_warm_;
+    std::atomic<int64_t> first_frame_us_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_CAPTURE_PIPELINE_H
@@ -9,11 +9,14 @@
 #ifndef AOS_AUDIO_RECORD_SV_COMMON_H
 #define AOS_AUDIO_RECORD_SV_COMMON_H
 
+#include <chrono>
+#include <memory>
 #include "string"
 
 #define arraysize(array) (sizeof(ArraySizeHelper(array)))
 const size_t SV_BUFFERS_PER_SECOND = 100;
 const size_t SV_OPENSLES_BUFFERS_LEN = 2;
+const size_t SV_OPENSLES_MAX_BUFFERS = 16;
 
 enum SV_RESULT: int16_t {
     SV_NO_ERROR,
@@ -28,20 +31,99 @@ enum SV_RECORD_TYPE : int32_t {
     UNDEFINED = -1,
     OPEN_SL = 0,
     AAUDIO = 1,
-    OBOE = 2
+    OBOE = 2,
+    SYNTHETIC = 3
 };
 
+// Per-recorder settings, applied with ISVNativeRecorder::SetOption() before InitRecording().
+enum SV_OPTION : int32_t {
+    SV_OPTION_OUTPUT_TYPE = 0,
+    SV_OPTION_CONTAINER = 1,
+    // OpenSL ES buffer queue depth, 2..SV_OPENSLES_MAX_BUFFERS.
+    SV_OPTION_BUFFER_QUEUE_DEPTH = 2,
+    // Sample rate of the written file, 0 keeps the device rate. Resampled on the writer thread.
+    SV_OPTION_OUTPUT_SAMPLE_RATE = 3,
+    // SV_RESAMPLE_QUALITY used when the output rate differs from the device rate.
+    SV_OPTION_RESAMPLE_QUALITY = 4,
+    // Milliseconds of audio kept in memory instead of recording to the file, 0 records
+    // everything. Files are only written by SVCapturePipeline::Commit().
+    SV_OPTION_PREROLL_MS = 5,
+    // 1 drops silence from the file and writes the kept segments to <file>.vad.
+    SV_OPTION_VAD = 6,
+    // Speech threshold in dBFS, SV_VAD_MIN_THRESHOLD_DB..0.
+    SV_OPTION_VAD_THRESHOLD_DB = 7,
+    // Silence kept after speech before a segment ends, 0..SV_VAD_MAX_HANGOVER_MS.
+    SV_OPTION_VAD_HANGOVER_MS = 8,
+    // Level/spectrum report period, 0 turns the analysis off.
+    SV_OPTION_ANALYSIS_INTERVAL_MS = 9,
+    // FFT length of the spectrum report, 0 for levels only.
+    SV_OPTION_ANALYSIS_FFT_SIZE = 10,
+    // 1 (default) reopens the stream after a device disconnect, 0 lets the recording end.
+    SV_OPTION_AUTO_RECOVERY = 11,
+    // 1 asks AAudio/Oboe for an exclusive MMAP stream sized from its burst, shared mode is the fallback.
+    SV_OPTION_LOW_LATENCY = 12,
+    // Input device id from AudioManager, 0 lets the system choose.
+    SV_OPTION_INPUT_DEVICE_ID = 13,
+    // Cuts the session file into <stem>.<index><ext> segments of this many seconds, listed in
+    // <file>.segments. 0 (default) writes a single file.
+    SV_OPTION_SEGMENT_SECONDS = 14,
+    // Starts a new segment once the current one reaches this many KB, 0 for no size limit.
+    SV_OPTION_SEGMENT_KB = 15,
+    // 1 (default) writes a seek and level index, <file>.idx, next to each recorded file.
+    SV_OPTION_FILE_INDEX = 16,
+    // 1 sizes the device buffer from the observed callback jitter and xruns, growing and
+    // shrinking it at runtime. AAudio/Oboe buffer size, OpenSL ES queue depth.
+    SV_OPTION_ADAPTIVE_BUFFER = 17,
+    // Lower bound of the adaptive buffer, 0..SV_MAX_LATENCY_MS, 0 for one burst.
+    SV_OPTION_MIN_LATENCY_MS = 18,
+    // Upper bound of the adaptive buffer plus the writer batch, 0..SV_MAX_LATENCY_MS,
+    // 0 bounds the buffer by its capacity only.
+    SV_OPTION_MAX_LATENCY_MS = 19,
+    // Opus bitrate in bit/s, SV_OPUS_MIN_BITRATE..SV_OPUS_MAX_BITRATE, 0 for the default.
+    SV_OPTION_OPUS_BITRATE = 20
+};
+
+enum SV_SAMPLE_FORMAT : int32_t {
+    SV_SAMPLE_I16 = 0,
+    SV_SAMPLE_F32 = 1,
+    SV_SAMPLE_I24 = 2  // packed, 3 bytes per sample
+};
+
+struct SVAudioFormat {
+    int sample_rate;
+    int channels;
+    SV_SAMPLE_FORMAT sample_format;
+
+    int BytesPerSample() const {
+      return sample_format == SV_SAMPLE_F32 ? 4 : (sample_format == SV_SAMPLE_I24 ? 3 : 2);
+    }
+    size_t BytesPerFrame() const { return static_cast<size_t>(channels * BytesPerSample()); }
+    size_t BytesPerSecond() const { return BytesPerFrame() * sample_rate; }
+};
+
+inline int64_t SVNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 template <typename T, size_t N>
 char (&ArraySizeHelper(T (&array)[N]))[N];
 
+namespace sv_recorder {
+class SVCapturePipeline;
+}
+
 class ISVNativeRecorder {
 public:
     using Ptr = std::shared_ptr<ISVNativeRecorder>;
     virtual ~ISVNativeRecorder() = default;
-    virtual int InitRecording(int sample_rate, int channels) = 0;
+    virtual int InitRecording(int sample_rate, int channels, SV_SAMPLE_FORMAT format) = 0;
     virtual int StartRecording() = 0;
     virtual int StopRecording() = 0;
     virtual int Release() = 0;
+    virtual int SetOption(int32_t option, int32_t value) = 0;
+    // Backend-independent buffering and outputs of this recorder.
+    virtual sv_recorder::SVCapturePipeline& pipeline() = 0;
 };
 
 #endif //AOS_AUDIO_RECORD_SV_COMMON_H
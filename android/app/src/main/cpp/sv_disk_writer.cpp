@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_disk_writer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include "log.h"
+#include "sv_common.h"
+
+namespace sv_recorder {
+
+SVDiskWriter::SVDiskWriter()
+  : persist_remaining_(0), metrics_(nullptr), tap_(nullptr), threads_(nullptr), bytes_per_second_(0),
+    batch_bytes_(0), batch_limit_(0), produced_bytes_(0), consumed_bytes_(0), gap_position_(0), gap_bytes_(0), running_(false),
+    bytes_written_(0), overrun_count_(0), overrun_bytes_(0), max_fill_bytes_(0), commit_count_(0),
+    preroll_bytes_(0) {
+}
+
+SVDiskWriter::~SVDiskWriter() {
+  Stop();
+  if(output_) {
+    output_->Close();
+    output_ = nullptr;
+  }
+}
+
+int SVDiskWriter::SetOutput(ISVFileOutput::Ptr output) {
+  if(running_) {
+    AV_LOGW("SVDiskWriter SetOutput error, writer is running.");
+    return SV_STATE_ERROR;
+  }
+  if(output_) {
+    output_->Close();
+  }
+  output_ = std::move(output);
+  return SV_NO_ERROR;
+}
+
+int SVDiskWriter::Prepare(size_t bytes_per_second) {
+  if(running_) {
+    AV_LOGW("SVDiskWriter Prepare error, writer is running.");
+    return SV_STATE_ERROR;
+  }
+  ring_.Reset(bytes_per_second * SV_WRITER_RING_SECONDS);
+  produced_bytes_ = 0;
+  consumed_bytes_ = 0;
+  gap_bytes_.store(0, std::memory_order_relaxed);
+  bytes_per_second_ = bytes_per_second;
+  batch_bytes_ = bytes_per_second * SV_WRITER_BATCH_MS / 1000;
+  batch_limit_.store(0, std::memory_order_relaxed);
+  return SV_NO_ERROR;
+}
+
+int SVDiskWriter::EnablePreroll(size_t bytes) {
+  if(running_) {
+    AV_LOGW("SVDiskWriter EnablePreroll error, writer is running.");
+    return SV_STATE_ERROR;
+  }
+  std::lock_guard<std::mutex> lock(output_mutex_);
+  preroll_.Reset(bytes);
+  preroll_bytes_.store(0, std::memory_order_relaxed);
+  return SV_NO_ERROR;
+}
+
+int SVDiskWriter::SetTap(ISVCaptureTap* tap, size_t interval_ms) {
+  if(running_) {
+    AV_LOGW("SVDiskWriter SetTap error, writer is running.");
+    return SV_STATE_ERROR;
+  }
+  tap_ = tap;
+  batch_bytes_ = bytes_per_second_ * SV_WRITER_BATCH_MS / 1000;
+  if(tap_) {
+    batch_bytes_ = std::min(batch_bytes_, bytes_per_second_ * interval_ms / 1000);
+  }
+  return SV_NO_ERROR;
+}
+
+int SVDiskWriter::Start() {
+  if(running_) {
+    return SV_NO_ERROR;
+  }
+  if(ring_.Capacity() == 0) {
+    AV_LOGW("SVDiskWriter Start error, not prepared.");
+    return SV_STATE_ERROR;
+  }
+  running_ = true;
+  thread_ = std::thread(&SVDiskWriter::WriterLoop, this);
+  return SV_NO_ERROR;
+}
+
+int SVDiskWriter::Stop() {
+  if(!running_) {
+    return SV_NO_ERROR;
+  }
+  running_ = false;
+  if(thread_.joinable()) {
+    thread_.join();
+  }
+  Drain(0);
+  if(IsPreroll()) {
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    FinishCommitLocked();
+  } else if(output_) {
+    output_->Flush();
+  }
+  auto stats = GetStats();
+  auto output_stats = GetOutputStats();
+  AV_LOGI("SVDiskWriter stopped, written:%llu, overruns:%llu, dropped:%llu, max fill:%zu/%zu, "
+          "io calls:%llu, %.1f KB/s",
+          (unsigned long long) stats.bytes_written, (unsigned long long) stats.overrun_count,
+          (unsigned long long) stats.overrun_bytes, stats.max_fill_bytes, ring_.Capacity(),
+          (unsigned long long) output_stats.io_calls, output_stats.BytesPerSecond() / 1024);
+  return SV_NO_ERROR;
+}
+
+bool SVDiskWriter::Write(const void* data, size_t len) {
+  if(!ring_.Write(data, len)) {
+    overrun_count_.fetch_add(1, std::memory_order_relaxed);
+    overrun_bytes_.fetch_add(len, std::memory_order_relaxed);
+    return false;
+  }
+  produced_bytes_ += len;
+  size_t fill = ring_.ReadableBytes();
+  if(fill > max_fill_bytes_.load(std::memory_order_relaxed)) {
+    max_fill_bytes_.store(fill, std::memory_order_relaxed);
+  }
+  return true;
+}
+
+int SVDiskWriter::Commit(ISVFileOutput::Ptr output, size_t post_roll_bytes) {
+  if(!IsPreroll() || !output) {
+    AV_LOGW("SVDiskWriter Commit error, pre-roll is off.");
+    return SV_STATE_ERROR;
+  }
+  std::lock_guard<std::mutex> lock(output_mutex_);
+  FinishCommitLocked();
+  output_ = std::move(output);
+  size_t history = preroll_.Size();
+  preroll_.Visit([this](const uint8_t* data, size_t len) {
+    if(output_->Write(data, len) != len) {
+      AV_LOGE("SVDiskWriter commit write error, len:%zu", len);
+    }
+  });
+  // The history is in this file now, the audio still queued in the ring follows it.
+  preroll_.Clear();
+  persist_remaining_ = post_roll_bytes > 0 ? post_roll_bytes : SIZE_MAX;
+  commit_count_.fetch_add(1, std::memory_order_relaxed);
+  AV_LOGI("SVDiskWriter commit, history:%zu, post roll:%zu", history, post_roll_bytes);
+  return SV_NO_ERROR;
+}
+
+int SVDiskWriter::EndCommit() {
+  std::lock_guard<std::mutex> lock(output_mutex_);
+  if(!output_) {
+    return SV_STATE_ERROR;
+  }
+  DrainLocked(0);
+  FinishCommitLocked();
+  return SV_NO_ERROR;
+}
+
+void SVDiskWriter::FinishCommitLocked() {
+  if(!output_) {
+    return;
+  }
+  output_->Flush();
+  output_->Close();
+  output_ = nullptr;
+  persist_remaining_ = 0;
+}
+
+bool SVDiskWriter::QueueSilence(size_t len) {
+  if(gap_bytes_.load(std::memory_order_acquire) != 0) {
+    // The previous gap is still queued, its position cannot move.
+    return false;
+  }
+  gap_position_.store(produced_bytes_, std::memory_order_relaxed);
+  gap_bytes_.store(len, std::memory_order_release);
+  return true;
+}
+
+SVFileOutputStats SVDiskWriter::GetOutputStats() const {
+  if(!output_) {
+    return SVFileOutputStats{0, 0, 0};
+  }
+  return output_->GetStats();
+}
+
+SVDiskWriterStats SVDiskWriter::GetStats() const {
+  SVDiskWriterStats stats;
+  stats.bytes_written = bytes_written_.load(std::memory_order_relaxed);
+  stats.overrun_count = overrun_count_.load(std::memory_order_relaxed);
+  stats.overrun_bytes = overrun_bytes_.load(std::memory_order_relaxed);
+  stats.max_fill_bytes = max_fill_bytes_.load(std::memory_order_relaxed);
+  stats.commit_count = commit_count_.load(std::memory_order_relaxed);
+  stats.preroll_bytes = preroll_bytes_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void SVDiskWriter::WriterLoop() {
+  SVThreadScope scope(threads_, SV_THREAD_WRITER);
+  while(running_.load(std::memory_order_acquire)) {
+    scope.Tick();
+    const size_t limit = batch_limit_.load(std::memory_order_relaxed);
+    if(Drain(limit > 0 ? std::min(limit, batch_bytes_) : batch_bytes_) == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(SV_WRITER_POLL_MS));
+    }
+  }
+}
+
+void SVDiskWriter::WriteRegionLocked(const uint8_t* data, size_t len) {
+  if(tap_) {
+    tap_->OnCapture(data, len);
+  }
+  size_t persist_len = len;
+  if(IsPreroll()) {
+    // Everything stays in the history so a later commit starts a full window back.
+    preroll_.Append(data, len);
+    persist_len = output_ ? std::min(len, persist_remaining_) : 0;
+  }
+  if(output_ && persist_len > 0) {
+    size_t write_len = output_->Write(data, persist_len);
+    bytes_written_.fetch_add(persist_len, std::memory_order_relaxed);
+    if(write_len != persist_len) {
+      AV_LOGE_RATELIMIT(1000, "SVDiskWriter write error, expect:%zu, written:%zu", persist_len, write_len);
+    }
+    if(IsPreroll() && persist_remaining_ != SIZE_MAX) {
+      persist_remaining_ -= persist_len;
+      if(persist_remaining_ == 0) {
+        FinishCommitLocked();
+      }
+    }
+  }
+}
+
+void SVDiskWriter::WriteSilenceLocked(size_t len) {
+  static const uint8_t kZeros[4096] = {};
+  AV_LOGI("SVDiskWriter filling a gap of %zu bytes with silence.", len);
+  if(output_) {
+    output_->OnGap(len);
+  }
+  while(len > 0) {
+    size_t chunk = std::min(len, sizeof(kZeros));
+    WriteRegionLocked(kZeros, chunk);
+    len -= chunk;
+  }
+}
+
+size_t SVDiskWriter::Drain(size_t min_batch) {
+  std::lock_guard<std::mutex> lock(output_mutex_);
+  return DrainLocked(min_batch);
+}
+
+size_t SVDiskWriter::DrainLocked(size_t min_batch) {
+  size_t readable = ring_.ReadableBytes();
+  if(readable == 0 || readable < min_batch) {
+    return 0;
+  }
+  if(metrics_ && bytes_per_second_) {
+    // The oldest queued byte has waited about as long as the queued audio lasts.
+    metrics_->OnSinkLatency(static_cast<int64_t>(readable * 1000000 / bytes_per_second_));
+  }
+
+  size_t total = 0;
+  const uint8_t* data = nullptr;
+  size_t len;
+  // At most two regions when the readable data wraps around the end of the ring,
+  // plus a split where queued silence has to go in between.
+  while((len = ring_.Peek(&data)) > 0) {
+    const size_t gap_bytes = gap_bytes_.load(std::memory_order_acquire);
+    if(gap_bytes > 0) {
+      const uint64_t gap_position = gap_position_.load(std::memory_order_relaxed);
+      if(gap_position <= consumed_bytes_) {
+        WriteSilenceLocked(gap_bytes);
+        gap_bytes_.store(0, std::memory_order_release);
+      } else if(gap_position < consumed_bytes_ + len) {
+        len = static_cast<size_t>(gap_position - consumed_bytes_);
+      }
+    }
+    WriteRegionLocked(data, len);
+    ring_.Consume(len);
+    consumed_bytes_ += len;
+    total += len;
+  }
+  if(IsPreroll()) {
+    preroll_bytes_.store(preroll_.Size(), std::memory_order_relaxed);
+  }
+  return total;
+}
+
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_DISK_WRITER_H
+#define AOS_AUDIO_RECORD_SV_DISK_WRITER_H
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "sv_file_output.h"
+#include "sv_metrics.h"
+#include "sv_preroll_buffer.h"
+#include "sv_ring_buffer.h"
+#include "sv_thread_manager.h"
+
+namespace sv_recorder {
+
+const size_t SV_WRITER_RING_SECONDS = 2;
+const size_t SV_WRITER_BATCH_MS = 100;
+const size_t SV_WRITER_POLL_MS = 10;
+
+struct SVDiskWriterStats {
+    // Bytes handed to the output, pre-roll history that was never committed is not counted.
+    uint64_t bytes_written;
+    uint64_t overrun_count;
+    uint64_t overrun_bytes;
+    size_t max_fill_bytes;
+    // Pre-roll mode only.
+    uint64_t commit_count;
+    size_t preroll_bytes;
+};
+
+// Sees every drained byte of capture on the writer thread, in place and in order,
+// before it goes to the output.
+class ISVCaptureTap {
+
+public:
+    virtual ~ISVCaptureTap() = default;
+    virtual void OnCapture(const uint8_t* data, size_t len) = 0;
+};
+
+// Moves audio data from the real-time callback to the file on a dedicated thread.
+// Write() only copies into a lock-free ring, the writer thread drains it in large batches.
+// In pre-roll mode the drained audio only refreshes an in-memory history of the last
+// seconds, nothing reaches the disk until Commit() hands over an output.
+class SVDiskWriter {
+
+public:
+    SVDiskWriter();
+    ~SVDiskWriter();
+
+    // Takes an opened output, the writer closes it on destruction.
+    int SetOutput(ISVFileOutput::Ptr output);
+    bool HasOutput() const { return output_ != nullptr; }
+    // Receives the sink latency of every drained batch, set before Start().
+    void SetMetrics(SVRecorderMetrics* metrics) { metrics_ = metrics; }
+    // The writer thread applies its policy and reports its CPU use here, set before Start().
+    void SetThreadManager(SVThreadManager* threads) { threads_ = threads; }
+    // Sizes the ring for |bytes_per_second|, must be called before Start().
+    int Prepare(size_t bytes_per_second);
+    // Keeps the newest |bytes| of audio instead of writing to an output, 0 turns it off.
+    // Must be called before Start(), allocates the history once.
+    int EnablePreroll(size_t bytes);
+    // Drains at least every |interval_ms| so the tap keeps up, call after Prepare() and before Start().
+    int SetTap(ISVCaptureTap* tap, size_t interval_ms);
+    bool IsPreroll() const { return preroll_.Capacity() > 0; }
+    // Any thread: drains once |bytes| are queued when that is less than the batch above,
+    // 0 lifts the limit. Keeps buffer plus batch within a latency bound.
+    void SetBatchLimit(size_t bytes) { batch_limit_.store(bytes, std::memory_order_relaxed); }
+    int Start();
+    // Stops the writer thread and flushes all pending data into the file.
+    int Stop();
+
+    // Called from the audio thread, never blocks.
+    bool Write(const void* data, size_t len);
+    // Audio thread, before the Write() that follows an outage: |len| bytes of silence go
+    // into the output at the current position. False while a previous gap is still queued.
+    bool QueueSilence(size_t len);
+
+    // Pre-roll mode: writes the history into the opened |output|, then keeps writing the
+    // captured audio to it for |post_roll_bytes|, 0 until EndCommit() or Stop().
+    // A running commit is finished first.
+    int Commit(ISVFileOutput::Ptr output, size_t post_roll_bytes);
+    // Writes what is still queued and closes the committed output.
+    int EndCommit();
+
+    SVDiskWriterStats GetStats() const;
+    // Only valid while the writer thread is stopped.
+    SVFileOutputStats GetOutputStats() const;
+
+private:
+    void WriterLoop();
+    size_t Drain(size_t min_batch);
+    size_t DrainLocked(size_t min_batch);
+    void WriteRegionLocked(const uint8_t* data, size_t len);
+    void WriteSilenceLocked(size_t len);
+    void FinishCommitLocked();
+
+private:
+    // Held by the draining thread, lets Commit() swap the output between two batches.
+    std::mutex output_mutex_;
+    ISVFileOutput::Ptr output_;
+    SVRingBuffer ring_;
+    SVPrerollBuffer preroll_;
+    // Bytes the committed output still takes.
+    size_t persist_remaining_;
+    SVRecorderMetrics* metrics_;
+    ISVCaptureTap* tap_;
+    SVThreadManager* threads_;
+    size_t bytes_per_second_;
+    size_t batch_bytes_;
+    std::atomic<size_t> batch_limit_;
+    // Ring positions counted by the producer and the consumer, to place queued silence.
+    uint64_t produced_bytes_;
+    uint64_t consumed_bytes_;
+    std::atomic<uint64_t> gap_position_;
+    std::atomic<size_t> gap_bytes_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::atomic<uint64_t> bytes_written_;
+    std::atomic<uint64_t> overrun_count_;
+    std::atomic<uint64_t> overrun_bytes_;
+    std::atomic<size_t> max_fill_bytes_;
+    std::atomic<uint64_t> commit_count_;
+    std::atomic<size_t> preroll_bytes_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_DISK_WRITER_H
@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_file_index.h"
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "log.h"
+#include "sv_flac_writer.h"
+
+namespace sv_recorder {
+
+static const char kIndexMagic[4] = {'S', 'V', 'I', 'X'};
+
+struct SVIndexHeader {
+    char magic[4];
+    uint32_t version;
+    int32_t sample_rate;
+    int32_t channels;
+    int32_t sample_format;
+    int32_t container;
+    uint32_t summary_frames;
+    // Reserved and 0 in version 1.
+    uint32_t block_count;
+    uint64_t data_offset;
+    uint64_t frames;
+    uint64_t second_count;
+    uint64_t summary_count;
+    uint64_t gap_count;
+};
+static_assert(sizeof(SVIndexHeader) == 72, "SVIndexHeader is part of the file format");
+
+static uint16_t QuantizeLevel(float level) {
+  return static_cast<uint16_t>(std::min(level, 1.0f) * 65535.0f + 0.5f);
+}
+
+template<typename T>
+static bool ReadArray(FILE* file, uint64_t count, std::vector<T>* values) {
+  values->resize(static_cast<size_t>(count));
+  return count == 0 || fread(values->data(), sizeof(T), values->size(), file) == values->size();
+}
+
+template<typename T>
+static bool WriteArray(FILE* file, const std::vector<T>& values) {
+  return values.empty() || fwrite(values.data(), sizeof(T), values.size(), file) == values.size();
+}
+
+SVFileIndex::SVFileIndex()
+  : format_({0, 0, SV_SAMPLE_I16}), container_(SV_CONTAINER_RAW), data_offset_(0), frames_(0),
+    partial_bytes_(0), summary_peak_(0.0f), summary_square_sum_(0.0), summary_frames_(0) {
+}
+
+void SVFileIndex::Reset(const SVAudioFormat& format, SV_CONTAINER_TYPE container, uint64_t data_offset) {
+  format_ = format;
+  container_ = container;
+  data_offset_ = data_offset;
+  frames_ = 0;
+  second_offsets_.clear();
+  block_offsets_.clear();
+  summaries_.clear();
+  gaps_.clear();
+  partial_bytes_ = 0;
+  samples_.resize(SV_INDEX_SUMMARY_FRAMES * static_cast<size_t>(format.channels));
+  summary_peak_ = 0.0f;
+  summary_square_sum_ = 0.0;
+  summary_frames_ = 0;
+}
+
+void SVFileIndex::AddAudio(const void* data, size_t len) {
+  const size_t frame_bytes = format_.BytesPerFrame();
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  if(partial_bytes_ > 0) {
+    const size_t take = std::min(len, frame_bytes - partial_bytes_);
+    memcpy(partial_ + partial_bytes_, src, take);
+    partial_bytes_ += take;
+    src += take;
+    len -= take;
+    if(partial_bytes_ < frame_bytes) {
+      return;
+    }
+    AddFrames(partial_, 1);
+    partial_bytes_ = 0;
+  }
+  const size_t frames = len / frame_bytes;
+  AddFrames(src, frames);
+  partial_bytes_ = len - frames * frame_bytes;
+  memcpy(partial_, src + frames * frame_bytes, partial_bytes_);
+}
+
+void SVFileIndex::AddFrames(const uint8_t* data, size_t frames) {
+  const SVConvertKernels& kernels = SVConvert();
+  const size_t frame_bytes = format_.BytesPerFrame();
+  while(frames > 0) {
+    const size_t chunk = std::min<size_t>(frames, SV_INDEX_SUMMARY_FRAMES - summary_frames_);
+    const size_t count = chunk * format_.channels;
+    float* samples = samples_.data();
+    if(format_.sample_format == SV_SAMPLE_F32) {
+      memcpy(samples, data, count * sizeof(float));
+    } else if(format_.sample_format == SV_SAMPLE_I24) {
+      kernels.i24_to_f32(data, samples, count);
+    } else {
+      kernels.i16_to_f32(reinterpret_cast<const int16_t*>(data), samples, count);
+    }
+    float peak = summary_peak_;
+    float square_sum = 0.0f;
+    for(size_t i = 0; i < count; i++) {
+      peak = std::max(peak, std::fabs(samples[i]));
+      square_sum += samples[i] * samples[i];
+    }
+    summary_peak_ = peak;
+    summary_square_sum_ += square_sum;
+    summary_frames_ += static_cast<uint32_t>(chunk);
+    frames_ += chunk;
+    data += chunk * frame_bytes;
+    frames -= chunk;
+    if(summary_frames_ == SV_INDEX_SUMMARY_FRAMES) {
+      EndSummary();
+    }
+  }
+}
+
+void SVFileIndex::EndSummary() {
+  if(summary_frames_ == 0) {
+    return;
+  }
+  const double rms = std::sqrt(summary_square_sum_ / (static_cast<double>(summary_frames_) * format_.channels));
+  summaries_.push_back({QuantizeLevel(summary_peak_), QuantizeLevel(static_cast<float>(rms))});
+  summary_peak_ = 0.0f;
+  summary_square_sum_ = 0.0;
+  summary_frames_ = 0;
+}
+
+void SVFileIndex::AddGap(uint64_t frames) {
+  if(!gaps_.empty() && gaps_.back().frame + gaps_.back().frames == frames_) {
+    gaps_.back().frames += frames;
+    return;
+  }
+  gaps_.push_back({frames_, frames});
+}
+
+void SVFileIndex::Finish() {
+  EndSummary();
+}
+
+int SVFileIndex::Load(const std::string& index_path) {
+  FILE* file = fopen(index_path.c_str(), "rb");
+  if(!file) {
+    return SV_INIT_ERROR;
+  }
+  SVIndexHeader header;
+  struct stat st;
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, kIndexMagic, 4) == 0 &&
+            (header.version == SV_INDEX_VERSION || (header.version == 1 && header.block_count == 0)) &&
+            header.summary_frames == SV_INDEX_SUMMARY_FRAMES &&
+            header.channels > 0 && header.channels <= SV_MAX_CONVERT_CHANNELS && header.sample_rate > 0 &&
+            fstat(fileno(file), &st) == 0;
+  // The counts must add up to the file size before anything is allocated for them.
+  ok = ok && header.second_count <= static_cast<uint64_t>(st.st_size) &&
+       header.summary_count <= static_cast<uint64_t>(st.st_size) &&
+       header.gap_count <= static_cast<uint64_t>(st.st_size) &&
+       sizeof(header) + header.second_count * sizeof(uint64_t) + header.summary_count * sizeof(SVIndexSummary) +
+       header.gap_count * sizeof(SVIndexGap) + uint64_t(header.block_count) * sizeof(uint64_t) ==
+       static_cast<uint64_t>(st.st_size);
+  if(ok) {
+    Reset({header.sample_rate, header.channels, static_cast<SV_SAMPLE_FORMAT>(header.sample_format)},
+          static_cast<SV_CONTAINER_TYPE>(header.container), header.data_offset);
+    frames_ = header.frames;
+    ok = ReadArray(file, header.second_count, &second_offsets_) &&
+         ReadArray(file, header.summary_count, &summaries_) && ReadArray(file, header.gap_count, &gaps_) &&
+         ReadArray(file, header.block_count, &block_offsets_);
+  }
+  fclose(file);
+  if(!ok) {
+    AV_LOGW("SVFileIndex %s is not a usable index.", index_path.c_str());
+    return SV_INIT_ERROR;
+  }
+  return SV_NO_ERROR;
+}
+
+int SVFileIndex::Save(const std::string& index_path) const {
+  const std::string temp_path = index_path + ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if(!file) {
+    AV_LOGW("SVFileIndex create %s failed: %s", temp_path.c_str(), strerror(errno));
+    return SV_INIT_ERROR;
+  }
+  SVIndexHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kIndexMagic, 4);
+  header.version = SV_INDEX_VERSION;
+  header.sample_rate = format_.sample_rate;
+  header.channels = format_.channels;
+  header.sample_format = format_.sample_format;
+  header.container = container_;
+  header.summary_frames = SV_INDEX_SUMMARY_FRAMES;
+  header.data_offset = data_offset_;
+  header.frames = frames_;
+  header.second_count = second_offsets_.size();
+  header.summary_count = summaries_.size();
+  header.gap_count = gaps_.size();
+  header.block_count = static_cast<uint32_t>(block_offsets_.size());
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 && WriteArray(file, second_offsets_) &&
+                 WriteArray(file, summaries_) && WriteArray(file, gaps_) && WriteArray(file, block_offsets_);
+  written = fclose(file) == 0 && written;
+  if(!written || rename(temp_path.c_str(), index_path.c_str()) != 0) {
+    AV_LOGW("SVFileIndex save %s failed: %s", index_path.c_str(), strerror(errno));
+    remove(temp_path.c_str());
+    return SV_INIT_ERROR;
+  }
+  return SV_NO_ERROR;
+}
+
+SVIndexFileOutput::SVIndexFileOutput(ISVFileOutput::Ptr output, const SVAudioFormat& format,
+                                     SV_CONTAINER_TYPE container)
+  : output_(std::move(output)), format_(format), container_(container), input_bytes_(0),
+    second_bytes_(format.BytesPerSecond()),
+    block_bytes_(container == SV_CONTAINER_FLAC ? uint64_t(SV_FLAC_BLOCK_FRAMES) * format.BytesPerFrame() : 0),
+    opened_(false) {
+}
+
+SVIndexFileOutput::~SVIndexFileOutput() {
+  Close();
+}
+
+int SVIndexFileOutput::Open(const std::string& file_path) {
+  int result = output_->Open(file_path);
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  // The container has written its header, the audio starts here.
+  index_.Reset(format_, container_, output_->Size());
+  index_path_ = file_path + SV_INDEX_SUFFIX;
+  input_bytes_ = 0;
+  opened_ = true;
+  return SV_NO_ERROR;
+}
+
+size_t SVIndexFileOutput::Write(const void* data, size_t len) {
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  size_t written = 0;
+  // Split at second and block boundaries so each offset is taken right before the first byte.
+  // A FLAC block is encoded as soon as it is complete, the next one starts at Size().
+  while(written < len) {
+    if(index_.second_offsets().size() * second_bytes_ <= input_bytes_) {
+      index_.AddSecond(output_->Size());
+    }
+    uint64_t chunk_limit = second_bytes_ - input_bytes_ % second_bytes_;
+    if(block_bytes_ > 0) {
+      if(index_.block_offsets().size() * block_bytes_ <= input_bytes_) {
+        index_.AddBlock(output_->Size());
+      }
+      chunk_limit = std::min(chunk_limit, block_bytes_ - input_bytes_ % block_bytes_);
+    }
+    const size_t chunk = static_cast<size_t>(std::min<uint64_t>(len - written, chunk_limit));
+    const size_t chunk_written = output_->Write(src + written, chunk);
+    index_.AddAudio(src + written, chunk_written);
+    input_bytes_ += chunk_written;
+    written += chunk_written;
+    if(chunk_written != chunk) {
+      break;
+    }
+  }
+  return written;
+}
+
+void SVIndexFileOutput::OnGap(uint64_t len) {
+  index_.AddGap(len / format_.BytesPerFrame());
+  output_->OnGap(len);
+}
+
+int SVIndexFileOutput::Close() {
+  if(!opened_) {
+    return SV_NO_ERROR;
+  }
+  opened_ = false;
+  // Saved after the file is complete, an index never describes more than is on disk.
+  int result = output_->Close();
+  index_.Finish();
+  index_.Save(index_path_);
+  return result;
+}
+
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_FILE_INDEX_H
+#define AOS_AUDIO_RECORD_SV_FILE_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "sv_common.h"
+#include "sv_file_output.h"
+#include "sv_sample_convert.h"
+#include "sv_wav_writer.h"
+
+namespace sv_recorder {
+
+// Index written next to every recorded file, <file>.idx.
+const char* const SV_INDEX_SUFFIX = ".idx";
+const uint32_t SV_INDEX_VERSION = 2;
+// Frames per peak/RMS summary, about 21ms at 48kHz.
+const uint32_t SV_INDEX_SUMMARY_FRAMES = 1024;
+
+// Peak and RMS of a stretch of audio over all channels, full scale is 65535.
+struct SVIndexSummary {
+    uint16_t peak;
+    uint16_t rms;
+};
+
+// Silence written in place of audio lost to a stream outage, in frames of the file.
+struct SVIndexGap {
+    uint64_t frame;
+    uint64_t frames;
+};
+
+// Seek table and level summary of one recorded file, stored as <file>.idx: a fixed header,
+// then the file offset of every second, a SVIndexSummary per SV_INDEX_SUMMARY_FRAMES, the
+// gaps and, for FLAC, the offset of every SV_FLAC_BLOCK_FRAMES block. Binary in host byte
+// order, which is little-endian on every Android ABI. Version 1 had no block offsets.
+// For raw and WAV files a second's offset is where its first frame is; for FLAC it is the
+// frame holding that sample, which starts at the previous multiple of SV_FLAC_BLOCK_FRAMES.
+class SVFileIndex {
+
+public:
+    SVFileIndex();
+
+    // Starts an empty index for |format| audio stored from |data_offset| of a |container| file.
+    void Reset(const SVAudioFormat& format, SV_CONTAINER_TYPE container, uint64_t data_offset);
+    // Interleaved PCM in |format|, of any length; a split frame waits for the rest of its bytes.
+    void AddAudio(const void* data, size_t len);
+    // Offset of the start of the next second, called once per second before its audio.
+    void AddSecond(uint64_t offset) { second_offsets_.push_back(offset); }
+    // Offset of the FLAC frame of the next block, called once per block before its audio.
+    void AddBlock(uint64_t offset) { block_offsets_.push_back(offset); }
+    // |frames| frames of silence follow at the current position.
+    void AddGap(uint64_t frames);
+    // Summarises the last, partial stretch.
+    void Finish();
+
+    int Load(const std::string& index_path);
+    // Writes a temporary file and renames it over the old one.
+    int Save(const std::string& index_path) const;
+
+    const SVAudioFormat& format() const { return format_; }
+    SV_CONTAINER_TYPE container() const { return container_; }
+    uint64_t data_offset() const { return data_offset_; }
+    uint64_t frames() const { return frames_; }
+    const std::vector<uint64_t>& second_offsets() const { return second_offsets_; }
+    const std::vector<uint64_t>& block_offsets() const { return block_offsets_; }
+    const std::vector<SVIndexSummary>& summaries() const { return summaries_; }
+    const std::vector<SVIndexGap>& gaps() const { return gaps_; }
+
+private:
+    void AddFrames(const uint8_t* data, size_t frames);
+    void EndSummary();
+
+private:
+    SVAudioFormat format_;
+    SV_CONTAINER_TYPE container_;
+    uint64_t data_offset_;
+    uint64_t frames_;
+    std::vector<uint64_t> second_offsets_;
+    std::vector<uint64_t> block_offsets_;
+    std::vector<SVIndexSummary> summaries_;
+    std::vector<SVIndexGap> gaps_;
+
+    // Builder state.
+    uint8_t partial_[SV_MAX_CONVERT_CHANNELS * sizeof(float)];
+    size_t partial_bytes_;
+    std::vector<float> samples_;
+    float summary_peak_;
+    double summary_square_sum_;
+    uint32_t summary_frames_;
+};
+
+// Writer-thread stage right on top of a container: notes the file offset at every second
+// boundary, summarises the audio on its way in and saves <file>.idx on Close().
+class SVIndexFileOutput : public ISVFileOutput {
+
+public:
+    SVIndexFileOutput(ISVFileOutput::Ptr output, const SVAudioFormat& format, SV_CONTAINER_TYPE container);
+    ~SVIndexFileOutput() override;
+    int Open(const std::string& file_path) override;
+    size_t Write(const void* data, size_t len) override;
+    int WriteAt(uint64_t offset, const void* data, size_t len) override { return output_->WriteAt(offset, data, len); }
+    int Flush() override { return output_->Flush(); }
+    int Close() override;
+    uint64_t Size() const override { return output_->Size(); }
+    SVFileOutputStats GetStats() const override { return output_->GetStats(); }
+    void OnGap(uint64_t len) override;
+
+    const SVFileIndex& index() const { return index_; }
+
+private:
+    ISVFileOutput::Ptr output_;
+    SVAudioFormat format_;
+    SV_CONTAINER_TYPE container_;
+    std::string index_path_;
+    SVFileIndex index_;
+    uint64_t input_bytes_;
+    uint64_t second_bytes_;
+    // 0 unless the container is FLAC.
+    uint64_t block_bytes_;
+    bool opened_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_FILE_INDEX_H
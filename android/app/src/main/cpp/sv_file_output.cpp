@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_file_output.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "log.h"
+#include "sv_common.h"
+
+namespace sv_recorder {
+
+ISVFileOutput::Ptr ISVFileOutput::Create(SV_FILE_OUTPUT_TYPE type) {
+  if(type == SV_OUTPUT_MMAP) {
+    return Ptr(new SVMmapFileOutput());
+  }
+  return Ptr(new SVStdioFileOutput());
+}
+
+SVStdioFileOutput::SVStdioFileOutput()
+  : file_(nullptr), size_(0), io_calls_(0), open_time_ns_(0),
+    close_time_ns_(0) {
+}
+
+SVStdioFileOutput::~SVStdioFileOutput() {
+  Close();
+}
+
+int SVStdioFileOutput::Open(const std::string& file_path) {
+  file_ = fopen(file_path.c_str(), "wb");
+  if(!file_) {
+    AV_LOGE("SVStdioFileOutput open failed: %s, %s", file_path.c_str(), strerror(errno));
+    return SV_INIT_ERROR;
+  }
+  size_ = 0;
+  io_calls_ = 0;
+  open_time_ns_ = SVNowNs();
+  close_time_ns_ = 0;
+  return SV_NO_ERROR;
+}
+
+size_t SVStdioFileOutput::Write(const void* data, size_t len) {
+  if(!file_) {
+    return 0;
+  }
+  size_t write_len = fwrite(data, 1, len, file_);
+  size_ += write_len;
+  io_calls_++;
+  return write_len;
+}
+
+int SVStdioFileOutput::WriteAt(uint64_t offset, const void* data, size_t len) {
+  if(!file_ || offset + len > size_) {
+    return SV_STATE_ERROR;
+  }
+  // Push buffered data down first so the patch is not overwritten by a later flush.
+  io_calls_ += 2;
+  fflush(file_);
+  ssize_t ret = pwrite(fileno(file_), data, len, static_cast<off_t>(offset));
+  return ret == static_cast<ssize_t>(len) ? SV_NO_ERROR : SV_STOP_ERROR;
+}
+
+int SVStdioFileOutput::Flush() {
+  if(!file_) {
+    return SV_STATE_ERROR;
+  }
+  io_calls_++;
+  return fflush(file_) == 0 ? SV_NO_ERROR : SV_STOP_ERROR;
+}
+
+int SVStdioFileOutput::Close() {
+  if(!file_) {
+    return SV_NO_ERROR;
+  }
+  fclose(file_);
+  file_ = nullptr;
+  close_time_ns_ = SVNowNs();
+  return SV_NO_ERROR;
+}
+
+SVFileOutputStats SVStdioFileOutput::GetStats() const {
+  SVFileOutputStats stats;
+  stats.bytes_written = size_;
+  stats.io_calls = io_calls_;
+  stats.open_ns = open_time_ns_ ? static_cast<uint64_t>((close_time_ns_ ? close_time_ns_ : SVNowNs()) - open_time_ns_) : 0;
+  return stats;
+}
+
+SVMmapFileOutput::SVMmapFileOutput()
+  : fd_(-1), window_(nullptr), window_offset_(0), allocated_(0), size_(0), io_calls_(0),
+    open_time_ns_(0), close_time_ns_(0) {
+}
+
+SVMmapFileOutput::~SVMmapFileOutput() {
+  Close();
+}
+
+int SVMmapFileOutput::Open(const std::string& file_path) {
+  fd_ = open(file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if(fd_ < 0) {
+    AV_LOGE("SVMmapFileOutput open failed: %s, %s", file_path.c_str(), strerror(errno));
+    return SV_INIT_ERROR;
+  }
+  size_ = 0;
+  allocated_ = 0;
+  io_calls_ = 1;
+  open_time_ns_ = SVNowNs();
+  close_time_ns_ = 0;
+  if(!MapWindow(0)) {
+    close(fd_);
+    fd_ = -1;
+    return SV_INIT_ERROR;
+  }
+  return SV_NO_ERROR;
+}
+
+bool SVMmapFileOutput::Reserve(uint64_t end) {
+  if(end <= allocated_) {
+    return true;
+  }
+  uint64_t new_allocated = (end + SV_MMAP_EXTENT_BYTES - 1) / SV_MMAP_EXTENT_BYTES * SV_MMAP_EXTENT_BYTES;
+  io_calls_++;
+  int ret = fallocate(fd_, 0, allocated_, new_allocated - allocated_);
+  if(ret != 0) {
+    // Some filesystems (e.g. sdcardfs, tmpfs on old kernels) do not support fallocate.
+    io_calls_++;
+    ret = ftruncate(fd_, new_allocated);
+  }
+  if(ret != 0) {
+    AV_LOGE("SVMmapFileOutput reserve %llu bytes failed: %s",
+            (unsigned long long) new_allocated, strerror(errno));
+    return false;
+  }
+  allocated_ = new_allocated;
+  return true;
+}
+
+bool SVMmapFileOutput::MapWindow(uint64_t offset) {
+  if(!Reserve(offset + SV_MMAP_WINDOW_BYTES)) {
+    return false;
+  }
+  io_calls_++;
+  void* addr = mmap(nullptr, SV_MMAP_WINDOW_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd_,
+                    static_cast<off_t>(offset));
+  if(addr == MAP_FAILED) {
+    AV_LOGE("SVMmapFileOutput mmap failed at %llu: %s", (unsigned long long) offset, strerror(errno));
+    return false;
+  }
+  window_ = static_cast<uint8_t*>(addr);
+  window_offset_ = offset;
+  return true;
+}
+
+void SVMmapFileOutput::UnmapWindow() {
+  if(window_) {
+    io_calls_++;
+    munmap(window_, SV_MMAP_WINDOW_BYTES);
+    window_ = nullptr;
+  }
+}
+
+size_t SVMmapFileOutput::Write(const void* data, size_t len) {
+  size_t written = 0;
+  auto src = static_cast<const uint8_t*>(data);
+  while(written < len && window_) {
+    size_t window_pos = static_cast<size_t>(size_ - window_offset_);
+    size_t chunk = SV_MMAP_WINDOW_BYTES - window_pos;
+    if(chunk > len - written) {
+      chunk = len - written;
+    }
+    memcpy(window_ + window_pos, src + written, chunk);
+    written += chunk;
+    size_ += chunk;
+
+    if(size_ - window_offset_ == SV_MMAP_WINDOW_BYTES) {
+      // Let the kernel start writeback of the full window before moving on.
+      io_calls_++;
+      msync(window_, SV_MMAP_WINDOW_BYTES, MS_ASYNC);
+      UnmapWindow();
+      MapWindow(size_);
+    }
+  }
+  return written;
+}
+
+int SVMmapFileOutput::WriteAt(uint64_t offset, const void* data, size_t len) {
+  if(fd_ < 0 || offset + len > size_) {
+    return SV_STATE_ERROR;
+  }
+  // The page cache is shared with the MAP_SHARED window, so this stays coherent.
+  io_calls_++;
+  ssize_t ret = pwrite(fd_, data, len, static_cast<off_t>(offset));
+  return ret == static_cast<ssize_t>(len) ? SV_NO_ERROR : SV_STOP_ERROR;
+}
+
+int SVMmapFileOutput::Flush() {
+  if(!window_) {
+    return SV_STATE_ERROR;
+  }
+  io_calls_++;
+  return msync(window_, SV_MMAP_WINDOW_BYTES, MS_ASYNC) == 0 ? SV_NO_ERROR : SV_STOP_ERROR;
+}
+
+int SVMmapFileOutput::Close() {
+  if(fd_ < 0) {
+    return SV_NO_ERROR;
+  }
+  UnmapWindow();
+  io_calls_++;
+  if(ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+    AV_LOGE("SVMmapFileOutput truncate failed: %s", strerror(errno));
+  }
+  close(fd_);
+  fd_ = -1;
+  allocated_ = 0;
+  close_time_ns_ = SVNowNs();
+  return SV_NO_ERROR;
+}
+
+SVFileOutputStats SVMmapFileOutput::GetStats() const {
+  SVFileOutputStats stats;
+  stats.bytes_written = size_;
+  stats.io_calls = io_calls_;
+  stats.open_ns = open_time_ns_ ? static_cast<uint64_t>((close_time_ns_ ? close_time_ns_ : SVNowNs()) - open_time_ns_) : 0;
+  return stats;
+}
+
+}
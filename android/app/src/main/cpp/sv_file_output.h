@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_FILE_OUTPUT_H
+#define AOS_AUDIO_RECORD_SV_FILE_OUTPUT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+namespace sv_recorder {
+
+enum SV_FILE_OUTPUT_TYPE : int32_t {
+    SV_OUTPUT_STDIO = 0,
+    SV_OUTPUT_MMAP = 1
+};
+
+const size_t SV_MMAP_EXTENT_BYTES = 16 * 1024 * 1024;
+const size_t SV_MMAP_WINDOW_BYTES = 4 * 1024 * 1024;
+
+struct SVFileOutputStats {
+    uint64_t bytes_written;
+    // stdio: fwrite/fflush calls. mmap: fallocate/mmap/munmap/ftruncate syscalls.
+    uint64_t io_calls;
+    uint64_t open_ns;
+
+    double BytesPerSecond() const { return open_ns ? bytes_written * 1e9 / open_ns : 0.0; }
+};
+
+// Byte-level destination of the disk writer. Only used from the writer thread.
+class ISVFileOutput {
+
+public:
+    using Ptr = std::unique_ptr<ISVFileOutput>;
+    virtual ~ISVFileOutput() = default;
+    virtual int Open(const std::string& file_path) = 0;
+    virtual size_t Write(const void* data, size_t len) = 0;
+    // Overwrites already written bytes, e.g. to patch a container header.
+    virtual int WriteAt(uint64_t offset, const void* data, size_t len) = 0;
+    virtual int Flush() = 0;
+    // Cuts off any preallocated tail and closes the file.
+    virtual int Close() = 0;
+    virtual uint64_t Size() const = 0;
+    virtual SVFileOutputStats GetStats() const = 0;
+    // The next |len| bytes written are silence standing in for lost audio. Stages that keep
+    // an index pass it on, everything else ignores it.
+    virtual void OnGap(uint64_t len) {}
+
+    static Ptr Create(SV_FILE_OUTPUT_TYPE type);
+};
+
+class SVStdioFileOutput : public ISVFileOutput {
+
+public:
+    SVStdioFileOutput();
+    ~SVStdioFileOutput() override;
+    int Open(const std::string& file_path) override;
+    size_t Write(const void* data, size_t len) override;
+    int WriteAt(uint64_t offset, const void* data, size_t len) override;
+    int Flush() override;
+    int Close() override;
+    uint64_t Size() const override { return size_; }
+    SVFileOutputStats GetStats() const override;
+
+private:
+    FILE* file_;
+    uint64_t size_;
+    uint64_t io_calls_;
+    int64_t open_time_ns_;
+    int64_t close_time_ns_;
+};
+
+// Preallocates the file in SV_MMAP_EXTENT_BYTES extents and copies data into a sliding
+// SV_MMAP_WINDOW_BYTES mapping, so the kernel sees few large page-aligned writebacks
+// instead of one small write per callback.
+class SVMmapFileOutput : public ISVFileOutput {
+
+public:
+    SVMmapFileOutput();
+    ~SVMmapFileOutput() override;
+    int Open(const std::string& file_path) override;
+    size_t Write(const void* data, size_t len) override;
+    int WriteAt(uint64_t offset, const void* data, size_t len) override;
+    int Flush() override;
+    int Close() override;
+    uint64_t Size() const override { return size_; }
+    SVFileOutputStats GetStats() const override;
+
+private:
+    bool MapWindow(uint64_t offset);
+    void UnmapWindow();
+    bool Reserve(uint64_t end);
+
+private:
+    int fd_;
+    uint8_t* window_;
+    uint64_t window_offset_;
+    uint64_t allocated_;
+    uint64_t size_;
+    uint64_t io_calls_;
+    int64_t open_time_ns_;
+    int64_t close_time_ns_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_FILE_OUTPUT_H
@@ -0,0 +1,707 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_flac_writer.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "log.h"
+#include "sv_sample_convert.h"
+
+namespace sv_recorder {
+
+const size_t SV_FLAC_HEADER_SIZE = 42;
+const int SV_FLAC_MAX_FIXED_ORDER = 4;
+const int SV_FLAC_MAX_PARTITION_ORDER = 8;
+// Parameter 15 (RICE) / 31 (RICE2) is the escape code.
+const int SV_FLAC_MAX_RICE_PARAM = 14;
+const int SV_FLAC_MAX_RICE2_PARAM = 30;
+
+enum SV_FLAC_CHANNEL_ASSIGNMENT {
+    SV_FLAC_LEFT_SIDE = 8,
+    SV_FLAC_SIDE_RIGHT = 9,
+    SV_FLAC_MID_SIDE = 10
+};
+
+struct SVFlacRicePlan {
+    int partition_order;
+    bool rice2;
+    int params[1 << SV_FLAC_MAX_PARTITION_ORDER];
+};
+
+static uint8_t kCrc8Table[256];
+static uint16_t kCrc16Table[256];
+
+static bool InitCrcTables() {
+  for(int i = 0; i < 256; i++) {
+    uint8_t crc8 = static_cast<uint8_t>(i);
+    uint16_t crc16 = static_cast<uint16_t>(i << 8);
+    for(int bit = 0; bit < 8; bit++) {
+      crc8 = static_cast<uint8_t>(crc8 & 0x80 ? (crc8 << 1) ^ 0x07 : crc8 << 1);
+      crc16 = static_cast<uint16_t>(crc16 & 0x8000 ? (crc16 << 1) ^ 0x8005 : crc16 << 1);
+    }
+    kCrc8Table[i] = crc8;
+    kCrc16Table[i] = crc16;
+  }
+  return true;
+}
+
+static uint8_t Crc8(const uint8_t* data, size_t len) {
+  uint8_t crc = 0;
+  for(size_t i = 0; i < len; i++) {
+    crc = kCrc8Table[crc ^ data[i]];
+  }
+  return crc;
+}
+
+static inline uint16_t Crc16Update(uint16_t crc, uint8_t byte) {
+  return static_cast<uint16_t>((crc << 8) ^ kCrc16Table[(crc >> 8) ^ byte]);
+}
+
+static uint16_t Crc16(const uint8_t* data, size_t len) {
+  uint16_t crc = 0;
+  for(size_t i = 0; i < len; i++) {
+    crc = Crc16Update(crc, data[i]);
+  }
+  return crc;
+}
+
+static int SampleRateCode(int sample_rate) {
+  switch (sample_rate) {
+    case 88200: return 1;
+    case 176400: return 2;
+    case 192000: return 3;
+    case 8000: return 4;
+    case 16000: return 5;
+    case 22050: return 6;
+    case 24000: return 7;
+    case 32000: return 8;
+    case 44100: return 9;
+    case 48000: return 10;
+    case 96000: return 11;
+    default: return 0; // taken from STREAMINFO
+  }
+}
+
+static int SampleSizeCode(int bits_per_sample) {
+  switch (bits_per_sample) {
+    case 8: return 1;
+    case 12: return 2;
+    case 16: return 4;
+    case 20: return 5;
+    case 24: return 6;
+    default: return 0;
+  }
+}
+
+static inline uint32_t ZigZag(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+static int RiceParam(uint64_t sum, uint32_t count, int max_param) {
+  int k = 0;
+  while(k < max_param && (static_cast<uint64_t>(count) << (k + 1)) < sum) {
+    k++;
+  }
+  return k;
+}
+
+// MSB-first bit packer into a byte vector.
+class SVFlacEncoder::BitWriter {
+
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out_(out), acc_(0), bits_(0) {
+      out_.clear();
+    }
+
+    void Put(uint32_t value, int count) {
+      acc_ = (acc_ << count) | (value & ((1ull << count) - 1));
+      bits_ += count;
+      while(bits_ >= 8) {
+        bits_ -= 8;
+        out_.push_back(static_cast<uint8_t>(acc_ >> bits_));
+      }
+    }
+
+    void PutSigned(int32_t value, int count) {
+      Put(static_cast<uint32_t>(value), count);
+    }
+
+    void PutRice(int32_t value, int k) {
+      uint32_t u = ZigZag(value);
+      uint32_t q = u >> k;
+      while(q >= 32) {
+        Put(0, 32);
+        q -= 32;
+      }
+      Put(1, static_cast<int>(q) + 1);
+      if(k) {
+        Put(u, k);
+      }
+    }
+
+    void AlignToByte() {
+      if(bits_) {
+        Put(0, 8 - bits_);
+      }
+    }
+
+    const uint8_t* data() const { return out_.data(); }
+    size_t size() const { return out_.size(); }
+
+private:
+    std::vector<uint8_t>& out_;
+    uint64_t acc_;
+    int bits_;
+};
+
+// Picks the fixed predictor order with the smallest sum of absolute residuals.
+static int BestFixedOrder(const int32_t* x, int32_t n, uint64_t* best_sum) {
+  uint64_t sums[SV_FLAC_MAX_FIXED_ORDER + 1] = {0, 0, 0, 0, 0};
+  for(int32_t i = SV_FLAC_MAX_FIXED_ORDER; i < n; i++) {
+    int64_t e0 = x[i];
+    int64_t e1 = e0 - x[i - 1];
+    int64_t e2 = e1 - (static_cast<int64_t>(x[i - 1]) - x[i - 2]);
+    int64_t e3 = e2 - (static_cast<int64_t>(x[i - 1]) - 2 * static_cast<int64_t>(x[i - 2]) + x[i - 3]);
+    int64_t e4 = e3 - (static_cast<int64_t>(x[i - 1]) - 3 * static_cast<int64_t>(x[i - 2]) +
+                       3 * static_cast<int64_t>(x[i - 3]) - x[i - 4]);
+    sums[0] += e0 < 0 ? -e0 : e0;
+    sums[1] += e1 < 0 ? -e1 : e1;
+    sums[2] += e2 < 0 ? -e2 : e2;
+    sums[3] += e3 < 0 ? -e3 : e3;
+    sums[4] += e4 < 0 ? -e4 : e4;
+  }
+  int order = 0;
+  for(int i = 1; i <= SV_FLAC_MAX_FIXED_ORDER; i++) {
+    if(sums[i] < sums[order]) {
+      order = i;
+    }
+  }
+  if(best_sum) {
+    *best_sum = sums[order];
+  }
+  return order;
+}
+
+static void FixedResidual(const int32_t* x, int32_t n, int order, int32_t* residual) {
+  for(int32_t i = order; i < n; i++) {
+    switch (order) {
+      case 0: residual[i] = x[i]; break;
+      case 1: residual[i] = x[i] - x[i - 1]; break;
+      case 2: residual[i] = x[i] - 2 * x[i - 1] + x[i - 2]; break;
+      case 3: residual[i] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3]; break;
+      default: residual[i] = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4]; break;
+    }
+  }
+}
+
+// Chooses the partition order and Rice parameters, returns the estimated residual size in bits.
+static uint64_t PlanResidual(const int32_t* residual, int32_t n, int order, SVFlacRicePlan* plan) {
+  int max_order = 0;
+  while(max_order < SV_FLAC_MAX_PARTITION_ORDER && (n % (2 << max_order)) == 0 &&
+        (n >> (max_order + 1)) > order) {
+    max_order++;
+  }
+
+  uint64_t sums[1 << SV_FLAC_MAX_PARTITION_ORDER];
+  const int32_t finest = n >> max_order;
+  for(int p = 0; p < (1 << max_order); p++) {
+    uint64_t sum = 0;
+    for(int32_t i = p == 0 ? order : p * finest; i < (p + 1) * finest; i++) {
+      sum += ZigZag(residual[i]);
+    }
+    sums[p] = sum;
+  }
+
+  uint64_t best_bits = UINT64_MAX;
+  for(int po = max_order; po >= 0; po--) {
+    const int partitions = 1 << po;
+    const int32_t partition_len = n >> po;
+    uint64_t bits = 0;
+    bool rice2 = false;
+    int params[1 << SV_FLAC_MAX_PARTITION_ORDER];
+    for(int p = 0; p < partitions; p++) {
+      uint32_t count = static_cast<uint32_t>(p == 0 ? partition_len - order : partition_len);
+      params[p] = RiceParam(sums[p], count, SV_FLAC_MAX_RICE2_PARAM);
+      rice2 |= params[p] > SV_FLAC_MAX_RICE_PARAM;
+      bits += static_cast<uint64_t>(count) * (params[p] + 1) + (sums[p] >> params[p]);
+    }
+    bits += 6 + partitions * (rice2 ? 5 : 4);
+    if(bits < best_bits) {
+      best_bits = bits;
+      plan->partition_order = po;
+      plan->rice2 = rice2;
+      memcpy(plan->params, params, partitions * sizeof(int));
+    }
+    // Merge pairs for the next coarser order.
+    for(int p = 0; p < partitions / 2; p++) {
+      sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+  }
+  return best_bits;
+}
+
+SVFlacEncoder::SVFlacEncoder()
+  : sample_rate_(0), channels_(0), bits_per_sample_(0), frame_number_(0), total_frames_(0),
+    min_frame_bytes_(0), max_frame_bytes_(0), stats_{0, 0, 0, 0} {
+  static bool crc_ready = InitCrcTables();
+  (void) crc_ready;
+}
+
+int SVFlacEncoder::Init(int sample_rate, int channels, int bits_per_sample) {
+  if(sample_rate <= 0 || sample_rate >= (1 << 20) || channels <= 0 || channels > SV_FLAC_MAX_CHANNELS ||
+     bits_per_sample < 8 || bits_per_sample > 24) {
+    AV_LOGW("SVFlacEncoder unsupported format: %d/%d/%d", sample_rate, channels, bits_per_sample);
+    return SV_INIT_ERROR;
+  }
+  sample_rate_ = sample_rate;
+  channels_ = channels;
+  bits_per_sample_ = bits_per_sample;
+  frame_number_ = 0;
+  total_frames_ = 0;
+  min_frame_bytes_ = 0;
+  max_frame_bytes_ = 0;
+  stats_ = {0, 0, 0, 0};
+  for(int ch = 0; ch < channels; ch++) {
+    planes_[ch].resize(SV_FLAC_BLOCK_FRAMES);
+  }
+  mid_.resize(SV_FLAC_BLOCK_FRAMES);
+  side_.resize(SV_FLAC_BLOCK_FRAMES);
+  residual_.resize(SV_FLAC_BLOCK_FRAMES);
+  // Worst case is a verbatim frame with one extra bit per sample for the side channel.
+  frame_.reserve(SV_FLAC_BLOCK_FRAMES * channels * (bits_per_sample + 1) / 8 + 64);
+  return SV_NO_ERROR;
+}
+
+const std::vector<uint8_t>& SVFlacEncoder::EncodeBlock(const int32_t* samples, int32_t num_frames) {
+  int64_t begin = SVNowNs();
+  for(int32_t i = 0; i < num_frames; i++) {
+    for(int ch = 0; ch < channels_; ch++) {
+      planes_[ch][i] = samples[i * channels_ + ch];
+    }
+  }
+
+  // Stereo decorrelation, chosen by the cheapest predicted residual like the reference encoder.
+  int assignment = channels_ - 1;
+  const int32_t* inputs[SV_FLAC_MAX_CHANNELS];
+  int bps[SV_FLAC_MAX_CHANNELS];
+  for(int ch = 0; ch < channels_; ch++) {
+    inputs[ch] = planes_[ch].data();
+    bps[ch] = bits_per_sample_;
+  }
+  if(channels_ == 2 && num_frames > SV_FLAC_MAX_FIXED_ORDER) {
+    const int32_t* left = planes_[0].data();
+    const int32_t* right = planes_[1].data();
+    for(int32_t i = 0; i < num_frames; i++) {
+      mid_[i] = (left[i] + right[i]) >> 1;
+      side_[i] = left[i] - right[i];
+    }
+    uint64_t cost_left, cost_right, cost_mid, cost_side;
+    BestFixedOrder(left, num_frames, &cost_left);
+    BestFixedOrder(right, num_frames, &cost_right);
+    BestFixedOrder(mid_.data(), num_frames, &cost_mid);
+    BestFixedOrder(side_.data(), num_frames, &cost_side);
+    uint64_t best = cost_left + cost_right;
+    if(cost_left + cost_side < best) {
+      best = cost_left + cost_side;
+      assignment = SV_FLAC_LEFT_SIDE;
+    }
+    if(cost_side + cost_right < best) {
+      best = cost_side + cost_right;
+      assignment = SV_FLAC_SIDE_RIGHT;
+    }
+    if(cost_mid + cost_side < best) {
+      assignment = SV_FLAC_MID_SIDE;
+    }
+    switch (assignment) {
+      case SV_FLAC_LEFT_SIDE:
+        inputs[1] = side_.data();
+        bps[1]++;
+        break;
+      case SV_FLAC_SIDE_RIGHT:
+        inputs[0] = side_.data();
+        bps[0]++;
+        break;
+      case SV_FLAC_MID_SIDE:
+        inputs[0] = mid_.data();
+        inputs[1] = side_.data();
+        bps[1]++;
+        break;
+      default:
+        break;
+    }
+  }
+
+  BitWriter bits(frame_);
+  // Sync code, reserved bit and the fixed-blocksize strategy.
+  bits.Put(0xFFF8, 16);
+  int block_code = num_frames == SV_FLAC_BLOCK_FRAMES ? 12 : (num_frames <= 256 ? 6 : 7);
+  bits.Put(static_cast<uint32_t>(block_code), 4);
+  bits.Put(static_cast<uint32_t>(SampleRateCode(sample_rate_)), 4);
+  bits.Put(static_cast<uint32_t>(assignment), 4);
+  bits.Put(static_cast<uint32_t>(SampleSizeCode(bits_per_sample_)), 3);
+  bits.Put(0, 1);
+  // Frame number in the UTF-8 like variable length coding.
+  if(frame_number_ < 0x80) {
+    bits.Put(frame_number_, 8);
+  } else {
+    int len = 2;
+    while(len < 6 && frame_number_ >= (1u << (5 * len + 1))) {
+      len++;
+    }
+    bits.Put((0xFF00u >> len) | (frame_number_ >> (6 * (len - 1))), 8);
+    for(int i = len - 2; i >= 0; i--) {
+      bits.Put(0x80 | ((frame_number_ >> (6 * i)) & 0x3F), 8);
+    }
+  }
+  if(block_code == 6) {
+    bits.Put(static_cast<uint32_t>(num_frames - 1), 8);
+  } else if(block_code == 7) {
+    bits.Put(static_cast<uint32_t>(num_frames - 1), 16);
+  }
+  bits.Put(Crc8(bits.data(), bits.size()), 8);
+
+  for(int ch = 0; ch < channels_; ch++) {
+    EncodeSubframe(bits, inputs[ch], num_frames, bps[ch]);
+  }
+  bits.AlignToByte();
+  bits.Put(Crc16(bits.data(), bits.size()), 16);
+
+  const uint32_t frame_bytes = static_cast<uint32_t>(frame_.size());
+  if(min_frame_bytes_ == 0 || frame_bytes < min_frame_bytes_) {
+    min_frame_bytes_ = frame_bytes;
+  }
+  if(frame_bytes > max_frame_bytes_) {
+    max_frame_bytes_ = frame_bytes;
+  }
+  frame_number_++;
+  total_frames_ += num_frames;
+  stats_.frames_encoded += num_frames;
+  stats_.input_bytes += static_cast<uint64_t>(num_frames) * channels_ * ((bits_per_sample_ + 7) / 8);
+  stats_.output_bytes += frame_bytes;
+  stats_.encode_ns += static_cast<uint64_t>(SVNowNs() - begin);
+  return frame_;
+}
+
+void SVFlacEncoder::EncodeSubframe(BitWriter& bits, const int32_t* x, int32_t num_frames, int bps) {
+  bool constant = true;
+  for(int32_t i = 1; i < num_frames && constant; i++) {
+    constant = x[i] == x[0];
+  }
+  if(constant) {
+    bits.Put(0x00, 8);
+    bits.PutSigned(x[0], bps);
+    return;
+  }
+
+  const uint64_t verbatim_bits = static_cast<uint64_t>(num_frames) * bps;
+  if(num_frames > SV_FLAC_MAX_FIXED_ORDER) {
+    int order = BestFixedOrder(x, num_frames, nullptr);
+    FixedResidual(x, num_frames, order, residual_.data());
+    SVFlacRicePlan plan;
+    uint64_t fixed_bits = order * bps + PlanResidual(residual_.data(), num_frames, order, &plan);
+    if(fixed_bits < verbatim_bits) {
+      bits.Put(static_cast<uint32_t>((0x08 | order) << 1), 8);
+      for(int i = 0; i < order; i++) {
+        bits.PutSigned(x[i], bps);
+      }
+      const int param_bits = plan.rice2 ? 5 : 4;
+      const int32_t partition_len = num_frames >> plan.partition_order;
+      bits.Put(plan.rice2 ? 1 : 0, 2);
+      bits.Put(static_cast<uint32_t>(plan.partition_order), 4);
+      for(int p = 0; p < (1 << plan.partition_order); p++) {
+        const int k = plan.params[p];
+        bits.Put(static_cast<uint32_t>(k), param_bits);
+        for(int32_t i = p == 0 ? order : p * partition_len; i < (p + 1) * partition_len; i++) {
+          bits.PutRice(residual_[i], k);
+        }
+      }
+      return;
+    }
+  }
+
+  bits.Put(0x02, 8);
+  for(int32_t i = 0; i < num_frames; i++) {
+    bits.PutSigned(x[i], bps);
+  }
+}
+
+static uint8_t* PutBE(uint8_t* p, uint64_t value, int bytes) {
+  for(int i = bytes - 1; i >= 0; i--) {
+    *p++ = static_cast<uint8_t>(value >> (8 * i));
+  }
+  return p;
+}
+
+size_t SVFlacEncoder::BuildHeader(uint8_t* header) const {
+  uint8_t* p = header;
+  memcpy(p, "fLaC", 4);
+  p += 4;
+  // Last metadata block flag, type 0 (STREAMINFO), 34 bytes.
+  *p++ = 0x80;
+  p = PutBE(p, 34, 3);
+  p = PutBE(p, SV_FLAC_BLOCK_FRAMES, 2);
+  p = PutBE(p, SV_FLAC_BLOCK_FRAMES, 2);
+  p = PutBE(p, min_frame_bytes_, 3);
+  p = PutBE(p, max_frame_bytes_, 3);
+  uint64_t packed = static_cast<uint64_t>(sample_rate_) << 44 |
+                    static_cast<uint64_t>(channels_ - 1) << 41 |
+                    static_cast<uint64_t>(bits_per_sample_ - 1) << 36 |
+                    (total_frames_ & 0xFFFFFFFFFull);
+  p = PutBE(p, packed, 8);
+  // No MD5 signature, decoders treat all zeros as unknown.
+  memset(p, 0, 16);
+  p += 16;
+  return static_cast<size_t>(p - header);
+}
+
+SVFlacFileOutput::SVFlacFileOutput(ISVFileOutput::Ptr output, const SVAudioFormat& format)
+  : output_(std::move(output)), format_(format), pending_bytes_(0), opened_(false) {
+  pending_.resize(static_cast<size_t>(SV_FLAC_BLOCK_FRAMES) * format_.BytesPerFrame());
+  int_block_.resize(static_cast<size_t>(SV_FLAC_BLOCK_FRAMES) * format_.channels);
+  if(format_.sample_format == SV_SAMPLE_F32) {
+    packed_block_.resize(static_cast<size_t>(SV_FLAC_BLOCK_FRAMES) * format_.channels * 3);
+  }
+}
+
+SVFlacFileOutput::~SVFlacFileOutput() {
+  Close();
+}
+
+int SVFlacFileOutput::Open(const std::string& file_path) {
+  const int bits = format_.sample_format == SV_SAMPLE_I16 ? 16 : 24;
+  int result = encoder_.Init(format_.sample_rate, format_.channels, bits);
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  result = output_->Open(file_path);
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+
+  uint8_t header[SV_FLAC_HEADER_SIZE];
+  size_t header_size = encoder_.BuildHeader(header);
+  if(output_->Write(header, header_size) != header_size) {
+    AV_LOGE("SVFlacFileOutput write header failed.");
+    return SV_INIT_ERROR;
+  }
+  pending_bytes_ = 0;
+  opened_ = true;
+  return SV_NO_ERROR;
+}
+
+size_t SVFlacFileOutput::Write(const void* data, size_t len) {
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  size_t consumed = 0;
+  while(consumed < len) {
+    size_t chunk = std::min(len - consumed, pending_.size() - pending_bytes_);
+    memcpy(pending_.data() + pending_bytes_, src + consumed, chunk);
+    pending_bytes_ += chunk;
+    consumed += chunk;
+    if(pending_bytes_ == pending_.size() && !EncodePending()) {
+      break;
+    }
+  }
+  return consumed;
+}
+
+bool SVFlacFileOutput::EncodePending() {
+  const size_t frame_bytes = format_.BytesPerFrame();
+  const int32_t num_frames = static_cast<int32_t>(pending_bytes_ / frame_bytes);
+  const size_t samples = static_cast<size_t>(num_frames) * format_.channels;
+  pending_bytes_ = 0;
+  if(num_frames == 0) {
+    return true;
+  }
+
+  const uint8_t* packed = pending_.data();
+  if(format_.sample_format == SV_SAMPLE_F32) {
+    SVConvert().f32_to_i24(reinterpret_cast<const float*>(pending_.data()), packed_block_.data(), samples);
+    packed = packed_block_.data();
+  }
+  int32_t* dst = int_block_.data();
+  if(format_.sample_format == SV_SAMPLE_I16) {
+    const int16_t* src = reinterpret_cast<const int16_t*>(packed);
+    for(size_t i = 0; i < samples; i++) {
+      dst[i] = src[i];
+    }
+  } else {
+    for(size_t i = 0; i < samples; i++) {
+      const uint8_t* s = packed + i * 3;
+      uint32_t value = static_cast<uint32_t>(s[0]) << 8 | static_cast<uint32_t>(s[1]) << 16 |
+                       static_cast<uint32_t>(s[2]) << 24;
+      dst[i] = static_cast<int32_t>(value) >> 8;
+    }
+  }
+
+  const std::vector<uint8_t>& frame = encoder_.EncodeBlock(dst, num_frames);
+  if(output_->Write(frame.data(), frame.size()) != frame.size()) {
+    AV_LOGE("SVFlacFileOutput write frame failed.");
+    return false;
+  }
+  return true;
+}
+
+int SVFlacFileOutput::WriteAt(uint64_t offset, const void* data, size_t len) {
+  return output_->WriteAt(offset, data, len);
+}
+
+int SVFlacFileOutput::PatchHeader() {
+  uint8_t header[SV_FLAC_HEADER_SIZE];
+  size_t header_size = encoder_.BuildHeader(header);
+  return output_->WriteAt(0, header, header_size);
+}
+
+int SVFlacFileOutput::Flush() {
+  // Only the last frame may be shorter than the block size, a partial block waits for more data.
+  PatchHeader();
+  return output_->Flush();
+}
+
+int SVFlacFileOutput::Close() {
+  if(!opened_) {
+    return SV_NO_ERROR;
+  }
+  opened_ = false;
+  EncodePending();
+  PatchHeader();
+
+  const SVFlacEncoderStats& stats = encoder_.stats();
+  double seconds = static_cast<double>(stats.frames_encoded) / format_.sample_rate;
+  AV_LOGI("SVFlacFileOutput closed, %.1fs audio, ratio:%.3f, encode:%.2fms (%.1fx realtime)",
+          seconds, stats.input_bytes ? static_cast<double>(stats.output_bytes) / stats.input_bytes : 0.0,
+          stats.encode_ns / 1e6, stats.encode_ns ? seconds * 1e9 / stats.encode_ns : 0.0);
+  return output_->Close();
+}
+
+// Frame header as written by SVFlacEncoder::EncodeBlock(). Returns its length, 0 when
+// |data| does not start with a valid one.
+static size_t ParseFrameHeader(const uint8_t* data, size_t len, uint32_t* number, int32_t* block_frames) {
+  if(len < 6 || data[0] != 0xFF || data[1] != 0xF8) {
+    return 0;
+  }
+  const int block_code = data[2] >> 4;
+  size_t pos = 4;
+  int ones = 0;
+  while(ones < 8 && (data[pos] & (0x80 >> ones))) {
+    ones++;
+  }
+  if(ones == 1 || ones > 6) {
+    return 0;
+  }
+  const size_t extra = ones == 0 ? 0 : ones - 1;
+  if(len < pos + 1 + extra + 3) {
+    return 0;
+  }
+  uint32_t value = ones == 0 ? data[pos] : data[pos] & (0x7F >> ones);
+  for(size_t i = 1; i <= extra; i++) {
+    if((data[pos + i] & 0xC0) != 0x80) {
+      return 0;
+    }
+    value = value << 6 | (data[pos + i] & 0x3F);
+  }
+  pos += 1 + extra;
+  if(block_code == 12) {
+    *block_frames = SV_FLAC_BLOCK_FRAMES;
+  } else if(block_code == 6) {
+    *block_frames = data[pos++] + 1;
+  } else if(block_code == 7) {
+    *block_frames = (data[pos] << 8 | data[pos + 1]) + 1;
+    pos += 2;
+  } else {
+    return 0;
+  }
+  if(Crc8(data, pos) != data[pos]) {
+    return 0;
+  }
+  *number = value;
+  return pos + 1;
+}
+
+int SVFlacRepairFile(const std::string& file_path, uint64_t length, uint64_t* frames) {
+  static bool crc_ready = InitCrcTables();
+  (void) crc_ready;
+  int fd = open(file_path.c_str(), O_RDWR);
+  if(fd < 0) {
+    AV_LOGW("SVFlacRepairFile open %s failed: %s", file_path.c_str(), strerror(errno));
+    return SV_INIT_ERROR;
+  }
+  struct stat st;
+  if(fstat(fd, &st) == 0) {
+    length = std::min<uint64_t>(length, static_cast<uint64_t>(st.st_size));
+  }
+  void* map = length >= SV_FLAC_HEADER_SIZE ? mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  const uint8_t* data = static_cast<const uint8_t*>(map);
+  // A single STREAMINFO block is all the writer puts in front of the frames.
+  if(map == MAP_FAILED || memcmp(data, "fLaC", 4) != 0 || data[4] != 0x80) {
+    AV_LOGW("SVFlacRepairFile %s has no usable header.", file_path.c_str());
+    if(map != MAP_FAILED) {
+      munmap(map, length);
+    }
+    close(fd);
+    return SV_INIT_ERROR;
+  }
+
+  size_t pos = SV_FLAC_HEADER_SIZE;
+  uint32_t expected = 0;
+  uint64_t total_frames = 0;
+  while(pos < length) {
+    uint32_t number;
+    int32_t block_frames;
+    const size_t header_len = ParseFrameHeader(data + pos, length - pos, &number, &block_frames);
+    if(header_len == 0 || number != expected) {
+      break;
+    }
+    // The frame ends at the first CRC-16 match followed by the end of the data or by the
+    // header of the next frame, a match inside the residuals is followed by neither.
+    uint16_t crc = Crc16(data + pos, header_len);
+    size_t end = 0;
+    for(size_t q = pos + header_len; q + 2 <= length && end == 0; q++) {
+      if(crc == (data[q] << 8 | data[q + 1])) {
+        uint32_t next_number;
+        int32_t next_frames;
+        const size_t next = q + 2;
+        if(next == length || (ParseFrameHeader(data + next, length - next, &next_number, &next_frames) > 0 &&
+                              next_number == expected + 1)) {
+          end = next;
+        }
+      }
+      crc = Crc16Update(crc, data[q]);
+    }
+    if(end == 0) {
+      break;
+    }
+    total_frames += block_frames;
+    expected++;
+    pos = end;
+  }
+  uint8_t packed[8];
+  memcpy(packed, data + 18, sizeof(packed));
+  munmap(map, length);
+
+  // Sample rate, channels and bits stay, the low 36 bits are the total frame count.
+  uint64_t value = 0;
+  for(uint8_t byte : packed) {
+    value = value << 8 | byte;
+  }
+  value = (value & ~0xFFFFFFFFFull) | (total_frames & 0xFFFFFFFFFull);
+  PutBE(packed, value, 8);
+  int result = SV_NO_ERROR;
+  if(ftruncate(fd, static_cast<off_t>(pos)) != 0 || pwrite(fd, packed, sizeof(packed), 18) != sizeof(packed)) {
+    AV_LOGW("SVFlacRepairFile %s failed: %s", file_path.c_str(), strerror(errno));
+    result = SV_INIT_ERROR;
+  }
+  close(fd);
+  *frames = total_frames;
+  return result;
+}
+
+}
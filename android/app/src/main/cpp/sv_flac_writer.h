@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_FLAC_WRITER_H
+#define AOS_AUDIO_RECORD_SV_FLAC_WRITER_H
+
+#include <vector>
+#include "sv_common.h"
+#include "sv_file_output.h"
+
+namespace sv_recorder {
+
+// 4096 frames is the FLAC reference block size, about 85ms at 48kHz.
+const int32_t SV_FLAC_BLOCK_FRAMES = 4096;
+const int SV_FLAC_MAX_CHANNELS = 8;
+
+struct SVFlacEncoderStats {
+    uint64_t frames_encoded;
+    uint64_t input_bytes;
+    uint64_t output_bytes;
+    uint64_t encode_ns;
+};
+
+// Minimal FLAC encoder: fixed block size, CONSTANT/VERBATIM/FIXED subframes with
+// partitioned Rice residuals and stereo decorrelation. Integer PCM only, up to 24 bits.
+class SVFlacEncoder {
+
+public:
+    SVFlacEncoder();
+
+    int Init(int sample_rate, int channels, int bits_per_sample);
+    // Encodes one block of interleaved samples into a complete FLAC frame.
+    // |num_frames| is at most SV_FLAC_BLOCK_FRAMES; only the last block may be shorter.
+    const std::vector<uint8_t>& EncodeBlock(const int32_t* samples, int32_t num_frames);
+    // "fLaC" marker plus the STREAMINFO block, reflecting the frames encoded so far.
+    size_t BuildHeader(uint8_t* header) const;
+
+    const SVFlacEncoderStats& stats() const { return stats_; }
+
+private:
+    class BitWriter;
+    void EncodeSubframe(BitWriter& bits, const int32_t* samples, int32_t num_frames, int bps);
+
+private:
+    int sample_rate_;
+    int channels_;
+    int bits_per_sample_;
+    uint32_t frame_number_;
+    uint64_t total_frames_;
+    uint32_t min_frame_bytes_;
+    uint32_t max_frame_bytes_;
+    std::vector<int32_t> planes_[SV_FLAC_MAX_CHANNELS];
+    std::vector<int32_t> mid_;
+    std::vector<int32_t> side_;
+    std::vector<int32_t> residual_;
+    std::vector<uint8_t> frame_;
+    SVFlacEncoderStats stats_;
+};
+
+// Streaming FLAC container on top of another ISVFileOutput. Incoming PCM is batched into
+// SV_FLAC_BLOCK_FRAMES blocks and encoded on the disk writer thread, so the audio callback
+// only pays for the ring copy. F32 captures are stored as 24-bit FLAC. STREAMINFO is
+// patched on Flush() and Close().
+class SVFlacFileOutput : public ISVFileOutput {
+
+public:
+    SVFlacFileOutput(ISVFileOutput::Ptr output, const SVAudioFormat& format);
+    ~SVFlacFileOutput() override;
+    int Open(const std::string& file_path) override;
+    size_t Write(const void* data, size_t len) override;
+    int WriteAt(uint64_t offset, const void* data, size_t len) override;
+    int Flush() override;
+    int Close() override;
+    uint64_t Size() const override { return output_->Size(); }
+    SVFileOutputStats GetStats() const override { return output_->GetStats(); }
+
+    const SVFlacEncoderStats& encoder_stats() const { return encoder_.stats(); }
+
+private:
+    bool EncodePending();
+    int PatchHeader();
+
+private:
+    ISVFileOutput::Ptr output_;
+    SVAudioFormat format_;
+    SVFlacEncoder encoder_;
+    std::vector<uint8_t> pending_;
+    size_t pending_bytes_;
+    std::vector<uint8_t> packed_block_;
+    std::vector<int32_t> int_block_;
+    bool opened_;
+};
+
+// Makes a FLAC file written by SVFlacFileOutput that was never closed decodable: walks the
+// frames in the first |length| bytes, cuts off a torn last frame and stores the frames kept
+// in STREAMINFO. |frames| receives the frames kept.
+int SVFlacRepairFile(const std::string& file_path, uint64_t length, uint64_t* frames);
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_FLAC_WRITER_H
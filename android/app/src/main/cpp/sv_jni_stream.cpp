@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_jni_stream.h"
+#include "log.h"
+
+namespace sv_recorder {
+
+std::shared_ptr<SVJniStreamListener> SVJniStreamListener::Create(JNIEnv* env, jobject listener) {
+  if(!listener) {
+    return nullptr;
+  }
+  JavaVM* vm = nullptr;
+  if(env->GetJavaVM(&vm) != JNI_OK) {
+    return nullptr;
+  }
+  jclass clazz = env->GetObjectClass(listener);
+  jmethodID on_chunk = env->GetMethodID(clazz, "onAudioChunk", "(Ljava/nio/ByteBuffer;JIJ)V");
+  env->DeleteLocalRef(clazz);
+  if(!on_chunk) {
+    AV_LOGE("SVJniStreamListener onAudioChunk not found.");
+    env->ExceptionClear();
+    return nullptr;
+  }
+  return std::shared_ptr<SVJniStreamListener>(
+          new SVJniStreamListener(vm, env->NewGlobalRef(listener), on_chunk));
+}
+
+SVJniStreamListener::SVJniStreamListener(JavaVM* vm, jobject listener, jmethodID on_chunk)
+  : vm_(vm), env_(nullptr), listener_(listener), on_chunk_(on_chunk), buffer_count_(0) {
+}
+
+SVJniStreamListener::~SVJniStreamListener() {
+  // The last reference may be dropped on any thread, attached or not.
+  JNIEnv* env = nullptr;
+  bool attached = false;
+  if(vm_->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) == JNI_EDETACHED) {
+    if(vm_->AttachCurrentThread(&env, nullptr) != JNI_OK) {
+      return;
+    }
+    attached = true;
+  }
+  env->DeleteGlobalRef(listener_);
+  if(attached) {
+    vm_->DetachCurrentThread();
+  }
+}
+
+void SVJniStreamListener::OnStreamStart(uint8_t* const* chunks, int chunk_count, size_t chunk_bytes) {
+  JavaVMAttachArgs args = {JNI_VERSION_1_6, "sv_stream", nullptr};
+  if(vm_->AttachCurrentThread(&env_, &args) != JNI_OK) {
+    AV_LOGE("SVJniStreamListener attach failed.");
+    env_ = nullptr;
+    return;
+  }
+  buffers_.reset(new jobject[chunk_count]);
+  buffer_count_ = chunk_count;
+  for(int i = 0; i < chunk_count; i++) {
+    jobject buffer = env_->NewDirectByteBuffer(chunks[i], static_cast<jlong>(chunk_bytes));
+    buffers_[i] = env_->NewGlobalRef(buffer);
+    env_->DeleteLocalRef(buffer);
+  }
+}
+
+void SVJniStreamListener::OnStreamChunk(const SVStreamChunk& chunk) {
+  if(!env_) {
+    return;
+  }
+  env_->CallVoidMethod(listener_, on_chunk_, buffers_[chunk.index], static_cast<jlong>(chunk.sequence),
+                       static_cast<jint>(chunk.size), static_cast<jlong>(chunk.timestamp_ns));
+  if(env_->ExceptionCheck()) {
+    // Keep delivering, a throwing listener must not take the recording down.
+    env_->ExceptionDescribe();
+    env_->ExceptionClear();
+  }
+}
+
+void SVJniStreamListener::OnStreamStop() {
+  if(!env_) {
+    return;
+  }
+  for(int i = 0; i < buffer_count_; i++) {
+    env_->DeleteGlobalRef(buffers_[i]);
+  }
+  buffers_.reset();
+  buffer_count_ = 0;
+  env_ = nullptr;
+  vm_->DetachCurrentThread();
+}
+
+}
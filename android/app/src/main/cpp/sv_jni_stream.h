@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_JNI_STREAM_H
+#define AOS_AUDIO_RECORD_SV_JNI_STREAM_H
+
+#include <jni.h>
+#include <memory>
+#include "sv_stream_sink.h"
+
+namespace sv_recorder {
+
+// Forwards SVStreamSink chunks to a Kotlin SVAudioStreamListener.
+// The delivery thread attaches to the VM once per recording, and every pool chunk is wrapped
+// in a direct ByteBuffer up front, so a chunk costs one CallVoidMethod and no Java allocation.
+class SVJniStreamListener : public ISVStreamListener {
+
+public:
+    // |listener| is a local reference, a global one is kept.
+    static std::shared_ptr<SVJniStreamListener> Create(JNIEnv* env, jobject listener);
+    ~SVJniStreamListener() override;
+
+    void OnStreamStart(uint8_t* const* chunks, int chunk_count, size_t chunk_bytes) override;
+    void OnStreamChunk(const SVStreamChunk& chunk) override;
+    void OnStreamStop() override;
+
+private:
+    SVJniStreamListener(JavaVM* vm, jobject listener, jmethodID on_chunk);
+
+private:
+    JavaVM* vm_;
+    JNIEnv* env_;
+    jobject listener_;
+    jmethodID on_chunk_;
+    std::unique_ptr<jobject[]> buffers_;
+    int buffer_count_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_JNI_STREAM_H
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_latency_tuner.h"
+#include <algorithm>
+#include <climits>
+#include "log.h"
+
+namespace sv_recorder {
+
+SVLatencyTuner::SVLatencyTuner()
+  : sample_rate_(0), frames_per_burst_(0), capacity_(0), min_size_(0), max_size_(0), last_xruns_(0),
+    window_start_ns_(0), window_frames_(0), min_lateness_(0), max_lateness_(0), epoch_start_ns_(0), peak_wanted_(0),
+    buffer_size_(0),
+    grows_(0), shrinks_(0), xruns_(0), jitter_frames_(0) {
+}
+
+void SVLatencyTuner::Configure(const SVLatencyConfig& config, int sample_rate) {
+  config_ = config;
+  sample_rate_ = sample_rate;
+}
+
+void SVLatencyTuner::Init(int32_t frames_per_burst, int32_t capacity, int32_t buffer_size, int32_t min_bursts) {
+  frames_per_burst_ = std::max(0, frames_per_burst);
+  capacity_ = capacity;
+  min_size_ = std::min(capacity, frames_per_burst_ * std::max(1, min_bursts));
+  max_size_ = capacity;
+  if(IsEnabled() && config_.adaptive && sample_rate_ > 0) {
+    if(config_.max_latency_ms > 0) {
+      // Whole bursts only, and the writer keeps its minimum batch of the budget.
+      const int64_t max_ms = std::max(0, config_.max_latency_ms - SV_LATENCY_MIN_WRITER_BATCH_MS);
+      const int64_t bursts = max_ms * sample_rate_ / 1000 / frames_per_burst_;
+      max_size_ = std::max<int64_t>(min_size_, std::min<int64_t>(capacity, bursts * frames_per_burst_));
+    }
+    min_size_ = std::min(max_size_, std::max(min_size_,
+                                             RoundToBursts(int64_t(config_.min_latency_ms) * sample_rate_ / 1000)));
+    buffer_size = std::max(min_size_, std::min(buffer_size, max_size_));
+  }
+  last_xruns_ = 0;
+  window_start_ns_ = 0;
+  buffer_size_.store(buffer_size, std::memory_order_relaxed);
+  grows_.store(0, std::memory_order_relaxed);
+  shrinks_.store(0, std::memory_order_relaxed);
+  xruns_.store(0, std::memory_order_relaxed);
+  jitter_frames_.store(0, std::memory_order_relaxed);
+}
+
+int32_t SVLatencyTuner::RoundToBursts(int64_t frames) const {
+  const int64_t bursts = (frames + frames_per_burst_ - 1) / frames_per_burst_;
+  return static_cast<int32_t>(std::min<int64_t>(bursts * frames_per_burst_, INT32_MAX));
+}
+
+void SVLatencyTuner::ResetWindow(int64_t now_ns) {
+  window_start_ns_ = now_ns;
+  window_frames_ = 0;
+  min_lateness_ = INT64_MAX;
+  max_lateness_ = INT64_MIN;
+}
+
+int32_t SVLatencyTuner::OnCallback(int64_t now_ns, int32_t num_frames, int32_t xruns) {
+  if(!IsEnabled()) {
+    return 0;
+  }
+  const int32_t size = buffer_size();
+  bool xrun = false;
+  if(xruns >= 0 && xruns != last_xruns_) {
+    xrun = xruns > last_xruns_;
+    // A reopened stream counts from zero again.
+    last_xruns_ = xruns;
+  }
+  if(!config_.adaptive) {
+    if(!xrun || size >= max_size_) {
+      return 0;
+    }
+    const int32_t next = std::min(size + frames_per_burst_, max_size_);
+    grows_.fetch_add(1, std::memory_order_relaxed);
+    xruns_.fetch_add(1, std::memory_order_relaxed);
+    AV_LOGW_RT("SVLatencyTuner xruns:%d, buffer %d -> %d frames.", xruns, size, next);
+    return next;
+  }
+
+  if(window_start_ns_ == 0) {
+    // Streams are at their most erratic right after the start, nothing shrinks before the holdoff.
+    ResetWindow(now_ns);
+    epoch_start_ns_ = now_ns;
+    peak_wanted_ = 0;
+  }
+  const int64_t lateness = (now_ns - window_start_ns_) * sample_rate_ / 1000000000LL - window_frames_;
+  window_frames_ += num_frames;
+  min_lateness_ = std::min(min_lateness_, lateness);
+  max_lateness_ = std::max(max_lateness_, lateness);
+  const int64_t spread = max_lateness_ - min_lateness_;
+  if(xruns < 0 && spread + frames_per_burst_ > size) {
+    // Later than the buffer could hold, the device has overwritten frames.
+    xrun = true;
+  }
+
+  int64_t wanted = spread * SV_LATENCY_HEADROOM_PERCENT / 100 + frames_per_burst_;
+  if(xrun) {
+    xruns_.fetch_add(1, std::memory_order_relaxed);
+    wanted = std::max<int64_t>(wanted, size + frames_per_burst_);
+  }
+  peak_wanted_ = std::max(peak_wanted_, wanted);
+  int32_t next = size;
+  if(wanted > size) {
+    next = std::min(RoundToBursts(wanted), max_size_);
+    // Growing starts a new holdoff, the need that caused it counts towards it.
+    epoch_start_ns_ = now_ns;
+    peak_wanted_ = wanted;
+  }
+  if(now_ns - window_start_ns_ >= SV_LATENCY_WINDOW_MS * 1000000LL) {
+    jitter_frames_.store(static_cast<int32_t>(std::min<int64_t>(spread, INT32_MAX)), std::memory_order_relaxed);
+    if(next == size && now_ns - epoch_start_ns_ >= SV_LATENCY_SHRINK_HOLDOFF_MS * 1000000LL) {
+      // The largest need of the whole holdoff, a window between two stalls proves nothing.
+      const int32_t target = std::max(RoundToBursts(peak_wanted_), min_size_);
+      if(target < size) {
+        next = target;
+      }
+      epoch_start_ns_ = now_ns;
+      peak_wanted_ = 0;
+    }
+    ResetWindow(now_ns);
+  }
+  if(xrun) {
+    // Dropped frames never arrive, the lateness starts over from here.
+    ResetWindow(now_ns);
+  }
+  if(next == size) {
+    return 0;
+  }
+  if(next > size) {
+    grows_.fetch_add(1, std::memory_order_relaxed);
+    AV_LOGW_RT("SVLatencyTuner jitter:%lld frames%s, buffer %d -> %d frames.", (long long) spread,
+               xrun ? ", xrun" : "", size, next);
+  } else {
+    shrinks_.fetch_add(1, std::memory_order_relaxed);
+    AV_LOGD_RT("SVLatencyTuner calm, buffer %d -> %d frames.", size, next);
+  }
+  return next;
+}
+
+void SVLatencyTuner::SetBufferSize(int32_t frames) {
+  if(frames > 0) {
+    buffer_size_.store(frames, std::memory_order_relaxed);
+  }
+}
+
+int32_t SVLatencyTuner::WriterBatchMs() const {
+  if(config_.max_latency_ms <= 0 || sample_rate_ <= 0) {
+    return 0;
+  }
+  const int32_t buffer_ms = static_cast<int32_t>(int64_t(buffer_size()) * 1000 / sample_rate_);
+  return std::max(SV_LATENCY_MIN_WRITER_BATCH_MS, config_.max_latency_ms - buffer_ms);
+}
+
+}
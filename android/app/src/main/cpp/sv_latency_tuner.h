@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_LATENCY_TUNER_H
+#define AOS_AUDIO_RECORD_SV_LATENCY_TUNER_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace sv_recorder {
+
+// Buffer depth a low-latency stream starts with, in bursts.
+const int32_t SV_LOW_LATENCY_INITIAL_BURSTS = 2;
+const int32_t SV_MAX_LATENCY_MS = 1000;
+// Adaptive sizing: the buffer holds the worst callback lateness of a window times this
+// percentage, plus the burst being read.
+const int32_t SV_LATENCY_HEADROOM_PERCENT = 150;
+const int32_t SV_LATENCY_WINDOW_MS = 1000;
+// The buffer shrinks at most once per holdoff, to the largest need seen during it.
+const int32_t SV_LATENCY_SHRINK_HOLDOFF_MS = 10000;
+// The writer never batches less than this, whatever is left of the latency budget.
+const int32_t SV_LATENCY_MIN_WRITER_BATCH_MS = 10;
+
+struct SVLatencyConfig {
+    // Sizes the buffer from the callback jitter, otherwise it only grows on xruns.
+    bool adaptive = false;
+    // 0 for one burst.
+    int32_t min_latency_ms = 0;
+    // Bound of buffer plus writer batch, 0 for the capacity.
+    int32_t max_latency_ms = 0;
+};
+
+// Buffer sizing of a stream. A low-latency stream starts a couple of bursts deep and grows
+// by one burst whenever the stream's xrun counter moves, up to the capacity. The adaptive
+// mode also watches how far each callback runs behind the device clock: the buffer grows
+// at once to hold the worst lateness seen, and after a holdoff without growing shrinks to
+// what the holdoff needed at most, within the configured latency bounds. Only the
+// decision lives here, the backend applies the size, so the logic also runs on a host.
+class SVLatencyTuner {
+
+public:
+    SVLatencyTuner();
+
+    // Before Init(), once the stream rate is known.
+    void Configure(const SVLatencyConfig& config, int sample_rate);
+    // Called whenever a stream is opened, before it starts. |frames_per_burst| 0 only
+    // records |buffer_size| and never tunes. The adaptive mode clamps |buffer_size| into
+    // its bounds, the backend applies buffer_size() afterwards. The buffer never gets
+    // smaller than |min_bursts|.
+    void Init(int32_t frames_per_burst, int32_t capacity, int32_t buffer_size, int32_t min_bursts = 1);
+    bool IsEnabled() const { return frames_per_burst_ > 0; }
+    bool adaptive() const { return config_.adaptive; }
+
+    // Audio thread, once per callback of |num_frames| with the stream's cumulative xrun
+    // count, -1 when the backend has none and overflows are inferred from the timing.
+    // Returns the buffer size to apply when it changes, 0 otherwise.
+    int32_t OnCallback(int64_t now_ns, int32_t num_frames, int32_t xruns);
+    // The size the stream actually accepted, errors (negative values) are ignored.
+    void SetBufferSize(int32_t frames);
+    // What the writer may batch without breaking the latency bound at the current buffer
+    // size, 0 without a bound.
+    int32_t WriterBatchMs() const;
+
+    int32_t buffer_size() const { return buffer_size_.load(std::memory_order_relaxed); }
+    int32_t capacity() const { return capacity_; }
+    int32_t min_size() const { return min_size_; }
+    int32_t max_size() const { return max_size_; }
+    uint32_t adjustments() const { return grows() + shrinks(); }
+    uint32_t grows() const { return grows_.load(std::memory_order_relaxed); }
+    uint32_t shrinks() const { return shrinks_.load(std::memory_order_relaxed); }
+    // Xruns reported or inferred while tuning.
+    uint32_t xruns() const { return xruns_.load(std::memory_order_relaxed); }
+    // Spread of the callback lateness over the last complete window.
+    int32_t jitter_frames() const { return jitter_frames_.load(std::memory_order_relaxed); }
+
+private:
+    int32_t RoundToBursts(int64_t frames) const;
+    void ResetWindow(int64_t now_ns);
+
+private:
+    SVLatencyConfig config_;
+    int sample_rate_;
+    int32_t frames_per_burst_;
+    int32_t capacity_;
+    int32_t min_size_;
+    int32_t max_size_;
+    int32_t last_xruns_;
+    // Audio thread only. Lateness is the frames the device captured since |window_start_ns_|
+    // minus the frames delivered, its spread over the window is the jitter to absorb.
+    int64_t window_start_ns_;
+    int64_t window_frames_;
+    int64_t min_lateness_;
+    int64_t max_lateness_;
+    // Start of the holdoff and the largest size wanted during it.
+    int64_t epoch_start_ns_;
+    int64_t peak_wanted_;
+    std::atomic<int32_t> buffer_size_;
+    std::atomic<uint32_t> grows_;
+    std::atomic<uint32_t> shrinks_;
+    std::atomic<uint32_t> xruns_;
+    std::atomic<int32_t> jitter_frames_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_LATENCY_TUNER_H
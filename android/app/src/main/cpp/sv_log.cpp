@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_log.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include "log.h"
+#include "sv_common.h"
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#endif
+
+namespace sv_recorder {
+
+const size_t SV_LOG_LINE_BYTES = 1024;
+const uint64_t SV_LOG_RECORDS = 256;
+const int64_t SV_LOG_POLL_MS = 20;
+
+enum SV_LOG_BACKEND {
+  SV_LOG_BACKEND_DEFAULT = 0,
+  SV_LOG_BACKEND_FILE = 1,
+  SV_LOG_BACKEND_CALLBACK = 2,
+};
+
+static std::mutex g_log_mutex;
+static SV_LOG_BACKEND g_backend = SV_LOG_BACKEND_DEFAULT;
+static FILE* g_file = nullptr;
+static SVLogCallback g_callback = nullptr;
+static void* g_callback_user = nullptr;
+static std::atomic<int> g_level(SV_LOG_LEVEL_DEBUG);
+
+static char LevelLetter(int level) {
+  static const char letters[] = "DIWEF";
+  return level >= SV_LOG_LEVEL_DEBUG && level <= SV_LOG_LEVEL_FATAL ? letters[level] : '?';
+}
+
+static void Emit(int level, const char* tag, const char* message) {
+  std::lock_guard<std::mutex> lock(g_log_mutex);
+  switch(g_backend) {
+    case SV_LOG_BACKEND_FILE:
+      fprintf(g_file, "%c/%s: %s\n", LevelLetter(level), tag, message);
+      fflush(g_file);
+      break;
+    case SV_LOG_BACKEND_CALLBACK:
+      g_callback(g_callback_user, level, tag, message);
+      break;
+    default:
+#ifdef __ANDROID__
+      __android_log_write(ANDROID_LOG_DEBUG + level, tag, message);
+#else
+      fprintf(stderr, "%c/%s: %s\n", LevelLetter(level), tag, message);
+#endif
+      break;
+  }
+}
+
+static void CloseFile() {
+  if(g_file) {
+    fclose(g_file);
+    g_file = nullptr;
+  }
+}
+
+void SVLogPrint(int level, const char* tag, const char* format, ...) {
+  if(level < g_level.load(std::memory_order_relaxed)) {
+    return;
+  }
+  char message[SV_LOG_LINE_BYTES];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+  Emit(level, tag, message);
+}
+
+void SVLogUseDefault() {
+  std::lock_guard<std::mutex> lock(g_log_mutex);
+  CloseFile();
+  g_backend = SV_LOG_BACKEND_DEFAULT;
+}
+
+bool SVLogOpenFile(const char* path) {
+  FILE* file = fopen(path, "a");
+  if(!file) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(g_log_mutex);
+  CloseFile();
+  g_file = file;
+  g_backend = SV_LOG_BACKEND_FILE;
+  return true;
+}
+
+void SVLogSetCallback(SVLogCallback callback, void* user) {
+  std::lock_guard<std::mutex> lock(g_log_mutex);
+  CloseFile();
+  g_callback = callback;
+  g_callback_user = user;
+  g_backend = callback ? SV_LOG_BACKEND_CALLBACK : SV_LOG_BACKEND_DEFAULT;
+}
+
+void SVLogSetLevel(int level) {
+  g_level.store(level, std::memory_order_relaxed);
+}
+
+int SVLogGetLevel() {
+  return g_level.load(std::memory_order_relaxed);
+}
+
+bool SVLogRateLimiter::Allow(int64_t interval_ms, uint32_t* suppressed) {
+  int64_t now = SVNowNs();
+  int64_t next = next_ns_.load(std::memory_order_relaxed);
+  // Losing the race against another thread counts as suppressed as well.
+  if(now < next || !next_ns_.compare_exchange_strong(next, now + interval_ms * 1000000,
+                                                     std::memory_order_relaxed)) {
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  *suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+  return true;
+}
+
+// Formats a deferred record. Every conversion is rebuilt with the width of the captured
+// argument, so "%d" with an int64 or "%zu" with a size_t both come out right.
+static void FormatRecord(const char* format, const SVLogArg* args, int arg_count, char* out, size_t size) {
+  size_t len = 0;
+  int next_arg = 0;
+  const char* p = format;
+  while(*p && len + 1 < size) {
+    if(*p != '%') {
+      out[len++] = *p++;
+      continue;
+    }
+    if(p[1] == '%') {
+      out[len++] = '%';
+      p += 2;
+      continue;
+    }
+    char spec[32] = "%";
+    size_t spec_len = 1;
+    p++;
+    while(*p && strchr("-+ #0123456789.", *p) && spec_len < sizeof(spec) - 4) {
+      spec[spec_len++] = *p++;
+    }
+    while(*p && strchr("hlLqjzt", *p)) {
+      p++;
+    }
+    char conversion = *p ? *p++ : 's';
+    if(next_arg >= arg_count) {
+      break;
+    }
+    const SVLogArg& arg = args[next_arg++];
+    int written;
+    char* dst = out + len;
+    size_t room = size - len;
+    switch(conversion) {
+      case 'd': case 'i':
+        memcpy(spec + spec_len, "lld", 4);
+        written = snprintf(dst, room, spec, arg.type == SVLogArg::DOUBLE ?
+                           static_cast<long long>(arg.d) : static_cast<long long>(arg.i));
+        break;
+      case 'u': case 'x': case 'X': case 'o':
+        spec[spec_len] = 'l'; spec[spec_len + 1] = 'l';
+        spec[spec_len + 2] = conversion; spec[spec_len + 3] = '\0';
+        written = snprintf(dst, room, spec, static_cast<unsigned long long>(arg.u));
+        break;
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        spec[spec_len] = conversion; spec[spec_len + 1] = '\0';
+        written = snprintf(dst, room, spec, arg.type == SVLogArg::DOUBLE ?
+                           arg.d : static_cast<double>(arg.i));
+        break;
+      case 'c':
+        memcpy(spec + spec_len, "c", 2);
+        written = snprintf(dst, room, spec, static_cast<int>(arg.i));
+        break;
+      case 's':
+        memcpy(spec + spec_len, "s", 2);
+        written = snprintf(dst, room, spec, arg.type == SVLogArg::STRING && arg.s ? arg.s : "(?)");
+        break;
+      default:
+        memcpy(spec + spec_len, "p", 2);
+        written = snprintf(dst, room, spec, arg.p);
+        break;
+    }
+    if(written < 0) {
+      break;
+    }
+    len += static_cast<size_t>(written) < room ? written : room - 1;
+  }
+  out[len] = '\0';
+}
+
+struct SVDeferredLog::Record {
+  std::atomic<uint64_t> sequence;
+  int32_t level;
+  int32_t arg_count;
+  const char* format;
+  SVLogArg args[SV_LOG_MAX_ARGS];
+};
+
+static std::mutex g_drain_mutex;
+
+SVDeferredLog& SVDeferredLog::Instance() {
+  // Trivially destructible, so it stays usable for the detached thread during exit.
+  static SVDeferredLog instance;
+  return instance;
+}
+
+SVDeferredLog::SVDeferredLog()
+  : records_(new Record[SV_LOG_RECORDS]), write_pos_(0), read_pos_(0), dropped_(0),
+    reported_dropped_(0), started_(false) {
+  for(uint64_t i = 0; i < SV_LOG_RECORDS; i++) {
+    records_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+void SVDeferredLog::Start() {
+  bool expected = false;
+  if(started_.compare_exchange_strong(expected, true)) {
+    std::thread(&SVDeferredLog::DrainLoop, this).detach();
+  }
+}
+
+void SVDeferredLog::Flush() {
+  Drain();
+}
+
+bool SVDeferredLog::Post(int level, const char* format, const SVLogArg* args, int arg_count) {
+  if(level < g_level.load(std::memory_order_relaxed)) {
+    return true;
+  }
+  // Bounded MPSC queue: a slot is free for position |pos| once its sequence equals |pos|,
+  // and readable once the producer published |pos| + 1.
+  uint64_t pos = write_pos_.load(std::memory_order_relaxed);
+  Record* record;
+  for(;;) {
+    record = &records_[pos % SV_LOG_RECORDS];
+    int64_t diff = static_cast<int64_t>(record->sequence.load(std::memory_order_acquire) - pos);
+    if(diff == 0) {
+      if(write_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if(diff < 0) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      pos = write_pos_.load(std::memory_order_relaxed);
+    }
+  }
+  record->level = level;
+  record->format = format;
+  record->arg_count = arg_count;
+  for(int i = 0; i < arg_count; i++) {
+    record->args[i] = args[i];
+  }
+  record->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+int SVDeferredLog::Drain() {
+  std::lock_guard<std::mutex> lock(g_drain_mutex);
+  char message[SV_LOG_LINE_BYTES];
+  int count = 0;
+  for(;;) {
+    Record& record = records_[read_pos_ % SV_LOG_RECORDS];
+    if(record.sequence.load(std::memory_order_acquire) != read_pos_ + 1) {
+      break;
+    }
+    int level = record.level;
+    FormatRecord(record.format, record.args, record.arg_count, message, sizeof(message));
+    record.sequence.store(read_pos_ + SV_LOG_RECORDS, std::memory_order_release);
+    read_pos_++;
+    Emit(level, TAG, message);
+    count++;
+  }
+  uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+  uint64_t reported = reported_dropped_.exchange(dropped, std::memory_order_relaxed);
+  if(dropped != reported) {
+    snprintf(message, sizeof(message), "SVDeferredLog ring full, dropped %llu records.",
+             (unsigned long long) (dropped - reported));
+    Emit(SV_LOG_LEVEL_WARN, TAG, message);
+  }
+  return count;
+}
+
+void SVDeferredLog::DrainLoop() {
+  for(;;) {
+    if(Drain() == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(SV_LOG_POLL_MS));
+    }
+  }
+}
+
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_LOG_H
+#define AOS_AUDIO_RECORD_SV_LOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+namespace sv_recorder {
+
+enum SV_LOG_LEVEL {
+    SV_LOG_LEVEL_DEBUG = 0,
+    SV_LOG_LEVEL_INFO = 1,
+    SV_LOG_LEVEL_WARN = 2,
+    SV_LOG_LEVEL_ERROR = 3,
+    SV_LOG_LEVEL_FATAL = 4,
+};
+
+// Receives every emitted line, |message| is only valid during the call.
+typedef void (*SVLogCallback)(void* user, int level, const char* tag, const char* message);
+
+// Formats and emits one line right away. Takes a lock, never call it from an audio callback.
+void SVLogPrint(int level, const char* tag, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Backends. Android defaults to logcat, host builds to stderr; each call replaces the
+// previous backend. SVLogOpenFile() appends to |path| and returns false if it can't be opened.
+void SVLogUseDefault();
+bool SVLogOpenFile(const char* path);
+void SVLogSetCallback(SVLogCallback callback, void* user);
+
+// Runtime threshold on top of the compile-time SV_LOG_MIN_LEVEL.
+void SVLogSetLevel(int level);
+int SVLogGetLevel();
+
+// Allows one line per |interval_ms| for a call site and counts what it swallowed.
+// Constant-initialized, so a function-local static costs no init guard.
+class SVLogRateLimiter {
+
+public:
+    constexpr SVLogRateLimiter() : next_ns_(0), suppressed_(0) {}
+
+    // Returns true if the line may be emitted, |*suppressed| is then the number of
+    // lines dropped since the previous one.
+    bool Allow(int64_t interval_ms, uint32_t* suppressed);
+
+private:
+    std::atomic<int64_t> next_ns_;
+    std::atomic<uint32_t> suppressed_;
+};
+
+// One argument of a deferred record, captured by value.
+struct SVLogArg {
+    enum Type : uint8_t { INT, UINT, DOUBLE, STRING, POINTER };
+    Type type;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const char* s;
+        const void* p;
+    };
+};
+
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, SVLogArg>::type
+SVMakeLogArg(T value) {
+  SVLogArg arg; arg.type = SVLogArg::INT; arg.i = value; return arg;
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value, SVLogArg>::type
+SVMakeLogArg(T value) {
+  SVLogArg arg; arg.type = SVLogArg::UINT; arg.u = value; return arg;
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_enum<T>::value, SVLogArg>::type SVMakeLogArg(T value) {
+  SVLogArg arg; arg.type = SVLogArg::INT; arg.i = static_cast<int64_t>(value); return arg;
+}
+
+inline SVLogArg SVMakeLogArg(double value) {
+  SVLogArg arg; arg.type = SVLogArg::DOUBLE; arg.d = value; return arg;
+}
+
+// Only the pointer is recorded: pass string literals or strings that outlive the process.
+inline SVLogArg SVMakeLogArg(const char* value) {
+  SVLogArg arg; arg.type = SVLogArg::STRING; arg.s = value; return arg;
+}
+
+template<typename T>
+inline SVLogArg SVMakeLogArg(const T* value) {
+  SVLogArg arg; arg.type = SVLogArg::POINTER; arg.p = value; return arg;
+}
+
+const int SV_LOG_MAX_ARGS = 6;
+
+// Real-time logging: the producer copies the format pointer and up to SV_LOG_MAX_ARGS
+// arguments into a fixed slot of a lock-free MPSC ring, a background thread formats and
+// emits them. Never allocates, locks or makes a syscall on the calling thread; a full ring
+// drops the record and counts it.
+class SVDeferredLog {
+
+public:
+    static SVDeferredLog& Instance();
+
+    // Starts the formatting thread, idempotent. Call it from a normal thread before any
+    // audio callback can log; records made earlier wait in the ring.
+    void Start();
+    // Formats and emits everything queued on the calling thread.
+    void Flush();
+
+    bool Post(int level, const char* format, const SVLogArg* args, int arg_count);
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    template<typename... Args>
+    void Log(int level, const char* format, Args... args) {
+      static_assert(sizeof...(Args) <= SV_LOG_MAX_ARGS, "too many deferred log arguments");
+      const SVLogArg packed[sizeof...(Args) + 1] = {SVMakeLogArg(args)...};
+      Post(level, format, packed, sizeof...(Args));
+    }
+
+private:
+    SVDeferredLog();
+    void DrainLoop();
+    int Drain();
+
+private:
+    struct Record;
+    Record* records_;
+    alignas(64) std::atomic<uint64_t> write_pos_;
+    alignas(64) uint64_t read_pos_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> reported_dropped_;
+    std::atomic<bool> started_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_LOG_H
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_metrics.h"
+#include <cstdio>
+
+namespace sv_recorder {
+
+static int BucketOf(int64_t value_us) {
+  if(value_us < SV_HISTOGRAM_SUB_BUCKETS) {
+    return static_cast<int>(value_us);
+  }
+  int octave = 63 - __builtin_clzll(static_cast<uint64_t>(value_us));
+  int shift = octave - 2;
+  int bucket = SV_HISTOGRAM_SUB_BUCKETS * (octave - 1) + static_cast<int>((value_us >> shift) & 3);
+  return bucket < SV_HISTOGRAM_BUCKETS ? bucket : SV_HISTOGRAM_BUCKETS - 1;
+}
+
+// Largest value that falls into |bucket|.
+static int64_t BucketUpper(int bucket) {
+  if(bucket < SV_HISTOGRAM_SUB_BUCKETS) {
+    return bucket;
+  }
+  int shift = bucket / SV_HISTOGRAM_SUB_BUCKETS - 1;
+  int64_t lower = static_cast<int64_t>(SV_HISTOGRAM_SUB_BUCKETS + bucket % SV_HISTOGRAM_SUB_BUCKETS) << shift;
+  return lower + (1LL << shift) - 1;
+}
+
+static void AppendFormat(std::string* out, const char* format, long long value) {
+  char text[48];
+  snprintf(text, sizeof(text), format, value);
+  out->append(text);
+}
+
+void SVHistogram::Reset() {
+  for(int i = 0; i < SV_HISTOGRAM_BUCKETS; i++) {
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+void SVHistogram::Record(int64_t value_us) {
+  if(value_us < 0) {
+    value_us = 0;
+  }
+  // Single writer, so load + store instead of read-modify-write.
+  std::atomic<uint32_t>& bucket = buckets_[BucketOf(value_us)];
+  bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  if(value_us > max_.load(std::memory_order_relaxed)) {
+    max_.store(value_us, std::memory_order_relaxed);
+  }
+}
+
+int64_t SVHistogram::Percentile(double percentile) const {
+  uint64_t total = 0;
+  uint32_t counts[SV_HISTOGRAM_BUCKETS];
+  for(int i = 0; i < SV_HISTOGRAM_BUCKETS; i++) {
+    counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if(total == 0) {
+    return 0;
+  }
+  uint64_t rank = static_cast<uint64_t>(total * percentile / 100.0 + 0.5);
+  uint64_t seen = 0;
+  for(int i = 0; i < SV_HISTOGRAM_BUCKETS - 1; i++) {
+    seen += counts[i];
+    if(seen >= rank && seen > 0) {
+      int64_t upper = BucketUpper(i);
+      return upper < max() ? upper : max();
+    }
+  }
+  return max();
+}
+
+void SVHistogram::AppendJson(std::string* out) const {
+  AppendFormat(out, "{\"count\":%lld", static_cast<long long>(count()));
+  AppendFormat(out, ",\"p50\":%lld", Percentile(50));
+  AppendFormat(out, ",\"p90\":%lld", Percentile(90));
+  AppendFormat(out, ",\"p99\":%lld", Percentile(99));
+  AppendFormat(out, ",\"max\":%lld", max());
+  out->append(",\"buckets\":[");
+  for(int i = 0; i < SV_HISTOGRAM_BUCKETS; i++) {
+    AppendFormat(out, i ? ",%lld" : "%lld", buckets_[i].load(std::memory_order_relaxed));
+  }
+  out->append("]}");
+}
+
+SVRecorderMetrics::SVRecorderMetrics() {
+  Reset(0);
+}
+
+void SVRecorderMetrics::Reset(int sample_rate) {
+  sample_rate_ = sample_rate;
+  callbacks_.store(0, std::memory_order_relaxed);
+  frames_delivered_.store(0, std::memory_order_relaxed);
+  first_ns_.store(0, std::memory_order_relaxed);
+  last_ns_.store(0, std::memory_order_relaxed);
+  first_frames_.store(0, std::memory_order_relaxed);
+  xruns_.store(0, std::memory_order_relaxed);
+  period_us_.Reset();
+  duration_us_.Reset();
+  sink_latency_us_.Reset();
+}
+
+void SVRecorderMetrics::OnCallback(int64_t begin_ns, int64_t end_ns, int32_t num_frames) {
+  int64_t last_ns = last_ns_.load(std::memory_order_relaxed);
+  if(last_ns == 0) {
+    first_ns_.store(begin_ns, std::memory_order_relaxed);
+    first_frames_.store(num_frames, std::memory_order_relaxed);
+  } else {
+    period_us_.Record((begin_ns - last_ns) / 1000);
+  }
+  last_ns_.store(begin_ns, std::memory_order_relaxed);
+  duration_us_.Record((end_ns - begin_ns) / 1000);
+  callbacks_.store(callbacks_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  frames_delivered_.store(frames_delivered_.load(std::memory_order_relaxed) + num_frames,
+                          std::memory_order_relaxed);
+}
+
+uint64_t SVRecorderMetrics::FramesExpected() const {
+  int64_t first_ns = first_ns_.load(std::memory_order_relaxed);
+  int64_t last_ns = last_ns_.load(std::memory_order_relaxed);
+  if(first_ns == 0) {
+    return 0;
+  }
+  // The first callback carries audio captured before it fired.
+  return static_cast<uint64_t>((last_ns - first_ns) * 1e-9 * sample_rate_) +
+         first_frames_.load(std::memory_order_relaxed);
+}
+
+void SVRecorderMetrics::AppendJson(std::string* out) const {
+  AppendFormat(out, "\"callbacks\":%lld", static_cast<long long>(callbacks()));
+  AppendFormat(out, ",\"frames_delivered\":%lld", static_cast<long long>(frames_delivered()));
+  AppendFormat(out, ",\"frames_expected\":%lld", static_cast<long long>(FramesExpected()));
+  AppendFormat(out, ",\"xruns\":%lld", xruns());
+  out->append(",\"callback_period_us\":");
+  period_us_.AppendJson(out);
+  out->append(",\"callback_duration_us\":");
+  duration_us_.AppendJson(out);
+  out->append(",\"sink_latency_us\":");
+  sink_latency_us_.AppendJson(out);
+}
+
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_METRICS_H
+#define AOS_AUDIO_RECORD_SV_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace sv_recorder {
+
+// Values below 4us get a bucket each, every power of two above is split into 4 linear
+// sub-buckets (<= 25% error), up to 2^26us; the last bucket holds everything larger.
+const int SV_HISTOGRAM_SUB_BUCKETS = 4;
+const int SV_HISTOGRAM_BUCKETS = SV_HISTOGRAM_SUB_BUCKETS * 25;
+
+// Log-linear histogram of microsecond values with a single writer and any number of readers.
+// Record() is two relaxed atomic stores, cheap enough for the audio callback.
+class SVHistogram {
+
+public:
+    SVHistogram() { Reset(); }
+
+    void Reset();
+    void Record(int64_t value_us);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    int64_t max() const { return max_.load(std::memory_order_relaxed); }
+    // Upper bound of the bucket holding the |percentile| (0..100) value.
+    int64_t Percentile(double percentile) const;
+    // {"count":..,"p50":..,"p90":..,"p99":..,"max":..,"buckets":[..]}
+    void AppendJson(std::string* out) const;
+
+private:
+    std::atomic<uint32_t> buckets_[SV_HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> count_;
+    std::atomic<int64_t> max_;
+};
+
+// Lock-free metrics of one recorder's capture path, written by the audio callback and the
+// disk writer, readable at any time from another thread.
+class SVRecorderMetrics {
+
+public:
+    SVRecorderMetrics();
+
+    // Called when a recording starts.
+    void Reset(int sample_rate);
+    // Audio thread, once per callback with its entry/exit time.
+    void OnCallback(int64_t begin_ns, int64_t end_ns, int32_t num_frames);
+    // Audio thread, with the backend's cumulative xrun counter.
+    void SetXRunCount(int32_t xruns) { xruns_.store(xruns, std::memory_order_relaxed); }
+    // Writer thread, with the age of the oldest queued audio when it drains the ring.
+    void OnSinkLatency(int64_t latency_us) { sink_latency_us_.Record(latency_us); }
+
+    uint64_t callbacks() const { return callbacks_.load(std::memory_order_relaxed); }
+    uint64_t frames_delivered() const { return frames_delivered_.load(std::memory_order_relaxed); }
+    // Frames the nominal sample rate implies for the time since the first callback.
+    uint64_t FramesExpected() const;
+    int32_t xruns() const { return xruns_.load(std::memory_order_relaxed); }
+    const SVHistogram& period_us() const { return period_us_; }
+    const SVHistogram& duration_us() const { return duration_us_; }
+    const SVHistogram& sink_latency_us() const { return sink_latency_us_; }
+
+    // Appends the members of a JSON object, without the braces.
+    void AppendJson(std::string* out) const;
+
+private:
+    int sample_rate_;
+    std::atomic<uint64_t> callbacks_;
+    std::atomic<uint64_t> frames_delivered_;
+    std::atomic<int64_t> first_ns_;
+    std::atomic<int64_t> last_ns_;
+    std::atomic<int32_t> first_frames_;
+    std::atomic<int32_t> xruns_;
+    SVHistogram period_us_;
+    SVHistogram duration_us_;
+    SVHistogram sink_latency_us_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_METRICS_H
@@ -14,46 +14,84 @@ namespace sv_recorder {
 using namespace oboe;
 
 SVOboeRecorder::SVOboeRecorder(std::string file_path):
-initialized_(false), recording_(false) {
+stream_(nullptr), pipeline_(file_path), initialized_(false), recording_(false) {
   AV_LOGI("=== SVOboeRecorder CreateBuilder ===");
-  file_ = fopen( file_path.c_str(), "wb");
+  pipeline_.recovery().SetHandler(this);
 }
 
 SVOboeRecorder::~SVOboeRecorder() {
   AV_LOGI("=== SVOboeRecorder Release Recorder ====");
   DestroyRecorder();
-  if(file_) {
-    fclose(file_);
-    file_ = nullptr;
-  }
 }
 
-int SVOboeRecorder::InitRecording(int sample_rate, int channel) {
+int SVOboeRecorder::InitRecording(int sample_rate, int channel, SV_SAMPLE_FORMAT format) {
 
   if (initialized_) {
     AV_LOGI("oboe recorder has init already.");
     return SV_RESULT::SV_NO_ERROR;
   }
 
-  builder.setDeviceId(0); //Get value from Java AudioManager.
+  pipeline_.BeginInit(OBOE);
+  const SVRecordOptions& options = pipeline_.options();
+  builder.setDeviceId(options.device_id); // From Java AudioManager, kUnspecified (0) lets the system choose.
   builder.setDirection(Direction::Input);
   builder.setPerformanceMode(PerformanceMode::LowLatency);
-  builder.setSharingMode(SharingMode::Shared);
-  builder.setFormat(AudioFormat::I16);
+  // Exclusive access is what gets an input stream onto the MMAP path.
+  builder.setSharingMode(options.low_latency ? SharingMode::Exclusive : SharingMode::Shared);
+  builder.setFormat(ToOboeFormat(format));
   builder.setChannelCount(channel);
   builder.setSampleRate(sample_rate);
   builder.setDataCallback(this);
+  // Oboe closes a disconnected stream itself and reports it through onErrorAfterClose().
+  builder.setErrorCallback(this);
 
-  Result result = builder.openStream(mStream);
-  if (result != Result::OK) {
-    AV_LOGE("InitRecording openStream error:%s", convertToText(result));
+  if (OpenStreamWithFallback() != SV_RESULT::SV_NO_ERROR) {
     return SV_RESULT::SV_INIT_ERROR;
   }
 
+  SV_SAMPLE_FORMAT actual_format;
+  if (!FromOboeFormat(mStream->getFormat(), &actual_format)) {
+    AV_LOGE("InitRecording unsupported stream format:%d", static_cast<int>(mStream->getFormat()));
+    CloseStream();
+    return SV_RESULT::SV_INIT_ERROR;
+  }
+  int result = pipeline_.Prepare({mStream->getSampleRate(), mStream->getChannelCount(), actual_format});
+  if (result != SV_RESULT::SV_NO_ERROR) {
+    AV_LOGE("InitRecording pipeline prepare error:%d", result);
+    CloseStream();
+    return result;
+  }
+  ConfigureStream();
+  pipeline_.EndInit();
   initialized_ = true;
   return SV_RESULT::SV_NO_ERROR;
 }
 
+int SVOboeRecorder::Prewarm(const SVAudioFormat& format) {
+  const int64_t begin_ns = SVNowNs();
+  SVBackendContext& context = SVBackendContext::Instance();
+  // Never started, a stream without callbacks is enough.
+  AudioStreamBuilder prewarm_builder;
+  prewarm_builder.setDirection(Direction::Input);
+  prewarm_builder.setPerformanceMode(PerformanceMode::LowLatency);
+  prewarm_builder.setSharingMode(SharingMode::Shared);
+  prewarm_builder.setFormat(ToOboeFormat(format.sample_format));
+  prewarm_builder.setChannelCount(format.channels);
+  prewarm_builder.setSampleRate(format.sample_rate);
+  std::shared_ptr<AudioStream> stream;
+  int result = SV_RESULT::SV_NO_ERROR;
+  Result opened = prewarm_builder.openStream(stream);
+  if (opened == Result::OK) {
+    stream->close();
+    context.MarkWarm(OBOE);
+  } else {
+    AV_LOGW("Prewarm openStream error:%s", convertToText(opened));
+    result = SV_RESULT::SV_INIT_ERROR;
+  }
+  context.OnPrewarm(OBOE, SVNowNs() - begin_ns, result);
+  return result;
+}
+
 int SVOboeRecorder::StartRecording() {
 
   if (!initialized_ ) {
@@ -66,9 +104,16 @@ int SVOboeRecorder::StartRecording() {
     return SV_RESULT::SV_START_RECORDING_ERROR;
   }
 
+  int started = pipeline_.Start();
+  if (started != SV_RESULT::SV_NO_ERROR) {
+    AV_LOGE("StartRecording pipeline start error:%d", started);
+    pipeline_.Stop();
+    return started;
+  }
   Result result = mStream->requestStart();
   if (result != Result::OK) {
     AV_LOGE("StartRecording requestStart error:%s", convertToText(result));
+    pipeline_.Stop();
     return SV_RESULT::SV_START_RECORDING_ERROR;
   }
 
@@ -78,41 +123,182 @@ int SVOboeRecorder::StartRecording() {
 
 int SVOboeRecorder::StopRecording() {
 
-  Result result = mStream->requestStop();
-  if (result != Result::OK) {
-    AV_LOGE("StopRecording requestStop error:%s", convertToText(result));
-    return SV_RESULT::SV_STOP_ERROR;
+  if (!recording_) {
+    AV_LOGW("StopRecording error, not recording.");
+    return SV_RESULT::SV_STATE_ERROR;
   }
 
+  // Waits for a recovery in flight, afterwards |mStream| is ours again, or null if it failed.
+  pipeline_.recovery().Stop();
+  if (mStream) {
+    // Synchronous, returns once the stream is stopped and no data callback runs any more.
+    Result result = mStream->stop();
+    if (result != Result::OK) {
+      AV_LOGE("StopRecording stop error:%s", convertToText(result));
+      return SV_RESULT::SV_STOP_ERROR;
+    }
+  }
+
+  pipeline_.Stop();
   recording_ = false;
   return SV_RESULT::SV_NO_ERROR;
 }
 
+int SVOboeRecorder::SetOption(int32_t option, int32_t value) {
+  return pipeline_.SetOption(option, value);
+}
+
 int SVOboeRecorder::Release() {
   DestroyRecorder();
   return SV_RESULT::SV_NO_ERROR;
 }
 
 void SVOboeRecorder::DestroyRecorder() {
-  Result result = mStream->close();
-  if (result != Result::OK) {
-    AV_LOGE("oboe stream close error:%s", convertToText(result));
+  pipeline_.recovery().Stop();
+  stream_.store(nullptr, std::memory_order_release);
+  if (mStream) {
+    Result result = mStream->close();
+    if (result != Result::OK) {
+      AV_LOGE("oboe stream close error:%s", convertToText(result));
+    }
   }
   mStream = nullptr;
   initialized_ = false;
   recording_ = false;
 }
 
+void SVOboeRecorder::CloseStream() {
+  // Unpublished first, a late error callback of this stream no longer matches.
+  stream_.store(nullptr, std::memory_order_release);
+  if (!mStream) {
+    return;
+  }
+  // Usually closed by Oboe already, closing again only returns an error.
+  mStream->close();
+  mStream = nullptr;
+}
+
+int SVOboeRecorder::OpenStream() {
+  if (OpenStreamWithFallback() != SV_RESULT::SV_NO_ERROR) {
+    return SV_RESULT::SV_INIT_ERROR;
+  }
+  // The new route may offer a different format, the file cannot change format midway.
+  const SVAudioFormat& format = pipeline_.format();
+  SV_SAMPLE_FORMAT actual_format;
+  if (!FromOboeFormat(mStream->getFormat(), &actual_format) || actual_format != format.sample_format ||
+      mStream->getSampleRate() != format.sample_rate || mStream->getChannelCount() != format.channels) {
+    AV_LOGW("OpenStream error, format changed to %d/%d/%d", mStream->getSampleRate(),
+            mStream->getChannelCount(), static_cast<int>(mStream->getFormat()));
+    CloseStream();
+    return SV_RESULT::SV_INIT_ERROR;
+  }
+  ConfigureStream();
+  return SV_RESULT::SV_NO_ERROR;
+}
+
+int SVOboeRecorder::OpenStreamWithFallback() {
+  std::shared_ptr<AudioStream> stream;
+  Result result = builder.openStream(stream);
+  if (result != Result::OK && pipeline_.options().low_latency) {
+    AV_LOGW("Exclusive stream denied:%s, falling back to shared.", convertToText(result));
+    builder.setSharingMode(SharingMode::Shared);
+    result = builder.openStream(stream);
+    // A later reopen tries exclusive again, the device may be free by then.
+    builder.setSharingMode(SharingMode::Exclusive);
+  }
+  if (result != Result::OK) {
+    AV_LOGE("openStream error:%s", convertToText(result));
+    return SV_RESULT::SV_INIT_ERROR;
+  }
+  mStream = stream;
+  stream_.store(stream.get(), std::memory_order_release);
+  return SV_RESULT::SV_NO_ERROR;
+}
+
+void SVOboeRecorder::ConfigureStream() {
+  const bool low_latency = pipeline_.options().low_latency;
+  SVStreamInfo info;
+  info.backend = "oboe";
+  info.sharing_mode = mStream->getSharingMode() == SharingMode::Exclusive ? SV_SHARING_EXCLUSIVE : SV_SHARING_SHARED;
+  info.mmap = OboeExtensions::isMMapUsed(mStream.get());
+  info.fallback = low_latency && info.sharing_mode != SV_SHARING_EXCLUSIVE;
+  info.device_id = mStream->getDeviceId();
+  info.frames_per_burst = mStream->getFramesPerBurst();
+  info.buffer_capacity = mStream->getBufferCapacityInFrames();
+
+  SVLatencyTuner& tuner = pipeline_.latency_tuner();
+  if (low_latency || tuner.adaptive()) {
+    // The adaptive mode starts from the device default and sizes from there.
+    tuner.Init(info.frames_per_burst, info.buffer_capacity,
+               low_latency ? info.frames_per_burst * SV_LOW_LATENCY_INITIAL_BURSTS : mStream->getBufferSizeInFrames());
+    auto applied = mStream->setBufferSizeInFrames(tuner.buffer_size());
+    tuner.SetBufferSize(applied ? applied.value() : -1);
+  } else {
+    tuner.Init(0, info.buffer_capacity, mStream->getBufferSizeInFrames());
+  }
+  pipeline_.SetStreamInfo(info);
+}
+
+int SVOboeRecorder::StartStream() {
+  Result result = mStream->requestStart();
+  if (result != Result::OK) {
+    AV_LOGW("StartStream requestStart error:%s", convertToText(result));
+    return SV_RESULT::SV_START_RECORDING_ERROR;
+  }
+  return SV_RESULT::SV_NO_ERROR;
+}
+
+AudioFormat SVOboeRecorder::ToOboeFormat(SV_SAMPLE_FORMAT format) {
+  switch (format) {
+    case SV_SAMPLE_F32:
+      return AudioFormat::Float;
+    case SV_SAMPLE_I24:
+      return AudioFormat::I24;
+    default:
+      return AudioFormat::I16;
+  }
+}
+
+bool SVOboeRecorder::FromOboeFormat(AudioFormat oboe_format, SV_SAMPLE_FORMAT* format) {
+  switch (oboe_format) {
+    case AudioFormat::I16:
+      *format = SV_SAMPLE_I16;
+      return true;
+    case AudioFormat::Float:
+      *format = SV_SAMPLE_F32;
+      return true;
+    case AudioFormat::I24:
+      *format = SV_SAMPLE_I24;
+      return true;
+    default:
+      return false;
+  }
+}
+
 oboe::DataCallbackResult
 SVOboeRecorder::onAudioReady(oboe::AudioStream *oboeStream, void *audioData,
                              int32_t numFrames) {
-  AV_LOGI("numFrames: %d", numFrames);
-  int32_t data_len = oboeStream->getChannelCount() * numFrames * 2;
-  if(file_) {
-    size_t write_len = fwrite(audioData, 1, data_len, file_);
-    AV_LOGI("Write into file data len:%d", write_len);
+  AV_LOG_CALLBACK("numFrames: %d", numFrames);
+  pipeline_.OnAudioData(audioData, numFrames);
+  auto xruns = oboeStream->getXRunCount();
+  if (xruns) {
+    pipeline_.metrics().SetXRunCount(xruns.value());
+  }
+  // Without a counter (OpenSL ES under Oboe) the tuner infers overflows from the timing.
+  SVLatencyTuner& tuner = pipeline_.latency_tuner();
+  int32_t buffer_size = tuner.OnCallback(SVNowNs(), numFrames, xruns ? xruns.value() : -1);
+  if (buffer_size > 0) {
+    auto applied = oboeStream->setBufferSizeInFrames(buffer_size);
+    tuner.SetBufferSize(applied ? applied.value() : -1);
   }
   return oboe::DataCallbackResult::Continue;
 }
 
-}
\ No newline at end of file
+void SVOboeRecorder::onErrorAfterClose(oboe::AudioStream *oboeStream, oboe::Result error) {
+  AV_LOGI("onErrorAfterClose error:%s", convertToText(error));
+  if (error == Result::ErrorDisconnected && oboeStream == stream_.load(std::memory_order_acquire)) {
+    pipeline_.recovery().OnDisconnected(convertToText(error));
+  }
+}
+
+}
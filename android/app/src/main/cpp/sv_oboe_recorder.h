@@ -7,29 +7,52 @@
  */
 #ifndef AOS_AUDIO_RECORD_SV_OBOE_RECORDER_H
 #define AOS_AUDIO_RECORD_SV_OBOE_RECORDER_H
+#include <atomic>
 #include <oboe/Oboe.h>
 #include "sv_common.h"
+#include "sv_capture_pipeline.h"
 
 namespace sv_recorder {
 
-class SVOboeRecorder : public ISVNativeRecorder, public oboe::AudioStreamDataCallback {
+class SVOboeRecorder : public ISVNativeRecorder, public ISVStreamHandler, public oboe::AudioStreamDataCallback,
+                       public oboe::AudioStreamErrorCallback {
 
 public:
   explicit SVOboeRecorder(std::string file_path);
   ~SVOboeRecorder();
-  int InitRecording(int sample_rate, int channel) override;
+  int InitRecording(int sample_rate, int channel, SV_SAMPLE_FORMAT format) override;
   int StartRecording() override;
   int StopRecording() override;
   int Release() override;
+  int SetOption(int32_t option, int32_t value) override;
+  SVCapturePipeline& pipeline() override { return pipeline_; }
+  // Opens and closes a shared input stream of |format|, so Oboe's backend and the audio
+  // service are up before the first session. Needs the RECORD_AUDIO permission.
+  static int Prewarm(const SVAudioFormat& format);
+
+  // ISVStreamHandler, reopens |builder| after a disconnect.
+  void CloseStream() override;
+  int OpenStream() override;
+  int StartStream() override;
 
 private:
   oboe::DataCallbackResult onAudioReady(oboe::AudioStream *oboeStream, void *audioData, int32_t numFrames) override;
+  void onErrorAfterClose(oboe::AudioStream *oboeStream, oboe::Result error) override;
+  // Opens |mStream| from |builder|, an exclusive request that is refused is retried shared.
+  int OpenStreamWithFallback();
+  // Reports the negotiated configuration and sizes the buffer of a freshly opened stream.
+  void ConfigureStream();
   void DestroyRecorder();
+  static oboe::AudioFormat ToOboeFormat(SV_SAMPLE_FORMAT format);
+  static bool FromOboeFormat(oboe::AudioFormat oboe_format, SV_SAMPLE_FORMAT* format);
 
 private:
   oboe::AudioStreamBuilder builder;
+  // Owned by the control and recovery threads, callbacks only see |stream_|.
   std::shared_ptr<oboe::AudioStream> mStream;
-  FILE* file_;
+  // |mStream| once it is open, cleared before it is closed, read by the error callback.
+  std::atomic<oboe::AudioStream*> stream_;
+  SVCapturePipeline pipeline_;
   bool initialized_;
   bool recording_;
 };
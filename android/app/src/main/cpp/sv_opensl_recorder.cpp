@@ -10,21 +10,58 @@
 
 namespace sv_recorder {
 
+SVOpenSLEngine& SVOpenSLEngine::Instance() {
+  static SVOpenSLEngine engine;
+  return engine;
+}
+
+SLEngineItf SVOpenSLEngine::Acquire() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const bool reused = engine_ != nullptr;
+  if(!reused && Create() != SV_NO_ERROR) {
+    return nullptr;
+  }
+  SVBackendContext::Instance().OnResource(SV_RESOURCE_ENGINE, reused);
+  return engine_;
+}
+
+SV_RESULT SVOpenSLEngine::Create() {
+
+  // Create the engine object in thread safe mode.
+  const SLEngineOption option[] = {
+          {SL_ENGINEOPTION_THREADSAFE, static_cast<SLuint32>(SL_BOOLEAN_TRUE)}};
+  SLresult result = slCreateEngine(&object_, 0, option, 0, NULL, NULL);
+  if(result != SL_RESULT_SUCCESS) {
+    AV_LOGW("slCreateEngine failed: %s", GetSLErrorString(result));
+    object_ = nullptr;
+    return SV_CRATE_ERROR;
+  }
+
+  result = (*object_)->Realize(object_, SL_BOOLEAN_FALSE);
+  if(result == SL_RESULT_SUCCESS) {
+    result = (*object_)->GetInterface(object_, SL_IID_ENGINE, &engine_);
+  }
+  if(result != SL_RESULT_SUCCESS) {
+    AV_LOGW("sl_object engine setup failed: %s", GetSLErrorString(result));
+    (*object_)->Destroy(object_);
+    object_ = nullptr;
+    engine_ = nullptr;
+    return SV_CRATE_ERROR;
+  }
+  return SV_NO_ERROR;
+}
+
 SVOpenSLRecorder::SVOpenSLRecorder(std::string file_path)
-        :sl_engine_(nullptr), sl_object_(nullptr), buffer_len_(0){
+        :sl_engine_(nullptr), sl_record_obj_(nullptr), sl_record_(nullptr), record_buffer_queue_(nullptr),
+         buffer_len_(0), buffer_bytes_(0),
+         queue_depth_(SV_OPENSLES_BUFFERS_LEN), queue_capacity_(SV_OPENSLES_BUFFERS_LEN), read_index_(0),
+         enqueued_(0), pipeline_(file_path){
   AV_LOGI("=== SVOpenSLRecorder Constructor ====");
-
-  file_ = fopen( file_path.c_str(), "wb");
-  CreateEngine();
 }
 
 SVOpenSLRecorder::~SVOpenSLRecorder() {
   AV_LOGI("=== SVOpenSLRecorder Deconstructor ===");
   DestroyAudioRecorder();
-  if(file_) {
-    fclose(file_);
-    file_ = nullptr;
-  }
 }
 
 // this callback handler is called every time a buffer finishes recording
@@ -37,14 +74,57 @@ void SVOpenSLRecorder::BufferQueueCallBack(SLAndroidSimpleBufferQueueItf bq, voi
   }
 }
 
-int SVOpenSLRecorder::InitRecording(int sample_rate, int channel) {
+int SVOpenSLRecorder::InitRecording(int sample_rate, int channel, SV_SAMPLE_FORMAT format) {
+
+  pipeline_.BeginInit(OPEN_SL);
+  // The pipeline is prepared with the requested rate, so it has to be the one recorded.
+  const SLuint32 sample_per_sec = GetSamplePerSec(sample_rate);
+  if(sample_per_sec == 0) {
+    AV_LOGW("InitRecording error, unsupported sample rate: %d", sample_rate);
+    return SV_INIT_ERROR;
+  }
+  sl_engine_ = SVOpenSLEngine::Instance().Acquire();
+  if(!sl_engine_) {
+    return SV_INIT_ERROR;
+  }
 
+  SVAudioFormat audio_format = {sample_rate, channel, format};
   size_t frames_per_buffer = sample_rate / SV_BUFFERS_PER_SECOND;
   buffer_len_ = frames_per_buffer * channel;
-  audio_buffers_ = std::make_unique<std::unique_ptr<SLint16[]>[]>(SV_OPENSLES_BUFFERS_LEN);
-  for(int i = 0; i < SV_OPENSLES_BUFFERS_LEN; i++) {
-    audio_buffers_[i].reset(new SLint16[buffer_len_]);
+  buffer_bytes_ = frames_per_buffer * audio_format.BytesPerFrame();
+  int prepared = pipeline_.Prepare(audio_format);
+  if(prepared != SV_NO_ERROR) {
+    AV_LOGW("InitRecording pipeline prepare failed: %d", prepared);
+    DestroyAudioRecorder();
+    return prepared;
+  }
+  SVLatencyTuner& tuner = pipeline_.latency_tuner();
+  // The adaptive buffer varies the number of buffers in flight, the queue is declared for all of them.
+  queue_capacity_ = tuner.adaptive() ? SV_OPENSLES_MAX_BUFFERS : queue_depth_;
+  // Buffers come from a pool of the process, a re-init or a later session with the same
+  // format reuses its slab.
+  for(size_t i = 0; i < SV_OPENSLES_MAX_BUFFERS; i++) {
+    audio_buffers_[i].reset();
+  }
+  if(!buffer_pool_) {
+    buffer_pool_ = SVBackendContext::Instance().AcquirePool(buffer_bytes_, static_cast<uint32_t>(queue_capacity_));
   }
+  if(buffer_pool_->Reserve(buffer_bytes_, static_cast<uint32_t>(queue_capacity_)) != SV_NO_ERROR) {
+    return SV_INIT_ERROR;
+  }
+  for(size_t i = 0; i < queue_capacity_; i++) {
+    audio_buffers_[i] = buffer_pool_->Acquire();
+  }
+  // OpenSL ES has no exclusive or MMAP path, the low-latency profile always falls back.
+  SVStreamInfo info;
+  info.backend = "opensl";
+  info.fallback = pipeline_.options().low_latency;
+  info.frames_per_burst = static_cast<int32_t>(frames_per_buffer);
+  info.buffer_capacity = static_cast<int32_t>(frames_per_buffer * queue_capacity_);
+  // The queue needs two buffers in flight, one recording while the other is read.
+  tuner.Init(tuner.adaptive() ? info.frames_per_burst : 0, info.buffer_capacity,
+             static_cast<int32_t>(frames_per_buffer * queue_depth_), SV_OPENSLES_BUFFERS_LEN);
+  pipeline_.SetStreamInfo(info);
 
   // 1. configure audio source
   SLDataLocator_IODevice loc_dev = {SL_DATALOCATOR_IODEVICE,
@@ -54,13 +134,24 @@ int SVOpenSLRecorder::InitRecording(int sample_rate, int channel) {
 
   // 2. configure audio sink
   SLDataLocator_AndroidSimpleBufferQueue buffer_queue = {
-          SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, SV_OPENSLES_BUFFERS_LEN};
+          SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, static_cast<SLuint32>(queue_capacity_)};
   SLDataFormat_PCM format_pcm = {
           SL_DATAFORMAT_PCM,           static_cast<SLuint32>(channel),
-          GetSamplePerSec(sample_rate),          SL_PCMSAMPLEFORMAT_FIXED_16,
+          sample_per_sec,              SL_PCMSAMPLEFORMAT_FIXED_16,
           SL_PCMSAMPLEFORMAT_FIXED_16, GetChannelMask(channel),
           SL_BYTEORDER_LITTLEENDIAN};
+  // Float and 24-bit capture need the Android PCM_EX extension.
+  SLuint32 bits = static_cast<SLuint32>(audio_format.BytesPerSample() * 8);
+  SLAndroidDataFormat_PCM_EX format_pcm_ex = {
+          SL_ANDROID_DATAFORMAT_PCM_EX, static_cast<SLuint32>(channel),
+          sample_per_sec, bits, bits, GetChannelMask(channel),
+          SL_BYTEORDER_LITTLEENDIAN,
+          format == SV_SAMPLE_F32 ? SL_ANDROID_PCM_REPRESENTATION_FLOAT
+                                  : SL_ANDROID_PCM_REPRESENTATION_SIGNED_INT};
   SLDataSink audioSink = {&buffer_queue, &format_pcm};
+  if (format != SV_SAMPLE_I16) {
+    audioSink.pFormat = &format_pcm_ex;
+  }
 
   // 3. create audio recorder
   // (requires the RECORD_AUDIO permission)
@@ -130,9 +221,25 @@ int SVOpenSLRecorder::InitRecording(int sample_rate, int channel) {
     return SV_INIT_ERROR;
   }
 
+  pipeline_.EndInit();
   return SV_NO_ERROR;
 }
 
+int SVOpenSLRecorder::Prewarm(const SVAudioFormat& format) {
+  const int64_t begin_ns = SVNowNs();
+  SVBackendContext& context = SVBackendContext::Instance();
+  int result = SVOpenSLEngine::Instance().Acquire() ? SV_NO_ERROR : SV_CRATE_ERROR;
+  if(result == SV_NO_ERROR) {
+    const size_t frames_per_buffer = format.sample_rate / SV_BUFFERS_PER_SECOND;
+    result = context.PrewarmPool(frames_per_buffer * format.BytesPerFrame(), SV_OPENSLES_BUFFERS_LEN);
+  }
+  if(result == SV_NO_ERROR) {
+    context.MarkWarm(OPEN_SL);
+  }
+  context.OnPrewarm(OPEN_SL, SVNowNs() - begin_ns, result);
+  return result;
+}
+
 int SVOpenSLRecorder::StartRecording() {
 
   AV_LOGI("StartRecording ....");
@@ -147,31 +254,35 @@ int SVOpenSLRecorder::StartRecording() {
     return SV_START_RECORDING_ERROR;
   }
 
-  SLAndroidSimpleBufferQueueState state;
-  result = (*record_buffer_queue_)->GetState(record_buffer_queue_, &state);
+  // Start from an empty queue so the completion order matches audio_buffers_.
+  result = (*record_buffer_queue_)->Clear(record_buffer_queue_);
   if (result != SL_RESULT_SUCCESS) {
-    AV_LOGW("StartRecording GetState failed: %s", GetSLErrorString(result));
+    AV_LOGW("StartRecording Clear failed: %s", GetSLErrorString(result));
     return SV_START_RECORDING_ERROR;
   }
 
-  auto buffer_count_in_queue = state.count;
-  if (buffer_count_in_queue > 0) {
-    (*record_buffer_queue_)->Clear(record_buffer_queue_);
-  }
-
-  for (int i = 0; i < SV_OPENSLES_BUFFERS_LEN - buffer_count_in_queue; i++) {
-    auto audio_buffer = reinterpret_cast<SLint8 *>(audio_buffers_[0].get());
-    auto len = buffer_len_ * 16 / 8;
-    SLresult err = (*record_buffer_queue_)->Enqueue(record_buffer_queue_, audio_buffer, len);
+  const size_t depth = static_cast<size_t>(pipeline_.latency_tuner().buffer_size() / FramesPerBuffer());
+  for (size_t i = 0; i < depth; i++) {
+    SLresult err = (*record_buffer_queue_)->Enqueue(record_buffer_queue_, audio_buffers_[i]->data(), buffer_bytes_);
     if (err != SL_RESULT_SUCCESS) {
       AV_LOGW("Enqueue failed, err: %s", GetSLErrorString(err));
       return SV_START_RECORDING_ERROR;
     }
   }
-
+  read_index_ = 0;
+  enqueued_ = depth;
+  callback_stats_.Reset(1000000000LL / SV_BUFFERS_PER_SECOND);
+
+  int started = pipeline_.Start();
+  if (started != SV_NO_ERROR) {
+    AV_LOGW("StartRecording pipeline start failed: %d", started);
+    pipeline_.Stop();
+    return started;
+  }
   result = (*sl_record_)->SetRecordState(sl_record_, SL_RECORDSTATE_RECORDING);
   if (result != SL_RESULT_SUCCESS) {
     AV_LOGW("StartRecording SetRecordState Recording failed.");
+    pipeline_.Stop();
     return SV_START_RECORDING_ERROR;
   }
 
@@ -192,74 +303,77 @@ int SVOpenSLRecorder::StopRecording() {
     return SV_STOP_ERROR;
   }
   (*record_buffer_queue_)->Clear(record_buffer_queue_);
+  pipeline_.Stop();
+  AV_LOGI("SVOpenSLRecorder callbacks:%llu, depth:%d, interval mean:%.2fms min:%.2fms max:%.2fms "
+          "jitter:%.3fms, late:%llu, max process:%.3fms",
+          (unsigned long long) callback_stats_.intervals(),
+          pipeline_.latency_tuner().buffer_size() / FramesPerBuffer(),
+          callback_stats_.mean_interval_ns() / 1e6, callback_stats_.min_interval_ns() / 1e6,
+          callback_stats_.max_interval_ns() / 1e6, callback_stats_.jitter_ns() / 1e6,
+          (unsigned long long) callback_stats_.late_count(), callback_stats_.max_process_ns() / 1e6);
   DestroyAudioRecorder();
   return SV_NO_ERROR;
 }
 
-SV_RESULT SVOpenSLRecorder::CreateEngine() {
-
-  // Create the engine object in thread safe mode.
-  const SLEngineOption option[] = {
-          {SL_ENGINEOPTION_THREADSAFE, static_cast<SLuint32>(SL_BOOLEAN_TRUE)}};
-  SLresult result = slCreateEngine(&sl_object_, 0, option, 0, NULL, NULL);
-  if(result != SL_RESULT_SUCCESS) {
-    AV_LOGW("slCreateEngine failed: %s", GetSLErrorString(result));
-    return SV_CRATE_ERROR;
-  }
-
-  result = (*sl_object_)->Realize(sl_object_, SL_BOOLEAN_FALSE);
-  if(result != SL_RESULT_SUCCESS) {
-    AV_LOGW("sl_object Realize failed: %s", GetSLErrorString(result));
-    return SV_CRATE_ERROR;
-  }
-
-  result = (*sl_object_)->GetInterface(sl_object_, SL_IID_ENGINE, &sl_engine_);
-  if(result != SL_RESULT_SUCCESS) {
-    AV_LOGW("sl_object SL_IID_ENGINE get Interface failed: %s", GetSLErrorString(result));
-    return SV_CRATE_ERROR;
-  }
-  return SV_NO_ERROR;
-}
-
 void SVOpenSLRecorder::ReadBufferQueue() {
 
   SLuint32 state;
   SLresult result = (*sl_record_)->GetRecordState(sl_record_, &state);
   if(SL_RESULT_SUCCESS != result) {
-    AV_LOGW("GetRecordState failed, err: %s", GetSLErrorString(result));
+    AV_LOGW_RT("GetRecordState failed, err: %s", GetSLErrorString(result));
     return;
   }
 
   if(state != SL_RECORDSTATE_RECORDING) {
-    AV_LOGW("Buffer callback in non-recording state! state: %d", state);
+    AV_LOGW_RT("Buffer callback in non-recording state! state: %d", state);
     return;
   }
 
-  auto audio_buffer = reinterpret_cast<SLint8 *>(audio_buffers_[0].get());
-  auto len = buffer_len_ * 16 / 8;
-  AV_LOGI("audio buffer len: %u", len);
-
-  result = (*record_buffer_queue_)->Enqueue(record_buffer_queue_, audio_buffer, len);
-  if(SL_RESULT_SUCCESS != result) {
-    AV_LOGW("Enqueue failed: err: %s", GetSLErrorString(result));
-    return;
+  int64_t begin_ns = SVNowNs();
+  // The device is done with the oldest buffer: consume it first, then give it back
+  // to the tail of the queue while the other buffers keep recording.
+  const int32_t frames = FramesPerBuffer();
+  auto audio_buffer = audio_buffers_[read_index_]->data();
+  read_index_ = (read_index_ + 1) % queue_capacity_;
+  enqueued_--;
+  pipeline_.OnAudioData(audio_buffer, frames);
+
+  // OpenSL ES has no xrun counter, the tuner infers overflows from the callback timing.
+  SVLatencyTuner& tuner = pipeline_.latency_tuner();
+  int32_t buffer_size = tuner.OnCallback(begin_ns, frames, -1);
+  if(buffer_size > 0) {
+    tuner.SetBufferSize(std::min(buffer_size / frames, static_cast<int32_t>(queue_capacity_)) * frames);
   }
-
-  if(file_) {
-    size_t write_len = fwrite(audio_buffer, 1, len, file_);
-    AV_LOGW("write into file size: %d", write_len);
+  // Back to the tuned depth: the buffer just read, one more to grow, none to shrink.
+  const size_t depth = static_cast<size_t>(tuner.buffer_size() / frames);
+  while(enqueued_ < depth) {
+    result = (*record_buffer_queue_)->Enqueue(record_buffer_queue_,
+                                              audio_buffers_[(read_index_ + enqueued_) % queue_capacity_]->data(),
+                                              buffer_bytes_);
+    if(SL_RESULT_SUCCESS != result) {
+      AV_LOGW_RT("Enqueue failed: err: %s", GetSLErrorString(result));
+      break;
+    }
+    enqueued_++;
   }
+  callback_stats_.Update(begin_ns, SVNowNs());
 }
 
 void SVOpenSLRecorder::DestroyAudioRecorder() {
-  (*record_buffer_queue_)->RegisterCallback(record_buffer_queue_, nullptr, nullptr);
+  if(record_buffer_queue_) {
+    (*record_buffer_queue_)->RegisterCallback(record_buffer_queue_, nullptr, nullptr);
+  }
+  // The engine outlives the recorder, its audio recorder object has to go explicitly.
+  if(sl_record_obj_) {
+    (*sl_record_obj_)->Destroy(sl_record_obj_);
+  }
   sl_record_obj_ = nullptr;
   sl_record_ = nullptr;
   record_buffer_queue_ = nullptr;
 }
 
 SLuint32 SVOpenSLRecorder::GetSamplePerSec(int sample_rate) {
-  SLuint32 samplePerSec = SL_SAMPLINGRATE_16;
+  SLuint32 samplePerSec = 0;
   switch (sample_rate) {
     case 8000:
       samplePerSec = SL_SAMPLINGRATE_8;
@@ -292,7 +406,6 @@ SLuint32 SVOpenSLRecorder::GetSamplePerSec(int sample_rate) {
       samplePerSec = SL_SAMPLINGRATE_96;
       break;
     default:
-      AV_LOGW("Unsupported sample rate: %d, so set default value: 16000", sample_rate);
       break;
   }
   return samplePerSec;
@@ -306,13 +419,36 @@ SLuint32 SVOpenSLRecorder::GetChannelMask(int channels) {
   return channelMask;
 }
 
+int SVOpenSLRecorder::SetOption(int32_t option, int32_t value) {
+  if(option == SV_OPTION_BUFFER_QUEUE_DEPTH) {
+    if(value < 2 || value > static_cast<int32_t>(SV_OPENSLES_MAX_BUFFERS)) {
+      AV_LOGW("Unsupported buffer queue depth: %d", value);
+      return SV_INIT_ERROR;
+    }
+    if(sl_record_) {
+      AV_LOGW("SetOption buffer queue depth error, already initialized.");
+      return SV_STATE_ERROR;
+    }
+    queue_depth_ = static_cast<size_t>(value);
+    return SV_NO_ERROR;
+  }
+  return pipeline_.SetOption(option, value);
+}
+
 int SVOpenSLRecorder::Release() {
-  sl_record_ = nullptr;
-  if(sl_record_obj_)
-    (*sl_record_obj_)->Destroy(sl_record_obj_);
+  DestroyAudioRecorder();
+  // The engine belongs to the process, see SVOpenSLEngine.
   sl_engine_ = nullptr;
-  if(sl_object_)
-    (*sl_object_)->Destroy(sl_object_);
+  for(size_t i = 0; i < SV_OPENSLES_MAX_BUFFERS; i++) {
+    audio_buffers_[i].reset();
+  }
+  if(buffer_pool_) {
+    auto pool_stats = buffer_pool_->GetStats();
+    AV_LOGI("SVOpenSLRecorder buffer pool, hits:%llu, misses:%llu, high water:%u/%u, slab allocations:%u",
+            (unsigned long long) pool_stats.hits, (unsigned long long) pool_stats.misses,
+            pool_stats.high_water, pool_stats.capacity, pool_stats.slab_allocations);
+    SVBackendContext::Instance().ReleasePool(std::move(buffer_pool_));
+  }
   return SV_NO_ERROR;
 }
 
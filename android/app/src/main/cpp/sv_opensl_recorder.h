@@ -10,6 +10,10 @@
 
 #include "log.h"
 #include "sv_common.h"
+#include "sv_backend_context.h"
+#include "sv_buffer_pool.h"
+#include "sv_callback_stats.h"
+#include "sv_capture_pipeline.h"
 #include <SLES/OpenSLES.h>
 #include <SLES/OpenSLES_Android.h>
 
@@ -42,35 +46,72 @@ inline const char* GetSLErrorString(size_t code) {
   return sl_error_strings[code];
 }
 
+// The OpenSL ES engine of the process. OpenSL ES wants one engine per application and
+// creating it is the slowest step of a cold start, so it is created on first use and kept
+// until the process exits; recorders only create and destroy their audio recorder object.
+class SVOpenSLEngine {
+
+  public:
+    static SVOpenSLEngine& Instance();
+
+    // nullptr when the engine cannot be created, a later call tries again.
+    SLEngineItf Acquire();
+
+  private:
+    SVOpenSLEngine() : object_(nullptr), engine_(nullptr) {}
+    SV_RESULT Create();
+
+  private:
+    std::mutex mutex_;
+    SLObjectItf object_;
+    SLEngineItf engine_;
+};
+
 class SVOpenSLRecorder : public ISVNativeRecorder {
 
   public:
     explicit SVOpenSLRecorder(std::string file_path);
     ~SVOpenSLRecorder();
-    int InitRecording(int sample_rate, int channel) override;
+    int InitRecording(int sample_rate, int channel, SV_SAMPLE_FORMAT format) override;
     int StartRecording() override;
     int StopRecording() override;
     int Release() override;
+    int SetOption(int32_t option, int32_t value) override;
+    SVCapturePipeline& pipeline() override { return pipeline_; }
+    // Creates the engine and reserves the buffers of |format| ahead of a session.
+    static int Prewarm(const SVAudioFormat& format);
+    // Only valid while stopped.
+    const SVCallbackStats& callback_stats() const { return callback_stats_; }
 
   private:
-    SV_RESULT CreateEngine();
     void ReadBufferQueue();
+    int32_t FramesPerBuffer() const { return static_cast<int32_t>(buffer_len_ / pipeline_.format().channels); }
     void DestroyAudioRecorder();
+    // 0 for a rate OpenSL ES has no constant for.
     static SLuint32 GetSamplePerSec(int sample_rate);
     static SLuint32 GetChannelMask(int channels);
     static void BufferQueueCallBack(SLAndroidSimpleBufferQueueItf bq, void* context);
 
   private:
     size_t buffer_len_;
-    FILE* file_;
+    size_t buffer_bytes_;
+    // Depth the queue starts with, the adaptive buffer moves it up to |queue_capacity_|.
+    size_t queue_depth_;
+    size_t queue_capacity_;
+    // Buffers complete in enqueue order, this one is filled next and |enqueued_| follow it.
+    size_t read_index_;
+    size_t enqueued_;
+    SVCallbackStats callback_stats_;
+    SVCapturePipeline pipeline_;
 
   private:
-    SLObjectItf sl_object_;
     SLEngineItf sl_engine_;
     SLObjectItf sl_record_obj_;
     SLRecordItf sl_record_;
     SLAndroidSimpleBufferQueueItf record_buffer_queue_;
-    std::unique_ptr<std::unique_ptr<SLint16[]>[]> audio_buffers_;
+    // From the process-wide pools, returned on Release().
+    std::shared_ptr<SVBufferPool> buffer_pool_;
+    SVBlockRef audio_buffers_[SV_OPENSLES_MAX_BUFFERS];
 };
 
 }
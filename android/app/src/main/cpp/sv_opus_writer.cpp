@@ -0,0 +1,430 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_opus_writer.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#ifdef SV_HAVE_OPUS
+#include <opus.h>
+#endif
+#include "log.h"
+#include "sv_sample_convert.h"
+
+namespace sv_recorder {
+
+const size_t SV_OGG_MAX_SEGMENTS = 255;
+const uint8_t SV_OGG_FIRST_PAGE = 0x02;
+const uint8_t SV_OGG_LAST_PAGE = 0x04;
+// Largest Opus packet, a packet takes len / 255 + 1 lacing values.
+const int32_t SV_OPUS_MAX_PACKET = 1275;
+const size_t SV_OPUS_HEAD_SIZE = 19;
+const char* const SV_OPUS_VENDOR = "sv_recorder";
+
+static uint32_t kOggCrcTable[256];
+
+static bool InitOggCrcTable() {
+  for(uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i << 24;
+    for(int bit = 0; bit < 8; bit++) {
+      crc = crc & 0x80000000u ? (crc << 1) ^ 0x04C11DB7u : crc << 1;
+    }
+    kOggCrcTable[i] = crc;
+  }
+  return true;
+}
+
+// Ogg's CRC-32: polynomial 0x04C11DB7, not reflected, no initial value or final xor.
+static uint32_t OggCrc(uint32_t crc, const uint8_t* data, size_t len) {
+  static bool crc_ready = InitOggCrcTable();
+  (void) crc_ready;
+  for(size_t i = 0; i < len; i++) {
+    crc = (crc << 8) ^ kOggCrcTable[((crc >> 24) ^ data[i]) & 0xFF];
+  }
+  return crc;
+}
+
+static uint8_t* PutLE(uint8_t* p, uint64_t value, int bytes) {
+  for(int i = 0; i < bytes; i++) {
+    *p++ = static_cast<uint8_t>(value >> (8 * i));
+  }
+  return p;
+}
+
+static uint64_t GetLE(const uint8_t* p, int bytes) {
+  uint64_t value = 0;
+  for(int i = bytes - 1; i >= 0; i--) {
+    value = value << 8 | p[i];
+  }
+  return value;
+}
+
+// Appends the lacing values of a |len| byte packet, returns how many.
+static size_t AddLacing(size_t len, std::vector<uint8_t>* lacing) {
+  const size_t count = len / 255 + 1;
+  lacing->insert(lacing->end(), count - 1, 255);
+  lacing->push_back(static_cast<uint8_t>(len % 255));
+  return count;
+}
+
+bool SVOpusAvailable() {
+#ifdef SV_HAVE_OPUS
+  return true;
+#else
+  return false;
+#endif
+}
+
+SVOpusEncoder::SVOpusEncoder()
+  : encoder_(nullptr), channels_(0), frame_length_(0), pre_skip_(0), stats_{0, 0, 0, 0} {
+}
+
+SVOpusEncoder::~SVOpusEncoder() {
+  Release();
+}
+
+void SVOpusEncoder::Release() {
+#ifdef SV_HAVE_OPUS
+  if(encoder_) {
+    opus_encoder_destroy(encoder_);
+  }
+#endif
+  encoder_ = nullptr;
+}
+
+int SVOpusEncoder::Init(int sample_rate, int channels, int32_t bitrate) {
+  Release();
+  stats_ = {0, 0, 0, 0};
+  if(!SVOpusSupportsRate(sample_rate) || channels <= 0 || channels > SV_OPUS_MAX_CHANNELS ||
+     bitrate < SV_OPUS_MIN_BITRATE || bitrate > SV_OPUS_MAX_BITRATE) {
+    AV_LOGW("SVOpusEncoder unsupported format: %d Hz, channels:%d, bitrate:%d", sample_rate, channels, bitrate);
+    return SV_INIT_ERROR;
+  }
+#ifdef SV_HAVE_OPUS
+  int error = OPUS_OK;
+  encoder_ = opus_encoder_create(sample_rate, channels, OPUS_APPLICATION_AUDIO, &error);
+  if(!encoder_ || error != OPUS_OK) {
+    AV_LOGW("SVOpusEncoder create failed: %s", opus_strerror(error));
+    encoder_ = nullptr;
+    return SV_INIT_ERROR;
+  }
+  opus_int32 lookahead = 0;
+  opus_encoder_ctl(encoder_, OPUS_SET_BITRATE(bitrate));
+  opus_encoder_ctl(encoder_, OPUS_SET_COMPLEXITY(SV_OPUS_COMPLEXITY));
+  opus_encoder_ctl(encoder_, OPUS_GET_LOOKAHEAD(&lookahead));
+  channels_ = channels;
+  frame_length_ = sample_rate * SV_OPUS_FRAME_MS / 1000;
+  pre_skip_ = lookahead * (SV_OPUS_GRANULE_RATE / sample_rate);
+  packet_.reserve(SV_OPUS_MAX_PACKET);
+  return SV_NO_ERROR;
+#else
+  AV_LOGW("SVOpusEncoder unavailable, built without libopus.");
+  return SV_INIT_ERROR;
+#endif
+}
+
+const std::vector<uint8_t>& SVOpusEncoder::EncodeFrame(const int16_t* samples) {
+  const int64_t begin_ns = SVNowNs();
+  int result = -1;
+#ifdef SV_HAVE_OPUS
+  if(encoder_) {
+    packet_.resize(SV_OPUS_MAX_PACKET);
+    result = opus_encode(encoder_, samples, frame_length_, packet_.data(), SV_OPUS_MAX_PACKET);
+  }
+#endif
+  return EndFrame(result, begin_ns, sizeof(int16_t));
+}
+
+const std::vector<uint8_t>& SVOpusEncoder::EncodeFrame(const float* samples) {
+  const int64_t begin_ns = SVNowNs();
+  int result = -1;
+#ifdef SV_HAVE_OPUS
+  if(encoder_) {
+    packet_.resize(SV_OPUS_MAX_PACKET);
+    result = opus_encode_float(encoder_, samples, frame_length_, packet_.data(), SV_OPUS_MAX_PACKET);
+  }
+#endif
+  return EndFrame(result, begin_ns, sizeof(float));
+}
+
+const std::vector<uint8_t>& SVOpusEncoder::EndFrame(int result, int64_t begin_ns, size_t sample_bytes) {
+  if(result < 0) {
+    AV_LOGE("SVOpusEncoder encode failed: %d", result);
+    packet_.clear();
+    return packet_;
+  }
+  packet_.resize(static_cast<size_t>(result));
+  stats_.frames_encoded += frame_length_;
+  stats_.input_bytes += static_cast<uint64_t>(frame_length_) * channels_ * sample_bytes;
+  stats_.output_bytes += packet_.size();
+  stats_.encode_ns += static_cast<uint64_t>(SVNowNs() - begin_ns);
+  return packet_;
+}
+
+SVOpusFileOutput::SVOpusFileOutput(ISVFileOutput::Ptr output, const SVAudioFormat& format, int32_t bitrate)
+  : output_(std::move(output)), format_(format), bitrate_(bitrate), pending_bytes_(0), page_packets_(0),
+    serial_(0), page_sequence_(0), input_bytes_(0), packets_(0), opened_(false) {
+}
+
+SVOpusFileOutput::~SVOpusFileOutput() {
+  Close();
+}
+
+int SVOpusFileOutput::Open(const std::string& file_path) {
+  int result = encoder_.Init(format_.sample_rate, format_.channels, bitrate_);
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  result = output_->Open(file_path);
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  const size_t frame_length = static_cast<size_t>(encoder_.frame_length());
+  pending_.resize(frame_length * format_.BytesPerFrame());
+  pending_bytes_ = 0;
+  if(format_.sample_format == SV_SAMPLE_I24) {
+    float_frame_.resize(frame_length * format_.channels);
+  }
+  page_data_.clear();
+  page_data_.reserve(SV_OGG_MAX_SEGMENTS * 255);
+  page_lacing_.clear();
+  page_packets_ = 0;
+  serial_ = static_cast<uint32_t>(SVNowNs());
+  page_sequence_ = 0;
+  input_bytes_ = 0;
+  packets_ = 0;
+
+  // Identification and comment header, each on a page of its own. Channel mapping family 0
+  // covers mono and stereo.
+  uint8_t head[SV_OPUS_HEAD_SIZE];
+  memcpy(head, "OpusHead", 8);
+  head[8] = 1;
+  head[9] = static_cast<uint8_t>(format_.channels);
+  PutLE(head + 10, static_cast<uint64_t>(encoder_.pre_skip()), 2);
+  PutLE(head + 12, static_cast<uint64_t>(format_.sample_rate), 4);
+  PutLE(head + 16, 0, 2);
+  head[18] = 0;
+  const size_t vendor_len = strlen(SV_OPUS_VENDOR);
+  std::vector<uint8_t> tags(8 + 4 + vendor_len + 4);
+  memcpy(tags.data(), "OpusTags", 8);
+  PutLE(tags.data() + 8, vendor_len, 4);
+  memcpy(tags.data() + 12, SV_OPUS_VENDOR, vendor_len);
+  PutLE(tags.data() + 12 + vendor_len, 0, 4);
+  if(!WriteHeaderPage(head, sizeof(head), SV_OGG_FIRST_PAGE) || !WriteHeaderPage(tags.data(), tags.size(), 0)) {
+    AV_LOGE("SVOpusFileOutput write header failed.");
+    return SV_INIT_ERROR;
+  }
+  opened_ = true;
+  return SV_NO_ERROR;
+}
+
+size_t SVOpusFileOutput::Write(const void* data, size_t len) {
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  size_t consumed = 0;
+  while(consumed < len) {
+    size_t chunk = std::min(len - consumed, pending_.size() - pending_bytes_);
+    memcpy(pending_.data() + pending_bytes_, src + consumed, chunk);
+    pending_bytes_ += chunk;
+    consumed += chunk;
+    input_bytes_ += chunk;
+    if(pending_bytes_ == pending_.size() && !EncodePending()) {
+      break;
+    }
+  }
+  return consumed;
+}
+
+bool SVOpusFileOutput::EncodePending() {
+  pending_bytes_ = 0;
+  const uint8_t* pending = pending_.data();
+  if(format_.sample_format == SV_SAMPLE_I16) {
+    return AddPacket(encoder_.EncodeFrame(reinterpret_cast<const int16_t*>(pending)));
+  }
+  if(format_.sample_format == SV_SAMPLE_F32) {
+    return AddPacket(encoder_.EncodeFrame(reinterpret_cast<const float*>(pending)));
+  }
+  SVConvert().i24_to_f32(pending, float_frame_.data(), float_frame_.size());
+  return AddPacket(encoder_.EncodeFrame(float_frame_.data()));
+}
+
+bool SVOpusFileOutput::AddPacket(const std::vector<uint8_t>& packet) {
+  if(packet.empty()) {
+    return false;
+  }
+  // Only a run of near-maximum packets fills the lacing table before the second is over.
+  if(page_lacing_.size() + packet.size() / 255 + 1 > SV_OGG_MAX_SEGMENTS && !WriteQueuedPage(0)) {
+    return false;
+  }
+  AddLacing(packet.size(), &page_lacing_);
+  page_data_.insert(page_data_.end(), packet.begin(), packet.end());
+  page_packets_++;
+  packets_++;
+  return page_packets_ < SV_OPUS_PAGE_PACKETS || WriteQueuedPage(0);
+}
+
+bool SVOpusFileOutput::WriteQueuedPage(uint8_t flags) {
+  const uint64_t granule_scale = SV_OPUS_GRANULE_RATE / format_.sample_rate;
+  // The last page's granule position trims the padding, the others count whole packets.
+  const uint64_t frames = flags & SV_OGG_LAST_PAGE ? input_bytes_ / format_.BytesPerFrame()
+                                                   : packets_ * encoder_.frame_length();
+  const bool written = WritePage(page_data_.data(), page_data_.size(), page_lacing_.data(), page_lacing_.size(),
+                                 encoder_.pre_skip() + frames * granule_scale, flags);
+  page_data_.clear();
+  page_lacing_.clear();
+  page_packets_ = 0;
+  return written;
+}
+
+bool SVOpusFileOutput::WriteHeaderPage(const uint8_t* packet, size_t len, uint8_t flags) {
+  std::vector<uint8_t> lacing;
+  AddLacing(len, &lacing);
+  return WritePage(packet, len, lacing.data(), lacing.size(), 0, flags);
+}
+
+bool SVOpusFileOutput::WritePage(const uint8_t* data, size_t len, const uint8_t* lacing, size_t segments,
+                                 uint64_t granule, uint8_t flags) {
+  uint8_t header[SV_OGG_HEADER_SIZE + SV_OGG_MAX_SEGMENTS];
+  memcpy(header, "OggS", 4);
+  header[4] = 0;
+  header[5] = flags;
+  PutLE(header + 6, granule, 8);
+  PutLE(header + 14, serial_, 4);
+  PutLE(header + 18, page_sequence_++, 4);
+  PutLE(header + 22, 0, 4);
+  header[26] = static_cast<uint8_t>(segments);
+  memcpy(header + SV_OGG_HEADER_SIZE, lacing, segments);
+  const size_t header_size = SV_OGG_HEADER_SIZE + segments;
+  PutLE(header + 22, OggCrc(OggCrc(0, header, header_size), data, len), 4);
+  return output_->Write(header, header_size) == header_size && output_->Write(data, len) == len;
+}
+
+int SVOpusFileOutput::WriteAt(uint64_t offset, const void* data, size_t len) {
+  return output_->WriteAt(offset, data, len);
+}
+
+int SVOpusFileOutput::Close() {
+  if(!opened_) {
+    return SV_NO_ERROR;
+  }
+  opened_ = false;
+  // Zeros complete the last packet and push the encoder delay out, the granule position of
+  // the last page trims them off again.
+  const uint64_t frame_length = static_cast<uint64_t>(encoder_.frame_length());
+  const uint64_t wanted = input_bytes_ / format_.BytesPerFrame() +
+                          encoder_.pre_skip() / (SV_OPUS_GRANULE_RATE / format_.sample_rate);
+  bool ok = true;
+  while(ok && packets_ * frame_length < wanted) {
+    memset(pending_.data() + pending_bytes_, 0, pending_.size() - pending_bytes_);
+    ok = EncodePending();
+  }
+  if(!ok || !WriteQueuedPage(SV_OGG_LAST_PAGE)) {
+    AV_LOGE("SVOpusFileOutput write last page failed.");
+  }
+
+  const SVOpusEncoderStats& stats = encoder_.stats();
+  double seconds = static_cast<double>(stats.frames_encoded) / format_.sample_rate;
+  AV_LOGI("SVOpusFileOutput closed, %.1fs audio, %.1f kbps, encode:%.2fms (%.1fx realtime)", seconds,
+          seconds > 0 ? stats.output_bytes * 8.0 / 1000.0 / seconds : 0.0, stats.encode_ns / 1e6,
+          stats.encode_ns ? seconds * 1e9 / stats.encode_ns : 0.0);
+  return output_->Close();
+}
+
+// CRC of a complete page, computed with its checksum field as zeros.
+static uint32_t PageCrc(const uint8_t* page, size_t len, uint8_t flags) {
+  uint8_t header[SV_OGG_HEADER_SIZE];
+  memcpy(header, page, sizeof(header));
+  header[5] = flags;
+  PutLE(header + 22, 0, 4);
+  return OggCrc(OggCrc(0, header, sizeof(header)), page + SV_OGG_HEADER_SIZE, len - SV_OGG_HEADER_SIZE);
+}
+
+int SVOpusRepairFile(const std::string& file_path, uint64_t length, uint64_t* frames) {
+  int fd = open(file_path.c_str(), O_RDWR);
+  if(fd < 0) {
+    AV_LOGW("SVOpusRepairFile open %s failed: %s", file_path.c_str(), strerror(errno));
+    return SV_INIT_ERROR;
+  }
+  struct stat st;
+  if(fstat(fd, &st) == 0) {
+    length = std::min<uint64_t>(length, static_cast<uint64_t>(st.st_size));
+  }
+  void* map = length >= SV_OGG_HEADER_SIZE ? mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  if(map == MAP_FAILED) {
+    AV_LOGW("SVOpusRepairFile %s has no usable header.", file_path.c_str());
+    close(fd);
+    return SV_INIT_ERROR;
+  }
+  const uint8_t* data = static_cast<const uint8_t*>(map);
+
+  // Every complete page, the first one carrying the identification header.
+  size_t pos = 0;
+  size_t last_page = 0;
+  size_t last_size = 0;
+  uint64_t granule = 0;
+  uint64_t pre_skip = 0;
+  uint64_t sample_rate = 0;
+  while(pos + SV_OGG_HEADER_SIZE <= length) {
+    const uint8_t* page = data + pos;
+    const size_t segments = page[26];
+    if(memcmp(page, "OggS", 4) != 0 || page[4] != 0 || pos + SV_OGG_HEADER_SIZE + segments > length) {
+      break;
+    }
+    size_t size = SV_OGG_HEADER_SIZE + segments;
+    for(size_t i = 0; i < segments; i++) {
+      size += page[SV_OGG_HEADER_SIZE + i];
+    }
+    if(pos + size > length || PageCrc(page, size, page[5]) != GetLE(page + 22, 4)) {
+      break;
+    }
+    if(pos == 0) {
+      const uint8_t* head = page + SV_OGG_HEADER_SIZE + segments;
+      if(size < SV_OGG_HEADER_SIZE + segments + SV_OPUS_HEAD_SIZE || memcmp(head, "OpusHead", 8) != 0) {
+        break;
+      }
+      pre_skip = GetLE(head + 10, 2);
+      sample_rate = GetLE(head + 12, 4);
+    }
+    granule = GetLE(page + 6, 8);
+    last_page = pos;
+    last_size = size;
+    pos += size;
+  }
+  int result = SV_NO_ERROR;
+  uint8_t patch[5];
+  bool patch_last = false;
+  if(sample_rate == 0 || !SVOpusSupportsRate(static_cast<int>(sample_rate))) {
+    AV_LOGW("SVOpusRepairFile %s has no usable header.", file_path.c_str());
+    result = SV_INIT_ERROR;
+  } else if(!(data[last_page + 5] & SV_OGG_LAST_PAGE)) {
+    const uint8_t flags = data[last_page + 5] | SV_OGG_LAST_PAGE;
+    patch[0] = flags;
+    PutLE(patch + 1, PageCrc(data + last_page, last_size, flags), 4);
+    patch_last = true;
+  }
+  munmap(map, length);
+  if(result != SV_NO_ERROR) {
+    close(fd);
+    return result;
+  }
+
+  // The flags are followed by the granule, serial and sequence number, then the CRC.
+  if(ftruncate(fd, static_cast<off_t>(pos)) != 0 ||
+     (patch_last && (pwrite(fd, patch, 1, static_cast<off_t>(last_page + 5)) != 1 ||
+                     pwrite(fd, patch + 1, 4, static_cast<off_t>(last_page + 22)) != 4))) {
+    AV_LOGW("SVOpusRepairFile %s failed: %s", file_path.c_str(), strerror(errno));
+    result = SV_INIT_ERROR;
+  }
+  close(fd);
+  *frames = granule > pre_skip ? (granule - pre_skip) * sample_rate / SV_OPUS_GRANULE_RATE : 0;
+  return result;
+}
+
+}
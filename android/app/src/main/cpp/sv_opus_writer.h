@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_OPUS_WRITER_H
+#define AOS_AUDIO_RECORD_SV_OPUS_WRITER_H
+
+#include <vector>
+#include "sv_common.h"
+#include "sv_file_output.h"
+
+struct OpusEncoder;
+
+namespace sv_recorder {
+
+// 20ms packets, the Opus default.
+const int SV_OPUS_FRAME_MS = 20;
+const int SV_OPUS_MAX_CHANNELS = 2;
+const int32_t SV_OPUS_DEFAULT_BITRATE = 32000;
+const int32_t SV_OPUS_MIN_BITRATE = 6000;
+const int32_t SV_OPUS_MAX_BITRATE = 256000;
+// 0..10, 10 is the libopus default; 5 keeps the writer thread light on low-end phones.
+const int SV_OPUS_COMPLEXITY = 5;
+// Ogg Opus granule positions and the pre-skip count 48kHz samples whatever the input rate.
+const int SV_OPUS_GRANULE_RATE = 48000;
+// Packets per Ogg page: a page holds one second, so every second starts a page.
+const int SV_OPUS_PAGE_PACKETS = 1000 / SV_OPUS_FRAME_MS;
+// Fixed part of an Ogg page header, the lacing values follow.
+const size_t SV_OGG_HEADER_SIZE = 27;
+
+// False when built without libopus, SV_CONTAINER_OPUS is then rejected.
+bool SVOpusAvailable();
+
+inline bool SVOpusSupportsRate(int sample_rate) {
+  return sample_rate == 8000 || sample_rate == 12000 || sample_rate == 16000 || sample_rate == 24000 ||
+         sample_rate == 48000;
+}
+
+struct SVOpusEncoderStats {
+    uint64_t frames_encoded;
+    uint64_t input_bytes;
+    uint64_t output_bytes;
+    uint64_t encode_ns;
+};
+
+// libopus encoder for one mono or stereo stream at a rate Opus codes natively.
+class SVOpusEncoder {
+
+public:
+    SVOpusEncoder();
+    ~SVOpusEncoder();
+
+    int Init(int sample_rate, int channels, int32_t bitrate);
+    int frame_length() const { return frame_length_; }
+    // Encoder delay at SV_OPUS_GRANULE_RATE, a decoder drops this much from the start.
+    int pre_skip() const { return pre_skip_; }
+    // Encodes frame_length() interleaved frames into one packet, empty on error.
+    const std::vector<uint8_t>& EncodeFrame(const int16_t* samples);
+    const std::vector<uint8_t>& EncodeFrame(const float* samples);
+
+    const SVOpusEncoderStats& stats() const { return stats_; }
+
+private:
+    void Release();
+    const std::vector<uint8_t>& EndFrame(int result, int64_t begin_ns, size_t sample_bytes);
+
+private:
+    OpusEncoder* encoder_;
+    int channels_;
+    int frame_length_;
+    int pre_skip_;
+    std::vector<uint8_t> packet_;
+    SVOpusEncoderStats stats_;
+};
+
+// Streaming Ogg Opus (RFC 7845) container on top of another ISVFileOutput. Incoming PCM is
+// batched into SV_OPUS_FRAME_MS packets and encoded on the disk writer thread; I24 is
+// encoded from float. Pages are written once per second of packets, Flush() leaves a
+// partial page queued so seconds and pages stay aligned.
+class SVOpusFileOutput : public ISVFileOutput {
+
+public:
+    SVOpusFileOutput(ISVFileOutput::Ptr output, const SVAudioFormat& format, int32_t bitrate);
+    ~SVOpusFileOutput() override;
+    int Open(const std::string& file_path) override;
+    size_t Write(const void* data, size_t len) override;
+    int WriteAt(uint64_t offset, const void* data, size_t len) override;
+    int Flush() override { return output_->Flush(); }
+    int Close() override;
+    uint64_t Size() const override { return output_->Size(); }
+    SVFileOutputStats GetStats() const override { return output_->GetStats(); }
+
+    const SVOpusEncoderStats& encoder_stats() const { return encoder_.stats(); }
+
+private:
+    bool EncodePending();
+    bool AddPacket(const std::vector<uint8_t>& packet);
+    bool WritePage(const uint8_t* data, size_t len, const uint8_t* lacing, size_t segments, uint64_t granule,
+                   uint8_t flags);
+    bool WriteQueuedPage(uint8_t flags);
+    bool WriteHeaderPage(const uint8_t* packet, size_t len, uint8_t flags);
+
+private:
+    ISVFileOutput::Ptr output_;
+    SVAudioFormat format_;
+    int32_t bitrate_;
+    SVOpusEncoder encoder_;
+    std::vector<uint8_t> pending_;
+    size_t pending_bytes_;
+    std::vector<float> float_frame_;
+    // Packets of the page being filled.
+    std::vector<uint8_t> page_data_;
+    std::vector<uint8_t> page_lacing_;
+    int page_packets_;
+    uint32_t serial_;
+    uint32_t page_sequence_;
+    // Bytes fed to the encoder, padding excluded.
+    uint64_t input_bytes_;
+    uint64_t packets_;
+    bool opened_;
+};
+
+// Makes an Ogg Opus file written by SVOpusFileOutput that was never closed playable: keeps
+// the complete pages in the first |length| bytes, cuts off a torn last one and marks the
+// last page kept as the end of the stream. |frames| receives the frames kept at the input rate.
+int SVOpusRepairFile(const std::string& file_path, uint64_t length, uint64_t* frames);
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_OPUS_WRITER_H
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_PREROLL_BUFFER_H
+#define AOS_AUDIO_RECORD_SV_PREROLL_BUFFER_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace sv_recorder {
+
+// Fixed-size history of the most recent audio: appending beyond the capacity overwrites
+// the oldest bytes. Single-threaded, owned by the disk writer thread.
+class SVPrerollBuffer {
+
+public:
+    SVPrerollBuffer() : allocated_(0), capacity_(0), head_(0), size_(0) {}
+
+    // Not thread safe. Allocates only when growing, so a restart keeps the buffer.
+    void Reset(size_t capacity) {
+      if (capacity > allocated_) {
+        buffer_.reset(new uint8_t[capacity]);
+        allocated_ = capacity;
+      }
+      capacity_ = capacity;
+      Clear();
+    }
+
+    void Clear() {
+      head_ = 0;
+      size_ = 0;
+    }
+
+    size_t Capacity() const { return capacity_; }
+    size_t Size() const { return size_; }
+
+    void Append(const void* data, size_t len) {
+      if (capacity_ == 0) {
+        return;
+      }
+      const uint8_t* src = static_cast<const uint8_t*>(data);
+      if (len >= capacity_) {
+        // Only the newest |capacity_| bytes survive.
+        memcpy(buffer_.get(), src + len - capacity_, capacity_);
+        head_ = 0;
+        size_ = capacity_;
+        return;
+      }
+      size_t tail = (head_ + size_) % capacity_;
+      size_t first = capacity_ - tail < len ? capacity_ - tail : len;
+      memcpy(buffer_.get() + tail, src, first);
+      memcpy(buffer_.get(), src + first, len - first);
+      size_ += len;
+      if (size_ > capacity_) {
+        head_ = (head_ + size_ - capacity_) % capacity_;
+        size_ = capacity_;
+      }
+    }
+
+    // Calls |fn(data, len)| for the stored bytes from oldest to newest, in at most two regions.
+    template <typename Fn>
+    void Visit(Fn fn) const {
+      size_t first = capacity_ - head_ < size_ ? capacity_ - head_ : size_;
+      if (first > 0) {
+        fn(buffer_.get() + head_, first);
+      }
+      if (size_ > first) {
+        fn(buffer_.get(), size_ - first);
+      }
+    }
+
+private:
+    std::unique_ptr<uint8_t[]> buffer_;
+    size_t allocated_;
+    size_t capacity_;
+    size_t head_;
+    size_t size_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_PREROLL_BUFFER_H
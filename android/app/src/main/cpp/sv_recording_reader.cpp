@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_recording_reader.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+#include "log.h"
+#include "sv_flac_writer.h"
+#include "sv_opus_writer.h"
+#include "sv_wav_writer.h"
+
+namespace sv_recorder {
+
+static SVIndexSummary CombineSummaries(const SVIndexSummary* summaries, size_t count) {
+  uint16_t peak = 0;
+  double square_sum = 0.0;
+  for(size_t i = 0; i < count; i++) {
+    peak = std::max(peak, summaries[i].peak);
+    square_sum += static_cast<double>(summaries[i].rms) * summaries[i].rms;
+  }
+  const double rms = count > 0 ? std::sqrt(square_sum / count) : 0.0;
+  return {peak, static_cast<uint16_t>(std::min(rms + 0.5, 65535.0))};
+}
+
+SVRecordingReader::SVRecordingReader() : fd_(-1), map_(nullptr), map_size_(0), data_(nullptr) {
+}
+
+SVRecordingReader::~SVRecordingReader() {
+  Close();
+}
+
+int SVRecordingReader::Open(const std::string& file_path, const SVAudioFormat& raw_format) {
+  Close();
+  int result = Map(file_path);
+  SVAudioFormat format;
+  SV_CONTAINER_TYPE container;
+  uint64_t data_offset = 0;
+  uint64_t data_frames = 0;
+  if(result == SV_NO_ERROR) {
+    result = ParseHeader(raw_format, &format, &container, &data_offset, &data_frames);
+  }
+  if(result != SV_NO_ERROR) {
+    Close();
+    return result;
+  }
+
+  const std::string index_path = file_path + SV_INDEX_SUFFIX;
+  bool usable = index_.Load(index_path) == SV_NO_ERROR && index_.container() == container;
+  if(container == SV_CONTAINER_FLAC || container == SV_CONTAINER_OPUS) {
+    // Without a decoder there is nothing to rebuild the index from.
+    if(!usable) {
+      AV_LOGW("SVRecordingReader %s has no index.", file_path.c_str());
+      Close();
+      return SV_INIT_ERROR;
+    }
+  } else {
+    data_ = map_ ? map_ + data_offset : nullptr;
+    usable = usable && index_.format().sample_rate == format.sample_rate &&
+             index_.format().channels == format.channels && index_.format().sample_format == format.sample_format &&
+             index_.data_offset() == data_offset && index_.frames() == data_frames;
+    if(!usable) {
+      Rebuild(format, container, data_offset, data_frames);
+      index_.Save(index_path);
+    }
+  }
+  BuildLevels();
+  return SV_NO_ERROR;
+}
+
+void SVRecordingReader::Close() {
+  if(map_) {
+    munmap(map_, map_size_);
+    map_ = nullptr;
+  }
+  if(fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  map_size_ = 0;
+  data_ = nullptr;
+  index_ = SVFileIndex();
+  levels_.clear();
+}
+
+int SVRecordingReader::Map(const std::string& file_path) {
+  fd_ = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if(fd_ < 0 || fstat(fd_, &st) != 0) {
+    AV_LOGW("SVRecordingReader open %s failed: %s", file_path.c_str(), strerror(errno));
+    return SV_INIT_ERROR;
+  }
+  if(static_cast<uint64_t>(st.st_size) > SIZE_MAX) {
+    AV_LOGW("SVRecordingReader %s does not fit into the address space.", file_path.c_str());
+    return SV_INIT_ERROR;
+  }
+  map_size_ = static_cast<size_t>(st.st_size);
+  if(map_size_ == 0) {
+    return SV_NO_ERROR;
+  }
+  void* map = mmap(nullptr, map_size_, PROT_READ, MAP_SHARED, fd_, 0);
+  if(map == MAP_FAILED) {
+    AV_LOGW("SVRecordingReader mmap %s failed: %s", file_path.c_str(), strerror(errno));
+    return SV_INIT_ERROR;
+  }
+  map_ = static_cast<uint8_t*>(map);
+  return SV_NO_ERROR;
+}
+
+int SVRecordingReader::ParseHeader(const SVAudioFormat& raw_format, SVAudioFormat* format,
+                                   SV_CONTAINER_TYPE* container, uint64_t* data_offset,
+                                   uint64_t* data_frames) const {
+  if(map_size_ >= 4 && memcmp(map_, "fLaC", 4) == 0) {
+    // Format and length come from the index.
+    *container = SV_CONTAINER_FLAC;
+    *format = raw_format;
+    return SV_NO_ERROR;
+  }
+  if(map_size_ >= 4 && memcmp(map_, "OggS", 4) == 0) {
+    *container = SV_CONTAINER_OPUS;
+    *format = raw_format;
+    return SV_NO_ERROR;
+  }
+  SVWavHeaderInfo info;
+  if(map_size_ >= 4 && (memcmp(map_, "RIFF", 4) == 0 || memcmp(map_, "RF64", 4) == 0)) {
+    if(!SVWavParseHeader(map_, map_size_, &info) || info.format.channels > SV_MAX_CONVERT_CHANNELS ||
+       info.data_offset > map_size_) {
+      AV_LOGW("SVRecordingReader unsupported WAV header.");
+      return SV_INIT_ERROR;
+    }
+    // A WAV file that was never closed has a stale size, the file length is what counts.
+    const uint64_t data_size = std::min<uint64_t>(info.data_size, map_size_ - info.data_offset);
+    *container = SV_CONTAINER_WAV;
+    *format = info.format;
+    *data_offset = info.data_offset;
+    *data_frames = data_size / info.format.BytesPerFrame();
+    return SV_NO_ERROR;
+  }
+  if(raw_format.sample_rate <= 0 || raw_format.channels <= 0 || raw_format.channels > SV_MAX_CONVERT_CHANNELS) {
+    AV_LOGW("SVRecordingReader raw file needs a format, rate:%d, channels:%d", raw_format.sample_rate,
+            raw_format.channels);
+    return SV_INIT_ERROR;
+  }
+  *container = SV_CONTAINER_RAW;
+  *format = raw_format;
+  *data_offset = 0;
+  *data_frames = map_size_ / raw_format.BytesPerFrame();
+  return SV_NO_ERROR;
+}
+
+void SVRecordingReader::Rebuild(const SVAudioFormat& format, SV_CONTAINER_TYPE container, uint64_t data_offset,
+                                uint64_t frames) {
+  const int64_t begin_ns = SVNowNs();
+  index_.Reset(format, container, data_offset);
+  const uint64_t second_bytes = format.BytesPerSecond();
+  const uint64_t bytes = frames * format.BytesPerFrame();
+  if(map_) {
+    madvise(map_, map_size_, MADV_SEQUENTIAL);
+  }
+  for(uint64_t offset = 0; offset < bytes; offset += second_bytes) {
+    index_.AddSecond(data_offset + offset);
+    index_.AddAudio(data_ + offset, static_cast<size_t>(std::min(second_bytes, bytes - offset)));
+  }
+  index_.Finish();
+  if(map_) {
+    madvise(map_, map_size_, MADV_NORMAL);
+  }
+  AV_LOGI("SVRecordingReader rebuilt the index, %" PRIu64 " frames in %" PRId64 "us.", frames,
+          (SVNowNs() - begin_ns) / 1000);
+}
+
+void SVRecordingReader::BuildLevels() {
+  levels_.clear();
+  levels_.push_back(index_.summaries());
+  while(levels_.back().size() > 1) {
+    const std::vector<SVIndexSummary>& below = levels_.back();
+    std::vector<SVIndexSummary> level((below.size() + SV_OVERVIEW_FACTOR - 1) / SV_OVERVIEW_FACTOR);
+    for(size_t i = 0; i < level.size(); i++) {
+      const size_t first = i * SV_OVERVIEW_FACTOR;
+      level[i] = CombineSummaries(&below[first], std::min<size_t>(SV_OVERVIEW_FACTOR, below.size() - first));
+    }
+    levels_.push_back(std::move(level));
+  }
+}
+
+uint64_t SVRecordingReader::SeekOffset(uint64_t frame, uint64_t* skip_frames) const {
+  frame = std::min(frame, frames());
+  const std::vector<uint64_t>& offsets = index_.second_offsets();
+  if(has_samples() || offsets.empty()) {
+    *skip_frames = has_samples() ? 0 : frame;
+    return index_.data_offset() + (has_samples() ? frame * format().BytesPerFrame() : 0);
+  }
+  const std::vector<uint64_t>& blocks = index_.block_offsets();
+  if(!blocks.empty()) {
+    const size_t block = static_cast<size_t>(std::min<uint64_t>(frame / SV_FLAC_BLOCK_FRAMES, blocks.size() - 1));
+    *skip_frames = frame - uint64_t(block) * SV_FLAC_BLOCK_FRAMES;
+    return blocks[block];
+  }
+  const uint64_t rate = static_cast<uint64_t>(format().sample_rate);
+  if(container() == SV_CONTAINER_OPUS) {
+    // A page per second: its packets decode from the second's start less the pre-skip,
+    // read from the identification header on the first page.
+    const size_t second = static_cast<size_t>(std::min<uint64_t>(frame / rate, offsets.size() - 1));
+    const size_t head = SV_OGG_HEADER_SIZE + 1;
+    const uint64_t pre_skip = map_size_ >= head + 12 ? map_[head + 10] | map_[head + 11] << 8 : 0;
+    *skip_frames = frame - second * rate + pre_skip * rate / SV_OPUS_GRANULE_RATE;
+    return offsets[second];
+  }
+  const size_t second = static_cast<size_t>(std::min<uint64_t>(frame / rate, offsets.size() - 1));
+  // The second's offset is that of the FLAC frame holding its first sample.
+  const uint64_t first_frame = second * rate / SV_FLAC_BLOCK_FRAMES * SV_FLAC_BLOCK_FRAMES;
+  *skip_frames = frame - first_frame;
+  return offsets[second];
+}
+
+const uint8_t* SVRecordingReader::FramePointer(uint64_t frame) const {
+  if(!data_ || frame >= frames()) {
+    return nullptr;
+  }
+  return data_ + frame * format().BytesPerFrame();
+}
+
+size_t SVRecordingReader::ReadFrames(uint64_t first_frame, size_t frames, void* out) const {
+  const uint8_t* src = FramePointer(first_frame);
+  if(!src) {
+    return 0;
+  }
+  frames = static_cast<size_t>(std::min<uint64_t>(frames, this->frames() - first_frame));
+  memcpy(out, src, frames * format().BytesPerFrame());
+  return frames;
+}
+
+size_t SVRecordingReader::Overview(uint64_t first_frame, uint64_t frames, size_t columns,
+                                   SVIndexSummary* out) const {
+  if(columns == 0 || levels_.empty() || levels_[0].empty() || first_frame >= this->frames()) {
+    return 0;
+  }
+  frames = std::min(frames, this->frames() - first_frame);
+  size_t level = 0;
+  uint64_t span = SV_INDEX_SUMMARY_FRAMES;
+  while(level + 1 < levels_.size() && span * SV_OVERVIEW_FACTOR * columns <= frames) {
+    level++;
+    span *= SV_OVERVIEW_FACTOR;
+  }
+  const std::vector<SVIndexSummary>& summaries = levels_[level];
+  for(size_t column = 0; column < columns; column++) {
+    const uint64_t begin = first_frame + frames * column / columns;
+    const uint64_t end = first_frame + frames * (column + 1) / columns;
+    const size_t first = static_cast<size_t>(std::min<uint64_t>(begin / span, summaries.size() - 1));
+    const size_t last = static_cast<size_t>(std::min<uint64_t>((end + span - 1) / span, summaries.size()));
+    out[column] = CombineSummaries(&summaries[first], std::max(last, first + 1) - first);
+  }
+  return columns;
+}
+
+}
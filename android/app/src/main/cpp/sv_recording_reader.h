@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_RECORDING_READER_H
+#define AOS_AUDIO_RECORD_SV_RECORDING_READER_H
+
+#include <string>
+#include <vector>
+#include "sv_common.h"
+#include "sv_file_index.h"
+
+namespace sv_recorder {
+
+// Each overview level summarises this many entries of the level below.
+const uint32_t SV_OVERVIEW_FACTOR = 4;
+
+// Random access to a recorded file. Raw and WAV files are mapped read-only, so a seek is
+// arithmetic and a window is one copy out of the page cache. The index is <file>.idx, or
+// is rebuilt with one pass over the mapping and saved when a crash left none behind.
+// FLAC and Opus files need their index and offer seek offsets, overview and gaps but no samples.
+class SVRecordingReader {
+
+public:
+    SVRecordingReader();
+    ~SVRecordingReader();
+
+    // |raw_format| describes a raw PCM file, WAV, FLAC and Opus files describe themselves.
+    int Open(const std::string& file_path, const SVAudioFormat& raw_format);
+    void Close();
+
+    const SVAudioFormat& format() const { return index_.format(); }
+    SV_CONTAINER_TYPE container() const { return index_.container(); }
+    uint64_t frames() const { return index_.frames(); }
+    const SVFileIndex& index() const { return index_; }
+    bool has_samples() const { return container() == SV_CONTAINER_RAW || container() == SV_CONTAINER_WAV; }
+    uint64_t FrameAt(int64_t ms) const { return ms > 0 ? static_cast<uint64_t>(ms) * format().sample_rate / 1000 : 0; }
+
+    // File offset a decoder can start at to reach |frame|, |skip_frames| receives the frames
+    // to drop from there: 0 for raw and WAV, less than a FLAC frame for FLAC. A version 1
+    // index has only the second offsets, the skip can then reach a second and a FLAC frame.
+    // For Opus the offset is the page starting the second and the skip counts from its first
+    // decoded frame, pre-skip included; exact output needs 80ms of preroll before the page.
+    uint64_t SeekOffset(uint64_t frame, uint64_t* skip_frames) const;
+    // Interleaved PCM of |frame| in the mapping, valid until Close(). nullptr past the end and for FLAC.
+    const uint8_t* FramePointer(uint64_t frame) const;
+    // Copies up to |frames| frames from |first_frame| to |out|, returns the frames copied.
+    size_t ReadFrames(uint64_t first_frame, size_t frames, void* out) const;
+    // Peak and RMS of |columns| equal slices of [first_frame, first_frame + frames), taken
+    // from the coarsest level that still has a summary per column. Returns the columns filled.
+    size_t Overview(uint64_t first_frame, uint64_t frames, size_t columns, SVIndexSummary* out) const;
+    size_t level_count() const { return levels_.size(); }
+
+private:
+    int Map(const std::string& file_path);
+    int ParseHeader(const SVAudioFormat& raw_format, SVAudioFormat* format, SV_CONTAINER_TYPE* container,
+                    uint64_t* data_offset, uint64_t* data_frames) const;
+    void Rebuild(const SVAudioFormat& format, SV_CONTAINER_TYPE container, uint64_t data_offset, uint64_t frames);
+    void BuildLevels();
+
+private:
+    int fd_;
+    uint8_t* map_;
+    size_t map_size_;
+    // Start of the audio in the mapping, nullptr for FLAC.
+    const uint8_t* data_;
+    SVFileIndex index_;
+    // Level n holds one summary per SV_INDEX_SUMMARY_FRAMES * SV_OVERVIEW_FACTOR^n frames.
+    std::vector<std::vector<SVIndexSummary>> levels_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_RECORDING_READER_H
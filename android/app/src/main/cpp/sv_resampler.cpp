@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_resampler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "log.h"
+
+namespace sv_recorder {
+
+struct SVResampleParams {
+    double attenuation_db;
+    // Passband edge as a fraction of the lower Nyquist frequency, the stopband starts at it.
+    double passband;
+};
+
+static const SVResampleParams kResampleParams[] = {
+        {60.0, 0.80},
+        {85.0, 0.90},
+        {100.0, 0.95},
+};
+
+static int Gcd(int a, int b) {
+  while(b != 0) {
+    int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// Zeroth-order modified Bessel function of the first kind, for the Kaiser window.
+static double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for(int k = 1; k < 50; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if(term < sum * 1e-12) {
+      break;
+    }
+  }
+  return sum;
+}
+
+SVResampler::SVResampler()
+  : in_rate_(0), out_rate_(0), channels_(0), up_(1), down_(1), taps_(0), position_(0) {
+}
+
+int SVResampler::Init(int in_rate, int out_rate, int channels, SV_RESAMPLE_QUALITY quality) {
+  if(in_rate <= 0 || out_rate <= 0 || channels <= 0 || channels > SV_MAX_CONVERT_CHANNELS ||
+     quality < SV_RESAMPLE_LOW || quality > SV_RESAMPLE_HIGH) {
+    AV_LOGW("SVResampler invalid config: %d -> %d, channels:%d, quality:%d", in_rate, out_rate, channels, quality);
+    return SV_INIT_ERROR;
+  }
+  const int gcd = Gcd(in_rate, out_rate);
+  if(out_rate / gcd > SV_RESAMPLE_MAX_PHASES) {
+    AV_LOGW("SVResampler ratio %d/%d needs %d phases.", out_rate, in_rate, out_rate / gcd);
+    return SV_INIT_ERROR;
+  }
+  in_rate_ = in_rate;
+  out_rate_ = out_rate;
+  channels_ = channels;
+  up_ = out_rate / gcd;
+  down_ = in_rate / gcd;
+
+  // Kaiser's design formulas: the transition band (1 - passband) * Nyquist at the lower
+  // rate sets the length, the attenuation sets beta. Decimation spans in/out times more input.
+  const SVResampleParams& params = kResampleParams[quality];
+  const double transition = (1.0 - params.passband) / 2.0;
+  const double beta = 0.1102 * (params.attenuation_db - 8.7);
+  const double span = ceil((params.attenuation_db - 7.95) / (14.36 * transition) *
+                           std::max(1.0, static_cast<double>(in_rate) / out_rate));
+  taps_ = (static_cast<int>(span) + 7) & ~7;
+  const int length = taps_ * up_;
+  // Prototype lowpass at the upsampled rate in_rate * up_, centered in the transition band.
+  const double cutoff = (1.0 + params.passband) / 2.0 * 0.5 * std::min(in_rate, out_rate) /
+                        (static_cast<double>(in_rate) * up_);
+  const double center = (length - 1) / 2.0;
+  const double i0_beta = BesselI0(beta);
+  std::vector<double> prototype(length);
+  double sum = 0.0;
+  for(int i = 0; i < length; i++) {
+    double x = i - center;
+    double sinc = x == 0.0 ? 1.0 : sin(2.0 * M_PI * cutoff * x) / (2.0 * M_PI * cutoff * x);
+    double r = length > 1 ? 2.0 * i / (length - 1) - 1.0 : 0.0;
+    double window = BesselI0(beta * sqrt(std::max(0.0, 1.0 - r * r))) / i0_beta;
+    prototype[i] = 2.0 * cutoff * sinc * window;
+    sum += prototype[i];
+  }
+
+  // Unity gain per phase, time-reversed so coefficient j multiplies history frame j.
+  coeffs_.resize(static_cast<size_t>(length));
+  for(int phase = 0; phase < up_; phase++) {
+    for(int j = 0; j < taps_; j++) {
+      coeffs_[phase * taps_ + j] = static_cast<float>(prototype[phase + (taps_ - 1 - j) * up_] * up_ / sum);
+    }
+  }
+
+  const size_t stride = taps_ - 1 + SV_RESAMPLE_BLOCK_FRAMES;
+  planar_.resize(stride * channels_);
+  channel_ptrs_.resize(channels_);
+  for(int ch = 0; ch < channels_; ch++) {
+    channel_ptrs_[ch] = planar_.data() + ch * stride;
+  }
+  Reset();
+  return SV_NO_ERROR;
+}
+
+void SVResampler::Reset() {
+  std::fill(planar_.begin(), planar_.end(), 0.0f);
+  position_ = static_cast<int64_t>(lrint(delay_frames() * up_));
+}
+
+size_t SVResampler::MaxOutputFrames(size_t in_frames) const {
+  return (in_frames * up_ + down_ - 1) / down_;
+}
+
+size_t SVResampler::Process(const float* in, size_t in_frames, float* out) {
+  const SVConvertKernels& kernels = SVConvert();
+  const size_t history = taps_ - 1;
+  float* block[SV_MAX_CONVERT_CHANNELS];
+  size_t produced = 0;
+
+  while(in_frames > 0) {
+    const size_t frames = std::min(in_frames, SV_RESAMPLE_BLOCK_FRAMES);
+    for(int ch = 0; ch < channels_; ch++) {
+      block[ch] = channel_ptrs_[ch] + history;
+    }
+    if(channels_ == 1) {
+      memcpy(block[0], in, frames * sizeof(float));
+    } else {
+      kernels.deinterleave(in, block, frames, channels_);
+    }
+
+    // Output frame at input position p needs frames p - history .. p, which start at
+    // index p of the planar buffer because the history sits in front of the block.
+    const int64_t end = static_cast<int64_t>(frames) * up_;
+    for(; position_ < end; position_ += down_) {
+      const int64_t base = position_ / up_;
+      const float* coeffs = coeffs_.data() + (position_ % up_) * taps_;
+      for(int ch = 0; ch < channels_; ch++) {
+        out[produced * channels_ + ch] = kernels.dot(coeffs, channel_ptrs_[ch] + base, taps_);
+      }
+      produced++;
+    }
+    position_ -= end;
+
+    for(int ch = 0; ch < channels_; ch++) {
+      memmove(channel_ptrs_[ch], channel_ptrs_[ch] + frames, history * sizeof(float));
+    }
+    in += frames * channels_;
+    in_frames -= frames;
+  }
+  return produced;
+}
+
+SVResampleFileOutput::SVResampleFileOutput(ISVFileOutput::Ptr output, const SVAudioFormat& format,
+                                           int out_rate, SV_RESAMPLE_QUALITY quality)
+  : output_(std::move(output)), format_(format), out_rate_(out_rate), quality_(quality), partial_bytes_(0),
+    opened_(false) {
+}
+
+int SVResampleFileOutput::Open(const std::string& file_path) {
+  if(format_.BytesPerFrame() > sizeof(partial_)) {
+    AV_LOGW("SVResampleFileOutput too many channels: %d", format_.channels);
+    return SV_INIT_ERROR;
+  }
+  int result = resampler_.Init(format_.sample_rate, out_rate_, format_.channels, quality_);
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  const size_t max_out = resampler_.MaxOutputFrames(SV_RESAMPLE_BLOCK_FRAMES) + 1;
+  in_float_.resize(SV_RESAMPLE_BLOCK_FRAMES * format_.channels);
+  out_float_.resize(max_out * format_.channels);
+  out_bytes_.resize(max_out * format_.BytesPerFrame());
+  partial_bytes_ = 0;
+  opened_ = true;
+  AV_LOGI("SVResampleFileOutput %d -> %d Hz, %d taps per phase.", format_.sample_rate, out_rate_, resampler_.taps());
+  return output_->Open(file_path);
+}
+
+size_t SVResampleFileOutput::Write(const void* data, size_t len) {
+  const size_t frame_bytes = format_.BytesPerFrame();
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  size_t remaining = len;
+
+  if(partial_bytes_ > 0) {
+    size_t take = std::min(frame_bytes - partial_bytes_, remaining);
+    memcpy(partial_ + partial_bytes_, src, take);
+    partial_bytes_ += take;
+    src += take;
+    remaining -= take;
+    if(partial_bytes_ < frame_bytes) {
+      return len;
+    }
+    partial_bytes_ = 0;
+    if(!ResampleFrames(partial_, 1)) {
+      return 0;
+    }
+  }
+
+  while(remaining >= frame_bytes) {
+    size_t frames = std::min(remaining / frame_bytes, SV_RESAMPLE_BLOCK_FRAMES);
+    if(!ResampleFrames(src, frames)) {
+      return len - remaining;
+    }
+    src += frames * frame_bytes;
+    remaining -= frames * frame_bytes;
+  }
+  memcpy(partial_, src, remaining);
+  partial_bytes_ = remaining;
+  return len;
+}
+
+bool SVResampleFileOutput::ResampleFrames(const uint8_t* data, size_t frames) {
+  const SVConvertKernels& kernels = SVConvert();
+  const size_t samples = frames * format_.channels;
+  float* in = in_float_.data();
+  if(format_.sample_format == SV_SAMPLE_F32) {
+    // Ring regions carry no alignment guarantee.
+    memcpy(in, data, samples * sizeof(float));
+  } else if(format_.sample_format == SV_SAMPLE_I24) {
+    kernels.i24_to_f32(data, in, samples);
+  } else {
+    kernels.i16_to_f32(reinterpret_cast<const int16_t*>(data), in, samples);
+  }
+
+  const size_t out_frames = resampler_.Process(in, frames, out_float_.data());
+  const size_t out_samples = out_frames * format_.channels;
+  const float* out = out_float_.data();
+  if(format_.sample_format == SV_SAMPLE_F32) {
+    memcpy(out_bytes_.data(), out, out_samples * sizeof(float));
+  } else if(format_.sample_format == SV_SAMPLE_I24) {
+    kernels.f32_to_i24(out, out_bytes_.data(), out_samples);
+  } else {
+    kernels.f32_to_i16(out, reinterpret_cast<int16_t*>(out_bytes_.data()), out_samples);
+  }
+  const size_t out_len = out_frames * format_.BytesPerFrame();
+  return output_->Write(out_bytes_.data(), out_len) == out_len;
+}
+
+int SVResampleFileOutput::WriteAt(uint64_t offset, const void* data, size_t len) {
+  return output_->WriteAt(offset, data, len);
+}
+
+int SVResampleFileOutput::Close() {
+  if(!opened_) {
+    return output_->Close();
+  }
+  opened_ = false;
+  // Push the filter's group delay of silence so the last captured frames come out.
+  std::vector<uint8_t> silence(static_cast<size_t>(ceil(resampler_.delay_frames())) * format_.BytesPerFrame(), 0);
+  partial_bytes_ = 0;
+  Write(silence.data(), silence.size());
+  resampler_.Reset();
+  return output_->Close();
+}
+
+}
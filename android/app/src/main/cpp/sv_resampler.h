@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_RESAMPLER_H
+#define AOS_AUDIO_RECORD_SV_RESAMPLER_H
+
+#include <cstdint>
+#include <vector>
+#include "sv_common.h"
+#include "sv_file_output.h"
+#include "sv_sample_convert.h"
+
+namespace sv_recorder {
+
+// Trades CPU for stopband rejection and passband width.
+enum SV_RESAMPLE_QUALITY : int32_t {
+    SV_RESAMPLE_LOW = 0,
+    SV_RESAMPLE_MEDIUM = 1,
+    SV_RESAMPLE_HIGH = 2
+};
+
+const int SV_MIN_OUTPUT_SAMPLE_RATE = 8000;
+const int SV_MAX_OUTPUT_SAMPLE_RATE = 192000;
+// Input frames converted per inner pass, bounds the planar work buffers.
+const size_t SV_RESAMPLE_BLOCK_FRAMES = 1024;
+// Upper bound of out_rate / gcd(in_rate, out_rate), i.e. filter phases kept in memory.
+const int SV_RESAMPLE_MAX_PHASES = 1024;
+
+// Streaming rational polyphase resampler. The rate ratio is reduced to L/M, a Kaiser
+// windowed sinc prototype is split into L phases, and every output frame is one dot
+// product per channel over the input history. State carries across Process() calls,
+// so arbitrary input chunking gives the same output.
+class SVResampler {
+
+public:
+    SVResampler();
+
+    int Init(int in_rate, int out_rate, int channels, SV_RESAMPLE_QUALITY quality);
+    // Forgets the input history, e.g. before a new recording.
+    void Reset();
+
+    // Output frames that |in_frames| more input frames can produce at most.
+    size_t MaxOutputFrames(size_t in_frames) const;
+    // Interleaved float in and out, returns the frames written to |out|.
+    size_t Process(const float* in, size_t in_frames, float* out);
+
+    int in_rate() const { return in_rate_; }
+    int out_rate() const { return out_rate_; }
+    int taps() const { return taps_; }
+    // Group delay of the filter in input frames, the center of the taps_ * up_ prototype.
+    double delay_frames() const { return (static_cast<double>(taps_) * up_ - 1) / (2.0 * up_); }
+
+private:
+    int in_rate_;
+    int out_rate_;
+    int channels_;
+    int up_;
+    int down_;
+    int taps_;
+    // up_ phases of taps_ coefficients, each stored time-reversed so it lines up with
+    // the oldest-first input history.
+    std::vector<float> coeffs_;
+    // Per channel: taps_ - 1 history frames followed by up to SV_RESAMPLE_BLOCK_FRAMES new ones.
+    std::vector<float> planar_;
+    std::vector<float*> channel_ptrs_;
+    // Position of the next output frame relative to the first new input frame, in 1/up_ frames.
+    // Starts one group delay in, so output frame 0 lines up with input frame 0.
+    int64_t position_;
+};
+
+// Writer-thread stage in front of a container output: converts the captured stream to
+// |out_rate| in the same sample format. The container below must be created with the
+// output rate.
+class SVResampleFileOutput : public ISVFileOutput {
+
+public:
+    SVResampleFileOutput(ISVFileOutput::Ptr output, const SVAudioFormat& format, int out_rate,
+                         SV_RESAMPLE_QUALITY quality);
+    int Open(const std::string& file_path) override;
+    size_t Write(const void* data, size_t len) override;
+    int WriteAt(uint64_t offset, const void* data, size_t len) override;
+    int Flush() override { return output_->Flush(); }
+    int Close() override;
+    uint64_t Size() const override { return output_->Size(); }
+    SVFileOutputStats GetStats() const override { return output_->GetStats(); }
+    // The gap as it comes out at the output rate.
+    void OnGap(uint64_t len) override {
+      const uint64_t frames = len / format_.BytesPerFrame() * out_rate_ / format_.sample_rate;
+      output_->OnGap(frames * format_.BytesPerFrame());
+    }
+
+private:
+    bool ResampleFrames(const uint8_t* data, size_t frames);
+
+private:
+    ISVFileOutput::Ptr output_;
+    SVAudioFormat format_;
+    int out_rate_;
+    SV_RESAMPLE_QUALITY quality_;
+    SVResampler resampler_;
+    // A frame split across two ring regions waits here for its remaining bytes.
+    uint8_t partial_[SV_MAX_CONVERT_CHANNELS * sizeof(float)];
+    size_t partial_bytes_;
+    std::vector<float> in_float_;
+    std::vector<float> out_float_;
+    std::vector<uint8_t> out_bytes_;
+    bool opened_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_RESAMPLER_H
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_RING_BUFFER_H
+#define AOS_AUDIO_RECORD_SV_RING_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace sv_recorder {
+
+const size_t SV_CACHE_LINE_SIZE = 64;
+
+// Wait-free single-producer/single-consumer byte ring.
+// The audio callback is the only producer and the disk writer thread the only consumer,
+// so neither side ever blocks or takes a lock.
+class SVRingBuffer {
+
+public:
+    SVRingBuffer() : capacity_(0), mask_(0), write_pos_(0), read_pos_(0) {}
+
+    // Not thread safe, call it before producer and consumer are running.
+    void Reset(size_t min_capacity) {
+      size_t capacity = 1;
+      while (capacity < min_capacity) {
+        capacity <<= 1;
+      }
+      if (capacity != capacity_) {
+        buffer_.reset(new uint8_t[capacity]);
+        capacity_ = capacity;
+        mask_ = capacity - 1;
+      }
+      write_pos_.store(0, std::memory_order_relaxed);
+      read_pos_.store(0, std::memory_order_relaxed);
+    }
+
+    size_t Capacity() const { return capacity_; }
+
+    size_t ReadableBytes() const {
+      return write_pos_.load(std::memory_order_acquire) - read_pos_.load(std::memory_order_relaxed);
+    }
+
+    size_t WritableBytes() const {
+      return capacity_ - (write_pos_.load(std::memory_order_relaxed) - read_pos_.load(std::memory_order_acquire));
+    }
+
+    // Producer side. Writes all of |len| bytes or nothing.
+    bool Write(const void* data, size_t len) {
+      if (len == 0) {
+        return true;
+      }
+      if (len > WritableBytes()) {
+        return false;
+      }
+      size_t pos = write_pos_.load(std::memory_order_relaxed);
+      size_t offset = pos & mask_;
+      size_t first = capacity_ - offset < len ? capacity_ - offset : len;
+      memcpy(buffer_.get() + offset, data, first);
+      if (first < len) {
+        memcpy(buffer_.get(), static_cast<const uint8_t*>(data) + first, len - first);
+      }
+      write_pos_.store(pos + len, std::memory_order_release);
+      return true;
+    }
+
+    // Consumer side. Returns the largest contiguous readable region without copying,
+    // the caller releases it with Consume() once done.
+    size_t Peek(const uint8_t** data) const {
+      size_t pos = read_pos_.load(std::memory_order_relaxed);
+      size_t readable = write_pos_.load(std::memory_order_acquire) - pos;
+      size_t offset = pos & mask_;
+      size_t contiguous = capacity_ - offset;
+      *data = buffer_.get() + offset;
+      return readable < contiguous ? readable : contiguous;
+    }
+
+    void Consume(size_t len) {
+      read_pos_.store(read_pos_.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    }
+
+private:
+    std::unique_ptr<uint8_t[]> buffer_;
+    size_t capacity_;
+    size_t mask_;
+    alignas(SV_CACHE_LINE_SIZE) std::atomic<size_t> write_pos_;
+    alignas(SV_CACHE_LINE_SIZE) std::atomic<size_t> read_pos_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_RING_BUFFER_H
@@ -0,0 +1,559 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_sample_convert.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define SV_HAVE_SSE2 1
+#if defined(__GNUC__) || defined(__clang__)
+#define SV_HAVE_AVX2 1
+#define SV_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SV_HAVE_NEON 1
+#endif
+
+namespace sv_recorder {
+
+const float SV_I16_SCALE = 32768.0f;
+const float SV_I24_SCALE = 8388608.0f;
+const float SV_I16_MAX = 32767.0f;
+const float SV_I24_MAX = 8388607.0f;
+
+// Scalar reference kernels, also used for the tails of the vector loops.
+
+static inline float ClampF(float value, float min, float max) {
+  return value < min ? min : (value > max ? max : value);
+}
+
+static inline void StoreI24(uint8_t* dst, int32_t value) {
+  dst[0] = static_cast<uint8_t>(value);
+  dst[1] = static_cast<uint8_t>(value >> 8);
+  dst[2] = static_cast<uint8_t>(value >> 16);
+}
+
+static inline int32_t LoadI24(const uint8_t* src) {
+  uint32_t value = static_cast<uint32_t>(src[0]) << 8 | static_cast<uint32_t>(src[1]) << 16 |
+                   static_cast<uint32_t>(src[2]) << 24;
+  return static_cast<int32_t>(value) >> 8;
+}
+
+static void I16ToF32Scalar(const int16_t* src, float* dst, size_t count) {
+  for(size_t i = 0; i < count; i++) {
+    dst[i] = src[i] * (1.0f / SV_I16_SCALE);
+  }
+}
+
+static void F32ToI16Scalar(const float* src, int16_t* dst, size_t count) {
+  for(size_t i = 0; i < count; i++) {
+    dst[i] = static_cast<int16_t>(lrintf(ClampF(src[i] * SV_I16_SCALE, -SV_I16_SCALE, SV_I16_MAX)));
+  }
+}
+
+static void F32ToI24Scalar(const float* src, uint8_t* dst, size_t count) {
+  for(size_t i = 0; i < count; i++) {
+    StoreI24(dst + i * 3, static_cast<int32_t>(lrintf(ClampF(src[i] * SV_I24_SCALE, -SV_I24_SCALE, SV_I24_MAX))));
+  }
+}
+
+static void I24ToF32Scalar(const uint8_t* src, float* dst, size_t count) {
+  for(size_t i = 0; i < count; i++) {
+    dst[i] = LoadI24(src + i * 3) * (1.0f / SV_I24_SCALE);
+  }
+}
+
+static void DeinterleaveScalar(const float* src, float* const* dst, size_t frames, int channels) {
+  for(int ch = 0; ch < channels; ch++) {
+    float* out = dst[ch];
+    const float* in = src + ch;
+    for(size_t i = 0; i < frames; i++) {
+      out[i] = in[i * channels];
+    }
+  }
+}
+
+static void InterleaveScalar(const float* const* src, float* dst, size_t frames, int channels) {
+  for(int ch = 0; ch < channels; ch++) {
+    const float* in = src[ch];
+    float* out = dst + ch;
+    for(size_t i = 0; i < frames; i++) {
+      out[i * channels] = in[i];
+    }
+  }
+}
+
+static float DotScalar(const float* a, const float* b, size_t count) {
+  float sum = 0.0f;
+  for(size_t i = 0; i < count; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+static size_t SignChangesScalar(const float* src, size_t count) {
+  size_t changes = 0;
+  for(size_t i = 1; i < count; i++) {
+    changes += (src[i] < 0.0f) != (src[i - 1] < 0.0f);
+  }
+  return changes;
+}
+
+static const SVConvertKernels kScalarKernels = {
+        SV_SIMD_SCALAR, "scalar",
+        I16ToF32Scalar, F32ToI16Scalar, F32ToI24Scalar, I24ToF32Scalar,
+        DeinterleaveScalar, InterleaveScalar, DotScalar, SignChangesScalar};
+
+#if SV_HAVE_SSE2
+
+static void I16ToF32Sse2(const int16_t* src, float* dst, size_t count) {
+  const __m128 scale = _mm_set1_ps(1.0f / SV_I16_SCALE);
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    // Widen with sign by placing each sample in the high half and shifting back.
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+  I16ToF32Scalar(src + i, dst + i, count - i);
+}
+
+static void F32ToI16Sse2(const float* src, int16_t* dst, size_t count) {
+  const __m128 scale = _mm_set1_ps(SV_I16_SCALE);
+  const __m128 min = _mm_set1_ps(-SV_I16_SCALE);
+  const __m128 max = _mm_set1_ps(SV_I16_MAX);
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8) {
+    __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), min), max);
+    __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale), min), max);
+    __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+  }
+  F32ToI16Scalar(src + i, dst + i, count - i);
+}
+
+static void F32ToI24Sse2(const float* src, uint8_t* dst, size_t count) {
+  const __m128 scale = _mm_set1_ps(SV_I24_SCALE);
+  const __m128 min = _mm_set1_ps(-SV_I24_SCALE);
+  const __m128 max = _mm_set1_ps(SV_I24_MAX);
+  alignas(16) int32_t values[4];
+  size_t i = 0;
+  for(; i + 4 <= count; i += 4) {
+    __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), min), max);
+    _mm_store_si128(reinterpret_cast<__m128i*>(values), _mm_cvtps_epi32(a));
+    StoreI24(dst + i * 3, values[0]);
+    StoreI24(dst + i * 3 + 3, values[1]);
+    StoreI24(dst + i * 3 + 6, values[2]);
+    StoreI24(dst + i * 3 + 9, values[3]);
+  }
+  F32ToI24Scalar(src + i, dst + i * 3, count - i);
+}
+
+static void DeinterleaveSse2(const float* src, float* const* dst, size_t frames, int channels) {
+  if(channels != 2) {
+    DeinterleaveScalar(src, dst, frames, channels);
+    return;
+  }
+  float* left = dst[0];
+  float* right = dst[1];
+  size_t i = 0;
+  for(; i + 4 <= frames; i += 4) {
+    __m128 a = _mm_loadu_ps(src + i * 2);
+    __m128 b = _mm_loadu_ps(src + i * 2 + 4);
+    _mm_storeu_ps(left + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(right + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+  for(; i < frames; i++) {
+    left[i] = src[i * 2];
+    right[i] = src[i * 2 + 1];
+  }
+}
+
+static void InterleaveSse2(const float* const* src, float* dst, size_t frames, int channels) {
+  if(channels != 2) {
+    InterleaveScalar(src, dst, frames, channels);
+    return;
+  }
+  const float* left = src[0];
+  const float* right = src[1];
+  size_t i = 0;
+  for(; i + 4 <= frames; i += 4) {
+    __m128 l = _mm_loadu_ps(left + i);
+    __m128 r = _mm_loadu_ps(right + i);
+    _mm_storeu_ps(dst + i * 2, _mm_unpacklo_ps(l, r));
+    _mm_storeu_ps(dst + i * 2 + 4, _mm_unpackhi_ps(l, r));
+  }
+  for(; i < frames; i++) {
+    dst[i * 2] = left[i];
+    dst[i * 2 + 1] = right[i];
+  }
+}
+
+static float DotSse2(const float* a, const float* b, size_t count) {
+  // Two accumulators hide the add latency.
+  __m128 sum0 = _mm_setzero_ps();
+  __m128 sum1 = _mm_setzero_ps();
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8) {
+    sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+  }
+  sum0 = _mm_add_ps(sum0, sum1);
+  sum0 = _mm_add_ps(sum0, _mm_movehl_ps(sum0, sum0));
+  sum0 = _mm_add_ss(sum0, _mm_shuffle_ps(sum0, sum0, 1));
+  return _mm_cvtss_f32(sum0) + DotScalar(a + i, b + i, count - i);
+}
+
+static size_t SignChangesSse2(const float* src, size_t count) {
+  // Each differing sign mask is -1, subtracting it counts the crossing per lane.
+  const __m128 zero = _mm_setzero_ps();
+  __m128i changes = _mm_setzero_si128();
+  size_t i = 1;
+  for(; i + 4 <= count; i += 4) {
+    __m128 current = _mm_cmplt_ps(_mm_loadu_ps(src + i), zero);
+    __m128 previous = _mm_cmplt_ps(_mm_loadu_ps(src + i - 1), zero);
+    changes = _mm_sub_epi32(changes, _mm_castps_si128(_mm_xor_ps(current, previous)));
+  }
+  int32_t lanes[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), changes);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + SignChangesScalar(src + i - 1, count - i + 1);
+}
+
+static const SVConvertKernels kSse2Kernels = {
+        SV_SIMD_SSE2, "sse2",
+        I16ToF32Sse2, F32ToI16Sse2, F32ToI24Sse2, I24ToF32Scalar,
+        DeinterleaveSse2, InterleaveSse2, DotSse2, SignChangesSse2};
+
+#endif
+
+#if SV_HAVE_AVX2
+
+SV_TARGET_AVX2 static void I16ToF32Avx2(const int16_t* src, float* dst, size_t count) {
+  const __m256 scale = _mm256_set1_ps(1.0f / SV_I16_SCALE);
+  size_t i = 0;
+  for(; i + 16 <= count; i += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(a)), scale));
+    _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(b)), scale));
+  }
+  I16ToF32Scalar(src + i, dst + i, count - i);
+}
+
+SV_TARGET_AVX2 static void F32ToI16Avx2(const float* src, int16_t* dst, size_t count) {
+  const __m256 scale = _mm256_set1_ps(SV_I16_SCALE);
+  const __m256 min = _mm256_set1_ps(-SV_I16_SCALE);
+  const __m256 max = _mm256_set1_ps(SV_I16_MAX);
+  size_t i = 0;
+  for(; i + 16 <= count; i += 16) {
+    __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), scale), min), max);
+    __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale), min), max);
+    // packs works per 128-bit lane, restore sample order afterwards.
+    __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+    packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+  }
+  F32ToI16Scalar(src + i, dst + i, count - i);
+}
+
+SV_TARGET_AVX2 static void F32ToI24Avx2(const float* src, uint8_t* dst, size_t count) {
+  const __m256 scale = _mm256_set1_ps(SV_I24_SCALE);
+  const __m256 min = _mm256_set1_ps(-SV_I24_SCALE);
+  const __m256 max = _mm256_set1_ps(SV_I24_MAX);
+  // Keep the low 3 bytes of each int32, packed into the first 12 bytes of each lane.
+  const __m256i pack = _mm256_setr_epi8(
+          0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+          0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+  alignas(32) uint8_t bytes[32];
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8) {
+    __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), scale), min), max);
+    __m256i packed = _mm256_shuffle_epi8(_mm256_cvtps_epi32(a), pack);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(bytes), packed);
+    memcpy(dst + i * 3, bytes, 12);
+    memcpy(dst + i * 3 + 12, bytes + 16, 12);
+  }
+  F32ToI24Scalar(src + i, dst + i * 3, count - i);
+}
+
+SV_TARGET_AVX2 static void I24ToF32Avx2(const uint8_t* src, float* dst, size_t count) {
+  const __m256 scale = _mm256_set1_ps(1.0f / SV_I24_SCALE);
+  // Move the 3 bytes of each sample into the top of an int32, then shift back with sign.
+  const __m256i unpack = _mm256_setr_epi8(
+          -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+          -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+  size_t i = 0;
+  // Each iteration loads 16 bytes at +12, i.e. reads 4 bytes past the 8 samples it converts.
+  for(; i + 10 <= count; i += 8) {
+    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+    __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 12));
+    __m256i x = _mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    x = _mm256_srai_epi32(_mm256_shuffle_epi8(x, unpack), 8);
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+  }
+  I24ToF32Scalar(src + i * 3, dst + i, count - i);
+}
+
+SV_TARGET_AVX2 static float DotAvx2(const float* a, const float* b, size_t count) {
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for(; i + 16 <= count; i += 16) {
+    sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+  }
+  sum0 = _mm256_add_ps(sum0, sum1);
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum0), _mm256_extractf128_ps(sum0, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum) + DotScalar(a + i, b + i, count - i);
+}
+
+SV_TARGET_AVX2 static size_t SignChangesAvx2(const float* src, size_t count) {
+  const __m256 zero = _mm256_setzero_ps();
+  __m256i changes = _mm256_setzero_si256();
+  size_t i = 1;
+  for(; i + 8 <= count; i += 8) {
+    __m256 current = _mm256_cmp_ps(_mm256_loadu_ps(src + i), zero, _CMP_LT_OQ);
+    __m256 previous = _mm256_cmp_ps(_mm256_loadu_ps(src + i - 1), zero, _CMP_LT_OQ);
+    changes = _mm256_sub_epi32(changes, _mm256_castps_si256(_mm256_xor_ps(current, previous)));
+  }
+  int32_t lanes[8];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), changes);
+  size_t total = 0;
+  for(int32_t lane : lanes) {
+    total += lane;
+  }
+  return total + SignChangesScalar(src + i - 1, count - i + 1);
+}
+
+static const SVConvertKernels kAvx2Kernels = {
+        SV_SIMD_AVX2, "avx2",
+        I16ToF32Avx2, F32ToI16Avx2, F32ToI24Avx2, I24ToF32Avx2,
+        DeinterleaveSse2, InterleaveSse2, DotAvx2, SignChangesAvx2};
+
+#endif
+
+#if SV_HAVE_NEON
+
+static inline int32x4_t RoundToS32(float32x4_t value) {
+#if defined(__aarch64__)
+  return vcvtnq_s32_f32(value);
+#else
+  // ARMv7 only truncates, round half away from zero instead.
+  const float32x4_t half = vdupq_n_f32(0.5f);
+  uint32x4_t negative = vcltq_f32(value, vdupq_n_f32(0.0f));
+  float32x4_t bias = vbslq_f32(negative, vnegq_f32(half), half);
+  return vcvtq_s32_f32(vaddq_f32(value, bias));
+#endif
+}
+
+static void I16ToF32Neon(const int16_t* src, float* dst, size_t count) {
+  const float scale = 1.0f / SV_I16_SCALE;
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8) {
+    int16x8_t x = vld1q_s16(src + i);
+    vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), scale));
+    vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), scale));
+  }
+  I16ToF32Scalar(src + i, dst + i, count - i);
+}
+
+static void F32ToI16Neon(const float* src, int16_t* dst, size_t count) {
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8) {
+    int32x4_t a = RoundToS32(vmulq_n_f32(vld1q_f32(src + i), SV_I16_SCALE));
+    int32x4_t b = RoundToS32(vmulq_n_f32(vld1q_f32(src + i + 4), SV_I16_SCALE));
+    vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+  }
+  F32ToI16Scalar(src + i, dst + i, count - i);
+}
+
+static void F32ToI24Neon(const float* src, uint8_t* dst, size_t count) {
+  const float32x4_t min = vdupq_n_f32(-SV_I24_SCALE);
+  const float32x4_t max = vdupq_n_f32(SV_I24_MAX);
+  size_t i = 0;
+#if defined(__aarch64__)
+  // 16 samples -> 48 bytes, gathered from the 64 bytes of int32 with three table lookups.
+  static const uint8_t kPack[48] = {
+          0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 16, 17, 18, 20,
+          21, 22, 24, 25, 26, 28, 29, 30, 32, 33, 34, 36, 37, 38, 40, 41,
+          42, 44, 45, 46, 48, 49, 50, 52, 53, 54, 56, 57, 58, 60, 61, 62};
+  const uint8x16_t p0 = vld1q_u8(kPack);
+  const uint8x16_t p1 = vld1q_u8(kPack + 16);
+  const uint8x16_t p2 = vld1q_u8(kPack + 32);
+  for(; i + 16 <= count; i += 16) {
+    uint8x16x4_t table;
+    for(int k = 0; k < 4; k++) {
+      float32x4_t v = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(src + i + k * 4), SV_I24_SCALE), min), max);
+      table.val[k] = vreinterpretq_u8_s32(RoundToS32(v));
+    }
+    vst1q_u8(dst + i * 3, vqtbl4q_u8(table, p0));
+    vst1q_u8(dst + i * 3 + 16, vqtbl4q_u8(table, p1));
+    vst1q_u8(dst + i * 3 + 32, vqtbl4q_u8(table, p2));
+  }
+#else
+  int32_t values[4];
+  for(; i + 4 <= count; i += 4) {
+    float32x4_t v = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(src + i), SV_I24_SCALE), min), max);
+    vst1q_s32(values, RoundToS32(v));
+    for(int k = 0; k < 4; k++) {
+      StoreI24(dst + (i + k) * 3, values[k]);
+    }
+  }
+#endif
+  F32ToI24Scalar(src + i, dst + i * 3, count - i);
+}
+
+static void I24ToF32Neon(const uint8_t* src, float* dst, size_t count) {
+  size_t i = 0;
+#if defined(__aarch64__)
+  static const uint8_t kUnpack[16] = {255, 0, 1, 2, 255, 3, 4, 5, 255, 6, 7, 8, 255, 9, 10, 11};
+  const uint8x16_t unpack = vld1q_u8(kUnpack);
+  // Loads 16 bytes for 4 samples (12 bytes), keep 4 bytes of headroom.
+  for(; i + 6 <= count; i += 4) {
+    uint8x16_t x = vqtbl1q_u8(vld1q_u8(src + i * 3), unpack);
+    int32x4_t value = vshrq_n_s32(vreinterpretq_s32_u8(x), 8);
+    vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(value), 1.0f / SV_I24_SCALE));
+  }
+#endif
+  I24ToF32Scalar(src + i * 3, dst + i, count - i);
+}
+
+static void DeinterleaveNeon(const float* src, float* const* dst, size_t frames, int channels) {
+  size_t i = 0;
+  if(channels == 2) {
+    for(; i + 4 <= frames; i += 4) {
+      float32x4x2_t x = vld2q_f32(src + i * 2);
+      vst1q_f32(dst[0] + i, x.val[0]);
+      vst1q_f32(dst[1] + i, x.val[1]);
+    }
+  } else if(channels == 3) {
+    for(; i + 4 <= frames; i += 4) {
+      float32x4x3_t x = vld3q_f32(src + i * 3);
+      vst1q_f32(dst[0] + i, x.val[0]);
+      vst1q_f32(dst[1] + i, x.val[1]);
+      vst1q_f32(dst[2] + i, x.val[2]);
+    }
+  } else if(channels == 4) {
+    for(; i + 4 <= frames; i += 4) {
+      float32x4x4_t x = vld4q_f32(src + i * 4);
+      vst1q_f32(dst[0] + i, x.val[0]);
+      vst1q_f32(dst[1] + i, x.val[1]);
+      vst1q_f32(dst[2] + i, x.val[2]);
+      vst1q_f32(dst[3] + i, x.val[3]);
+    }
+  }
+  float* tails[SV_MAX_CONVERT_CHANNELS];
+  for(int ch = 0; ch < channels; ch++) {
+    tails[ch] = dst[ch] + i;
+  }
+  DeinterleaveScalar(src + i * channels, tails, frames - i, channels);
+}
+
+static void InterleaveNeon(const float* const* src, float* dst, size_t frames, int channels) {
+  size_t i = 0;
+  if(channels == 2) {
+    for(; i + 4 <= frames; i += 4) {
+      float32x4x2_t x = {{vld1q_f32(src[0] + i), vld1q_f32(src[1] + i)}};
+      vst2q_f32(dst + i * 2, x);
+    }
+  } else if(channels == 3) {
+    for(; i + 4 <= frames; i += 4) {
+      float32x4x3_t x = {{vld1q_f32(src[0] + i), vld1q_f32(src[1] + i), vld1q_f32(src[2] + i)}};
+      vst3q_f32(dst + i * 3, x);
+    }
+  } else if(channels == 4) {
+    for(; i + 4 <= frames; i += 4) {
+      float32x4x4_t x = {{vld1q_f32(src[0] + i), vld1q_f32(src[1] + i),
+                          vld1q_f32(src[2] + i), vld1q_f32(src[3] + i)}};
+      vst4q_f32(dst + i * 4, x);
+    }
+  }
+  const float* tails[SV_MAX_CONVERT_CHANNELS];
+  for(int ch = 0; ch < channels; ch++) {
+    tails[ch] = src[ch] + i;
+  }
+  InterleaveScalar(tails, dst + i * channels, frames - i, channels);
+}
+
+static float DotNeon(const float* a, const float* b, size_t count) {
+  float32x4_t sum0 = vdupq_n_f32(0.0f);
+  float32x4_t sum1 = vdupq_n_f32(0.0f);
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8) {
+    sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+    sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+  sum0 = vaddq_f32(sum0, sum1);
+  float32x2_t sum = vadd_f32(vget_low_f32(sum0), vget_high_f32(sum0));
+  return vget_lane_f32(vpadd_f32(sum, sum), 0) + DotScalar(a + i, b + i, count - i);
+}
+
+static size_t SignChangesNeon(const float* src, size_t count) {
+  const float32x4_t zero = vdupq_n_f32(0.0f);
+  uint32x4_t changes = vdupq_n_u32(0);
+  size_t i = 1;
+  for(; i + 4 <= count; i += 4) {
+    uint32x4_t current = vcltq_f32(vld1q_f32(src + i), zero);
+    uint32x4_t previous = vcltq_f32(vld1q_f32(src + i - 1), zero);
+    changes = vsubq_u32(changes, veorq_u32(current, previous));
+  }
+  uint32x2_t sum = vadd_u32(vget_low_u32(changes), vget_high_u32(changes));
+  return vget_lane_u32(vpadd_u32(sum, sum), 0) + SignChangesScalar(src + i - 1, count - i + 1);
+}
+
+static const SVConvertKernels kNeonKernels = {
+        SV_SIMD_NEON, "neon",
+        I16ToF32Neon, F32ToI16Neon, F32ToI24Neon, I24ToF32Neon,
+        DeinterleaveNeon, InterleaveNeon, DotNeon, SignChangesNeon};
+
+#endif
+
+const SVConvertKernels* SVGetConvertKernels(SV_SIMD_LEVEL level) {
+  switch (level) {
+    case SV_SIMD_SCALAR:
+      return &kScalarKernels;
+#if SV_HAVE_SSE2
+    case SV_SIMD_SSE2:
+      return &kSse2Kernels;
+#endif
+#if SV_HAVE_AVX2
+    case SV_SIMD_AVX2:
+      return __builtin_cpu_supports("avx2") ? &kAvx2Kernels : nullptr;
+#endif
+#if SV_HAVE_NEON
+    case SV_SIMD_NEON:
+      return &kNeonKernels;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+const SVConvertKernels& SVConvert() {
+  static const SVConvertKernels* kernels = [] {
+    const SV_SIMD_LEVEL preferred[] = {SV_SIMD_AVX2, SV_SIMD_NEON, SV_SIMD_SSE2};
+    for(SV_SIMD_LEVEL level : preferred) {
+      const SVConvertKernels* candidate = SVGetConvertKernels(level);
+      if(candidate) {
+        return candidate;
+      }
+    }
+    return &kScalarKernels;
+  }();
+  return *kernels;
+}
+
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_SAMPLE_CONVERT_H
+#define AOS_AUDIO_RECORD_SV_SAMPLE_CONVERT_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sv_recorder {
+
+const int SV_MAX_CONVERT_CHANNELS = 8;
+
+enum SV_SIMD_LEVEL : int32_t {
+    SV_SIMD_SCALAR = 0,
+    SV_SIMD_SSE2 = 1,
+    SV_SIMD_AVX2 = 2,
+    SV_SIMD_NEON = 3
+};
+
+// Sample format conversion and (de)interleaving. |count| is in samples, |frames| in frames.
+// Float samples are in [-1, 1); conversions to integer round to nearest and saturate.
+// I24 is packed little-endian, 3 bytes per sample.
+struct SVConvertKernels {
+    SV_SIMD_LEVEL level;
+    const char* name;
+    void (*i16_to_f32)(const int16_t* src, float* dst, size_t count);
+    void (*f32_to_i16)(const float* src, int16_t* dst, size_t count);
+    void (*f32_to_i24)(const float* src, uint8_t* dst, size_t count);
+    void (*i24_to_f32)(const uint8_t* src, float* dst, size_t count);
+    void (*deinterleave)(const float* src, float* const* dst, size_t frames, int channels);
+    void (*interleave)(const float* const* src, float* dst, size_t frames, int channels);
+    // Sum of a[i] * b[i], the inner loop of FIR filtering.
+    float (*dot)(const float* a, const float* b, size_t count);
+    // Number of sign changes between neighbouring samples, the zero-crossing count.
+    size_t (*sign_changes)(const float* src, size_t count);
+};
+
+// Kernels for |level|, or nullptr when this build or CPU cannot run them.
+const SVConvertKernels* SVGetConvertKernels(SV_SIMD_LEVEL level);
+// Best kernels supported by the running CPU, resolved once.
+const SVConvertKernels& SVConvert();
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_SAMPLE_CONVERT_H
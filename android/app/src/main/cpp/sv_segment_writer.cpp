@@ -0,0 +1,571 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_segment_writer.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include "log.h"
+#include "sv_file_index.h"
+#include "sv_flac_writer.h"
+#include "sv_opus_writer.h"
+
+namespace sv_recorder {
+
+static const char* const kStateNames[] = {"open", "complete", "recovered"};
+
+// Flushes the file's data and size to storage, through a descriptor of its own so it works
+// for any output and from any thread.
+static int SyncPath(const std::string& path, bool directory) {
+  int fd = open(path.empty() ? "." : path.c_str(), directory ? O_RDONLY | O_DIRECTORY : O_RDONLY);
+  if(fd < 0) {
+    return SV_INIT_ERROR;
+  }
+  int result = fsync(fd) == 0 ? SV_NO_ERROR : SV_INIT_ERROR;
+  close(fd);
+  return result;
+}
+
+static bool FileSize(const std::string& path, uint64_t* size) {
+  struct stat st;
+  if(stat(path.c_str(), &st) != 0) {
+    return false;
+  }
+  *size = static_cast<uint64_t>(st.st_size);
+  return true;
+}
+
+// Removes a segment that never received audio, with the index its container left behind.
+static void RemoveSegmentFiles(const std::string& path) {
+  remove(path.c_str());
+  remove((path + SV_INDEX_SUFFIX).c_str());
+}
+
+int SVSegmentManifest::Load(const std::string& manifest_path) {
+  FILE* file = fopen(manifest_path.c_str(), "r");
+  if(!file) {
+    AV_LOGW("SVSegmentManifest open %s failed.", manifest_path.c_str());
+    return SV_INIT_ERROR;
+  }
+  segments.clear();
+  int result = SV_NO_ERROR;
+  int sample_format;
+  int container_type;
+  int output;
+  if(fscanf(file, "# sv_segments %d %d %d %d %d", &format.sample_rate, &format.channels, &sample_format,
+            &container_type, &output) != 5) {
+    AV_LOGW("SVSegmentManifest %s has no header.", manifest_path.c_str());
+    result = SV_INIT_ERROR;
+  } else {
+    format.sample_format = static_cast<SV_SAMPLE_FORMAT>(sample_format);
+    container = static_cast<SV_CONTAINER_TYPE>(container_type);
+    output_type = static_cast<SV_FILE_OUTPUT_TYPE>(output);
+  }
+  SVSegmentInfo info;
+  char state[16];
+  char name[256];
+  while(result == SV_NO_ERROR &&
+        fscanf(file, "%" SCNu32 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %15s %255[^\n]", &info.index,
+               &info.start_frame, &info.frames, &info.bytes, state, name) == 6) {
+    info.state = SV_SEGMENT_OPEN;
+    for(int i = 0; i < 3; i++) {
+      if(strcmp(state, kStateNames[i]) == 0) {
+        info.state = static_cast<SV_SEGMENT_STATE>(i);
+      }
+    }
+    info.name = name;
+    segments.push_back(info);
+  }
+  fclose(file);
+  return result;
+}
+
+int SVSegmentManifest::Save(const std::string& manifest_path) const {
+  const std::string temp_path = manifest_path + ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "w");
+  if(!file) {
+    AV_LOGW("SVSegmentManifest create %s failed: %s", temp_path.c_str(), strerror(errno));
+    return SV_INIT_ERROR;
+  }
+  fprintf(file, "# sv_segments %d %d %d %d %d\n", format.sample_rate, format.channels, format.sample_format,
+          container, output_type);
+  for(const SVSegmentInfo& info : segments) {
+    fprintf(file, "%" PRIu32 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %s %s\n", info.index, info.start_frame,
+            info.frames, info.bytes, kStateNames[info.state], info.name.c_str());
+  }
+  // The rename must not publish a manifest that only exists in the page cache.
+  bool written = fflush(file) == 0 && fsync(fileno(file)) == 0;
+  written = fclose(file) == 0 && written;
+  if(!written || rename(temp_path.c_str(), manifest_path.c_str()) != 0) {
+    AV_LOGW("SVSegmentManifest save %s failed: %s", manifest_path.c_str(), strerror(errno));
+    remove(temp_path.c_str());
+    return SV_INIT_ERROR;
+  }
+  size_t slash = manifest_path.rfind('/');
+  SyncPath(slash == std::string::npos ? "" : manifest_path.substr(0, slash + 1), true);
+  return SV_NO_ERROR;
+}
+
+SVSegmentInfo* SVSegmentManifest::Find(uint32_t index) {
+  for(SVSegmentInfo& info : segments) {
+    if(info.index == index) {
+      return &info;
+    }
+  }
+  return nullptr;
+}
+
+SVSegmentFileOutput::SVSegmentFileOutput(SVSegmentFactory factory, const SVAudioFormat& format,
+                                         SV_CONTAINER_TYPE container, SV_FILE_OUTPUT_TYPE output_type,
+                                         const SVSegmentConfig& config, SVSegmentCounters* counters,
+                                         SVThreadManager* threads)
+  : factory_(std::move(factory)), format_(format), container_(container), output_type_(output_type),
+    config_(config), counters_(counters), threads_(threads), frame_bytes_(format.BytesPerFrame()),
+    limit_bytes_(static_cast<uint64_t>(config.seconds) * format.BytesPerSecond()),
+    limit_file_bytes_(static_cast<uint64_t>(config.size_kb) * 1024),
+    sync_bytes_(format.BytesPerSecond() * SV_SEGMENT_SYNC_MS / 1000), opened_(false), input_bytes_(0),
+    flushed_bytes_(0), manifest_dirty_(false), next_index_(0), closed_stats_{0, 0, 0},
+    flushed_{0, 0, 0, 0, SV_SEGMENT_OPEN, ""}, synced_{0, 0, 0, 0, SV_SEGMENT_OPEN, ""}, last_sync_ns_(0),
+    sync_requested_(false), running_(false) {
+  current_.info = flushed_;
+}
+
+SVSegmentFileOutput::~SVSegmentFileOutput() {
+  Close();
+}
+
+std::string SVSegmentFileOutput::SegmentName(uint32_t index) const {
+  char number[16];
+  snprintf(number, sizeof(number), ".%05" PRIu32, index);
+  return stem_ + number + extension_;
+}
+
+int SVSegmentFileOutput::Open(const std::string& file_path) {
+  if(opened_) {
+    return SV_STATE_ERROR;
+  }
+  manifest_path_ = file_path + SV_SEGMENT_MANIFEST_SUFFIX;
+  size_t slash = file_path.rfind('/');
+  directory_ = slash == std::string::npos ? "" : file_path.substr(0, slash + 1);
+  std::string name = file_path.substr(directory_.size());
+  size_t dot = name.rfind('.');
+  stem_ = dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+  extension_ = name.substr(stem_.size());
+
+  int result = Recover();
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  uint64_t start_frame = 0;
+  if(!manifest_.segments.empty()) {
+    start_frame = manifest_.segments.back().start_frame + manifest_.segments.back().frames;
+  }
+  manifest_.format = format_;
+  manifest_.container = container_;
+  manifest_.output_type = output_type_;
+  result = OpenSegment(next_index_, &current_);
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  next_index_++;
+  current_.info.start_frame = start_frame;
+  manifest_.segments.push_back(current_.info);
+  // Listed before it holds audio, a crash from here on leaves a segment the next start repairs.
+  result = manifest_.Save(manifest_path_);
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  counters_->AddSegment();
+  input_bytes_ = 0;
+  flushed_bytes_ = 0;
+  flushed_ = current_.info;
+  synced_ = current_.info;
+  last_sync_ns_ = SVNowNs();
+  opened_ = true;
+  running_ = true;
+  thread_ = std::thread(&SVSegmentFileOutput::SegmentLoop, this);
+  AV_LOGI("SVSegmentFileOutput %s, %d s / %d KB per segment, starting at segment %" PRIu32 ".",
+          manifest_path_.c_str(), config_.seconds, config_.size_kb, current_.info.index);
+  return SV_NO_ERROR;
+}
+
+int SVSegmentFileOutput::Recover() {
+  manifest_ = SVSegmentManifest();
+  next_index_ = 0;
+  if(access(manifest_path_.c_str(), F_OK) != 0) {
+    return SV_NO_ERROR;
+  }
+  SVSegmentManifest previous;
+  if(previous.Load(manifest_path_) != SV_NO_ERROR) {
+    return SV_INIT_ERROR;
+  }
+  manifest_ = previous;
+  manifest_.segments.clear();
+  uint64_t recovered = 0;
+  uint64_t truncated_bytes = 0;
+  for(SVSegmentInfo info : previous.segments) {
+    next_index_ = std::max(next_index_, info.index + 1);
+    if(info.state == SV_SEGMENT_OPEN) {
+      if(RepairSegment(previous, &info, &truncated_bytes) != SV_NO_ERROR) {
+        continue;
+      }
+      recovered++;
+    }
+    manifest_.segments.push_back(info);
+  }
+  // Segments created after the manifest was last saved are not listed yet, they follow
+  // the last listed one.
+  uint64_t start_frame = 0;
+  if(!manifest_.segments.empty()) {
+    start_frame = manifest_.segments.back().start_frame + manifest_.segments.back().frames;
+  }
+  while(access((directory_ + SegmentName(next_index_)).c_str(), F_OK) == 0) {
+    SVSegmentInfo info = {next_index_, start_frame, 0, 0, SV_SEGMENT_OPEN, SegmentName(next_index_)};
+    next_index_++;
+    if(RepairSegment(previous, &info, &truncated_bytes) == SV_NO_ERROR) {
+      manifest_.segments.push_back(info);
+      start_frame += info.frames;
+      recovered++;
+    }
+  }
+  // Indexes of removed files are free again.
+  next_index_ = manifest_.segments.empty() ? 0 : manifest_.segments.back().index + 1;
+  if(recovered > 0 || manifest_.segments.size() != previous.segments.size()) {
+    AV_LOGI("SVSegmentFileOutput recovered %" PRIu64 " segments of %s, cut %" PRIu64 " torn bytes.", recovered,
+            manifest_path_.c_str(), truncated_bytes);
+    counters_->AddRecovered(recovered, truncated_bytes);
+    manifest_.Save(manifest_path_);
+  }
+
+  // Every segment of a series has to decode the same way.
+  if(previous.format.sample_rate != format_.sample_rate || previous.format.channels != format_.channels ||
+     previous.format.sample_format != format_.sample_format || previous.container != container_) {
+    AV_LOGE("SVSegmentFileOutput %s holds %d/%d/%d container %d, cannot continue it as %d/%d/%d container %d.",
+            manifest_path_.c_str(), previous.format.sample_rate, previous.format.channels,
+            previous.format.sample_format, previous.container, format_.sample_rate, format_.channels,
+            format_.sample_format, container_);
+    return SV_INIT_ERROR;
+  }
+  return SV_NO_ERROR;
+}
+
+int SVSegmentFileOutput::RepairSegment(const SVSegmentManifest& manifest, SVSegmentInfo* info,
+                                       uint64_t* truncated_bytes) {
+  const std::string path = directory_ + info->name;
+  uint64_t size;
+  if(!FileSize(path, &size)) {
+    AV_LOGW("SVSegmentFileOutput segment %s is missing.", path.c_str());
+    return SV_INIT_ERROR;
+  }
+  // An mmap segment is preallocated, only what was synced is known to be audio.
+  const uint64_t length = manifest.output_type == SV_OUTPUT_MMAP ? std::min(size, info->bytes) : size;
+  uint64_t frames = 0;
+  int result;
+  if(manifest.container == SV_CONTAINER_WAV) {
+    result = SVWavRepairFile(path, length, &frames);
+  } else if(manifest.container == SV_CONTAINER_FLAC) {
+    result = SVFlacRepairFile(path, length, &frames);
+  } else if(manifest.container == SV_CONTAINER_OPUS) {
+    result = SVOpusRepairFile(path, length, &frames);
+  } else {
+    const size_t frame_bytes = manifest.format.BytesPerFrame();
+    frames = frame_bytes > 0 ? length / frame_bytes : 0;
+    result = truncate(path.c_str(), static_cast<off_t>(frames * frame_bytes)) == 0 ? SV_NO_ERROR : SV_INIT_ERROR;
+  }
+  if(result != SV_NO_ERROR || frames == 0) {
+    // Nothing to keep, e.g. a segment opened ahead of time that never received audio.
+    remove(path.c_str());
+    return SV_INIT_ERROR;
+  }
+  SyncPath(path, false);
+  FileSize(path, &info->bytes);
+  *truncated_bytes += size > info->bytes ? size - info->bytes : 0;
+  info->frames = frames;
+  info->state = SV_SEGMENT_RECOVERED;
+  AV_LOGI("SVSegmentFileOutput repaired %s, %" PRIu64 " frames, %" PRIu64 " -> %" PRIu64 " bytes.", path.c_str(),
+          frames, size, info->bytes);
+  return SV_NO_ERROR;
+}
+
+int SVSegmentFileOutput::OpenSegment(uint32_t index, Segment* segment) {
+  segment->info = {index, 0, 0, 0, SV_SEGMENT_OPEN, SegmentName(index)};
+  segment->output = factory_();
+  int result = segment->output->Open(directory_ + segment->info.name);
+  if(result != SV_NO_ERROR) {
+    segment->output = nullptr;
+  }
+  return result;
+}
+
+bool SVSegmentFileOutput::ShouldRotate() const {
+  // Only between whole frames, so every segment decodes on its own.
+  if(input_bytes_ == 0 || input_bytes_ % frame_bytes_ != 0) {
+    return false;
+  }
+  return (limit_bytes_ > 0 && input_bytes_ >= limit_bytes_) ||
+         (limit_file_bytes_ > 0 && current_.output->Size() >= limit_file_bytes_);
+}
+
+uint64_t SVSegmentFileOutput::BytesToBoundary() const {
+  uint64_t bytes = UINT64_MAX;
+  if(limit_bytes_ > 0 && input_bytes_ < limit_bytes_) {
+    bytes = limit_bytes_ - input_bytes_;
+  }
+  if(limit_file_bytes_ > 0 && current_.output->Size() >= limit_file_bytes_ && input_bytes_ % frame_bytes_ != 0) {
+    bytes = std::min<uint64_t>(bytes, frame_bytes_ - input_bytes_ % frame_bytes_);
+  }
+  return bytes;
+}
+
+size_t SVSegmentFileOutput::Write(const void* data, size_t len) {
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  size_t written = 0;
+  while(written < len && current_.output) {
+    size_t chunk = len - written;
+    // A failed rotation keeps the audio in the current segment, the next write tries again.
+    if(!ShouldRotate() || Rotate()) {
+      chunk = static_cast<size_t>(std::min<uint64_t>(chunk, BytesToBoundary()));
+    }
+    size_t chunk_written = current_.output->Write(src + written, chunk);
+    input_bytes_ += chunk_written;
+    written += chunk_written;
+    if(chunk_written != chunk) {
+      break;
+    }
+  }
+  if(current_.output && input_bytes_ - flushed_bytes_ >= sync_bytes_) {
+    FlushCurrent();
+  }
+  return written;
+}
+
+bool SVSegmentFileOutput::Rotate() {
+  const int64_t begin_ns = SVNowNs();
+  Segment next;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::swap(next, ready_);
+  }
+  if(!next.output) {
+    // The segment thread fell behind, opening here stalls this thread but loses no audio.
+    std::lock_guard<std::mutex> open_lock(open_mutex_);
+    uint32_t index;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::swap(next, ready_);
+      index = next_index_;
+    }
+    if(!next.output) {
+      if(OpenSegment(index, &next) != SV_NO_ERROR) {
+        AV_LOGE_RATELIMIT(1000, "SVSegmentFileOutput open segment %" PRIu32 " failed.", index);
+        return false;
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      next_index_ = index + 1;
+      counters_->AddSyncOpen();
+    }
+  }
+  current_.info.frames = input_bytes_ / frame_bytes_;
+  next.info.start_frame = current_.info.start_frame + current_.info.frames;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    manifest_.segments.push_back(next.info);
+    manifest_dirty_ = true;
+    closed_.push_back(std::move(current_));
+    flushed_ = next.info;
+  }
+  current_ = std::move(next);
+  input_bytes_ = 0;
+  flushed_bytes_ = 0;
+  counters_->AddSegment();
+  counters_->OnRotate((SVNowNs() - begin_ns) / 1000);
+  return true;
+}
+
+void SVSegmentFileOutput::FlushCurrent() {
+  current_.output->Flush();
+  flushed_bytes_ = input_bytes_;
+  std::lock_guard<std::mutex> lock(mutex_);
+  flushed_.frames = input_bytes_ / frame_bytes_;
+  flushed_.bytes = current_.output->Size();
+}
+
+int SVSegmentFileOutput::Flush() {
+  if(!current_.output) {
+    return SV_STATE_ERROR;
+  }
+  FlushCurrent();
+  sync_requested_.store(true, std::memory_order_relaxed);
+  return SV_NO_ERROR;
+}
+
+void SVSegmentFileOutput::SegmentLoop() {
+  SVThreadScope scope(threads_, SV_THREAD_SEGMENT);
+  while(running_) {
+    scope.Tick();
+    PrepareNext();
+    FinishClosed();
+    SyncCurrent();
+    SaveManifest();
+    std::this_thread::sleep_for(std::chrono::milliseconds(SV_SEGMENT_POLL_MS));
+  }
+}
+
+void SVSegmentFileOutput::PrepareNext() {
+  std::lock_guard<std::mutex> open_lock(open_mutex_);
+  uint32_t index;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(ready_.output) {
+      return;
+    }
+    index = next_index_;
+  }
+  Segment next;
+  if(OpenSegment(index, &next) != SV_NO_ERROR) {
+    AV_LOGE_RATELIMIT(1000, "SVSegmentFileOutput open segment %" PRIu32 " ahead failed.", index);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ready_ = std::move(next);
+  next_index_ = index + 1;
+}
+
+void SVSegmentFileOutput::FinishClosed() {
+  std::vector<Segment> closed;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed.swap(closed_);
+  }
+  for(Segment& segment : closed) {
+    FinishSegment(&segment);
+  }
+}
+
+void SVSegmentFileOutput::FinishSegment(Segment* segment) {
+  const std::string path = directory_ + segment->info.name;
+  // Patches the container header, e.g. the WAV sizes or the FLAC STREAMINFO.
+  segment->output->Close();
+  SyncPath(path, false);
+  SVFileOutputStats stats = segment->output->GetStats();
+  uint64_t bytes = segment->output->Size();
+  FileSize(path, &bytes);
+  segment->output = nullptr;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  closed_stats_.bytes_written += stats.bytes_written;
+  closed_stats_.io_calls += stats.io_calls;
+  closed_stats_.open_ns += stats.open_ns;
+  SVSegmentInfo* info = manifest_.Find(segment->info.index);
+  if(info) {
+    info->frames = segment->info.frames;
+    info->bytes = bytes;
+    info->state = SV_SEGMENT_COMPLETE;
+    manifest_dirty_ = true;
+  }
+  AV_LOGI("SVSegmentFileOutput segment %s complete, %" PRIu64 " frames, %" PRIu64 " bytes.",
+          segment->info.name.c_str(), segment->info.frames, bytes);
+}
+
+void SVSegmentFileOutput::SyncCurrent() {
+  const int64_t now_ns = SVNowNs();
+  if(!sync_requested_.exchange(false, std::memory_order_relaxed) &&
+     now_ns - last_sync_ns_ < SV_SEGMENT_SYNC_MS * 1000000) {
+    return;
+  }
+  last_sync_ns_ = now_ns;
+  SVSegmentInfo flushed;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    flushed = flushed_;
+  }
+  if(flushed.index == synced_.index && flushed.bytes == synced_.bytes) {
+    return;
+  }
+  if(SyncPath(directory_ + flushed.name, false) != SV_NO_ERROR) {
+    return;
+  }
+  synced_ = flushed;
+  counters_->AddSync();
+  std::lock_guard<std::mutex> lock(mutex_);
+  SVSegmentInfo* info = manifest_.Find(flushed.index);
+  if(info && info->state == SV_SEGMENT_OPEN) {
+    info->frames = flushed.frames;
+    info->bytes = flushed.bytes;
+    manifest_dirty_ = true;
+  }
+}
+
+void SVSegmentFileOutput::SaveManifest() {
+  SVSegmentManifest manifest;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!manifest_dirty_) {
+      return;
+    }
+    manifest = manifest_;
+    manifest_dirty_ = false;
+  }
+  if(manifest.Save(manifest_path_) != SV_NO_ERROR) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    manifest_dirty_ = true;
+  }
+}
+
+int SVSegmentFileOutput::Close() {
+  if(!opened_) {
+    return SV_NO_ERROR;
+  }
+  opened_ = false;
+  running_ = false;
+  if(thread_.joinable()) {
+    thread_.join();
+  }
+  FinishClosed();
+  if(ready_.output) {
+    ready_.output->Close();
+    ready_.output = nullptr;
+    RemoveSegmentFiles(directory_ + ready_.info.name);
+  }
+  current_.info.frames = input_bytes_ / frame_bytes_;
+  if(current_.info.frames > 0) {
+    FinishSegment(&current_);
+  } else {
+    current_.output->Close();
+    current_.output = nullptr;
+    RemoveSegmentFiles(directory_ + current_.info.name);
+    std::lock_guard<std::mutex> lock(mutex_);
+    manifest_.segments.erase(std::remove_if(manifest_.segments.begin(), manifest_.segments.end(),
+                                            [this](const SVSegmentInfo& info) {
+                                              return info.index == current_.info.index;
+                                            }), manifest_.segments.end());
+    manifest_dirty_ = true;
+  }
+  SaveManifest();
+  AV_LOGI("SVSegmentFileOutput closed %s, %zu segments.", manifest_path_.c_str(), manifest_.segments.size());
+  return SV_NO_ERROR;
+}
+
+SVFileOutputStats SVSegmentFileOutput::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  SVFileOutputStats stats = closed_stats_;
+  if(current_.output) {
+    SVFileOutputStats current = current_.output->GetStats();
+    stats.bytes_written += current.bytes_written;
+    stats.io_calls += current.io_calls;
+    stats.open_ns += current.open_ns;
+  }
+  return stats;
+}
+
+}
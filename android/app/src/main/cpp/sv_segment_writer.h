@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_SEGMENT_WRITER_H
+#define AOS_AUDIO_RECORD_SV_SEGMENT_WRITER_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sv_common.h"
+#include "sv_file_output.h"
+#include "sv_thread_manager.h"
+#include "sv_wav_writer.h"
+
+namespace sv_recorder {
+
+// Manifest written next to the series, <file>.segments.
+const char* const SV_SEGMENT_MANIFEST_SUFFIX = ".segments";
+const int32_t SV_SEGMENT_MAX_SECONDS = 24 * 3600;
+const int32_t SV_SEGMENT_MIN_KB = 64;
+// The open segment is flushed and synced this often, a crash loses at most about this much.
+const int64_t SV_SEGMENT_SYNC_MS = 1000;
+const size_t SV_SEGMENT_POLL_MS = 10;
+
+struct SVSegmentConfig {
+    // Rotation after this many seconds of written audio, 0 for no time limit.
+    int32_t seconds = 0;
+    // Rotation once a segment file reaches this size, 0 for no size limit.
+    int32_t size_kb = 0;
+
+    bool IsEnabled() const { return seconds > 0 || size_kb > 0; }
+};
+
+enum SV_SEGMENT_STATE : int32_t {
+    // Being written, |bytes| and |frames| are what was last synced.
+    SV_SEGMENT_OPEN = 0,
+    SV_SEGMENT_COMPLETE = 1,
+    // Left open by a previous run and repaired on the next start.
+    SV_SEGMENT_RECOVERED = 2
+};
+
+struct SVSegmentInfo {
+    uint32_t index;
+    // Position of the first frame in the series, frames at the output rate.
+    uint64_t start_frame;
+    uint64_t frames;
+    uint64_t bytes;
+    SV_SEGMENT_STATE state;
+    // File name in the manifest's directory.
+    std::string name;
+};
+
+// Index of a segment series, stored as <file>.segments text: a
+// "# sv_segments <sample_rate> <channels> <sample_format> <container> <output_type>" line, then
+// "index start_frame frames bytes state name" per segment. Saved by writing a temporary file
+// and renaming it over the old one, so a reader always sees a complete manifest.
+struct SVSegmentManifest {
+    SVAudioFormat format = {0, 0, SV_SAMPLE_I16};
+    SV_CONTAINER_TYPE container = SV_CONTAINER_RAW;
+    SV_FILE_OUTPUT_TYPE output_type = SV_OUTPUT_STDIO;
+    std::vector<SVSegmentInfo> segments;
+
+    int Load(const std::string& manifest_path);
+    int Save(const std::string& manifest_path) const;
+    SVSegmentInfo* Find(uint32_t index);
+};
+
+// Shared between the pipeline and its segment stage, written by the writer and segment threads.
+class SVSegmentCounters {
+
+public:
+    SVSegmentCounters() { Reset(); }
+
+    void Reset() {
+      segments_.store(0, std::memory_order_relaxed);
+      sync_opens_.store(0, std::memory_order_relaxed);
+      syncs_.store(0, std::memory_order_relaxed);
+      recovered_.store(0, std::memory_order_relaxed);
+      truncated_bytes_.store(0, std::memory_order_relaxed);
+      max_rotate_us_.store(0, std::memory_order_relaxed);
+    }
+    void AddSegment() { segments_.fetch_add(1, std::memory_order_relaxed); }
+    void AddSyncOpen() { sync_opens_.fetch_add(1, std::memory_order_relaxed); }
+    void AddSync() { syncs_.fetch_add(1, std::memory_order_relaxed); }
+    void AddRecovered(uint64_t segments, uint64_t truncated_bytes) {
+      recovered_.fetch_add(segments, std::memory_order_relaxed);
+      truncated_bytes_.fetch_add(truncated_bytes, std::memory_order_relaxed);
+    }
+    void OnRotate(int64_t duration_us) {
+      if(duration_us > max_rotate_us_.load(std::memory_order_relaxed)) {
+        max_rotate_us_.store(duration_us, std::memory_order_relaxed);
+      }
+    }
+
+    uint64_t segments() const { return segments_.load(std::memory_order_relaxed); }
+    // Rotations that found no pre-opened segment and opened one on the writer thread.
+    uint64_t sync_opens() const { return sync_opens_.load(std::memory_order_relaxed); }
+    uint64_t syncs() const { return syncs_.load(std::memory_order_relaxed); }
+    uint64_t recovered() const { return recovered_.load(std::memory_order_relaxed); }
+    uint64_t truncated_bytes() const { return truncated_bytes_.load(std::memory_order_relaxed); }
+    int64_t max_rotate_us() const { return max_rotate_us_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> segments_;
+    std::atomic<uint64_t> sync_opens_;
+    std::atomic<uint64_t> syncs_;
+    std::atomic<uint64_t> recovered_;
+    std::atomic<uint64_t> truncated_bytes_;
+    std::atomic<int64_t> max_rotate_us_;
+};
+
+// Creates the container and file output of one segment, unopened.
+using SVSegmentFactory = std::function<ISVFileOutput::Ptr()>;
+
+// Writer-thread stage that cuts the recording into segments, each a complete file of its own
+// named <stem>.<index><ext> after the series path, which itself is never created.
+// A segment thread opens the next segment ahead of time, closes and fsyncs finished ones and
+// keeps the manifest current, so a rotation on the writer thread is a pointer swap.
+class SVSegmentFileOutput : public ISVFileOutput {
+
+public:
+    // The segment thread runs as SV_THREAD_SEGMENT of |threads|, which may be null.
+    SVSegmentFileOutput(SVSegmentFactory factory, const SVAudioFormat& format, SV_CONTAINER_TYPE container,
+                        SV_FILE_OUTPUT_TYPE output_type, const SVSegmentConfig& config,
+                        SVSegmentCounters* counters, SVThreadManager* threads = nullptr);
+    ~SVSegmentFileOutput() override;
+    // Recovers what a previous run left behind and continues the series after it.
+    int Open(const std::string& file_path) override;
+    size_t Write(const void* data, size_t len) override;
+    // Offsets would span segments, each container patches its own header.
+    int WriteAt(uint64_t offset, const void* data, size_t len) override { return SV_STATE_ERROR; }
+    // Flushes the open segment and has the segment thread sync it right away.
+    int Flush() override;
+    int Close() override;
+    // Size of the open segment.
+    uint64_t Size() const override { return current_.output ? current_.output->Size() : 0; }
+    SVFileOutputStats GetStats() const override;
+    // Recorded in the open segment, a gap across a rotation is only marked where it starts.
+    void OnGap(uint64_t len) override {
+      if (current_.output) {
+        current_.output->OnGap(len);
+      }
+    }
+
+    const std::string& manifest_path() const { return manifest_path_; }
+
+private:
+    struct Segment {
+        SVSegmentInfo info;
+        ISVFileOutput::Ptr output;
+    };
+
+    std::string SegmentName(uint32_t index) const;
+    int Recover();
+    int RepairSegment(const SVSegmentManifest& manifest, SVSegmentInfo* info, uint64_t* truncated_bytes);
+    int OpenSegment(uint32_t index, Segment* segment);
+    bool ShouldRotate() const;
+    uint64_t BytesToBoundary() const;
+    bool Rotate();
+    void FlushCurrent();
+    void SegmentLoop();
+    void PrepareNext();
+    void FinishClosed();
+    void SyncCurrent();
+    void SaveManifest();
+    void FinishSegment(Segment* segment);
+
+private:
+    SVSegmentFactory factory_;
+    SVAudioFormat format_;
+    SV_CONTAINER_TYPE container_;
+    SV_FILE_OUTPUT_TYPE output_type_;
+    SVSegmentConfig config_;
+    SVSegmentCounters* counters_;
+    SVThreadManager* threads_;
+    std::string manifest_path_;
+    std::string directory_;
+    std::string stem_;
+    std::string extension_;
+    size_t frame_bytes_;
+    // Input and file bytes per segment, 0 when not limited.
+    uint64_t limit_bytes_;
+    uint64_t limit_file_bytes_;
+    uint64_t sync_bytes_;
+    bool opened_;
+
+    // Writer thread.
+    Segment current_;
+    uint64_t input_bytes_;
+    uint64_t flushed_bytes_;
+
+    // Guards the manifest and the segments passed between the writer and segment threads.
+    mutable std::mutex mutex_;
+    SVSegmentManifest manifest_;
+    bool manifest_dirty_;
+    Segment ready_;
+    std::vector<Segment> closed_;
+    uint32_t next_index_;
+    SVFileOutputStats closed_stats_;
+    // The open segment as of its last flush, index, frames and bytes only.
+    SVSegmentInfo flushed_;
+    // Held while a segment is opened, keeps the indexes in order when the writer opens one.
+    std::mutex open_mutex_;
+
+    // Segment thread.
+    SVSegmentInfo synced_;
+    int64_t last_sync_ns_;
+    std::atomic<bool> sync_requested_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_SEGMENT_WRITER_H
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_SEQLOCK_H
+#define AOS_AUDIO_RECORD_SV_SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace sv_recorder {
+
+// Readers retry this often before giving up on a value that keeps changing.
+const int SV_SEQLOCK_READ_ATTEMPTS = 64;
+
+// Single-writer publication of a trivially copyable value. The writer never waits,
+// readers copy the value and retry when the sequence moved underneath them.
+template <typename T>
+class SVSeqlock {
+    static_assert(std::is_trivially_copyable<T>::value, "SVSeqlock needs a trivially copyable value");
+
+public:
+    SVSeqlock() : sequence_(0) {
+      memset(&value_, 0, sizeof(value_));
+    }
+
+    // Writer side, only ever called from one thread.
+    void Store(const T& value) {
+      uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+      sequence_.store(sequence + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      memcpy(&value_, &value, sizeof(T));
+      sequence_.store(sequence + 2, std::memory_order_release);
+    }
+
+    // Returns false when nothing was published yet or every attempt raced with a Store().
+    bool Load(T* value) const {
+      for (int attempt = 0; attempt < SV_SEQLOCK_READ_ATTEMPTS; attempt++) {
+        uint64_t begin = sequence_.load(std::memory_order_acquire);
+        if (begin & 1) {
+          continue;
+        }
+        memcpy(value, &value_, sizeof(T));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence_.load(std::memory_order_relaxed) == begin) {
+          return begin != 0;
+        }
+      }
+      return false;
+    }
+
+    // Number of completed Store() calls.
+    uint64_t version() const { return sequence_.load(std::memory_order_acquire) / 2; }
+
+private:
+    std::atomic<uint64_t> sequence_;
+    T value_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_SEQLOCK_H
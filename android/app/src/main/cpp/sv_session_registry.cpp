@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_session_registry.h"
+#include <thread>
+#include "log.h"
+
+namespace sv_recorder {
+
+const int32_t SV_SESSION_INDEX_BITS = 8;
+const uint32_t SV_SESSION_GENERATION_MASK = 0x7FFFFFu;
+
+SVSessionRef::SVSessionRef(SVSessionRef&& other) noexcept
+  : registry_(other.registry_), index_(other.index_), recorder_(other.recorder_) {
+  other.registry_ = nullptr;
+  other.recorder_ = nullptr;
+}
+
+SVSessionRef::~SVSessionRef() {
+  if(registry_ && recorder_) {
+    registry_->Unref(index_);
+  }
+}
+
+SVSessionRegistry& SVSessionRegistry::Instance() {
+  static SVSessionRegistry registry;
+  return registry;
+}
+
+SVSessionRegistry::SVSessionRegistry() {
+  for(auto& slot : slots_) {
+    slot.tag.store(SLOT_FREE, std::memory_order_relaxed);
+    slot.refs.store(0, std::memory_order_relaxed);
+    slot.type = UNDEFINED;
+  }
+}
+
+bool SVSessionRegistry::Decode(int32_t handle, int32_t* index, uint32_t* generation) {
+  if(handle < 0) {
+    return false;
+  }
+  *index = handle & ((1 << SV_SESSION_INDEX_BITS) - 1);
+  *generation = static_cast<uint32_t>(handle) >> SV_SESSION_INDEX_BITS;
+  return *index < SV_MAX_SESSIONS;
+}
+
+int32_t SVSessionRegistry::Create(SV_RECORD_TYPE type, ISVNativeRecorder::Ptr recorder) {
+  if(!recorder) {
+    return SV_INVALID_SESSION;
+  }
+
+  for(int32_t index = 0; index < SV_MAX_SESSIONS; index++) {
+    Slot& slot = slots_[index];
+    uint32_t tag = slot.tag.load(std::memory_order_relaxed);
+    if((tag & 3u) != SLOT_FREE) {
+      continue;
+    }
+    uint32_t generation = tag >> 2;
+    if(!slot.tag.compare_exchange_strong(tag, generation << 2 | SLOT_BUSY)) {
+      continue;
+    }
+    slot.type = type;
+    slot.recorder = std::move(recorder);
+    slot.tag.store(generation << 2 | SLOT_LIVE, std::memory_order_release);
+    return static_cast<int32_t>(generation << SV_SESSION_INDEX_BITS | index);
+  }
+
+  AV_LOGW("SVSessionRegistry Create error, all %d sessions in use.", SV_MAX_SESSIONS);
+  return SV_INVALID_SESSION;
+}
+
+SVSessionRef SVSessionRegistry::Acquire(int32_t handle) {
+  int32_t index;
+  uint32_t generation;
+  if(!Decode(handle, &index, &generation)) {
+    return SVSessionRef();
+  }
+
+  Slot& slot = slots_[index];
+  // seq_cst pairs with Remove(): either we see the slot closing or Remove() sees our ref.
+  slot.refs.fetch_add(1);
+  if(slot.tag.load() != (generation << 2 | SLOT_LIVE)) {
+    slot.refs.fetch_sub(1, std::memory_order_release);
+    return SVSessionRef();
+  }
+  return SVSessionRef(this, index, slot.recorder.get());
+}
+
+void SVSessionRegistry::Unref(int32_t index) {
+  slots_[index].refs.fetch_sub(1, std::memory_order_release);
+}
+
+SV_RECORD_TYPE SVSessionRegistry::GetType(int32_t handle) {
+  SVSessionRef ref = Acquire(handle);
+  if(!ref) {
+    return UNDEFINED;
+  }
+  int32_t index = handle & ((1 << SV_SESSION_INDEX_BITS) - 1);
+  return slots_[index].type;
+}
+
+ISVNativeRecorder::Ptr SVSessionRegistry::Remove(int32_t handle) {
+  int32_t index;
+  uint32_t generation;
+  if(!Decode(handle, &index, &generation)) {
+    return nullptr;
+  }
+
+  Slot& slot = slots_[index];
+  uint32_t tag = generation << 2 | SLOT_LIVE;
+  if(!slot.tag.compare_exchange_strong(tag, generation << 2 | SLOT_BUSY)) {
+    return nullptr;
+  }
+  while(slot.refs.load() != 0) {
+    std::this_thread::yield();
+  }
+
+  ISVNativeRecorder::Ptr recorder = std::move(slot.recorder);
+  slot.recorder = nullptr;
+  slot.type = UNDEFINED;
+  uint32_t next_generation = (generation + 1) & SV_SESSION_GENERATION_MASK;
+  slot.tag.store(next_generation << 2 | SLOT_FREE, std::memory_order_release);
+  return recorder;
+}
+
+int32_t SVSessionRegistry::ActiveCount() const {
+  int32_t count = 0;
+  for(const auto& slot : slots_) {
+    if((slot.tag.load(std::memory_order_relaxed) & 3u) == SLOT_LIVE) {
+      count++;
+    }
+  }
+  return count;
+}
+
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_SESSION_REGISTRY_H
+#define AOS_AUDIO_RECORD_SV_SESSION_REGISTRY_H
+
+#include <atomic>
+#include "sv_common.h"
+
+namespace sv_recorder {
+
+const int32_t SV_MAX_SESSIONS = 16;
+const int32_t SV_INVALID_SESSION = -1;
+
+class SVSessionRegistry;
+
+// Keeps a session alive while a caller uses it, Remove() waits for all refs to drop.
+class SVSessionRef {
+
+public:
+    SVSessionRef() : registry_(nullptr), index_(-1), recorder_(nullptr) {}
+    SVSessionRef(SVSessionRegistry* registry, int32_t index, ISVNativeRecorder* recorder)
+      : registry_(registry), index_(index), recorder_(recorder) {}
+    SVSessionRef(SVSessionRef&& other) noexcept;
+    SVSessionRef(const SVSessionRef&) = delete;
+    SVSessionRef& operator=(const SVSessionRef&) = delete;
+    ~SVSessionRef();
+
+    explicit operator bool() const { return recorder_ != nullptr; }
+    ISVNativeRecorder* operator->() const { return recorder_; }
+    ISVNativeRecorder* get() const { return recorder_; }
+
+private:
+    SVSessionRegistry* registry_;
+    int32_t index_;
+    ISVNativeRecorder* recorder_;
+};
+
+// Fixed table of recorder sessions addressed by integer handles.
+// Acquire() is lock-free: one atomic increment plus a tag check, so concurrent
+// sessions never serialize on a global lock. A handle carries the slot generation,
+// so a stale handle to a reused slot is rejected.
+class SVSessionRegistry {
+
+public:
+    static SVSessionRegistry& Instance();
+
+    // Returns the new handle, or SV_INVALID_SESSION when all slots are used.
+    int32_t Create(SV_RECORD_TYPE type, ISVNativeRecorder::Ptr recorder);
+    SVSessionRef Acquire(int32_t handle);
+    SV_RECORD_TYPE GetType(int32_t handle);
+    // Detaches the session and returns its recorder, once no SVSessionRef uses it.
+    ISVNativeRecorder::Ptr Remove(int32_t handle);
+    int32_t ActiveCount() const;
+
+private:
+    friend class SVSessionRef;
+    void Unref(int32_t index);
+
+    enum SlotState : uint32_t {
+        SLOT_FREE = 0,
+        SLOT_BUSY = 1,
+        SLOT_LIVE = 2
+    };
+
+    struct Slot {
+        // generation << 2 | SlotState
+        std::atomic<uint32_t> tag;
+        std::atomic<int32_t> refs;
+        SV_RECORD_TYPE type;
+        ISVNativeRecorder::Ptr recorder;
+    };
+
+    SVSessionRegistry();
+    static bool Decode(int32_t handle, int32_t* index, uint32_t* generation);
+
+    Slot slots_[SV_MAX_SESSIONS];
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_SESSION_REGISTRY_H
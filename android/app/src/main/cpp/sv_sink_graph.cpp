@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_sink_graph.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "log.h"
+#include "sv_flac_writer.h"
+#include "sv_opus_writer.h"
+
+namespace sv_recorder {
+
+SVSinkGraph::SVSinkGraph() : threads_(nullptr), block_bytes_(0), running_(false), sequence_(0), pool_misses_(0) {
+}
+
+SVSinkGraph::~SVSinkGraph() {
+  Stop();
+}
+
+int SVSinkGraph::AddSink(std::shared_ptr<ISVBlockSink> sink, int queue_blocks) {
+  if(running_) {
+    AV_LOGW("SVSinkGraph AddSink error, graph is running.");
+    return SV_STATE_ERROR;
+  }
+  if(!sink || queue_blocks <= 0 || queue_blocks > SV_SINK_MAX_QUEUE_BLOCKS ||
+     nodes_.size() >= static_cast<size_t>(SV_SINK_MAX_SINKS)) {
+    return SV_INIT_ERROR;
+  }
+  std::unique_ptr<Node> node(new Node());
+  node->sink = std::move(sink);
+  node->slots.reset(new Slot[queue_blocks]);
+  node->capacity = static_cast<uint32_t>(queue_blocks);
+  node->head.store(0, std::memory_order_relaxed);
+  node->tail.store(0, std::memory_order_relaxed);
+  node->running.store(false, std::memory_order_relaxed);
+  node->blocks_delivered.store(0, std::memory_order_relaxed);
+  node->blocks_dropped.store(0, std::memory_order_relaxed);
+  node->bytes_dropped.store(0, std::memory_order_relaxed);
+  node->max_backlog.store(0, std::memory_order_relaxed);
+  nodes_.push_back(std::move(node));
+  return SV_NO_ERROR;
+}
+
+int SVSinkGraph::Prepare(const SVAudioFormat& format) {
+  if(running_) {
+    AV_LOGW("SVSinkGraph Prepare error, graph is running.");
+    return SV_STATE_ERROR;
+  }
+  if(nodes_.empty()) {
+    return SV_NO_ERROR;
+  }
+  for(auto& node : nodes_) {
+    int result = node->sink->Prepare(format);
+    if(result != SV_NO_ERROR) {
+      AV_LOGW("SVSinkGraph sink %s Prepare error: %d", node->sink->name(), result);
+      return result;
+    }
+  }
+  // Each sink pins at most its queue plus the block it is processing, one more is being
+  // filled: with that many blocks a slow sink can only ever drop from its own queue.
+  uint32_t blocks = 1;
+  for(auto& node : nodes_) {
+    blocks += node->capacity + 1;
+  }
+  const size_t frames = std::max<size_t>(1, static_cast<size_t>(format.sample_rate) * SV_SINK_BLOCK_MS / 1000);
+  block_bytes_ = frames * format.BytesPerFrame();
+  return pool_.Reserve(block_bytes_, blocks);
+}
+
+int SVSinkGraph::Start() {
+  if(running_ || nodes_.empty()) {
+    return SV_NO_ERROR;
+  }
+  if(block_bytes_ == 0) {
+    AV_LOGW("SVSinkGraph Start error, not prepared.");
+    return SV_STATE_ERROR;
+  }
+  sequence_ = 0;
+  pool_misses_.store(0, std::memory_order_relaxed);
+  for(auto& node : nodes_) {
+    node->running.store(true, std::memory_order_release);
+    node->thread = std::thread(&SVSinkGraph::NodeLoop, node.get(), threads_);
+  }
+  running_ = true;
+  return SV_NO_ERROR;
+}
+
+int SVSinkGraph::Stop() {
+  if(!running_) {
+    return SV_NO_ERROR;
+  }
+  // SVCapturePipeline::Stop() runs only after the backend waited for its stream to stop, no
+  // Write() is in flight, so the partial block is safe to submit from this thread.
+  if(current_ && current_->size > 0) {
+    Submit();
+  }
+  current_.reset();
+  for(auto& node : nodes_) {
+    node->running.store(false, std::memory_order_release);
+  }
+  for(size_t i = 0; i < nodes_.size(); i++) {
+    Node* node = nodes_[i].get();
+    if(node->thread.joinable()) {
+      node->thread.join();
+    }
+    SVSinkStats stats = GetStats(i);
+    AV_LOGI("SVSinkGraph sink %s stopped, delivered:%llu, dropped:%llu, max backlog:%u/%u", node->sink->name(),
+            (unsigned long long) stats.blocks_delivered, (unsigned long long) stats.blocks_dropped,
+            stats.max_backlog, node->capacity);
+  }
+  if(pool_misses_.load(std::memory_order_relaxed) > 0) {
+    AV_LOGW("SVSinkGraph pool exhausted %llu times.", (unsigned long long) pool_misses_.load());
+  }
+  running_ = false;
+  return SV_NO_ERROR;
+}
+
+void SVSinkGraph::Write(const void* data, size_t len) {
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  while(len > 0) {
+    if(!current_) {
+      current_ = pool_.Acquire();
+      if(!current_) {
+        // Cannot happen with the pool sized in Prepare(), counted in case it ever does.
+        pool_misses_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      current_->size = 0;
+      current_->timestamp_ns = SVNowNs();
+    }
+    size_t copy = std::min(len, block_bytes_ - current_->size);
+    memcpy(current_->data() + current_->size, src, copy);
+    current_->size += copy;
+    src += copy;
+    len -= copy;
+    if(current_->size == block_bytes_) {
+      Submit();
+    }
+  }
+}
+
+void SVSinkGraph::Submit() {
+  const uint64_t sequence = sequence_++;
+  for(auto& node_ptr : nodes_) {
+    Node* node = node_ptr.get();
+    const uint32_t tail = node->tail.load(std::memory_order_relaxed);
+    const uint32_t backlog = tail - node->head.load(std::memory_order_acquire);
+    if(backlog >= node->capacity) {
+      node->blocks_dropped.fetch_add(1, std::memory_order_relaxed);
+      node->bytes_dropped.fetch_add(current_->size, std::memory_order_relaxed);
+      continue;
+    }
+    Slot& slot = node->slots[tail % node->capacity];
+    // Copying the ref only bumps the block's count.
+    slot.block = current_;
+    slot.sequence = sequence;
+    node->tail.store(tail + 1, std::memory_order_release);
+    if(backlog + 1 > node->max_backlog.load(std::memory_order_relaxed)) {
+      node->max_backlog.store(backlog + 1, std::memory_order_relaxed);
+    }
+  }
+  // Recycled right away when every sink dropped it.
+  current_.reset();
+}
+
+void SVSinkGraph::NodeLoop(Node* node, SVThreadManager* threads) {
+  SVThreadScope scope(threads, SV_THREAD_SINK);
+  while(node->running.load(std::memory_order_acquire)) {
+    scope.Tick();
+    if(Deliver(node) == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(SV_SINK_POLL_MS));
+    }
+  }
+  Deliver(node);
+  node->sink->OnStop();
+}
+
+size_t SVSinkGraph::Deliver(Node* node) {
+  uint32_t head = node->head.load(std::memory_order_relaxed);
+  const uint32_t tail = node->tail.load(std::memory_order_acquire);
+  size_t delivered = 0;
+  while(head != tail) {
+    Slot& slot = node->slots[head % node->capacity];
+    node->sink->OnBlock(*slot.block.get(), slot.sequence);
+    slot.block.reset();
+    node->head.store(++head, std::memory_order_release);
+    delivered++;
+  }
+  node->blocks_delivered.fetch_add(delivered, std::memory_order_relaxed);
+  return delivered;
+}
+
+SVSinkStats SVSinkGraph::GetStats(size_t index) const {
+  const Node& node = *nodes_[index];
+  SVSinkStats stats;
+  stats.blocks_delivered = node.blocks_delivered.load(std::memory_order_relaxed);
+  stats.blocks_dropped = node.blocks_dropped.load(std::memory_order_relaxed);
+  stats.bytes_dropped = node.bytes_dropped.load(std::memory_order_relaxed);
+  stats.backlog = node.tail.load(std::memory_order_relaxed) - node.head.load(std::memory_order_relaxed);
+  stats.max_backlog = node.max_backlog.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void SVSinkGraph::AppendJson(std::string* json) const {
+  json->append("\"sinks\":[");
+  char text[256];
+  for(size_t i = 0; i < nodes_.size(); i++) {
+    SVSinkStats stats = GetStats(i);
+    snprintf(text, sizeof(text), "%s{\"name\":\"%s\",\"queue_blocks\":%u,\"delivered\":%llu,\"dropped\":%llu,"
+             "\"dropped_bytes\":%llu,\"backlog\":%u,\"max_backlog\":%u}", i > 0 ? "," : "",
+             nodes_[i]->sink->name(), nodes_[i]->capacity, (unsigned long long) stats.blocks_delivered,
+             (unsigned long long) stats.blocks_dropped, (unsigned long long) stats.bytes_dropped, stats.backlog,
+             stats.max_backlog);
+    json->append(text);
+  }
+  json->append("]");
+}
+
+SVFileBlockSink::SVFileBlockSink(std::string file_path, SV_CONTAINER_TYPE container,
+                                 SV_FILE_OUTPUT_TYPE output_type, int32_t opus_bitrate)
+  : file_path_(std::move(file_path)), container_(container), output_type_(output_type),
+    opus_bitrate_(opus_bitrate) {
+}
+
+SVFileBlockSink::~SVFileBlockSink() {
+  if(output_) {
+    output_->Close();
+  }
+}
+
+const char* SVFileBlockSink::name() const {
+  switch (container_) {
+    case SV_CONTAINER_WAV: return "wav";
+    case SV_CONTAINER_FLAC: return "flac";
+    case SV_CONTAINER_OPUS: return "opus";
+    default: return "raw";
+  }
+}
+
+int SVFileBlockSink::Prepare(const SVAudioFormat& format) {
+  if(output_) {
+    return SV_NO_ERROR;
+  }
+  ISVFileOutput::Ptr output = ISVFileOutput::Create(output_type_);
+  if(container_ == SV_CONTAINER_WAV) {
+    output.reset(new SVWavFileOutput(std::move(output), format));
+  } else if(container_ == SV_CONTAINER_FLAC) {
+    output.reset(new SVFlacFileOutput(std::move(output), format));
+  } else if(container_ == SV_CONTAINER_OPUS) {
+    output.reset(new SVOpusFileOutput(std::move(output), format, opus_bitrate_));
+  }
+  int result = output->Open(file_path_);
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  output_ = std::move(output);
+  return SV_NO_ERROR;
+}
+
+void SVFileBlockSink::OnBlock(const SVAudioBlock& block, uint64_t sequence) {
+  if(output_->Write(block.data(), block.size) != block.size) {
+    AV_LOGE_RATELIMIT(1000, "SVFileBlockSink %s write error, len:%zu", name(), block.size);
+  }
+}
+
+void SVFileBlockSink::OnStop() {
+  output_->Flush();
+}
+
+}
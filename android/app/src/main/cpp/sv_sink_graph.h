@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_SINK_GRAPH_H
+#define AOS_AUDIO_RECORD_SV_SINK_GRAPH_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sv_buffer_pool.h"
+#include "sv_common.h"
+#include "sv_file_output.h"
+#include "sv_thread_manager.h"
+#include "sv_wav_writer.h"
+
+namespace sv_recorder {
+
+const int SV_SINK_BLOCK_MS = 20;
+// One second of backlog per sink before it starts dropping.
+const int SV_SINK_DEFAULT_QUEUE_BLOCKS = 50;
+const int SV_SINK_MAX_QUEUE_BLOCKS = 500;
+const int SV_SINK_MAX_SINKS = 8;
+const size_t SV_SINK_POLL_MS = 5;
+
+// Consumer of captured blocks, runs on a thread of its own.
+class ISVBlockSink {
+
+public:
+    virtual ~ISVBlockSink() = default;
+    virtual const char* name() const = 0;
+    // Caller thread, once the stream format is known. Errors fail the recording's Prepare().
+    virtual int Prepare(const SVAudioFormat& format) = 0;
+    // Sink thread. |block| is shared with the other sinks and read-only, it is recycled
+    // after the last sink returns. |sequence| skips every block this sink dropped.
+    virtual void OnBlock(const SVAudioBlock& block, uint64_t sequence) = 0;
+    // Sink thread, after the last block.
+    virtual void OnStop() {}
+};
+
+struct SVSinkStats {
+    uint64_t blocks_delivered;
+    uint64_t blocks_dropped;
+    uint64_t bytes_dropped;
+    uint32_t backlog;
+    uint32_t max_backlog;
+};
+
+// Fans captured audio out to N sinks without copying: the audio thread fills pooled
+// blocks and hands every full block by reference to each sink's bounded SPSC queue.
+// A sink that falls behind drops from its own queue only, capture and the other sinks
+// never wait for it.
+class SVSinkGraph {
+
+public:
+    SVSinkGraph();
+    ~SVSinkGraph();
+
+    // While stopped. |queue_blocks| is how far the sink may fall behind before it drops.
+    int AddSink(std::shared_ptr<ISVBlockSink> sink, int queue_blocks);
+    // Sink threads run as SV_THREAD_SINK of |threads|, set it before Start().
+    void SetThreadManager(SVThreadManager* threads) { threads_ = threads; }
+    bool IsEnabled() const { return !nodes_.empty(); }
+    size_t sink_count() const { return nodes_.size(); }
+    // Prepares every sink and sizes the pool so no sink can starve another of blocks.
+    int Prepare(const SVAudioFormat& format);
+    int Start();
+    // Submits the partially filled block, lets every sink drain its queue and joins them.
+    // Only once Write() can no longer be called, see SVCapturePipeline::Stop().
+    int Stop();
+
+    // Audio thread, never blocks or allocates.
+    void Write(const void* data, size_t len);
+
+    SVSinkStats GetStats(size_t index) const;
+    SVBufferPoolStats GetPoolStats() const { return pool_.GetStats(); }
+    // "sinks":[...] with one object per sink.
+    void AppendJson(std::string* json) const;
+
+private:
+    struct Slot {
+        SVBlockRef block;
+        uint64_t sequence;
+    };
+
+    struct Node {
+        std::shared_ptr<ISVBlockSink> sink;
+        std::unique_ptr<Slot[]> slots;
+        uint32_t capacity;
+        // Free-running positions, the slot is position % capacity.
+        std::atomic<uint32_t> head;
+        std::atomic<uint32_t> tail;
+        std::thread thread;
+        std::atomic<bool> running;
+        std::atomic<uint64_t> blocks_delivered;
+        std::atomic<uint64_t> blocks_dropped;
+        std::atomic<uint64_t> bytes_dropped;
+        std::atomic<uint32_t> max_backlog;
+    };
+
+    void Submit();
+    static void NodeLoop(Node* node, SVThreadManager* threads);
+    static size_t Deliver(Node* node);
+
+private:
+    std::vector<std::unique_ptr<Node>> nodes_;
+    SVBufferPool pool_;
+    SVThreadManager* threads_;
+    size_t block_bytes_;
+    bool running_;
+    // Audio thread state.
+    SVBlockRef current_;
+    uint64_t sequence_;
+    std::atomic<uint64_t> pool_misses_;
+};
+
+// Writes the blocks to a file of its own, raw or in a container, at the capture format.
+class SVFileBlockSink : public ISVBlockSink {
+
+public:
+    // |opus_bitrate| only applies to SV_CONTAINER_OPUS, the file is written at the capture format.
+    SVFileBlockSink(std::string file_path, SV_CONTAINER_TYPE container, SV_FILE_OUTPUT_TYPE output_type,
+                    int32_t opus_bitrate);
+    ~SVFileBlockSink();
+
+    const char* name() const override;
+    // Opens the file once, a re-prepared recording keeps appending to it.
+    int Prepare(const SVAudioFormat& format) override;
+    void OnBlock(const SVAudioBlock& block, uint64_t sequence) override;
+    void OnStop() override;
+
+private:
+    std::string file_path_;
+    SV_CONTAINER_TYPE container_;
+    SV_FILE_OUTPUT_TYPE output_type_;
+    int32_t opus_bitrate_;
+    ISVFileOutput::Ptr output_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_SINK_GRAPH_H
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_stream_recovery.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include "log.h"
+#include "sv_capture_pipeline.h"
+
+namespace sv_recorder {
+
+// How often the recovery thread looks for the first callback of a restarted stream.
+const int SV_RECOVERY_POLL_MS = 2;
+
+SVStreamRecovery::SVStreamRecovery(SVCapturePipeline* pipeline)
+  : pipeline_(pipeline), handler_(nullptr), enabled_(true), running_(false), pending_(false),
+    state_(SV_STREAM_IDLE), disconnect_ns_(0), resume_ns_(0), disconnects_(0), recoveries_(0), failures_(0),
+    attempts_(0), last_recovery_us_(0), max_recovery_us_(0), gap_frames_(0) {
+}
+
+SVStreamRecovery::~SVStreamRecovery() {
+  Stop();
+}
+
+void SVStreamRecovery::Start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  state_.store(SV_STREAM_RUNNING, std::memory_order_release);
+  if(running_ || !handler_ || !enabled_) {
+    return;
+  }
+  running_ = true;
+  pending_ = false;
+  thread_ = std::thread(&SVStreamRecovery::RecoveryLoop, this);
+}
+
+void SVStreamRecovery::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+    pending_ = false;
+  }
+  cond_.notify_all();
+  if(thread_.joinable()) {
+    thread_.join();
+  }
+  if(state() != SV_STREAM_FAILED) {
+    state_.store(SV_STREAM_IDLE, std::memory_order_release);
+  }
+}
+
+void SVStreamRecovery::OnDisconnected(const char* reason) {
+  disconnects_.fetch_add(1, std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(state() == SV_STREAM_RECOVERING) {
+    // A stream that dies before its first callback is retried by the running recovery.
+    return;
+  }
+  AV_LOGW("SVStreamRecovery stream disconnected: %s%s", reason ? reason : "unknown",
+          running_ ? "" : ", recovery disabled");
+  disconnect_ns_.store(SVNowNs(), std::memory_order_relaxed);
+  state_.store(SV_STREAM_DISCONNECTED, std::memory_order_release);
+  if(running_) {
+    pending_ = true;
+    cond_.notify_all();
+  }
+}
+
+void SVStreamRecovery::OnGapFilled(uint64_t frames, int64_t resume_ns) {
+  gap_frames_.fetch_add(frames, std::memory_order_relaxed);
+  resume_ns_.store(resume_ns, std::memory_order_release);
+}
+
+void SVStreamRecovery::RecoveryLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while(running_) {
+    cond_.wait(lock, [this] { return !running_ || pending_; });
+    if(!running_) {
+      break;
+    }
+    pending_ = false;
+    state_.store(SV_STREAM_RECOVERING, std::memory_order_release);
+    lock.unlock();
+    bool recovered = Recover();
+    lock.lock();
+    if(!recovered && running_) {
+      failures_.fetch_add(1, std::memory_order_relaxed);
+      state_.store(SV_STREAM_FAILED, std::memory_order_release);
+      AV_LOGE("SVStreamRecovery gave up after %d attempts.", SV_RECOVERY_MAX_ATTEMPTS);
+    }
+  }
+}
+
+bool SVStreamRecovery::Recover() {
+  handler_->CloseStream();
+  int backoff_ms = SV_RECOVERY_BACKOFF_MS;
+  for(int attempt = 1; attempt <= SV_RECOVERY_MAX_ATTEMPTS; attempt++) {
+    attempts_.fetch_add(1, std::memory_order_relaxed);
+    resume_ns_.store(0, std::memory_order_relaxed);
+    // Armed per attempt: a stream that delivered once and died again still leaves a gap.
+    pipeline_->ArmGap();
+    int result = handler_->OpenStream();
+    if(result == SV_NO_ERROR) {
+      result = handler_->StartStream();
+    }
+    if(result == SV_NO_ERROR &&
+       WaitForResume(SVNowNs() + SV_RECOVERY_FIRST_CALLBACK_TIMEOUT_MS * 1000000LL)) {
+      const int64_t recovery_us = (resume_ns_.load(std::memory_order_acquire) -
+                                   disconnect_ns_.load(std::memory_order_relaxed)) / 1000;
+      last_recovery_us_.store(recovery_us, std::memory_order_relaxed);
+      max_recovery_us_.store(std::max(recovery_us, max_recovery_us_.load(std::memory_order_relaxed)),
+                             std::memory_order_relaxed);
+      recoveries_.fetch_add(1, std::memory_order_relaxed);
+      state_.store(SV_STREAM_RUNNING, std::memory_order_release);
+      AV_LOGI("SVStreamRecovery recovered after %d attempts in %.1f ms.", attempt, recovery_us / 1000.0);
+      return true;
+    }
+    AV_LOGW("SVStreamRecovery attempt %d failed: %d", attempt, result);
+    handler_->CloseStream();
+    if(!Backoff(backoff_ms)) {
+      return false;
+    }
+    backoff_ms = std::min(backoff_ms * 2, SV_RECOVERY_MAX_BACKOFF_MS);
+  }
+  return false;
+}
+
+bool SVStreamRecovery::WaitForResume(int64_t deadline_ns) {
+  // The first callback stamps resume_ns_ without locking, so poll for it.
+  while(resume_ns_.load(std::memory_order_acquire) == 0) {
+    if(SVNowNs() >= deadline_ns || !Backoff(SV_RECOVERY_POLL_MS)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SVStreamRecovery::Backoff(int ms) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait_for(lock, std::chrono::milliseconds(ms), [this] { return !running_; });
+  return running_;
+}
+
+SVRecoveryStats SVStreamRecovery::GetStats() const {
+  SVRecoveryStats stats;
+  stats.state = state();
+  stats.disconnects = disconnects_.load(std::memory_order_relaxed);
+  stats.recoveries = recoveries_.load(std::memory_order_relaxed);
+  stats.failures = failures_.load(std::memory_order_relaxed);
+  stats.attempts = attempts_.load(std::memory_order_relaxed);
+  stats.last_recovery_us = last_recovery_us_.load(std::memory_order_relaxed);
+  stats.max_recovery_us = max_recovery_us_.load(std::memory_order_relaxed);
+  stats.gap_frames = gap_frames_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void SVStreamRecovery::AppendJson(std::string* json) const {
+  SVRecoveryStats stats = GetStats();
+  char text[320];
+  snprintf(text, sizeof(text), "\"recovery\":{\"state\":%d,\"disconnects\":%llu,\"recoveries\":%llu,"
+           "\"failures\":%llu,\"attempts\":%llu,\"last_recovery_us\":%lld,\"max_recovery_us\":%lld,"
+           "\"gap_frames\":%llu}", stats.state, (unsigned long long) stats.disconnects,
+           (unsigned long long) stats.recoveries, (unsigned long long) stats.failures,
+           (unsigned long long) stats.attempts, (long long) stats.last_recovery_us,
+           (long long) stats.max_recovery_us, (unsigned long long) stats.gap_frames);
+  json->append(text);
+}
+
+}
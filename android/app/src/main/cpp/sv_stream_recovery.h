@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_STREAM_RECOVERY_H
+#define AOS_AUDIO_RECORD_SV_STREAM_RECOVERY_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace sv_recorder {
+
+class SVCapturePipeline;
+
+enum SV_STREAM_STATE : int32_t {
+    SV_STREAM_IDLE = 0,
+    SV_STREAM_RUNNING = 1,
+    // The backend reported the device gone, recovery has not started yet.
+    SV_STREAM_DISCONNECTED = 2,
+    SV_STREAM_RECOVERING = 3,
+    // Every reopen attempt failed, the recording stays stopped.
+    SV_STREAM_FAILED = 4
+};
+
+const int SV_RECOVERY_MAX_ATTEMPTS = 8;
+// Backoff between attempts doubles from the first up to the last value.
+const int SV_RECOVERY_BACKOFF_MS = 50;
+const int SV_RECOVERY_MAX_BACKOFF_MS = 2000;
+// A restarted stream that delivers nothing within this time counts as a failed attempt.
+const int SV_RECOVERY_FIRST_CALLBACK_TIMEOUT_MS = 1000;
+
+// Stream operations a backend exposes for recovery, always called on the recovery thread
+// and never while the backend's own StopRecording() runs.
+class ISVStreamHandler {
+
+public:
+    virtual ~ISVStreamHandler() = default;
+    // Closes the dead stream, tolerates a stream the platform already closed.
+    virtual void CloseStream() = 0;
+    // Opens a stream with the original configuration, it must match the prepared format.
+    virtual int OpenStream() = 0;
+    virtual int StartStream() = 0;
+};
+
+struct SVRecoveryStats {
+    SV_STREAM_STATE state;
+    uint64_t disconnects;
+    uint64_t recoveries;
+    uint64_t failures;
+    uint64_t attempts;
+    // Disconnect to the first callback of the new stream.
+    int64_t last_recovery_us;
+    int64_t max_recovery_us;
+    // Silence written in place of the missing audio.
+    uint64_t gap_frames;
+};
+
+// Reopen state machine shared by the backends: the error callback only reports the
+// disconnect, a dedicated thread closes, reopens and restarts the stream with backoff.
+// The pipeline fills the outage with silence so the file timeline stays continuous.
+class SVStreamRecovery {
+
+public:
+    explicit SVStreamRecovery(SVCapturePipeline* pipeline);
+    ~SVStreamRecovery();
+
+    void SetHandler(ISVStreamHandler* handler) { handler_ = handler; }
+    void SetEnabled(bool enabled) { enabled_ = enabled; }
+    // Called when capture starts and stops. Stop() waits for a running recovery to finish
+    // so the backend owns its stream again afterwards.
+    void Start();
+    void Stop();
+
+    // Any thread, typically the backend's error callback. Never blocks on stream operations.
+    void OnDisconnected(const char* reason);
+    // Pipeline side, from the first callback after a restart.
+    void OnGapFilled(uint64_t frames, int64_t resume_ns);
+
+    SV_STREAM_STATE state() const { return state_.load(std::memory_order_acquire); }
+    SVRecoveryStats GetStats() const;
+    void AppendJson(std::string* json) const;
+
+private:
+    void RecoveryLoop();
+    bool Recover();
+    bool WaitForResume(int64_t deadline_ns);
+    // Sleeps up to |ms| unless Stop() is called, returns false when stopping.
+    bool Backoff(int ms);
+
+private:
+    SVCapturePipeline* pipeline_;
+    ISVStreamHandler* handler_;
+    bool enabled_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::thread thread_;
+    bool running_;
+    bool pending_;
+    std::atomic<SV_STREAM_STATE> state_;
+    std::atomic<int64_t> disconnect_ns_;
+    std::atomic<int64_t> resume_ns_;
+    std::atomic<uint64_t> disconnects_;
+    std::atomic<uint64_t> recoveries_;
+    std::atomic<uint64_t> failures_;
+    std::atomic<uint64_t> attempts_;
+    std::atomic<int64_t> last_recovery_us_;
+    std::atomic<int64_t> max_recovery_us_;
+    std::atomic<uint64_t> gap_frames_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_STREAM_RECOVERY_H
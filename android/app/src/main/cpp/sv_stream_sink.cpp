@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_stream_sink.h"
+#include <algorithm>
+#include <chrono>
+#include "log.h"
+#include "sv_common.h"
+
+namespace sv_recorder {
+
+SVStreamSink::SVStreamSink()
+  : chunk_bytes_(0), chunk_count_(0), current_(-1), fill_(0), sequence_(0), overrun_(false),
+    threads_(nullptr), running_(false), chunks_delivered_(0), overrun_count_(0), overrun_bytes_(0) {
+}
+
+SVStreamSink::~SVStreamSink() {
+  Stop();
+}
+
+int SVStreamSink::SetListener(std::shared_ptr<ISVStreamListener> listener, size_t chunk_bytes,
+                              int chunk_count) {
+  if(running_) {
+    AV_LOGW("SVStreamSink SetListener error, sink is running.");
+    return SV_STATE_ERROR;
+  }
+  if(!listener) {
+    listener_ = nullptr;
+    blocks_.reset();
+    return SV_NO_ERROR;
+  }
+  if(chunk_bytes == 0 || chunk_count < SV_STREAM_MIN_CHUNKS || chunk_count > SV_STREAM_MAX_CHUNKS) {
+    AV_LOGW("SVStreamSink invalid pool: %zu x %d", chunk_bytes, chunk_count);
+    return SV_INIT_ERROR;
+  }
+
+  // The chunks stay checked out of the pool for the sink's lifetime, the listener sees
+  // the same memory on every recording.
+  blocks_.reset();
+  if(pool_.Reserve(chunk_bytes, static_cast<uint32_t>(chunk_count)) != SV_NO_ERROR) {
+    return SV_INIT_ERROR;
+  }
+  blocks_.reset(new SVBlockRef[chunk_count]);
+  chunks_.reset(new uint8_t*[chunk_count]);
+  headers_.reset(new SVStreamChunk[chunk_count]);
+  for(int i = 0; i < chunk_count; i++) {
+    blocks_[i] = pool_.Acquire();
+    chunks_[i] = blocks_[i]->data();
+  }
+  free_queue_.Reset(chunk_count * sizeof(int32_t));
+  ready_queue_.Reset(chunk_count * sizeof(int32_t));
+  chunk_bytes_ = chunk_bytes;
+  chunk_count_ = chunk_count;
+  listener_ = std::move(listener);
+  return SV_NO_ERROR;
+}
+
+int SVStreamSink::Start() {
+  if(running_ || !listener_) {
+    return SV_NO_ERROR;
+  }
+  free_queue_.Reset(chunk_count_ * sizeof(int32_t));
+  ready_queue_.Reset(chunk_count_ * sizeof(int32_t));
+  for(int32_t i = 0; i < chunk_count_; i++) {
+    free_queue_.Write(&i, sizeof(i));
+  }
+  current_ = -1;
+  fill_ = 0;
+  overrun_ = false;
+  running_ = true;
+  thread_ = std::thread(&SVStreamSink::DeliveryLoop, this);
+  return SV_NO_ERROR;
+}
+
+int SVStreamSink::Stop() {
+  if(!running_) {
+    return SV_NO_ERROR;
+  }
+  // The backends wait for their stream to stop before stopping the pipeline, no Write() runs
+  // any more, so this thread may act as the producer.
+  if(current_ >= 0 && fill_ > 0) {
+    Submit();
+  }
+  running_ = false;
+  if(thread_.joinable()) {
+    thread_.join();
+  }
+  auto stats = GetStats();
+  AV_LOGI("SVStreamSink stopped, delivered:%llu, overruns:%llu, dropped:%llu",
+          (unsigned long long) stats.chunks_delivered, (unsigned long long) stats.overrun_count,
+          (unsigned long long) stats.overrun_bytes);
+  return SV_NO_ERROR;
+}
+
+void SVStreamSink::Write(const void* data, size_t len) {
+  if(!running_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  while(len > 0) {
+    if(current_ < 0) {
+      const uint8_t* slot = nullptr;
+      if(free_queue_.Peek(&slot) < sizeof(int32_t)) {
+        // The listener is too slow, drop instead of blocking the audio thread.
+        overrun_ = true;
+        overrun_count_.fetch_add(1, std::memory_order_relaxed);
+        overrun_bytes_.fetch_add(len, std::memory_order_relaxed);
+        return;
+      }
+      memcpy(&current_, slot, sizeof(current_));
+      free_queue_.Consume(sizeof(current_));
+      fill_ = 0;
+      headers_[current_].timestamp_ns = SVNowNs();
+    }
+    size_t copy = std::min(len, chunk_bytes_ - fill_);
+    memcpy(chunks_[current_] + fill_, src, copy);
+    fill_ += copy;
+    src += copy;
+    len -= copy;
+    if(fill_ == chunk_bytes_) {
+      Submit();
+    }
+  }
+}
+
+void SVStreamSink::Submit() {
+  if(overrun_) {
+    sequence_++;
+    overrun_ = false;
+  }
+  SVStreamChunk& header = headers_[current_];
+  header.index = current_;
+  header.sequence = sequence_++;
+  header.data = chunks_[current_];
+  header.size = fill_;
+  // Cannot fail, the ring holds every index of the pool.
+  ready_queue_.Write(&current_, sizeof(current_));
+  current_ = -1;
+  fill_ = 0;
+}
+
+SVStreamStats SVStreamSink::GetStats() const {
+  SVStreamStats stats;
+  stats.chunks_delivered = chunks_delivered_.load(std::memory_order_relaxed);
+  stats.overrun_count = overrun_count_.load(std::memory_order_relaxed);
+  stats.overrun_bytes = overrun_bytes_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void SVStreamSink::DeliveryLoop() {
+  SVThreadScope scope(threads_, SV_THREAD_STREAM);
+  listener_->OnStreamStart(chunks_.get(), chunk_count_, chunk_bytes_);
+  while(running_.load(std::memory_order_acquire)) {
+    scope.Tick();
+    if(Deliver() == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(SV_STREAM_POLL_MS));
+    }
+  }
+  Deliver();
+  listener_->OnStreamStop();
+}
+
+size_t SVStreamSink::Deliver() {
+  size_t delivered = 0;
+  const uint8_t* slot = nullptr;
+  while(ready_queue_.Peek(&slot) >= sizeof(int32_t)) {
+    int32_t index;
+    memcpy(&index, slot, sizeof(index));
+    ready_queue_.Consume(sizeof(index));
+    listener_->OnStreamChunk(headers_[index]);
+    free_queue_.Write(&index, sizeof(index));
+    delivered++;
+  }
+  chunks_delivered_.fetch_add(delivered, std::memory_order_relaxed);
+  return delivered;
+}
+
+}
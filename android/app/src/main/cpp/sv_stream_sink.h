@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_STREAM_SINK_H
+#define AOS_AUDIO_RECORD_SV_STREAM_SINK_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "sv_buffer_pool.h"
+#include "sv_ring_buffer.h"
+#include "sv_thread_manager.h"
+
+namespace sv_recorder {
+
+const int SV_STREAM_MIN_CHUNKS = 2;
+const int SV_STREAM_MAX_CHUNKS = 64;
+const size_t SV_STREAM_POLL_MS = 5;
+
+struct SVStreamChunk {
+    int32_t index;
+    // Increments per delivered chunk and skips one value after every overrun,
+    // so a consumer can detect lost audio from the sequence alone.
+    uint64_t sequence;
+    const uint8_t* data;
+    size_t size;
+    // SVNowNs() when the first frame of the chunk arrived.
+    int64_t timestamp_ns;
+};
+
+struct SVStreamStats {
+    uint64_t chunks_delivered;
+    uint64_t overrun_count;
+    uint64_t overrun_bytes;
+};
+
+// Receives live audio on the delivery thread.
+class ISVStreamListener {
+
+public:
+    virtual ~ISVStreamListener() = default;
+    // First call on a new delivery thread. |chunks| stay valid until OnStreamStop().
+    virtual void OnStreamStart(uint8_t* const* chunks, int chunk_count, size_t chunk_bytes) = 0;
+    // |chunk| goes back to the pool when this returns, copy anything needed later.
+    virtual void OnStreamChunk(const SVStreamChunk& chunk) = 0;
+    // Last call on the delivery thread.
+    virtual void OnStreamStop() = 0;
+};
+
+// Hands captured audio to a listener through a fixed pool of preallocated chunks.
+// Write() copies into the current chunk on the audio thread; full chunks travel to the
+// delivery thread and back through two SPSC index rings, so no side blocks or allocates.
+class SVStreamSink {
+
+public:
+    SVStreamSink();
+    ~SVStreamSink();
+
+    // Allocates the pool, must be called while stopped. A null listener disables the sink.
+    int SetListener(std::shared_ptr<ISVStreamListener> listener, size_t chunk_bytes, int chunk_count);
+    bool IsEnabled() const { return listener_ != nullptr; }
+    // The delivery thread applies its policy and reports its CPU use here, set before Start().
+    void SetThreadManager(SVThreadManager* threads) { threads_ = threads; }
+    int Start();
+    // Delivers the partially filled chunk and everything queued, then stops the thread.
+    int Stop();
+
+    // Called from the audio thread, never blocks.
+    void Write(const void* data, size_t len);
+
+    SVStreamStats GetStats() const;
+    SVBufferPoolStats GetPoolStats() const { return pool_.GetStats(); }
+
+private:
+    void DeliveryLoop();
+    size_t Deliver();
+    void Submit();
+
+private:
+    std::shared_ptr<ISVStreamListener> listener_;
+    SVBufferPool pool_;
+    std::unique_ptr<SVBlockRef[]> blocks_;
+    std::unique_ptr<uint8_t*[]> chunks_;
+    std::unique_ptr<SVStreamChunk[]> headers_;
+    size_t chunk_bytes_;
+    int chunk_count_;
+    SVRingBuffer free_queue_;
+    SVRingBuffer ready_queue_;
+    // Audio thread state.
+    int32_t current_;
+    size_t fill_;
+    uint64_t sequence_;
+    bool overrun_;
+    SVThreadManager* threads_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::atomic<uint64_t> chunks_delivered_;
+    std::atomic<uint64_t> overrun_count_;
+    std::atomic<uint64_t> overrun_bytes_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_STREAM_SINK_H
@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_synthetic_recorder.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include "log.h"
+#include "sv_sample_convert.h"
+
+namespace sv_recorder {
+
+const double SV_SYNTHETIC_SINE_HZ = 440.0;
+const double SV_SYNTHETIC_AMPLITUDE = 0.5;
+
+SVSyntheticRecorder::SVSyntheticRecorder(std::string file_path, SV_SYNTHETIC_SOURCE source,
+                                         std::string input_path)
+  : pipeline_(file_path), source_(source), input_path_(std::move(input_path)), input_(nullptr),
+    format_{0, 0, SV_SAMPLE_I16}, frames_per_callback_(0), phase_(0.0), noise_state_(0x12345678u),
+    jitter_state_(0x9e3779b9u), jitter_ms_(0), stall_ms_(0), stall_interval_ms_(0), xruns_(0),
+    initialized_(false), recording_(false), streaming_(false), inject_outage_ms_(-1), inject_failed_reopens_(0),
+    outage_end_ns_(0), failed_reopens_(0) {
+  AV_LOGI("=== SVSyntheticRecorder Constructor, source:%d ===", source_);
+  pipeline_.recovery().SetHandler(this);
+}
+
+SVSyntheticRecorder::~SVSyntheticRecorder() {
+  AV_LOGI("=== SVSyntheticRecorder Deconstructor ===");
+  StopRecording();
+  Release();
+}
+
+int SVSyntheticRecorder::InitRecording(int sample_rate, int channel, SV_SAMPLE_FORMAT format) {
+
+  if(recording_) {
+    AV_LOGW("SVSyntheticRecorder InitRecording error, recording.");
+    return SV_STATE_ERROR;
+  }
+  pipeline_.BeginInit(SYNTHETIC);
+
+  if(source_ == SV_SOURCE_FILE && !input_) {
+    input_ = fopen(input_path_.c_str(), "rb");
+    if(!input_) {
+      AV_LOGW("SVSyntheticRecorder open input failed: %s", input_path_.c_str());
+      return SV_INIT_ERROR;
+    }
+  }
+
+  format_ = {sample_rate, channel, format};
+  if(frames_per_callback_ <= 0) {
+    frames_per_callback_ = sample_rate / SV_BUFFERS_PER_SECOND;
+  }
+  const size_t buffer_bytes = frames_per_callback_ * format_.BytesPerFrame();
+  buffer_.reset();
+  if(!pool_) {
+    pool_ = SVBackendContext::Instance().AcquirePool(buffer_bytes, 1);
+  }
+  if(pool_->Reserve(buffer_bytes, 1) != SV_NO_ERROR) {
+    return SV_INIT_ERROR;
+  }
+  buffer_ = pool_->Acquire();
+  scratch_.reset(new float[frames_per_callback_ * channel]);
+
+  int result = pipeline_.Prepare(format_);
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  SVStreamInfo info;
+  info.backend = "synthetic";
+  info.fallback = pipeline_.options().low_latency;
+  info.frames_per_burst = frames_per_callback_;
+  info.buffer_capacity = frames_per_callback_ * SV_SYNTHETIC_CAPACITY_BURSTS;
+  // Sized like AAudio: a low-latency stream starts small, the others at the full buffer.
+  SVLatencyTuner& tuner = pipeline_.latency_tuner();
+  const bool low_latency = pipeline_.options().low_latency;
+  tuner.Init(low_latency || tuner.adaptive() ? info.frames_per_burst : 0, info.buffer_capacity,
+             low_latency ? info.frames_per_burst * SV_LOW_LATENCY_INITIAL_BURSTS : info.buffer_capacity);
+  xruns_.store(0, std::memory_order_relaxed);
+  pipeline_.SetStreamInfo(info);
+  pipeline_.EndInit();
+  initialized_ = true;
+  return SV_NO_ERROR;
+}
+
+int SVSyntheticRecorder::StartRecording() {
+
+  if(!initialized_) {
+    AV_LOGW("SVSyntheticRecorder StartRecording error, not initialized.");
+    return SV_STATE_ERROR;
+  }
+  if(recording_) {
+    return SV_START_RECORDING_ERROR;
+  }
+
+  int result = pipeline_.Start();
+  if(result != SV_NO_ERROR) {
+    pipeline_.Stop();
+    return result;
+  }
+  recording_ = true;
+  return StartStream();
+}
+
+int SVSyntheticRecorder::StopRecording() {
+
+  if(!recording_) {
+    return SV_STATE_ERROR;
+  }
+  recording_ = false;
+  pipeline_.recovery().Stop();
+  CloseStream();
+  pipeline_.Stop();
+  return SV_NO_ERROR;
+}
+
+int SVSyntheticRecorder::SetOption(int32_t option, int32_t value) {
+  return pipeline_.SetOption(option, value);
+}
+
+int SVSyntheticRecorder::Release() {
+  if(input_) {
+    fclose(input_);
+    input_ = nullptr;
+  }
+  buffer_.reset();
+  SVBackendContext::Instance().ReleasePool(std::move(pool_));
+  initialized_ = false;
+  return SV_NO_ERROR;
+}
+
+int SVSyntheticRecorder::Prewarm(const SVAudioFormat& format) {
+  const int64_t begin_ns = SVNowNs();
+  SVBackendContext& context = SVBackendContext::Instance();
+  const int result = context.PrewarmPool(format.sample_rate / SV_BUFFERS_PER_SECOND * format.BytesPerFrame(), 1);
+  if(result == SV_NO_ERROR) {
+    context.MarkWarm(SYNTHETIC);
+  }
+  context.OnPrewarm(SYNTHETIC, SVNowNs() - begin_ns, result);
+  return result;
+}
+
+void SVSyntheticRecorder::InjectDisconnect(int32_t outage_ms, int32_t failed_reopens) {
+  // Published by the store below, read by the timer thread after it saw the outage.
+  inject_failed_reopens_ = failed_reopens;
+  inject_outage_ms_.store(std::max(0, outage_ms), std::memory_order_release);
+}
+
+void SVSyntheticRecorder::SetJitter(const SVSyntheticJitter& jitter) {
+  jitter_ms_.store(std::max(0, jitter.jitter_ms), std::memory_order_relaxed);
+  stall_ms_.store(std::max(0, jitter.stall_ms), std::memory_order_relaxed);
+  stall_interval_ms_.store(std::max(0, jitter.stall_interval_ms), std::memory_order_relaxed);
+}
+
+void SVSyntheticRecorder::CloseStream() {
+  streaming_ = false;
+  if(thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+int SVSyntheticRecorder::OpenStream() {
+  if(SVNowNs() < outage_end_ns_) {
+    AV_LOGW("SVSyntheticRecorder OpenStream error, device still gone.");
+    return SV_INIT_ERROR;
+  }
+  if(failed_reopens_ > 0) {
+    failed_reopens_--;
+    AV_LOGW("SVSyntheticRecorder OpenStream error, injected failure.");
+    return SV_INIT_ERROR;
+  }
+  return SV_NO_ERROR;
+}
+
+int SVSyntheticRecorder::StartStream() {
+  streaming_ = true;
+  thread_ = std::thread(&SVSyntheticRecorder::TimerLoop, this);
+  return SV_NO_ERROR;
+}
+
+void SVSyntheticRecorder::TimerLoop() {
+  SVLatencyTuner& tuner = pipeline_.latency_tuner();
+  const int64_t rate = format_.sample_rate;
+  const int64_t start_ns = SVNowNs();
+  // Frames the device captured since |start_ns| that were delivered or overwritten.
+  int64_t consumed = 0;
+  int64_t next_stall_ns = 0;
+  // A reopened stream counts from zero, like the platform counters.
+  int32_t stream_xruns = 0;
+
+  while(streaming_.load(std::memory_order_acquire)) {
+    const int32_t outage_ms = inject_outage_ms_.exchange(-1, std::memory_order_acquire);
+    if(outage_ms >= 0) {
+      // Set up before reporting, the recovery thread reopens right after the report.
+      outage_end_ns_ = SVNowNs() + outage_ms * 1000000LL;
+      failed_reopens_ = inject_failed_reopens_;
+      streaming_ = false;
+      pipeline_.recovery().OnDisconnected("injected");
+      return;
+    }
+    // Woken when the next burst is complete, plus the injected lateness.
+    const int64_t ready_ns = start_ns + (consumed + frames_per_callback_) * 1000000000LL / rate;
+    const int64_t wake_ns = ready_ns + WakeupDelayNs(ready_ns, &next_stall_ns);
+    std::this_thread::sleep_for(std::chrono::nanoseconds(wake_ns - SVNowNs()));
+
+    int64_t available = (SVNowNs() - start_ns) * rate / 1000000000LL - consumed;
+    const int32_t buffer_size = tuner.buffer_size();
+    if(available > buffer_size) {
+      // The device wrapped around and overwrote what the callback did not take in time.
+      consumed += available - buffer_size;
+      available = buffer_size;
+      stream_xruns++;
+      xruns_.fetch_add(1, std::memory_order_relaxed);
+      pipeline_.metrics().SetXRunCount(stream_xruns);
+    }
+    // A late callback catches up with back-to-back bursts, like a real one.
+    while(available >= frames_per_callback_) {
+      Generate(buffer_->data(), frames_per_callback_);
+      pipeline_.OnAudioData(buffer_->data(), frames_per_callback_);
+      const int32_t next_size = tuner.OnCallback(SVNowNs(), frames_per_callback_, stream_xruns);
+      if(next_size > 0) {
+        tuner.SetBufferSize(std::min(next_size, tuner.capacity()));
+      }
+      consumed += frames_per_callback_;
+      available -= frames_per_callback_;
+    }
+  }
+}
+
+int64_t SVSyntheticRecorder::WakeupDelayNs(int64_t ready_ns, int64_t* next_stall_ns) {
+  int64_t delay_ns = 0;
+  const int32_t jitter_ms = jitter_ms_.load(std::memory_order_relaxed);
+  if(jitter_ms > 0) {
+    jitter_state_ ^= jitter_state_ << 13;
+    jitter_state_ ^= jitter_state_ >> 17;
+    jitter_state_ ^= jitter_state_ << 5;
+    delay_ns = jitter_state_ % (jitter_ms * 1000000LL);
+  }
+  const int32_t stall_interval_ms = stall_interval_ms_.load(std::memory_order_relaxed);
+  if(stall_interval_ms > 0 && ready_ns >= *next_stall_ns) {
+    delay_ns += stall_ms_.load(std::memory_order_relaxed) * 1000000LL;
+    *next_stall_ns = ready_ns + stall_interval_ms * 1000000LL;
+  }
+  return delay_ns;
+}
+
+void SVSyntheticRecorder::Generate(uint8_t* data, int32_t num_frames) {
+  const int channels = format_.channels;
+  const size_t samples = static_cast<size_t>(num_frames) * channels;
+
+  if(source_ == SV_SOURCE_FILE) {
+    // The input file holds raw frames in the requested format.
+    const size_t frame_bytes = format_.BytesPerFrame();
+    size_t read = fread(data, frame_bytes, num_frames, input_);
+    if(read < static_cast<size_t>(num_frames)) {
+      // Loop the input so long runs keep a steady load.
+      rewind(input_);
+      read += fread(data + read * frame_bytes, frame_bytes, num_frames - read, input_);
+    }
+    memset(data + read * frame_bytes, 0, (num_frames - read) * frame_bytes);
+    return;
+  }
+
+  float* scratch = scratch_.get();
+  const double step = 2.0 * M_PI * SV_SYNTHETIC_SINE_HZ / format_.sample_rate;
+  for(int32_t frame = 0; frame < num_frames; frame++) {
+    float value;
+    if(source_ == SV_SOURCE_NOISE) {
+      // xorshift32, cheap enough to never be the bottleneck of a benchmark.
+      noise_state_ ^= noise_state_ << 13;
+      noise_state_ ^= noise_state_ >> 17;
+      noise_state_ ^= noise_state_ << 5;
+      value = static_cast<float>(SV_SYNTHETIC_AMPLITUDE * (noise_state_ * (2.0 / 4294967296.0) - 1.0));
+    } else {
+      value = static_cast<float>(SV_SYNTHETIC_AMPLITUDE * sin(phase_));
+      phase_ += step;
+      if(phase_ >= 2.0 * M_PI) {
+        phase_ -= 2.0 * M_PI;
+      }
+    }
+    for(int ch = 0; ch < channels; ch++) {
+      scratch[frame * channels + ch] = value;
+    }
+  }
+
+  const SVConvertKernels& convert = SVConvert();
+  if(format_.sample_format == SV_SAMPLE_F32) {
+    memcpy(data, scratch, samples * sizeof(float));
+  } else if(format_.sample_format == SV_SAMPLE_I24) {
+    convert.f32_to_i24(scratch, data, samples);
+  } else {
+    convert.f32_to_i16(scratch, reinterpret_cast<int16_t*>(data), samples);
+  }
+}
+
+}
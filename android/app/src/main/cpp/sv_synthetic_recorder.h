@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_SYNTHETIC_RECORDER_H
+#define AOS_AUDIO_RECORD_SV_SYNTHETIC_RECORDER_H
+
+#include <atomic>
+#include <thread>
+#include "sv_common.h"
+#include "sv_capture_pipeline.h"
+
+namespace sv_recorder {
+
+enum SV_SYNTHETIC_SOURCE : int32_t {
+    SV_SOURCE_SINE = 0,
+    SV_SOURCE_NOISE = 1,
+    SV_SOURCE_FILE = 2
+};
+
+// Device buffer of the synthetic stream, in callbacks.
+const int32_t SV_SYNTHETIC_CAPACITY_BURSTS = 50;
+
+// Scheduling noise of the synthetic callback, to exercise the buffer sizing.
+struct SVSyntheticJitter {
+    // Every wakeup comes up to this late, uniformly distributed.
+    int32_t jitter_ms = 0;
+    // On top of that one wakeup every |stall_interval_ms| comes |stall_ms| late.
+    int32_t stall_ms = 0;
+    int32_t stall_interval_ms = 0;
+};
+
+// Hardware-free backend. A timer thread generates frames and drives
+// SVCapturePipeline exactly like the AAudio/Oboe/OpenSL callbacks do,
+// so the whole capture path can run and be profiled on a Linux host.
+// The device captures on its own clock into a buffer of the tuned size and counts an
+// xrun whenever a late callback lets it overflow. Disconnects and callback jitter can be
+// injected to exercise the stream recovery and the buffer sizing without a device.
+class SVSyntheticRecorder : public ISVNativeRecorder, public ISVStreamHandler {
+
+public:
+    explicit SVSyntheticRecorder(std::string file_path,
+                                 SV_SYNTHETIC_SOURCE source = SV_SOURCE_SINE,
+                                 std::string input_path = "");
+    ~SVSyntheticRecorder();
+    int InitRecording(int sample_rate, int channel, SV_SAMPLE_FORMAT format) override;
+    int StartRecording() override;
+    int StopRecording() override;
+    int Release() override;
+    int SetOption(int32_t option, int32_t value) override;
+    SVCapturePipeline& pipeline() override { return pipeline_; }
+    // Reserves the callback buffer of |format| in the process-wide pools ahead of a session.
+    static int Prewarm(const SVAudioFormat& format);
+
+    // Frames delivered per callback, defaults to 10ms like the OpenSL backend.
+    void SetFramesPerCallback(int32_t frames) { frames_per_callback_ = frames; }
+    // Fault injection: the timer thread dies like a disconnected device at its next callback,
+    // reopening fails for |outage_ms| and then |failed_reopens| more times.
+    void InjectDisconnect(int32_t outage_ms, int32_t failed_reopens = 0);
+    // Applies from the next wakeup, may be changed while recording.
+    void SetJitter(const SVSyntheticJitter& jitter);
+    // Device buffer overflows since InitRecording().
+    uint32_t xruns() const { return xruns_.load(std::memory_order_relaxed); }
+
+    // ISVStreamHandler, the "stream" is the timer thread.
+    void CloseStream() override;
+    int OpenStream() override;
+    int StartStream() override;
+
+private:
+    void TimerLoop();
+    void Generate(uint8_t* data, int32_t num_frames);
+    int64_t WakeupDelayNs(int64_t ready_ns, int64_t* next_stall_ns);
+
+private:
+    SVCapturePipeline pipeline_;
+    SV_SYNTHETIC_SOURCE source_;
+    std::string input_path_;
+    FILE* input_;
+    SVAudioFormat format_;
+    int32_t frames_per_callback_;
+    // Callback buffer from the process-wide pools, returned on Release().
+    std::shared_ptr<SVBufferPool> pool_;
+    SVBlockRef buffer_;
+    std::unique_ptr<float[]> scratch_;
+    double phase_;
+    uint32_t noise_state_;
+    // Timer thread only, separate from the noise so the audio stays the same with jitter.
+    uint32_t jitter_state_;
+    std::atomic<int32_t> jitter_ms_;
+    std::atomic<int32_t> stall_ms_;
+    std::atomic<int32_t> stall_interval_ms_;
+    std::atomic<uint32_t> xruns_;
+    bool initialized_;
+    std::atomic<bool> recording_;
+    // The timer thread runs while set, recovery stops and restarts it.
+    std::atomic<bool> streaming_;
+    std::atomic<int32_t> inject_outage_ms_;
+    int32_t inject_failed_reopens_;
+    int64_t outage_end_ns_;
+    int32_t failed_reopens_;
+    std::thread thread_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_SYNTHETIC_RECORDER_H
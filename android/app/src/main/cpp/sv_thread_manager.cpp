@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_thread_manager.h"
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include "log.h"
+#include "sv_common.h"
+
+namespace sv_recorder {
+
+static const char* const kRoleNames[SV_THREAD_ROLE_COUNT] = {"capture", "writer", "stream", "sink", "segment"};
+
+static const char* ResultName(int32_t result) {
+  switch (result) {
+    case SV_POLICY_APPLIED: return "applied";
+    case SV_POLICY_DENIED: return "denied";
+    default: return "default";
+  }
+}
+
+SVThreadManager::SVThreadManager() {
+  Reset();
+}
+
+int SVThreadManager::SetPolicy(SV_THREAD_ROLE role, const SVThreadPolicy& policy) {
+  if(role <= SV_THREAD_CAPTURE || role >= SV_THREAD_ROLE_COUNT) {
+    AV_LOGW("SVThreadManager SetPolicy error, role %d is not ours to schedule.", role);
+    return SV_INIT_ERROR;
+  }
+  if(policy.nice < SV_THREAD_MIN_NICE || policy.nice > SV_THREAD_MAX_NICE ||
+     policy.fifo_priority < 0 || policy.fifo_priority > SV_THREAD_MAX_FIFO_PRIORITY) {
+    return SV_INIT_ERROR;
+  }
+  slots_[role].policy = policy;
+  return SV_NO_ERROR;
+}
+
+void SVThreadManager::Reset() {
+  for(Slot& slot : slots_) {
+    if(&slot != &slots_[SV_THREAD_CAPTURE] && slot.tid.load(std::memory_order_acquire) != 0) {
+      // A thread that outlives a restart, such as the segment thread opened in Prepare(),
+      // keeps its slot. The platform's callback thread never leaves and is always reset.
+      continue;
+    }
+    slot.entered = false;
+    slot.ticks = 0;
+    slot.tid.store(0, std::memory_order_relaxed);
+    slot.cpu.store(-1, std::memory_order_relaxed);
+    slot.cpu_time_us.store(0, std::memory_order_relaxed);
+    slot.migrations.store(0, std::memory_order_relaxed);
+    slot.affinity.store(SV_POLICY_DEFAULT, std::memory_order_relaxed);
+    slot.nice.store(SV_POLICY_DEFAULT, std::memory_order_relaxed);
+    slot.fifo.store(SV_POLICY_DEFAULT, std::memory_order_relaxed);
+  }
+}
+
+bool SVThreadManager::Enter(SV_THREAD_ROLE role) {
+  Slot& slot = slots_[role];
+  const int32_t tid = static_cast<int32_t>(syscall(SYS_gettid));
+  if(role == SV_THREAD_CAPTURE) {
+    // A recovered stream calls back on a new thread, which takes over.
+    slot.tid.store(tid, std::memory_order_relaxed);
+  } else {
+    char name[16];
+    snprintf(name, sizeof(name), "sv_%s", kRoleNames[role]);
+    pthread_setname_np(pthread_self(), name);
+    ApplyPolicy(role, slot, tid);
+    int32_t unclaimed = 0;
+    if(!slot.tid.compare_exchange_strong(unclaimed, tid, std::memory_order_acq_rel)) {
+      return false;
+    }
+  }
+  slot.thread = pthread_self();
+  slot.entered = true;
+  slot.ticks = 0;
+  slot.cpu.store(sched_getcpu(), std::memory_order_relaxed);
+  SampleCpuTime(slot);
+  return true;
+}
+
+void SVThreadManager::Tick(SV_THREAD_ROLE role) {
+  Slot& slot = slots_[role];
+  if(!slot.entered || !pthread_equal(slot.thread, pthread_self())) {
+    // A recovered stream calls back on a new thread, its CPU time starts from zero.
+    Enter(role);
+    return;
+  }
+  const int32_t cpu = sched_getcpu();
+  if(cpu != slot.cpu.load(std::memory_order_relaxed)) {
+    slot.cpu.store(cpu, std::memory_order_relaxed);
+    slot.migrations.fetch_add(1, std::memory_order_relaxed);
+  }
+  if(++slot.ticks % SV_THREAD_SAMPLE_TICKS == 0) {
+    SampleCpuTime(slot);
+  }
+}
+
+void SVThreadManager::Leave(SV_THREAD_ROLE role) {
+  Slot& slot = slots_[role];
+  SampleCpuTime(slot);
+  slot.entered = false;
+  slot.tid.store(0, std::memory_order_release);
+}
+
+void SVThreadManager::ApplyPolicy(SV_THREAD_ROLE role, Slot& slot, int32_t tid) {
+  const SVThreadPolicy& policy = slot.policy;
+  if(policy.cpu_mask != 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int cpu = 0; cpu < 32; cpu++) {
+      if(policy.cpu_mask & (1u << cpu)) {
+        CPU_SET(cpu, &set);
+      }
+    }
+    bool applied = sched_setaffinity(0, sizeof(set), &set) == 0;
+    if(!applied) {
+      AV_LOGW("SVThreadManager %s affinity 0x%x failed: %s", kRoleNames[role], policy.cpu_mask, strerror(errno));
+    }
+    slot.affinity.store(applied ? SV_POLICY_APPLIED : SV_POLICY_DENIED, std::memory_order_relaxed);
+  }
+  if(policy.nice != 0) {
+    // On Linux the nice value is per thread when addressed by tid.
+    bool applied = setpriority(PRIO_PROCESS, tid, policy.nice) == 0;
+    if(!applied) {
+      AV_LOGW("SVThreadManager %s nice %d failed: %s", kRoleNames[role], policy.nice, strerror(errno));
+    }
+    slot.nice.store(applied ? SV_POLICY_APPLIED : SV_POLICY_DENIED, std::memory_order_relaxed);
+  }
+  if(policy.fifo_priority > 0) {
+    sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = policy.fifo_priority;
+    int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if(result != 0) {
+      AV_LOGW("SVThreadManager %s SCHED_FIFO %d denied: %s", kRoleNames[role], policy.fifo_priority,
+              strerror(result));
+    }
+    slot.fifo.store(result == 0 ? SV_POLICY_APPLIED : SV_POLICY_DENIED, std::memory_order_relaxed);
+  }
+}
+
+void SVThreadManager::SampleCpuTime(Slot& slot) {
+  timespec ts;
+  if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+    slot.cpu_time_us.store(static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000, std::memory_order_relaxed);
+  }
+}
+
+SVThreadStats SVThreadManager::GetStats(SV_THREAD_ROLE role) const {
+  const Slot& slot = slots_[role];
+  SVThreadStats stats;
+  stats.tid = slot.tid.load(std::memory_order_relaxed);
+  stats.cpu = slot.cpu.load(std::memory_order_relaxed);
+  stats.cpu_time_us = slot.cpu_time_us.load(std::memory_order_relaxed);
+  stats.migrations = slot.migrations.load(std::memory_order_relaxed);
+  stats.affinity = static_cast<SV_POLICY_RESULT>(slot.affinity.load(std::memory_order_relaxed));
+  stats.nice = static_cast<SV_POLICY_RESULT>(slot.nice.load(std::memory_order_relaxed));
+  stats.fifo = static_cast<SV_POLICY_RESULT>(slot.fifo.load(std::memory_order_relaxed));
+  return stats;
+}
+
+void SVThreadManager::AppendJson(std::string* json) const {
+  json->append("\"threads\":{");
+  char text[320];
+  for(int role = 0; role < SV_THREAD_ROLE_COUNT; role++) {
+    SVThreadStats stats = GetStats(static_cast<SV_THREAD_ROLE>(role));
+    const SVThreadPolicy& policy = slots_[role].policy;
+    snprintf(text, sizeof(text), "%s\"%s\":{\"tid\":%d,\"cpu\":%d,\"cpu_time_ms\":%.1f,\"migrations\":%llu,"
+             "\"cpu_mask\":%u,\"nice\":%d,\"fifo_priority\":%d,\"affinity_result\":\"%s\","
+             "\"nice_result\":\"%s\",\"fifo_result\":\"%s\"}", role > 0 ? "," : "", kRoleNames[role],
+             stats.tid, stats.cpu, stats.cpu_time_us / 1000.0, (unsigned long long) stats.migrations,
+             policy.cpu_mask, policy.nice, policy.fifo_priority, ResultName(stats.affinity),
+             ResultName(stats.nice), ResultName(stats.fifo));
+    json->append(text);
+  }
+  json->append("}");
+}
+
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_THREAD_MANAGER_H
+#define AOS_AUDIO_RECORD_SV_THREAD_MANAGER_H
+
+#include <pthread.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace sv_recorder {
+
+enum SV_THREAD_ROLE : int32_t {
+    // The backend's callback thread. It belongs to the platform, so it is observed only.
+    SV_THREAD_CAPTURE = 0,
+    // Disk writer, it also runs the resampler, VAD, encoders and the analysis tap.
+    SV_THREAD_WRITER = 1,
+    // Live stream delivery to the listener.
+    SV_THREAD_STREAM = 2,
+    // One per sink of the sink graph, all under the same policy.
+    SV_THREAD_SINK = 3,
+    // Opens, syncs and closes the files of a segmented recording.
+    SV_THREAD_SEGMENT = 4,
+    SV_THREAD_ROLE_COUNT = 5
+};
+
+const int32_t SV_THREAD_MIN_NICE = -20;
+const int32_t SV_THREAD_MAX_NICE = 19;
+const int32_t SV_THREAD_MAX_FIFO_PRIORITY = 99;
+// CPU time is sampled every this many ticks, the migration check runs on every tick.
+const uint32_t SV_THREAD_SAMPLE_TICKS = 64;
+
+// Scheduling applied by a thread to itself when it starts. The defaults change nothing.
+struct SVThreadPolicy {
+    // Bit n allows CPU n, 0 keeps the inherited affinity.
+    uint32_t cpu_mask = 0;
+    // 0 keeps the inherited nice value.
+    int32_t nice = 0;
+    // SCHED_FIFO priority, 0 stays SCHED_OTHER. Usually denied to apps, which is logged and reported.
+    int32_t fifo_priority = 0;
+};
+
+enum SV_POLICY_RESULT : int32_t {
+    SV_POLICY_DEFAULT = 0,
+    SV_POLICY_APPLIED = 1,
+    SV_POLICY_DENIED = 2
+};
+
+struct SVThreadStats {
+    // 0 when the thread has not run yet or has exited.
+    int32_t tid;
+    // CPU of the last tick.
+    int32_t cpu;
+    int64_t cpu_time_us;
+    // CPU changes seen between consecutive ticks, a lower bound of the real count.
+    uint64_t migrations;
+    SV_POLICY_RESULT affinity;
+    SV_POLICY_RESULT nice;
+    SV_POLICY_RESULT fifo;
+};
+
+// Per-pipeline view of the threads around a backend: applies each role's policy when its
+// thread starts and keeps CPU time and migration counts that any thread can read. A role
+// with several threads applies the policy to each and reports the first one that entered.
+class SVThreadManager {
+
+public:
+    SVThreadManager();
+
+    // Takes effect the next time the role's thread starts, set it before Start().
+    int SetPolicy(SV_THREAD_ROLE role, const SVThreadPolicy& policy);
+    const SVThreadPolicy& policy(SV_THREAD_ROLE role) const { return slots_[role].policy; }
+    // Clears the stats of the roles without a running thread.
+    void Reset();
+
+    // On the thread itself. Enter() applies the policy and returns false when another thread
+    // already reports the role, such a thread neither ticks nor leaves. Tick() also enters a
+    // thread it has not seen before, which is how the platform's callback thread gets registered.
+    bool Enter(SV_THREAD_ROLE role);
+    void Tick(SV_THREAD_ROLE role);
+    void Leave(SV_THREAD_ROLE role);
+
+    SVThreadStats GetStats(SV_THREAD_ROLE role) const;
+    // "threads":{...} with one object per role.
+    void AppendJson(std::string* json) const;
+
+private:
+    struct Slot {
+        SVThreadPolicy policy;
+        // Owner thread state.
+        pthread_t thread;
+        bool entered;
+        uint32_t ticks;
+        std::atomic<int32_t> tid;
+        std::atomic<int32_t> cpu;
+        std::atomic<int64_t> cpu_time_us;
+        std::atomic<uint64_t> migrations;
+        std::atomic<int32_t> affinity;
+        std::atomic<int32_t> nice;
+        std::atomic<int32_t> fifo;
+    };
+
+    void ApplyPolicy(SV_THREAD_ROLE role, Slot& slot, int32_t tid);
+    static void SampleCpuTime(Slot& slot);
+
+private:
+    Slot slots_[SV_THREAD_ROLE_COUNT];
+};
+
+// Enters |role| for the lifetime of a thread function, a null manager does nothing.
+class SVThreadScope {
+
+public:
+    SVThreadScope(SVThreadManager* manager, SV_THREAD_ROLE role)
+      : manager_(manager), role_(role), reported_(manager && manager->Enter(role)) {
+    }
+    ~SVThreadScope() {
+        if (reported_) {
+            manager_->Leave(role_);
+        }
+    }
+    void Tick() {
+        if (reported_) {
+            manager_->Tick(role_);
+        }
+    }
+
+private:
+    SVThreadManager* manager_;
+    SV_THREAD_ROLE role_;
+    bool reported_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_THREAD_MANAGER_H
@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_vad.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "log.h"
+
+namespace sv_recorder {
+
+// Speech must stand this far above the noise floor.
+const float SV_VAD_SNR_DB = 10.0f;
+// Fricatives are allowed this much below the threshold and closer to the floor.
+const float SV_VAD_FRICATIVE_MARGIN_DB = 10.0f;
+const float SV_VAD_FRICATIVE_SNR_DB = 6.0f;
+// Crossings per second above which a frame counts as noise-like, voiced speech stays below.
+const float SV_VAD_FRICATIVE_CROSSINGS = 3000.0f;
+// The floor follows quieter frames quickly and louder ones at this rate.
+const float SV_VAD_NOISE_FALL = 0.2f;
+const float SV_VAD_NOISE_RISE_DB_PER_SECOND = 2.0f;
+
+SVVoiceDetector::SVVoiceDetector()
+  : channels_(0), frame_length_(0), sample_rate_(0), threshold_db_(0), energy_db_(SV_VAD_MIN_THRESHOLD_DB),
+    noise_rise_db_(0) {
+}
+
+int SVVoiceDetector::Init(int sample_rate, int channels, const SVVadConfig& config) {
+  if(sample_rate <= 0 || channels <= 0 || channels > SV_MAX_CONVERT_CHANNELS) {
+    AV_LOGW("SVVoiceDetector invalid config: %d Hz, channels:%d", sample_rate, channels);
+    return SV_INIT_ERROR;
+  }
+  channels_ = channels;
+  sample_rate_ = sample_rate;
+  frame_length_ = std::max(1, sample_rate * SV_VAD_FRAME_MS / 1000);
+  threshold_db_ = static_cast<float>(config.threshold_db);
+  noise_rise_db_ = SV_VAD_NOISE_RISE_DB_PER_SECOND * SV_VAD_FRAME_MS / 1000.0f;
+  planar_.resize(static_cast<size_t>(frame_length_) * channels_);
+  channel_ptrs_.resize(channels_);
+  for(int ch = 0; ch < channels_; ch++) {
+    channel_ptrs_[ch] = planar_.data() + ch * frame_length_;
+  }
+  Reset();
+  return SV_NO_ERROR;
+}
+
+void SVVoiceDetector::Reset() {
+  std::fill(noise_db_, noise_db_ + SV_MAX_CONVERT_CHANNELS, static_cast<float>(SV_VAD_MIN_THRESHOLD_DB));
+  energy_db_ = SV_VAD_MIN_THRESHOLD_DB;
+}
+
+bool SVVoiceDetector::IsActive(const float* frames) {
+  if(channels_ == 1) {
+    return IsChannelActive(0, frames);
+  }
+  SVConvert().deinterleave(frames, channel_ptrs_.data(), frame_length_, channels_);
+  // Every channel keeps its own floor, speech on any of them keeps the frame.
+  bool active = false;
+  for(int ch = 0; ch < channels_; ch++) {
+    active |= IsChannelActive(ch, channel_ptrs_[ch]);
+  }
+  return active;
+}
+
+bool SVVoiceDetector::IsChannelActive(int channel, const float* samples) {
+  const SVConvertKernels& kernels = SVConvert();
+  const float power = kernels.dot(samples, samples, frame_length_) / frame_length_;
+  const float energy_db = 10.0f * log10f(power + 1e-10f);
+  const float crossings = static_cast<float>(kernels.sign_changes(samples, frame_length_)) *
+                          sample_rate_ / frame_length_;
+  float& noise_db = noise_db_[channel];
+
+  bool voiced = energy_db > threshold_db_ && energy_db > noise_db + SV_VAD_SNR_DB;
+  bool fricative = crossings > SV_VAD_FRICATIVE_CROSSINGS &&
+                   energy_db > threshold_db_ - SV_VAD_FRICATIVE_MARGIN_DB &&
+                   energy_db > noise_db + SV_VAD_FRICATIVE_SNR_DB;
+  if(energy_db < noise_db) {
+    noise_db += (energy_db - noise_db) * SV_VAD_NOISE_FALL;
+  } else {
+    noise_db += std::min(energy_db - noise_db, noise_rise_db_);
+  }
+  if(channel == 0) {
+    energy_db_ = energy_db;
+  }
+  return voiced || fricative;
+}
+
+int SVVadIndex::Load(const std::string& index_path) {
+  FILE* file = fopen(index_path.c_str(), "r");
+  if(!file) {
+    AV_LOGW("SVVadIndex open %s failed.", index_path.c_str());
+    return SV_INIT_ERROR;
+  }
+  segments_.clear();
+  int result = SV_NO_ERROR;
+  if(fscanf(file, "# sv_vad %d", &sample_rate_) != 1) {
+    AV_LOGW("SVVadIndex %s has no header.", index_path.c_str());
+    result = SV_INIT_ERROR;
+  }
+  SVVadSegment segment;
+  while(result == SV_NO_ERROR &&
+        fscanf(file, "%" SCNu64 " %" SCNu64 " %" SCNu64, &segment.source_frame, &segment.file_frame,
+               &segment.frames) == 3) {
+    segments_.push_back(segment);
+  }
+  fclose(file);
+  return result;
+}
+
+int SVVadIndex::Save(const std::string& index_path, int sample_rate) const {
+  FILE* file = fopen(index_path.c_str(), "w");
+  if(!file) {
+    AV_LOGW("SVVadIndex create %s failed.", index_path.c_str());
+    return SV_INIT_ERROR;
+  }
+  fprintf(file, "# sv_vad %d\n", sample_rate);
+  for(const SVVadSegment& segment : segments_) {
+    fprintf(file, "%" PRIu64 " %" PRIu64 " %" PRIu64 "\n", segment.source_frame, segment.file_frame,
+            segment.frames);
+  }
+  return fclose(file) == 0 ? SV_NO_ERROR : SV_INIT_ERROR;
+}
+
+bool SVVadIndex::ToFileFrame(uint64_t source_frame, uint64_t* file_frame) const {
+  // First segment that ends after |source_frame|.
+  auto it = std::upper_bound(segments_.begin(), segments_.end(), source_frame,
+                             [](uint64_t frame, const SVVadSegment& segment) {
+                               return frame < segment.source_frame + segment.frames;
+                             });
+  if(it == segments_.end()) {
+    return false;
+  }
+  *file_frame = it->file_frame + (source_frame > it->source_frame ? source_frame - it->source_frame : 0);
+  return true;
+}
+
+SVVadFileOutput::SVVadFileOutput(ISVFileOutput::Ptr output, const SVAudioFormat& format,
+                                 const SVVadConfig& config, SVVadCounters* counters)
+  : output_(std::move(output)), format_(format), config_(config), counters_(counters), analysis_bytes_(0),
+    pending_bytes_(0), hangover_frames_(0), hangover_left_(0), in_segment_(false), segment_{0, 0, 0},
+    source_frames_(0), file_frames_(0), gap_begin_(0), gap_end_(0), opened_(false) {
+}
+
+int SVVadFileOutput::Open(const std::string& file_path) {
+  int result = detector_.Init(format_.sample_rate, format_.channels, config_);
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+  const int frame_length = detector_.frame_length();
+  analysis_bytes_ = frame_length * format_.BytesPerFrame();
+  pending_.resize(analysis_bytes_);
+  pending_bytes_ = 0;
+  samples_.resize(static_cast<size_t>(frame_length) * format_.channels);
+  lead_.Reset(SV_VAD_LEAD_MS / SV_VAD_FRAME_MS * analysis_bytes_);
+  hangover_frames_ = config_.hangover_ms / SV_VAD_FRAME_MS;
+  hangover_left_ = 0;
+  in_segment_ = false;
+  source_frames_ = 0;
+  file_frames_ = 0;
+  gap_begin_ = 0;
+  gap_end_ = 0;
+  index_ = SVVadIndex();
+  index_path_ = file_path + SV_VAD_INDEX_SUFFIX;
+  opened_ = true;
+  AV_LOGI("SVVadFileOutput threshold:%d dB, hangover:%d ms, index:%s", config_.threshold_db,
+          config_.hangover_ms, index_path_.c_str());
+  return output_->Open(file_path);
+}
+
+size_t SVVadFileOutput::Write(const void* data, size_t len) {
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  size_t remaining = len;
+
+  if(pending_bytes_ > 0) {
+    size_t take = std::min(analysis_bytes_ - pending_bytes_, remaining);
+    memcpy(pending_.data() + pending_bytes_, src, take);
+    pending_bytes_ += take;
+    src += take;
+    remaining -= take;
+    if(pending_bytes_ < analysis_bytes_) {
+      return len;
+    }
+    pending_bytes_ = 0;
+    if(!AnalyseFrame(pending_.data())) {
+      return 0;
+    }
+  }
+
+  // Whole analysis frames straight from the ring region, only the tail is copied.
+  while(remaining >= analysis_bytes_) {
+    if(!AnalyseFrame(src)) {
+      return len - remaining;
+    }
+    src += analysis_bytes_;
+    remaining -= analysis_bytes_;
+  }
+  memcpy(pending_.data(), src, remaining);
+  pending_bytes_ = remaining;
+  return len;
+}
+
+bool SVVadFileOutput::AnalyseFrame(const uint8_t* data) {
+  const SVConvertKernels& kernels = SVConvert();
+  const size_t samples = samples_.size();
+  float* frames = samples_.data();
+  if(format_.sample_format == SV_SAMPLE_F32) {
+    memcpy(frames, data, samples * sizeof(float));
+  } else if(format_.sample_format == SV_SAMPLE_I24) {
+    kernels.i24_to_f32(data, frames, samples);
+  } else {
+    kernels.i16_to_f32(reinterpret_cast<const int16_t*>(data), frames, samples);
+  }
+
+  const uint64_t frame_begin = source_frames_;
+  source_frames_ += detector_.frame_length();
+  if(counters_) {
+    counters_->Add(analysis_bytes_, 0);
+  }
+
+  if(detector_.IsActive(frames)) {
+    hangover_left_ = hangover_frames_;
+    if(!in_segment_) {
+      const uint64_t lead_frames = lead_.Size() / format_.BytesPerFrame();
+      segment_ = {frame_begin - lead_frames, file_frames_, 0};
+      in_segment_ = true;
+      bool ok = true;
+      uint64_t lead_frame = segment_.source_frame;
+      lead_.Visit([this, &ok, &lead_frame](const uint8_t* lead, size_t len) {
+        ok &= Keep(lead, len, lead_frame);
+        lead_frame += len / format_.BytesPerFrame();
+      });
+      lead_.Clear();
+      if(!ok) {
+        return false;
+      }
+    }
+    return Keep(data, analysis_bytes_, frame_begin);
+  }
+  if(in_segment_ && hangover_left_ > 0) {
+    hangover_left_--;
+    return Keep(data, analysis_bytes_, frame_begin);
+  }
+  if(in_segment_) {
+    EndSegment();
+  }
+  lead_.Append(data, analysis_bytes_);
+  return true;
+}
+
+bool SVVadFileOutput::Keep(const uint8_t* data, size_t len, uint64_t source_frame) {
+  const size_t bytes_per_frame = format_.BytesPerFrame();
+  const uint64_t frames = len / bytes_per_frame;
+  segment_.frames += frames;
+  file_frames_ += frames;
+  if(counters_) {
+    counters_->Add(0, len);
+  }
+  if(gap_end_ > gap_begin_ && source_frame < gap_end_ && source_frame + frames > gap_begin_) {
+    // The marker goes right in front of the first kept frame of the gap.
+    const uint64_t begin = std::max(source_frame, gap_begin_);
+    const uint64_t end = std::min(source_frame + frames, gap_end_);
+    const size_t head = static_cast<size_t>(begin - source_frame) * bytes_per_frame;
+    if(head > 0 && output_->Write(data, head) != head) {
+      return false;
+    }
+    output_->OnGap((end - begin) * bytes_per_frame);
+    gap_begin_ = end;
+    data += head;
+    len -= head;
+  }
+  return output_->Write(data, len) == len;
+}
+
+void SVVadFileOutput::EndSegment() {
+  index_.Add(segment_);
+  in_segment_ = false;
+  if(counters_) {
+    counters_->AddSegment();
+  }
+}
+
+void SVVadFileOutput::OnGap(uint64_t len) {
+  const size_t bytes_per_frame = format_.BytesPerFrame();
+  // The silence follows whatever waits in pending_.
+  const uint64_t begin = source_frames_ + pending_bytes_ / bytes_per_frame;
+  const uint64_t frames = len / bytes_per_frame;
+  if(gap_end_ > gap_begin_ && gap_end_ == begin) {
+    gap_end_ += frames;
+    return;
+  }
+  gap_begin_ = begin;
+  gap_end_ = begin + frames;
+}
+
+int SVVadFileOutput::WriteAt(uint64_t offset, const void* data, size_t len) {
+  return output_->WriteAt(offset, data, len);
+}
+
+int SVVadFileOutput::Close() {
+  if(!opened_) {
+    return output_->Close();
+  }
+  opened_ = false;
+  // A trailing partial analysis frame follows the current decision.
+  const size_t tail = pending_bytes_ - pending_bytes_ % format_.BytesPerFrame();
+  if(in_segment_ && tail > 0) {
+    Keep(pending_.data(), tail, source_frames_);
+  }
+  pending_bytes_ = 0;
+  if(in_segment_) {
+    EndSegment();
+  }
+  index_.Save(index_path_, format_.sample_rate);
+  AV_LOGI("SVVadFileOutput kept %zu segments, %" PRIu64 "/%" PRIu64 " frames.", index_.segments().size(),
+          file_frames_, source_frames_);
+  return output_->Close();
+}
+
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_VAD_H
+#define AOS_AUDIO_RECORD_SV_VAD_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "sv_common.h"
+#include "sv_file_output.h"
+#include "sv_preroll_buffer.h"
+#include "sv_sample_convert.h"
+
+namespace sv_recorder {
+
+// Analysis frame of the detector.
+const int SV_VAD_FRAME_MS = 10;
+const int SV_VAD_DEFAULT_THRESHOLD_DB = -45;
+const int SV_VAD_MIN_THRESHOLD_DB = -90;
+const int SV_VAD_DEFAULT_HANGOVER_MS = 300;
+const int SV_VAD_MAX_HANGOVER_MS = 5000;
+// Audio kept in front of each speech onset so soft word starts are not clipped.
+const int SV_VAD_LEAD_MS = 30;
+// Extension of the file index written next to a VAD-filtered recording.
+const char* const SV_VAD_INDEX_SUFFIX = ".vad";
+
+struct SVVadConfig {
+    int threshold_db = SV_VAD_DEFAULT_THRESHOLD_DB;
+    int hangover_ms = SV_VAD_DEFAULT_HANGOVER_MS;
+};
+
+// Per analysis frame and channel: energy and zero-crossing rate against an adaptive noise
+// floor. Loud frames are voiced speech; quieter frames with a high crossing rate are
+// fricatives, as long as they stand out of the background.
+class SVVoiceDetector {
+
+public:
+    SVVoiceDetector();
+
+    int Init(int sample_rate, int channels, const SVVadConfig& config);
+    void Reset();
+
+    int frame_length() const { return frame_length_; }
+    // |frames| holds frame_length() interleaved float frames.
+    bool IsActive(const float* frames);
+    // Channel 0 of the last analysed frame, for tuning and the benchmark.
+    float energy_db() const { return energy_db_; }
+    float noise_db() const { return noise_db_[0]; }
+
+private:
+    bool IsChannelActive(int channel, const float* samples);
+
+private:
+    int channels_;
+    int frame_length_;
+    int sample_rate_;
+    float threshold_db_;
+    float noise_db_[SV_MAX_CONVERT_CHANNELS];
+    float energy_db_;
+    float noise_rise_db_;
+    std::vector<float> planar_;
+    std::vector<float*> channel_ptrs_;
+};
+
+// A kept span: |frames| frames from |source_frame| of the capture, stored at |file_frame|
+// of the filtered stream.
+struct SVVadSegment {
+    uint64_t source_frame;
+    uint64_t file_frame;
+    uint64_t frames;
+};
+
+// Maps capture time to positions in a VAD-filtered file, stored as <file>.vad text:
+// a "# sv_vad <sample_rate>" line, then "source_frame file_frame frames" per segment.
+class SVVadIndex {
+
+public:
+    int Load(const std::string& index_path);
+    int Save(const std::string& index_path, int sample_rate) const;
+
+    void Add(const SVVadSegment& segment) { segments_.push_back(segment); }
+    const std::vector<SVVadSegment>& segments() const { return segments_; }
+    int sample_rate() const { return sample_rate_; }
+    // File frame of |source_frame|, or of the next kept frame when it was dropped as silence.
+    // Returns false past the last segment.
+    bool ToFileFrame(uint64_t source_frame, uint64_t* file_frame) const;
+
+private:
+    std::vector<SVVadSegment> segments_;
+    int sample_rate_ = 0;
+};
+
+// Shared between the pipeline and its VAD stages, written by the writer thread only.
+class SVVadCounters {
+
+public:
+    SVVadCounters() : bytes_in_(0), bytes_kept_(0), segments_(0) {}
+
+    void Reset() {
+      bytes_in_.store(0, std::memory_order_relaxed);
+      bytes_kept_.store(0, std::memory_order_relaxed);
+      segments_.store(0, std::memory_order_relaxed);
+    }
+    void Add(uint64_t in, uint64_t kept) {
+      bytes_in_.store(bytes_in_.load(std::memory_order_relaxed) + in, std::memory_order_relaxed);
+      bytes_kept_.store(bytes_kept_.load(std::memory_order_relaxed) + kept, std::memory_order_relaxed);
+    }
+    void AddSegment() {
+      segments_.store(segments_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    uint64_t bytes_in() const { return bytes_in_.load(std::memory_order_relaxed); }
+    uint64_t bytes_kept() const { return bytes_kept_.load(std::memory_order_relaxed); }
+    uint64_t segments() const { return segments_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> bytes_in_;
+    std::atomic<uint64_t> bytes_kept_;
+    std::atomic<uint64_t> segments_;
+};
+
+// Writer-thread stage in front of a container output: passes speech, drops silence after
+// the hangover and records the kept segments in <file>.vad on Close().
+class SVVadFileOutput : public ISVFileOutput {
+
+public:
+    SVVadFileOutput(ISVFileOutput::Ptr output, const SVAudioFormat& format, const SVVadConfig& config,
+                    SVVadCounters* counters);
+    int Open(const std::string& file_path) override;
+    size_t Write(const void* data, size_t len) override;
+    int WriteAt(uint64_t offset, const void* data, size_t len) override;
+    int Flush() override { return output_->Flush(); }
+    int Close() override;
+    uint64_t Size() const override { return output_->Size(); }
+    SVFileOutputStats GetStats() const override { return output_->GetStats(); }
+    // The gap silence is analysed like any other audio, its marker is passed on in front of
+    // whatever part of it the file keeps.
+    void OnGap(uint64_t len) override;
+
+    const SVVadIndex& index() const { return index_; }
+
+private:
+    bool AnalyseFrame(const uint8_t* data);
+    // |len| bytes starting at |source_frame| of the capture.
+    bool Keep(const uint8_t* data, size_t len, uint64_t source_frame);
+    void EndSegment();
+
+private:
+    ISVFileOutput::Ptr output_;
+    SVAudioFormat format_;
+    SVVadConfig config_;
+    SVVadCounters* counters_;
+    SVVoiceDetector detector_;
+    std::string index_path_;
+    SVVadIndex index_;
+    // Bytes of one analysis frame, a partial one waits in pending_.
+    size_t analysis_bytes_;
+    std::vector<uint8_t> pending_;
+    size_t pending_bytes_;
+    std::vector<float> samples_;
+    // The last silent frames, written ahead of the next onset.
+    SVPrerollBuffer lead_;
+    int hangover_frames_;
+    int hangover_left_;
+    bool in_segment_;
+    SVVadSegment segment_;
+    uint64_t source_frames_;
+    uint64_t file_frames_;
+    // Source frames of the last gap not yet passed on, empty when both are equal.
+    uint64_t gap_begin_;
+    uint64_t gap_end_;
+    bool opened_;
+};
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_VAD_H
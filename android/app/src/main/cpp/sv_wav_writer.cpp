@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_wav_writer.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include "log.h"
+
+namespace sv_recorder {
+
+const uint16_t SV_WAVE_FORMAT_PCM = 0x0001;
+const uint16_t SV_WAVE_FORMAT_IEEE_FLOAT = 0x0003;
+const uint16_t SV_WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+const uint32_t SV_DS64_CHUNK_SIZE = 28;
+const size_t SV_WAV_MAX_HEADER_SIZE = 128;
+
+// KSDATAFORMAT_SUBTYPE_PCM/IEEE_FLOAT without the leading format tag.
+static const uint8_t kSubFormatGuidTail[14] = {
+        0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+
+static uint8_t* PutTag(uint8_t* p, const char* tag) {
+  memcpy(p, tag, 4);
+  return p + 4;
+}
+
+static uint8_t* PutLE16(uint8_t* p, uint16_t value) {
+  p[0] = static_cast<uint8_t>(value);
+  p[1] = static_cast<uint8_t>(value >> 8);
+  return p + 2;
+}
+
+static uint8_t* PutLE32(uint8_t* p, uint32_t value) {
+  p = PutLE16(p, static_cast<uint16_t>(value));
+  return PutLE16(p, static_cast<uint16_t>(value >> 16));
+}
+
+static uint8_t* PutLE64(uint8_t* p, uint64_t value) {
+  p = PutLE32(p, static_cast<uint32_t>(value));
+  return PutLE32(p, static_cast<uint32_t>(value >> 32));
+}
+
+static uint16_t GetLE16(const uint8_t* p) {
+  return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+
+static uint32_t GetLE32(const uint8_t* p) {
+  return GetLE16(p) | static_cast<uint32_t>(GetLE16(p + 2)) << 16;
+}
+
+SVWavFileOutput::SVWavFileOutput(ISVFileOutput::Ptr output, const SVAudioFormat& format)
+  : output_(std::move(output)), format_(format), header_size_(0), data_size_(0),
+    patched_data_size_(0), patch_interval_(format.BytesPerSecond()), rf64_(false), opened_(false) {
+}
+
+SVWavFileOutput::~SVWavFileOutput() {
+  Close();
+}
+
+size_t SVWavFileOutput::BuildHeader(uint8_t* header) const {
+  const uint16_t bits = static_cast<uint16_t>(format_.BytesPerSample() * 8);
+  const uint16_t block_align = static_cast<uint16_t>(format_.BytesPerFrame());
+  const bool is_float = format_.sample_format == SV_SAMPLE_F32;
+  const uint16_t format_tag = is_float ? SV_WAVE_FORMAT_IEEE_FLOAT : SV_WAVE_FORMAT_PCM;
+  // WAVE_FORMAT_EXTENSIBLE is required for more than 2 channels or integer samples over 16 bits.
+  const bool extensible = format_.channels > 2 || (!is_float && bits > 16);
+  // Non-PCM formats carry a cbSize field even when it is 0.
+  const uint32_t fmt_size = extensible ? 40 : (is_float ? 18 : 16);
+  const size_t header_size = 12 + 8 + SV_DS64_CHUNK_SIZE + 8 + fmt_size + 8;
+  const uint64_t riff_size = header_size - 8 + data_size_ + (data_size_ & 1);
+
+  uint8_t* p = header;
+  p = PutTag(p, rf64_ ? "RF64" : "RIFF");
+  p = PutLE32(p, rf64_ ? 0xFFFFFFFFu : static_cast<uint32_t>(riff_size));
+  p = PutTag(p, "WAVE");
+
+  // Reserved for the ds64 chunk, a JUNK chunk until the file needs RF64.
+  p = PutTag(p, rf64_ ? "ds64" : "JUNK");
+  p = PutLE32(p, SV_DS64_CHUNK_SIZE);
+  p = PutLE64(p, rf64_ ? riff_size : 0);
+  p = PutLE64(p, rf64_ ? data_size_ : 0);
+  p = PutLE64(p, rf64_ ? data_size_ / block_align : 0);
+  p = PutLE32(p, 0);
+
+  p = PutTag(p, "fmt ");
+  p = PutLE32(p, fmt_size);
+  p = PutLE16(p, extensible ? SV_WAVE_FORMAT_EXTENSIBLE : format_tag);
+  p = PutLE16(p, static_cast<uint16_t>(format_.channels));
+  p = PutLE32(p, static_cast<uint32_t>(format_.sample_rate));
+  p = PutLE32(p, static_cast<uint32_t>(format_.BytesPerSecond()));
+  p = PutLE16(p, block_align);
+  p = PutLE16(p, bits);
+  if(extensible) {
+    p = PutLE16(p, 22);
+    p = PutLE16(p, bits);
+    p = PutLE32(p, 0); // no speaker positions
+    p = PutLE16(p, format_tag);
+    memcpy(p, kSubFormatGuidTail, sizeof(kSubFormatGuidTail));
+    p += sizeof(kSubFormatGuidTail);
+  } else if(is_float) {
+    p = PutLE16(p, 0);
+  }
+
+  p = PutTag(p, "data");
+  p = PutLE32(p, rf64_ ? 0xFFFFFFFFu : static_cast<uint32_t>(data_size_));
+  return static_cast<size_t>(p - header);
+}
+
+int SVWavFileOutput::Open(const std::string& file_path) {
+  int result = output_->Open(file_path);
+  if(result != SV_NO_ERROR) {
+    return result;
+  }
+
+  uint8_t header[SV_WAV_MAX_HEADER_SIZE];
+  data_size_ = 0;
+  patched_data_size_ = 0;
+  rf64_ = false;
+  header_size_ = BuildHeader(header);
+  if(output_->Write(header, header_size_) != header_size_) {
+    AV_LOGE("SVWavFileOutput write header failed.");
+    return SV_INIT_ERROR;
+  }
+  opened_ = true;
+  return SV_NO_ERROR;
+}
+
+size_t SVWavFileOutput::Write(const void* data, size_t len) {
+  size_t written = output_->Write(data, len);
+  data_size_ += written;
+  if(data_size_ - patched_data_size_ >= patch_interval_) {
+    PatchSizes();
+  }
+  return written;
+}
+
+int SVWavFileOutput::WriteAt(uint64_t offset, const void* data, size_t len) {
+  return output_->WriteAt(offset, data, len);
+}
+
+int SVWavFileOutput::PatchSizes() {
+  if(!rf64_ && header_size_ - 8 + data_size_ + 1 > 0xFFFFFFFFull) {
+    AV_LOGI("SVWavFileOutput switch to RF64 at %llu bytes.", (unsigned long long) data_size_);
+    rf64_ = true;
+  }
+  uint8_t header[SV_WAV_MAX_HEADER_SIZE];
+  size_t header_size = BuildHeader(header);
+  patched_data_size_ = data_size_;
+  return output_->WriteAt(0, header, header_size);
+}
+
+int SVWavFileOutput::Flush() {
+  PatchSizes();
+  return output_->Flush();
+}
+
+int SVWavFileOutput::Close() {
+  if(!opened_) {
+    return SV_NO_ERROR;
+  }
+  opened_ = false;
+  if(data_size_ & 1) {
+    // RIFF chunks are word aligned, the pad byte is not part of the data size.
+    uint8_t pad = 0;
+    output_->Write(&pad, 1);
+  }
+  PatchSizes();
+  return output_->Close();
+}
+
+bool SVWavParseHeader(const uint8_t* header, size_t len, SVWavHeaderInfo* info) {
+  if(len < 12 || (memcmp(header, "RIFF", 4) != 0 && memcmp(header, "RF64", 4) != 0) ||
+     memcmp(header + 8, "WAVE", 4) != 0) {
+    return false;
+  }
+  const bool rf64 = memcmp(header, "RF64", 4) == 0;
+  uint64_t ds64_data_size = 0;
+  uint16_t format_tag = 0;
+  uint16_t bits = 0;
+  info->format = {0, 0, SV_SAMPLE_I16};
+  info->data_offset = 0;
+  size_t pos = 12;
+  while(pos + 8 <= len) {
+    const uint32_t chunk_size = GetLE32(header + pos + 4);
+    const uint8_t* body = header + pos + 8;
+    if(memcmp(header + pos, "ds64", 4) == 0 && pos + 8 + 16 <= len) {
+      ds64_data_size = GetLE32(body + 8) | static_cast<uint64_t>(GetLE32(body + 12)) << 32;
+    } else if(memcmp(header + pos, "fmt ", 4) == 0 && pos + 8 + 16 <= len) {
+      format_tag = GetLE16(body);
+      info->format.channels = GetLE16(body + 2);
+      info->format.sample_rate = static_cast<int>(GetLE32(body + 4));
+      bits = GetLE16(body + 14);
+      if(format_tag == SV_WAVE_FORMAT_EXTENSIBLE && chunk_size >= 40 && pos + 8 + 26 <= len) {
+        format_tag = GetLE16(body + 24);
+      }
+    } else if(memcmp(header + pos, "data", 4) == 0) {
+      info->data_offset = pos + 8;
+      if(rf64) {
+        info->data_size = ds64_data_size > 0 ? ds64_data_size : UINT64_MAX;
+      } else {
+        info->data_size = chunk_size > 0 && chunk_size != 0xFFFFFFFFu ? chunk_size : UINT64_MAX;
+      }
+      break;
+    }
+    pos += 8 + static_cast<size_t>(chunk_size) + (chunk_size & 1);
+  }
+  if(format_tag == SV_WAVE_FORMAT_IEEE_FLOAT && bits == 32) {
+    info->format.sample_format = SV_SAMPLE_F32;
+  } else if(format_tag == SV_WAVE_FORMAT_PCM && (bits == 16 || bits == 24)) {
+    info->format.sample_format = bits == 24 ? SV_SAMPLE_I24 : SV_SAMPLE_I16;
+  } else {
+    return false;
+  }
+  return info->data_offset > 0 && info->format.channels > 0 && info->format.sample_rate > 0;
+}
+
+int SVWavRepairFile(const std::string& file_path, uint64_t length, uint64_t* frames) {
+  int fd = open(file_path.c_str(), O_RDWR);
+  if(fd < 0) {
+    AV_LOGW("SVWavRepairFile open %s failed: %s", file_path.c_str(), strerror(errno));
+    return SV_INIT_ERROR;
+  }
+  uint8_t header[SV_WAV_MAX_HEADER_SIZE];
+  ssize_t header_len = pread(fd, header, sizeof(header), 0);
+  SVWavHeaderInfo info;
+  if(header_len <= 0 || !SVWavParseHeader(header, static_cast<size_t>(header_len), &info) ||
+     length < info.data_offset) {
+    AV_LOGW("SVWavRepairFile %s has no usable header.", file_path.c_str());
+    close(fd);
+    return SV_INIT_ERROR;
+  }
+  const size_t data_offset = static_cast<size_t>(info.data_offset);
+  const uint64_t block_align = info.format.BytesPerFrame();
+
+  const uint64_t data_size = (length - data_offset) / block_align * block_align;
+  const uint64_t riff_size = data_offset - 8 + data_size + (data_size & 1);
+  const bool rf64 = memcmp(header, "RF64", 4) == 0 || riff_size > 0xFFFFFFFFull;
+  int result = ftruncate(fd, static_cast<off_t>(data_offset + data_size)) == 0 ? SV_NO_ERROR : SV_INIT_ERROR;
+  uint8_t* p = header;
+  if(rf64) {
+    // The writer reserves the ds64 chunk right behind the RIFF header.
+    p = PutTag(p, "RF64");
+    p = PutLE32(p, 0xFFFFFFFFu);
+    p = PutTag(p + 4, "ds64");
+    p = PutLE32(p, SV_DS64_CHUNK_SIZE);
+    p = PutLE64(p, riff_size);
+    p = PutLE64(p, data_size);
+    p = PutLE64(p, data_size / block_align);
+    PutLE32(header + data_offset - 4, 0xFFFFFFFFu);
+  } else {
+    PutLE32(header + 4, static_cast<uint32_t>(riff_size));
+    PutLE32(header + data_offset - 4, static_cast<uint32_t>(data_size));
+  }
+  if(result == SV_NO_ERROR && pwrite(fd, header, data_offset, 0) != static_cast<ssize_t>(data_offset)) {
+    result = SV_INIT_ERROR;
+  }
+  if(result == SV_NO_ERROR && (data_size & 1)) {
+    uint8_t pad = 0;
+    if(pwrite(fd, &pad, 1, static_cast<off_t>(data_offset + data_size)) != 1) {
+      result = SV_INIT_ERROR;
+    }
+  }
+  if(result != SV_NO_ERROR) {
+    AV_LOGW("SVWavRepairFile %s failed: %s", file_path.c_str(), strerror(errno));
+  }
+  close(fd);
+  *frames = data_size / block_align;
+  return result;
+}
+
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_WAV_WRITER_H
+#define AOS_AUDIO_RECORD_SV_WAV_WRITER_H
+
+#include "sv_common.h"
+#include "sv_file_output.h"
+
+namespace sv_recorder {
+
+enum SV_CONTAINER_TYPE : int32_t {
+    SV_CONTAINER_RAW = 0,
+    SV_CONTAINER_WAV = 1,
+    SV_CONTAINER_FLAC = 2,
+    // Ogg Opus, only in builds with libopus, see SVOpusAvailable().
+    SV_CONTAINER_OPUS = 3
+};
+
+// Streaming WAV container on top of another ISVFileOutput.
+// The header is reserved up front with a JUNK chunk the size of a ds64 chunk, so a
+// recording that grows past 4GB is turned into RF64 in place. Sizes are patched about
+// once per second of audio and on Close(); sample data is passed through untouched.
+class SVWavFileOutput : public ISVFileOutput {
+
+public:
+    SVWavFileOutput(ISVFileOutput::Ptr output, const SVAudioFormat& format);
+    ~SVWavFileOutput() override;
+    int Open(const std::string& file_path) override;
+    size_t Write(const void* data, size_t len) override;
+    int WriteAt(uint64_t offset, const void* data, size_t len) override;
+    int Flush() override;
+    int Close() override;
+    uint64_t Size() const override { return output_->Size(); }
+    SVFileOutputStats GetStats() const override { return output_->GetStats(); }
+
+    size_t header_size() const { return header_size_; }
+
+private:
+    size_t BuildHeader(uint8_t* header) const;
+    int PatchSizes();
+
+private:
+    ISVFileOutput::Ptr output_;
+    SVAudioFormat format_;
+    size_t header_size_;
+    uint64_t data_size_;
+    uint64_t patched_data_size_;
+    uint64_t patch_interval_;
+    bool rf64_;
+    bool opened_;
+};
+
+// What a reader needs from a WAV header.
+struct SVWavHeaderInfo {
+    SVAudioFormat format;
+    uint64_t data_offset;
+    // From the data or ds64 chunk, UINT64_MAX when the header was never patched.
+    uint64_t data_size;
+};
+
+// Parses the RIFF or RF64 header in the first |len| bytes of a file. Fails for anything but
+// 16/24-bit PCM and 32-bit float, the formats the writer produces.
+bool SVWavParseHeader(const uint8_t* header, size_t len, SVWavHeaderInfo* info);
+
+// Makes a WAV file that was never closed playable: cuts the first |length| bytes down to
+// whole frames and rewrites the sizes in the header, switching to RF64 when needed.
+// |frames| receives the frames kept.
+int SVWavRepairFile(const std::string& file_path, uint64_t length, uint64_t* frames);
+
+}
+
+#endif //AOS_AUDIO_RECORD_SV_WAV_WRITER_H
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#ifndef AOS_AUDIO_RECORD_SV_TEST_H
+#define AOS_AUDIO_RECORD_SV_TEST_H
+
+#include <cstdio>
+
+namespace sv_recorder {
+
+// Host tests for sv_core, one executable per area registered with CTest. Expectations
+// report file and line on stderr and keep going, the exit code fails the run.
+inline int& SVTestFailures() {
+  static int failures = 0;
+  return failures;
+}
+
+// Return value of main().
+inline int SVTestResult(const char* name) {
+  const int failures = SVTestFailures();
+  fprintf(stderr, "%s: %s, %d failed expectations\n", name, failures == 0 ? "PASSED" : "FAILED", failures);
+  return failures == 0 ? 0 : 1;
+}
+
+}
+
+#define SV_EXPECT(condition) do { \
+    if(!(condition)) { \
+      fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, #condition); \
+      sv_recorder::SVTestFailures()++; \
+    } \
+  } while(0)
+
+#define SV_EXPECT_EQ(expected, actual) do { \
+    const long long sv_expected = static_cast<long long>(expected); \
+    const long long sv_actual = static_cast<long long>(actual); \
+    if(sv_expected != sv_actual) { \
+      fprintf(stderr, "%s:%d: expected %s == %s, %lld != %lld\n", __FILE__, __LINE__, #expected, #actual, \
+              sv_expected, sv_actual); \
+      sv_recorder::SVTestFailures()++; \
+    } \
+  } while(0)
+
+#endif //AOS_AUDIO_RECORD_SV_TEST_H
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_test.h"
+#include <algorithm>
+#include <memory>
+#include "sv_latency_tuner.h"
+
+using namespace sv_recorder;
+
+const int SV_TEST_RATE = 48000;
+// 10ms bursts, one second of capacity.
+const int32_t SV_TEST_BURST = SV_TEST_RATE / 100;
+const int32_t SV_TEST_CAPACITY = SV_TEST_RATE;
+const int64_t SV_TEST_BURST_NS = 10000000LL;
+
+// A device on a simulated clock. Callbacks come on time unless a stall delays one, the
+// bursts that became ready meanwhile follow back to back, like a real late callback that
+// catches up. The tuner's decisions are applied the way a backend does.
+class SVTestStream {
+
+public:
+    explicit SVTestStream(SVLatencyTuner* tuner)
+      : tuner_(tuner), next_ns_(1000000000LL), last_ns_(0), last_change_ns_(0), changes_(0) {}
+
+    // |ms| of device time, the first callback |stall_ms| late.
+    void Run(int ms, int stall_ms = 0, int32_t xruns = 0) {
+      const int64_t end_ns = next_ns_ + ms * 1000000LL;
+      int64_t stall_ns = stall_ms * 1000000LL;
+      while(next_ns_ < end_ns) {
+        const int64_t now_ns = std::max(next_ns_ + stall_ns, last_ns_);
+        stall_ns = 0;
+        const int32_t size = tuner_->OnCallback(now_ns, SV_TEST_BURST, xruns);
+        if(size > 0) {
+          tuner_->SetBufferSize(std::min(size, tuner_->capacity()));
+          last_change_ns_ = now_ns;
+          changes_++;
+        }
+        last_ns_ = now_ns;
+        next_ns_ += SV_TEST_BURST_NS;
+      }
+    }
+
+    int64_t last_change_ns() const { return last_change_ns_; }
+    int changes() const { return changes_; }
+
+private:
+    SVLatencyTuner* tuner_;
+    int64_t next_ns_;
+    int64_t last_ns_;
+    int64_t last_change_ns_;
+    int changes_;
+};
+
+static std::unique_ptr<SVLatencyTuner> NewTuner(const SVLatencyConfig& config, int32_t buffer_size) {
+  std::unique_ptr<SVLatencyTuner> tuner(new SVLatencyTuner());
+  tuner->Configure(config, SV_TEST_RATE);
+  tuner->Init(SV_TEST_BURST, SV_TEST_CAPACITY, buffer_size);
+  return tuner;
+}
+
+// Without the adaptive mode only a moving xrun counter grows the buffer, one burst at a
+// time up to the capacity. A reopened stream counting from zero is no xrun.
+static void TestXrunGrowth() {
+  SVLatencyTuner disabled;
+  disabled.Init(0, SV_TEST_CAPACITY, SV_TEST_BURST);
+  SV_EXPECT(!disabled.IsEnabled());
+  SV_EXPECT_EQ(0, disabled.OnCallback(SV_TEST_BURST_NS, SV_TEST_BURST, 5));
+
+  SVLatencyConfig config;
+  std::unique_ptr<SVLatencyTuner> tuner = NewTuner(config, 2 * SV_TEST_BURST);
+  SVTestStream stream(tuner.get());
+  stream.Run(1000, 200);
+  SV_EXPECT_EQ(0, tuner->grows());
+  SV_EXPECT_EQ(2 * SV_TEST_BURST, tuner->buffer_size());
+
+  stream.Run(100, 0, 1);
+  SV_EXPECT_EQ(1, tuner->grows());
+  SV_EXPECT_EQ(3 * SV_TEST_BURST, tuner->buffer_size());
+  stream.Run(100, 0, 0);
+  stream.Run(100, 0, 1);
+  SV_EXPECT_EQ(2, tuner->grows());
+  SV_EXPECT_EQ(4 * SV_TEST_BURST, tuner->buffer_size());
+
+  for(int32_t xruns = 2; xruns < 200; xruns++) {
+    stream.Run(10, 0, xruns);
+  }
+  SV_EXPECT_EQ(SV_TEST_CAPACITY, tuner->buffer_size());
+  SV_EXPECT_EQ((SV_TEST_CAPACITY - 2 * SV_TEST_BURST) / SV_TEST_BURST, tuner->grows());
+  SV_EXPECT_EQ(0, tuner->shrinks());
+}
+
+// The adaptive buffer grows at once to hold a stall with headroom, keeps that size for a
+// holdoff, and only then comes back down to what the calm stream needs.
+static void TestJitterGrowAndShrink() {
+  SVLatencyConfig config;
+  config.adaptive = true;
+  std::unique_ptr<SVLatencyTuner> tuner = NewTuner(config, 2 * SV_TEST_BURST);
+  SVTestStream stream(tuner.get());
+  // A calm start never shrinks before the first holdoff.
+  stream.Run(2000);
+  SV_EXPECT_EQ(0, stream.changes());
+  SV_EXPECT_EQ(2 * SV_TEST_BURST, tuner->buffer_size());
+
+  // 30ms late: 1440 frames of lateness, with headroom plus a burst 2640, whole bursts 2880.
+  const int stall_ms = 30;
+  stream.Run(1000, stall_ms);
+  const int64_t spread = int64_t(stall_ms) * SV_TEST_RATE / 1000;
+  const int64_t wanted = spread * SV_LATENCY_HEADROOM_PERCENT / 100 + SV_TEST_BURST;
+  const int32_t grown = static_cast<int32_t>((wanted + SV_TEST_BURST - 1) / SV_TEST_BURST * SV_TEST_BURST);
+  SV_EXPECT_EQ(1, tuner->grows());
+  SV_EXPECT_EQ(grown, tuner->buffer_size());
+  SV_EXPECT_EQ(0, tuner->xruns());
+  const int64_t grown_ns = stream.last_change_ns();
+
+  // Calm from here on: nothing changes during the holdoff.
+  stream.Run(SV_LATENCY_SHRINK_HOLDOFF_MS - SV_LATENCY_WINDOW_MS);
+  SV_EXPECT_EQ(0, tuner->shrinks());
+  SV_EXPECT_EQ(grown, tuner->buffer_size());
+  SV_EXPECT_EQ(0, tuner->jitter_frames());
+
+  stream.Run(2 * SV_LATENCY_SHRINK_HOLDOFF_MS + SV_LATENCY_WINDOW_MS);
+  SV_EXPECT_EQ(1, tuner->grows());
+  SV_EXPECT_EQ(1, tuner->shrinks());
+  SV_EXPECT_EQ(tuner->min_size(), tuner->buffer_size());
+  SV_EXPECT_EQ(SV_TEST_BURST, tuner->min_size());
+  SV_EXPECT(stream.last_change_ns() - grown_ns >= SV_LATENCY_SHRINK_HOLDOFF_MS * 1000000LL);
+}
+
+// Xruns grow the adaptive buffer by at least a burst, whether the backend counts them or
+// they are inferred from a callback later than the buffer could hold.
+static void TestAdaptiveXruns() {
+  SVLatencyConfig config;
+  config.adaptive = true;
+  std::unique_ptr<SVLatencyTuner> counted = NewTuner(config, 2 * SV_TEST_BURST);
+  SVTestStream counted_stream(counted.get());
+  counted_stream.Run(1000);
+  counted_stream.Run(100, 0, 1);
+  SV_EXPECT_EQ(1, counted->xruns());
+  SV_EXPECT_EQ(1, counted->grows());
+  SV_EXPECT_EQ(3 * SV_TEST_BURST, counted->buffer_size());
+
+  std::unique_ptr<SVLatencyTuner> inferred = NewTuner(config, 2 * SV_TEST_BURST);
+  SVTestStream inferred_stream(inferred.get());
+  inferred_stream.Run(1000, 0, -1);
+  SV_EXPECT_EQ(0, inferred->xruns());
+  // 20ms late on a 20ms buffer: the lateness plus the burst being read no longer fit.
+  inferred_stream.Run(1000, 20, -1);
+  SV_EXPECT_EQ(1, inferred->xruns());
+  SV_EXPECT_EQ(1, inferred->grows());
+  SV_EXPECT_EQ(4 * SV_TEST_BURST, inferred->buffer_size());
+}
+
+// min_latency_ms and max_latency_ms bound the buffer both ways, in whole bursts, with the
+// writer's minimum batch taken off the top.
+static void TestLatencyBounds() {
+  SVLatencyConfig config;
+  config.adaptive = true;
+  config.min_latency_ms = 45;
+  config.max_latency_ms = 100;
+  std::unique_ptr<SVLatencyTuner> tuner = NewTuner(config, 2 * SV_TEST_BURST);
+  const int32_t min_size = 5 * SV_TEST_BURST;
+  const int32_t max_size = (config.max_latency_ms - SV_LATENCY_MIN_WRITER_BATCH_MS) / 10 * SV_TEST_BURST;
+  SV_EXPECT_EQ(min_size, tuner->min_size());
+  SV_EXPECT_EQ(max_size, tuner->max_size());
+  // The initial size is clamped into the bounds.
+  SV_EXPECT_EQ(min_size, tuner->buffer_size());
+  SV_EXPECT_EQ(config.max_latency_ms - min_size * 1000 / SV_TEST_RATE, tuner->WriterBatchMs());
+
+  SVTestStream stream(tuner.get());
+  stream.Run(1000);
+  stream.Run(1000, 200);
+  SV_EXPECT_EQ(max_size, tuner->buffer_size());
+  SV_EXPECT_EQ(SV_LATENCY_MIN_WRITER_BATCH_MS, tuner->WriterBatchMs());
+  // An xrun at the upper bound has nowhere to go.
+  const uint32_t grows = tuner->grows();
+  stream.Run(100, 0, 1);
+  SV_EXPECT_EQ(grows, tuner->grows());
+  SV_EXPECT_EQ(max_size, tuner->buffer_size());
+
+  stream.Run(3 * SV_LATENCY_SHRINK_HOLDOFF_MS);
+  SV_EXPECT_EQ(1, tuner->shrinks());
+  SV_EXPECT_EQ(min_size, tuner->buffer_size());
+}
+
+int main() {
+  TestXrunGrowth();
+  TestJitterGrowAndShrink();
+  TestAdaptiveXruns();
+  TestLatencyBounds();
+  return SVTestResult("sv_test_latency");
+}
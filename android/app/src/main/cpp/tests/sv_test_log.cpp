@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+// Everything below warnings is compiled out of this file, whatever the build type.
+#define SV_LOG_MIN_LEVEL 2
+
+#include "sv_test.h"
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log.h"
+
+using namespace sv_recorder;
+
+const int SV_TEST_RATELIMIT_MS = 100;
+const int SV_TEST_PRODUCERS = 4;
+const int SV_TEST_PRODUCER_RECORDS = 50;
+
+struct SVTestLine {
+    int level;
+    std::string tag;
+    std::string message;
+};
+
+// The callback sink, called under the log lock.
+static void CollectLine(void* user, int level, const char* tag, const char* message) {
+  static_cast<std::vector<SVTestLine>*>(user)->push_back({level, tag, message});
+}
+
+static int g_evaluations = 0;
+
+static int Evaluate() {
+  return ++g_evaluations;
+}
+
+// Lines below SV_LOG_MIN_LEVEL are gone at compile time: their arguments are never
+// evaluated and nothing reaches the sink, even with the runtime level wide open.
+static void TestCompileTimeLevel(std::vector<SVTestLine>* lines) {
+  SVLogSetLevel(SV_LOG_LEVEL_DEBUG);
+  lines->clear();
+  AV_LOGD("debug %d", Evaluate());
+  AV_LOGI("info %d", Evaluate());
+  AV_LOGD_RT("deferred debug %d", Evaluate());
+  SVDeferredLog::Instance().Flush();
+  SV_EXPECT_EQ(0, g_evaluations);
+  SV_EXPECT_EQ(0, lines->size());
+
+  AV_LOGW("warn %d", Evaluate());
+  AV_LOGE("error %d", Evaluate());
+  SV_EXPECT_EQ(2, g_evaluations);
+  SV_EXPECT_EQ(2, lines->size());
+  if(lines->size() == 2) {
+    SV_EXPECT_EQ(SV_LOG_LEVEL_WARN, (*lines)[0].level);
+    SV_EXPECT((*lines)[0].tag == TAG);
+    SV_EXPECT((*lines)[0].message == "warn 1");
+    SV_EXPECT_EQ(SV_LOG_LEVEL_ERROR, (*lines)[1].level);
+    SV_EXPECT((*lines)[1].message == "error 2");
+  }
+
+  // The runtime level filters what the compile-time level let through.
+  SVLogSetLevel(SV_LOG_LEVEL_ERROR);
+  lines->clear();
+  AV_LOGW("filtered");
+  AV_LOGW_RT("filtered");
+  SVDeferredLog::Instance().Flush();
+  AV_LOGE("kept");
+  SV_EXPECT_EQ(1, lines->size());
+  SVLogSetLevel(SV_LOG_LEVEL_DEBUG);
+}
+
+static void RateLimitedSite(int i) {
+  AV_LOGW_RATELIMIT(SV_TEST_RATELIMIT_MS, "site a %d", i);
+}
+
+// One line per interval from a call site, the next one reports how many were swallowed.
+// Every call site keeps its own limiter.
+static void TestRateLimit(std::vector<SVTestLine>* lines) {
+  const int calls = 1000;
+  lines->clear();
+  for(int i = 0; i < calls; i++) {
+    RateLimitedSite(i);
+    AV_LOGE_RATELIMIT(SV_TEST_RATELIMIT_MS, "site b %d", i);
+  }
+  SV_EXPECT_EQ(2, lines->size());
+  if(lines->size() == 2) {
+    SV_EXPECT((*lines)[0].message == "site a 0");
+    SV_EXPECT_EQ(SV_LOG_LEVEL_ERROR, (*lines)[1].level);
+    SV_EXPECT((*lines)[1].message == "site b 0");
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(SV_TEST_RATELIMIT_MS + 20));
+  lines->clear();
+  RateLimitedSite(calls);
+  SV_EXPECT_EQ(2, lines->size());
+  if(lines->size() == 2) {
+    SV_EXPECT_EQ(SV_LOG_LEVEL_WARN, (*lines)[0].level);
+    SV_EXPECT((*lines)[0].message == "site a 1000");
+    SV_EXPECT((*lines)[1].message == "(999 similar lines suppressed)");
+  }
+
+  // Nothing was suppressed in the meantime, so no count follows.
+  std::this_thread::sleep_for(std::chrono::milliseconds(SV_TEST_RATELIMIT_MS + 20));
+  lines->clear();
+  RateLimitedSite(calls + 1);
+  SV_EXPECT_EQ(1, lines->size());
+}
+
+// Deferred records are formatted with the width of the captured arguments.
+static void TestDeferredFormat(std::vector<SVTestLine>* lines) {
+  SVDeferredLog& log = SVDeferredLog::Instance();
+  lines->clear();
+  const int64_t large = int64_t(1) << 40;
+  const size_t size = 4096;
+  const int* pointer = nullptr;
+  log.Log(SV_LOG_LEVEL_WARN, "int:%d large:%d size:%zu hex:%04x", -5, large, size, 255u);
+  log.Log(SV_LOG_LEVEL_ERROR, "%.2f|%5s|%-3d|%c|100%%", 1.5, "lit", 7, 'x');
+  log.Log(SV_LOG_LEVEL_WARN, "missing %d %d", 1);
+  log.Log(SV_LOG_LEVEL_WARN, "not a string %s", 3);
+  log.Log(SV_LOG_LEVEL_WARN, "pointer %p", pointer);
+  log.Flush();
+  char expected_pointer[32];
+  snprintf(expected_pointer, sizeof(expected_pointer), "pointer %p", static_cast<const void*>(pointer));
+  SV_EXPECT_EQ(5, lines->size());
+  if(lines->size() == 5) {
+    SV_EXPECT_EQ(SV_LOG_LEVEL_WARN, (*lines)[0].level);
+    SV_EXPECT((*lines)[0].tag == TAG);
+    SV_EXPECT((*lines)[0].message == "int:-5 large:1099511627776 size:4096 hex:00ff");
+    SV_EXPECT_EQ(SV_LOG_LEVEL_ERROR, (*lines)[1].level);
+    SV_EXPECT((*lines)[1].message == "1.50|  lit|7  |x|100%");
+    SV_EXPECT((*lines)[2].message == "missing 1 ");
+    SV_EXPECT((*lines)[3].message == "not a string (?)");
+    SV_EXPECT((*lines)[4].message == expected_pointer);
+  }
+}
+
+// Each producer's records come out in its order, and none is lost or duplicated.
+static void TestDeferredOrder(std::vector<SVTestLine>* lines) {
+  SVDeferredLog& log = SVDeferredLog::Instance();
+  lines->clear();
+  std::vector<std::thread> producers;
+  for(int producer = 0; producer < SV_TEST_PRODUCERS; producer++) {
+    producers.emplace_back([&log, producer]() {
+      for(int i = 0; i < SV_TEST_PRODUCER_RECORDS; i++) {
+        log.Log(SV_LOG_LEVEL_WARN, "producer %d record %d", producer, i);
+      }
+    });
+  }
+  for(std::thread& producer : producers) {
+    producer.join();
+  }
+  log.Flush();
+  SV_EXPECT_EQ(SV_TEST_PRODUCERS * SV_TEST_PRODUCER_RECORDS, lines->size());
+  int next[SV_TEST_PRODUCERS] = {};
+  for(const SVTestLine& line : *lines) {
+    int producer = -1;
+    int record = -1;
+    if(sscanf(line.message.c_str(), "producer %d record %d", &producer, &record) != 2 ||
+       producer < 0 || producer >= SV_TEST_PRODUCERS) {
+      SV_EXPECT(!"unexpected line");
+      continue;
+    }
+    SV_EXPECT_EQ(next[producer], record);
+    next[producer] = record + 1;
+  }
+}
+
+// A full ring refuses records and counts them, the next drain emits what was queued in
+// order and then one line with the number dropped.
+static void TestDeferredDrops(std::vector<SVTestLine>* lines) {
+  SVDeferredLog& log = SVDeferredLog::Instance();
+  lines->clear();
+  const uint64_t dropped_before = log.dropped();
+  int accepted = 0;
+  int refused = 0;
+  for(int i = 0; i < 1000; i++) {
+    SVLogArg arg = SVMakeLogArg(i);
+    if(log.Post(SV_LOG_LEVEL_WARN, "queued %d", &arg, 1)) {
+      accepted++;
+    } else {
+      refused++;
+    }
+  }
+  SV_EXPECT(accepted > 0);
+  SV_EXPECT(refused > 0);
+  SV_EXPECT_EQ(refused, log.dropped() - dropped_before);
+
+  log.Flush();
+  SV_EXPECT_EQ(accepted + 1, lines->size());
+  for(int i = 0; i < accepted && i < static_cast<int>(lines->size()); i++) {
+    SV_EXPECT((*lines)[i].message == "queued " + std::to_string(i));
+  }
+  if(!lines->empty()) {
+    SV_EXPECT_EQ(SV_LOG_LEVEL_WARN, lines->back().level);
+    SV_EXPECT(lines->back().message ==
+              "SVDeferredLog ring full, dropped " + std::to_string(refused) + " records.");
+  }
+
+  // Reported once: the next drain has nothing to say.
+  lines->clear();
+  log.Flush();
+  SV_EXPECT_EQ(0, lines->size());
+}
+
+int main() {
+  std::vector<SVTestLine> lines;
+  SVLogSetCallback(CollectLine, &lines);
+  TestCompileTimeLevel(&lines);
+  TestRateLimit(&lines);
+  TestDeferredFormat(&lines);
+  TestDeferredOrder(&lines);
+  TestDeferredDrops(&lines);
+  SVLogUseDefault();
+  return SVTestResult("sv_test_log");
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_test.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "sv_synthetic_recorder.h"
+
+using namespace sv_recorder;
+
+const int SV_TEST_RATE = 48000;
+const int SV_TEST_CHANNELS = 2;
+const int SV_TEST_POLL_MS = 5;
+// Scheduling slack allowed on top of every backoff and timeout.
+const int64_t SV_TEST_SLACK_MS = 60;
+const char* const SV_TEST_PATH = "/tmp/sv_test_recovery.pcm";
+
+static int64_t ElapsedMs(int64_t begin_ns, int64_t end_ns) {
+  return (end_ns - begin_ns) / 1000000;
+}
+
+// Waits until recovery has left the disconnected and recovering states, false on timeout.
+static bool WaitSettled(const SVStreamRecovery& recovery, int timeout_ms) {
+  for(int waited = 0; waited < timeout_ms; waited += SV_TEST_POLL_MS) {
+    const SV_STREAM_STATE state = recovery.state();
+    if(recovery.GetStats().disconnects > 0 && state != SV_STREAM_DISCONNECTED && state != SV_STREAM_RECOVERING) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(SV_TEST_POLL_MS));
+  }
+  return false;
+}
+
+// A stream that refuses to reopen |failures| times and then delivers at once, with the
+// time of every open attempt.
+class SVTestStreamHandler : public ISVStreamHandler {
+
+public:
+    SVTestStreamHandler(SVStreamRecovery* recovery, int failures)
+      : recovery_(recovery), failures_(failures), closes_(0) {}
+
+    void CloseStream() override { closes_++; }
+    int OpenStream() override {
+      opens_ns_.push_back(SVNowNs());
+      if(failures_ > 0) {
+        failures_--;
+        return SV_INIT_ERROR;
+      }
+      return SV_NO_ERROR;
+    }
+    int StartStream() override {
+      // What the pipeline reports from the first callback of the new stream.
+      recovery_->OnGapFilled(0, SVNowNs());
+      return SV_NO_ERROR;
+    }
+
+    const std::vector<int64_t>& opens_ns() const { return opens_ns_; }
+    int closes() const { return closes_; }
+
+private:
+    SVStreamRecovery* recovery_;
+    int failures_;
+    int closes_;
+    std::vector<int64_t> opens_ns_;
+};
+
+// Backoff before attempt |attempt| + 1, doubling from the first value up to the cap.
+static int64_t ExpectedBackoffMs(int attempt) {
+  int64_t backoff_ms = SV_RECOVERY_BACKOFF_MS;
+  for(int i = 1; i < attempt; i++) {
+    backoff_ms = std::min<int64_t>(backoff_ms * 2, SV_RECOVERY_MAX_BACKOFF_MS);
+  }
+  return backoff_ms;
+}
+
+// A device that never comes back: every attempt is spaced by the doubling backoff, the
+// recovery gives up after the attempt limit plus the last backoff and stays failed.
+static void TestGiveUp() {
+  SVCapturePipeline pipeline(SV_TEST_PATH);
+  SVStreamRecovery& recovery = pipeline.recovery();
+  SVTestStreamHandler handler(&recovery, SV_RECOVERY_MAX_ATTEMPTS + 1);
+  recovery.SetHandler(&handler);
+  recovery.Start();
+  const int64_t disconnect_ns = SVNowNs();
+  recovery.OnDisconnected("test");
+
+  int64_t total_ms = 0;
+  for(int attempt = 1; attempt <= SV_RECOVERY_MAX_ATTEMPTS; attempt++) {
+    total_ms += ExpectedBackoffMs(attempt);
+  }
+  SV_EXPECT(WaitSettled(recovery, static_cast<int>(total_ms + 10 * SV_TEST_SLACK_MS)));
+  const int64_t failed_ns = SVNowNs();
+  const SVRecoveryStats stats = recovery.GetStats();
+  SV_EXPECT_EQ(SV_STREAM_FAILED, stats.state);
+  SV_EXPECT_EQ(1, stats.disconnects);
+  SV_EXPECT_EQ(0, stats.recoveries);
+  SV_EXPECT_EQ(1, stats.failures);
+  SV_EXPECT_EQ(SV_RECOVERY_MAX_ATTEMPTS, stats.attempts);
+  // The dead stream once, then every attempt that failed.
+  SV_EXPECT_EQ(1 + SV_RECOVERY_MAX_ATTEMPTS, handler.closes());
+
+  const std::vector<int64_t>& opens = handler.opens_ns();
+  SV_EXPECT_EQ(SV_RECOVERY_MAX_ATTEMPTS, opens.size());
+  if(opens.size() == static_cast<size_t>(SV_RECOVERY_MAX_ATTEMPTS)) {
+    SV_EXPECT(ElapsedMs(disconnect_ns, opens[0]) < SV_TEST_SLACK_MS);
+    for(size_t i = 1; i < opens.size(); i++) {
+      const int64_t spacing_ms = ElapsedMs(opens[i - 1], opens[i]);
+      SV_EXPECT(spacing_ms >= ExpectedBackoffMs(static_cast<int>(i)));
+      SV_EXPECT(spacing_ms < ExpectedBackoffMs(static_cast<int>(i)) + SV_TEST_SLACK_MS);
+    }
+  }
+  SV_EXPECT(ElapsedMs(disconnect_ns, failed_ns) >= total_ms);
+
+  // Nothing is retried after giving up, and Stop() keeps the failure visible.
+  std::this_thread::sleep_for(std::chrono::milliseconds(SV_RECOVERY_BACKOFF_MS));
+  SV_EXPECT_EQ(SV_RECOVERY_MAX_ATTEMPTS, handler.opens_ns().size());
+  recovery.Stop();
+  SV_EXPECT_EQ(SV_STREAM_FAILED, recovery.state());
+}
+
+// A few refused reopens are retried with backoff and the stream comes back.
+static void TestRetryThenRecover() {
+  const int failures = 3;
+  SVCapturePipeline pipeline(SV_TEST_PATH);
+  SVStreamRecovery& recovery = pipeline.recovery();
+  SVTestStreamHandler handler(&recovery, failures);
+  recovery.SetHandler(&handler);
+  recovery.Start();
+  recovery.OnDisconnected("test");
+
+  int64_t backoff_ms = 0;
+  for(int attempt = 1; attempt <= failures; attempt++) {
+    backoff_ms += ExpectedBackoffMs(attempt);
+  }
+  SV_EXPECT(WaitSettled(recovery, static_cast<int>(backoff_ms + 10 * SV_TEST_SLACK_MS)));
+  const SVRecoveryStats stats = recovery.GetStats();
+  SV_EXPECT_EQ(SV_STREAM_RUNNING, stats.state);
+  SV_EXPECT_EQ(1, stats.recoveries);
+  SV_EXPECT_EQ(0, stats.failures);
+  SV_EXPECT_EQ(failures + 1, stats.attempts);
+  SV_EXPECT(stats.last_recovery_us >= backoff_ms * 1000);
+  SV_EXPECT(stats.last_recovery_us < (backoff_ms + SV_TEST_SLACK_MS) * 1000);
+  recovery.Stop();
+  SV_EXPECT_EQ(SV_STREAM_IDLE, recovery.state());
+}
+
+static std::vector<int16_t> ReadFile(const char* path) {
+  std::vector<int16_t> samples;
+  FILE* file = fopen(path, "rb");
+  if(!file) {
+    return samples;
+  }
+  int16_t buffer[4096];
+  size_t read;
+  while((read = fread(buffer, sizeof(int16_t), 4096, file)) > 0) {
+    samples.insert(samples.end(), buffer, buffer + read);
+  }
+  fclose(file);
+  return samples;
+}
+
+// The longest stretch of all-zero frames, the sine source has no such stretch of its own.
+static size_t LongestSilence(const std::vector<int16_t>& samples) {
+  size_t longest = 0;
+  size_t run = 0;
+  for(size_t i = 0; i + SV_TEST_CHANNELS <= samples.size(); i += SV_TEST_CHANNELS) {
+    bool silent = true;
+    for(int ch = 0; ch < SV_TEST_CHANNELS; ch++) {
+      silent = silent && samples[i + ch] == 0;
+    }
+    run = silent ? run + 1 : 0;
+    longest = std::max(longest, run);
+  }
+  return longest;
+}
+
+// The synthetic device disappears for |outage_ms| in the middle of a real-time recording.
+// The reopen that finds it back follows the backoff, the outage is filled with exactly as
+// much silence as it lasted, and the file is as long as the recording.
+static void TestSyntheticOutage() {
+  const int32_t outage_ms = 300;
+  const int32_t frames_per_callback = SV_TEST_RATE / SV_BUFFERS_PER_SECOND;
+  remove(SV_TEST_PATH);
+  SVRecoveryStats stats;
+  int64_t wall_ns;
+  {
+    SVSyntheticRecorder recorder(SV_TEST_PATH, SV_SOURCE_SINE);
+    recorder.SetOption(SV_OPTION_FILE_INDEX, 0);
+    SV_EXPECT_EQ(SV_NO_ERROR, recorder.InitRecording(SV_TEST_RATE, SV_TEST_CHANNELS, SV_SAMPLE_I16));
+    const int64_t begin_ns = SVNowNs();
+    SV_EXPECT_EQ(SV_NO_ERROR, recorder.StartRecording());
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    recorder.InjectDisconnect(outage_ms);
+    SVStreamRecovery& recovery = recorder.pipeline().recovery();
+    SV_EXPECT(WaitSettled(recovery, outage_ms + SV_RECOVERY_MAX_BACKOFF_MS));
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    SV_EXPECT_EQ(SV_NO_ERROR, recorder.StopRecording());
+    wall_ns = SVNowNs() - begin_ns;
+    stats = recovery.GetStats();
+  }
+
+  // Attempts at 0, 50 and 150ms still find the device gone, the one at 350ms gets it.
+  int attempts = 1;
+  int64_t reopen_ms = 0;
+  while(reopen_ms < outage_ms) {
+    reopen_ms += ExpectedBackoffMs(attempts++);
+  }
+  SV_EXPECT_EQ(SV_STREAM_IDLE, stats.state);
+  SV_EXPECT_EQ(1, stats.recoveries);
+  SV_EXPECT_EQ(0, stats.failures);
+  SV_EXPECT_EQ(attempts, stats.attempts);
+  SV_EXPECT(stats.last_recovery_us >= reopen_ms * 1000);
+  SV_EXPECT(stats.last_recovery_us < (reopen_ms + SV_TEST_SLACK_MS) * 1000);
+
+  // The last callback before the disconnect to the first one after it, less the frames
+  // that first callback brings itself.
+  const int64_t measured_frames = stats.last_recovery_us * SV_TEST_RATE / 1000000 - frames_per_callback;
+  SV_EXPECT(std::abs(static_cast<int64_t>(stats.gap_frames) - measured_frames) <= frames_per_callback);
+
+  const std::vector<int16_t> samples = ReadFile(SV_TEST_PATH);
+  const int64_t file_frames = static_cast<int64_t>(samples.size() / SV_TEST_CHANNELS);
+  const int64_t wall_frames = wall_ns * SV_TEST_RATE / 1000000000LL;
+  SV_EXPECT(std::abs(file_frames - wall_frames) <= 3 * frames_per_callback);
+  // A sine sample rounds to zero now and then, never for a whole callback.
+  const int64_t silence = static_cast<int64_t>(LongestSilence(samples));
+  SV_EXPECT(std::abs(silence - static_cast<int64_t>(stats.gap_frames)) <= 2);
+  remove(SV_TEST_PATH);
+}
+
+int main() {
+  TestGiveUp();
+  TestRetryThenRecover();
+  TestSyntheticOutage();
+  return SVTestResult("sv_test_recovery");
+}
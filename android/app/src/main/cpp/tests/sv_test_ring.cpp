@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+#include "sv_test.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "sv_common.h"
+#include "sv_disk_writer.h"
+#include "sv_ring_buffer.h"
+
+using namespace sv_recorder;
+
+// 10ms of 48kHz stereo 16-bit, what the OpenSL callback delivers.
+const int SV_TEST_RATE = 48000;
+const size_t SV_TEST_BLOCK_BYTES = SV_TEST_RATE / SV_BUFFERS_PER_SECOND * 2 * sizeof(int16_t);
+const size_t SV_TEST_BYTES_PER_SECOND = SV_TEST_RATE * 2 * sizeof(int16_t);
+
+// Every block carries its sequence number and a pattern derived from it, so the consumer
+// can tell a reordered, torn or corrupted block from a dropped one.
+static void FillBlock(uint32_t sequence, uint8_t* block) {
+  memcpy(block, &sequence, sizeof(sequence));
+  for(size_t i = sizeof(sequence); i < SV_TEST_BLOCK_BYTES; i++) {
+    block[i] = static_cast<uint8_t>(sequence * 31 + i);
+  }
+}
+
+static bool CheckBlock(const uint8_t* block, uint32_t* sequence) {
+  memcpy(sequence, block, sizeof(*sequence));
+  for(size_t i = sizeof(*sequence); i < SV_TEST_BLOCK_BYTES; i++) {
+    if(block[i] != static_cast<uint8_t>(*sequence * 31 + i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Reassembles the byte stream into blocks and checks that they arrive intact and in
+// producer order, a gap only where the producer reported a drop.
+class SVTestBlockChecker {
+
+public:
+    SVTestBlockChecker() : block_(SV_TEST_BLOCK_BYTES), fill_(0), blocks_(0), corrupt_(0), reordered_(0),
+                           next_sequence_(0), skipped_(0) {}
+
+    void Feed(const uint8_t* data, size_t len) {
+      while(len > 0) {
+        const size_t take = std::min(len, SV_TEST_BLOCK_BYTES - fill_);
+        memcpy(block_.data() + fill_, data, take);
+        fill_ += take;
+        data += take;
+        len -= take;
+        if(fill_ == SV_TEST_BLOCK_BYTES) {
+          fill_ = 0;
+          uint32_t sequence;
+          if(!CheckBlock(block_.data(), &sequence)) {
+            corrupt_++;
+          } else if(sequence < next_sequence_) {
+            reordered_++;
+          } else {
+            skipped_ += sequence - next_sequence_;
+            next_sequence_ = sequence + 1;
+          }
+          blocks_++;
+        }
+      }
+    }
+
+    uint64_t blocks() const { return blocks_; }
+    uint64_t corrupt() const { return corrupt_; }
+    uint64_t reordered() const { return reordered_; }
+    // Sequence numbers that never arrived before the last one that did.
+    uint64_t skipped() const { return skipped_; }
+    uint32_t next_sequence() const { return next_sequence_; }
+    size_t partial_bytes() const { return fill_; }
+
+private:
+    std::vector<uint8_t> block_;
+    size_t fill_;
+    uint64_t blocks_;
+    uint64_t corrupt_;
+    uint64_t reordered_;
+    uint32_t next_sequence_;
+    uint64_t skipped_;
+};
+
+// Producer and consumer threads on a small ring: first paced like a 48kHz stereo device,
+// where the consumer always keeps up, then as fast as possible against a consumer that
+// naps, where whole blocks have to be refused and nothing else may go missing.
+static void TestRingStress() {
+  SVRingBuffer ring;
+  ring.Reset(SV_TEST_BLOCK_BYTES * 8);
+  std::atomic<bool> done(false);
+  SVTestBlockChecker checker;
+  std::thread consumer([&]() {
+    uint64_t reads = 0;
+    for(;;) {
+      const bool finished = done.load(std::memory_order_acquire);
+      const uint8_t* data;
+      const size_t len = ring.Peek(&data);
+      if(len == 0) {
+        if(finished) {
+          break;
+        }
+        std::this_thread::yield();
+        continue;
+      }
+      // Odd read sizes, so blocks are split across reads and across the wrap.
+      const size_t take = std::min<size_t>(len, 777 + reads % 1000);
+      checker.Feed(data, take);
+      ring.Consume(take);
+      if(++reads % 64 == 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+      }
+    }
+  });
+
+  std::vector<uint8_t> block(SV_TEST_BLOCK_BYTES);
+  uint32_t sequence = 0;
+  uint64_t paced_dropped = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < SV_BUFFERS_PER_SECOND; i++, sequence++) {
+    std::this_thread::sleep_until(start + std::chrono::milliseconds(i * 1000 / SV_BUFFERS_PER_SECOND));
+    FillBlock(sequence, block.data());
+    paced_dropped += ring.Write(block.data(), block.size()) ? 0 : 1;
+  }
+  const uint32_t paced_blocks = sequence;
+  uint64_t dropped = 0;
+  for(int i = 0; i < 200000; i++, sequence++) {
+    FillBlock(sequence, block.data());
+    dropped += ring.Write(block.data(), block.size()) ? 0 : 1;
+  }
+  done.store(true, std::memory_order_release);
+  consumer.join();
+
+  SV_EXPECT_EQ(0, paced_dropped);
+  SV_EXPECT(dropped > 0);
+  SV_EXPECT_EQ(0, checker.corrupt());
+  SV_EXPECT_EQ(0, checker.reordered());
+  SV_EXPECT_EQ(0, checker.partial_bytes());
+  SV_EXPECT_EQ(sequence - dropped, checker.blocks());
+  // Drops at the very end leave no gap behind the last block received.
+  SV_EXPECT_EQ(dropped, checker.skipped() + (sequence - checker.next_sequence()));
+  SV_EXPECT(checker.blocks() >= paced_blocks);
+  SV_EXPECT_EQ(0, ring.ReadableBytes());
+}
+
+// Collects the writer's output in memory, Write() blocks while stalled like a slow disk.
+class SVTestMemoryOutput : public ISVFileOutput {
+
+public:
+    explicit SVTestMemoryOutput(SVTestBlockChecker* checker, std::atomic<bool>* stalled)
+      : checker_(checker), stalled_(stalled), size_(0), writes_(0) {}
+
+    int Open(const std::string& file_path) override { return SV_NO_ERROR; }
+    size_t Write(const void* data, size_t len) override {
+      while(stalled_->load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      checker_->Feed(static_cast<const uint8_t*>(data), len);
+      size_ += len;
+      writes_++;
+      return len;
+    }
+    int WriteAt(uint64_t offset, const void* data, size_t len) override { return SV_NO_ERROR; }
+    int Flush() override { return SV_NO_ERROR; }
+    int Close() override { return SV_NO_ERROR; }
+    uint64_t Size() const override { return size_; }
+    SVFileOutputStats GetStats() const override { return {size_, writes_, 0}; }
+
+private:
+    SVTestBlockChecker* checker_;
+    std::atomic<bool>* stalled_;
+    uint64_t size_;
+    uint64_t writes_;
+};
+
+// The disk writer end to end: a paced second where the writer keeps up, then a stalled
+// output while the producer keeps going, so the ring fills and refuses whole callbacks.
+// Written plus overrun bytes add up to everything produced, and the file holds exactly
+// the accepted blocks in order.
+static void TestDiskWriterOverrun() {
+  SVTestBlockChecker checker;
+  std::atomic<bool> stalled(false);
+  SVDiskWriter writer;
+  SV_EXPECT_EQ(SV_NO_ERROR, writer.SetOutput(ISVFileOutput::Ptr(new SVTestMemoryOutput(&checker, &stalled))));
+  SV_EXPECT_EQ(SV_NO_ERROR, writer.Prepare(SV_TEST_BYTES_PER_SECOND));
+  SV_EXPECT_EQ(SV_NO_ERROR, writer.Start());
+
+  std::vector<uint8_t> block(SV_TEST_BLOCK_BYTES);
+  uint32_t sequence = 0;
+  uint64_t rejected = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < SV_BUFFERS_PER_SECOND; i++, sequence++) {
+    std::this_thread::sleep_until(start + std::chrono::milliseconds(i * 1000 / SV_BUFFERS_PER_SECOND));
+    FillBlock(sequence, block.data());
+    rejected += writer.Write(block.data(), block.size()) ? 0 : 1;
+  }
+  SV_EXPECT_EQ(0, rejected);
+  SV_EXPECT_EQ(0, writer.GetStats().overrun_count);
+
+  // Four seconds of audio against a stalled disk, the ring holds about two of them.
+  stalled.store(true, std::memory_order_release);
+  std::this_thread::sleep_for(std::chrono::milliseconds(2 * SV_WRITER_POLL_MS));
+  for(size_t i = 0; i < 4 * SV_BUFFERS_PER_SECOND; i++, sequence++) {
+    FillBlock(sequence, block.data());
+    rejected += writer.Write(block.data(), block.size()) ? 0 : 1;
+  }
+  stalled.store(false, std::memory_order_release);
+  // And a last paced stretch once the disk is back.
+  for(size_t i = 0; i < SV_BUFFERS_PER_SECOND / 2; i++, sequence++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000 / SV_BUFFERS_PER_SECOND));
+    FillBlock(sequence, block.data());
+    rejected += writer.Write(block.data(), block.size()) ? 0 : 1;
+  }
+  SV_EXPECT_EQ(SV_NO_ERROR, writer.Stop());
+
+  const SVDiskWriterStats stats = writer.GetStats();
+  const uint64_t produced = uint64_t(sequence) * SV_TEST_BLOCK_BYTES;
+  SV_EXPECT(rejected > 0);
+  SV_EXPECT_EQ(rejected, stats.overrun_count);
+  SV_EXPECT_EQ(rejected * SV_TEST_BLOCK_BYTES, stats.overrun_bytes);
+  SV_EXPECT_EQ(produced, stats.bytes_written + stats.overrun_bytes);
+  SV_EXPECT_EQ(stats.bytes_written, writer.GetOutputStats().bytes_written);
+  SV_EXPECT_EQ(0, checker.corrupt());
+  SV_EXPECT_EQ(0, checker.reordered());
+  SV_EXPECT_EQ(0, checker.partial_bytes());
+  SV_EXPECT_EQ(sequence - rejected, checker.blocks());
+  SV_EXPECT_EQ(rejected, checker.skipped());
+  SV_EXPECT_EQ(sequence, checker.next_sequence());
+  SV_EXPECT(stats.max_fill_bytes <= 2 * SV_WRITER_RING_SECONDS * SV_TEST_BYTES_PER_SECOND);
+}
+
+int main() {
+  TestRingStress();
+  TestDiskWriterOverrun();
+  return SVTestResult("sv_test_ring");
+}
@@ -16,6 +16,8 @@ class SVNativeRecorder private constructor() : IAudioRecorder{
 
     private val tag = "SVNativeRecorder"
 
+    var container: Int = SV_CONTAINER_WAV
+
     companion object {
         val instance: SVNativeRecorder by lazy {
             SVNativeRecorder()
@@ -35,12 +37,19 @@ class SVNativeRecorder private constructor() : IAudioRecorder{
            val result = svDir.mkdirs()
            assert(result) { Log.w(tag, "mkdir sv_recorder failed.")}
         }
-        val fileName = "_" + System.currentTimeMillis() + "_.pcm"
+        val extension = when (container) {
+            SV_CONTAINER_WAV -> ".wav"
+            SV_CONTAINER_FLAC -> ".flac"
+            SV_CONTAINER_OPUS -> ".opus"
+            else -> ".pcm"
+        }
+        val fileName = "_" + System.currentTimeMillis() + "_" + extension
         val file = File(svDir, fileName)
-        assert(file.createNewFile()) { Log.w(tag, "create .pcm file failed.") }
+        assert(file.createNewFile()) { Log.w(tag, "create $extension file failed.") }
         Log.i(this.tag, "fileName: ${file.absolutePath}")
 
         set_record_type(2, file.absolutePath)
+        set_record_option(SV_OPTION_CONTAINER, container)
         return int_recording(sampleRate, channel)
     }
 
@@ -61,4 +70,50 @@ class SVNativeRecorder private constructor() : IAudioRecorder{
     external fun start_recording(): Int
     external fun stop_recording(): Int
     external fun release_recording(): Int
+    external fun set_record_option(option: Int, value: Int): Int
+
+    // Multi-session API, each handle owns its own backend and output file.
+    external fun create_session(type: Int, filePath: String): Int
+    external fun session_set_option(handle: Int, option: Int, value: Int): Int
+    // Pins SV_THREAD_WRITER / STREAM / SINK / SEGMENT to cpuMask (0 keeps the affinity) with a nice value
+    // and SCHED_FIFO priority (0 for neither), before session_start. Denied parts show up in the stats.
+    external fun session_set_thread_policy(handle: Int, role: Int, cpuMask: Int, nice: Int, fifoPriority: Int): Int
+    // Records a second file (SV_CONTAINER_*) at the capture format alongside the session file,
+    // before session_init. Each one gets its own queue, a slow one never stalls the others.
+    external fun session_add_file_sink(handle: Int, filePath: String, container: Int): Int
+    external fun session_init(handle: Int, sample_rate: Int, channel: Int, format: Int): Int
+    external fun session_start(handle: Int): Int
+    external fun session_stop(handle: Int): Int
+    external fun session_release(handle: Int): Int
+    // Callback timing, xruns and sink counters as a JSON object, null for an unknown handle.
+    external fun session_get_stats(handle: Int): String?
+    // Negotiated backend, sharing mode, MMAP, burst and buffer size of the open stream as JSON.
+    external fun session_get_stream_info(handle: Int): String?
+    // Live audio after session_init and before session_start, pass null to turn it off.
+    external fun session_open_stream(handle: Int, listener: SVAudioStreamListener?, chunkMs: Int, chunkCount: Int): Int
+    // With SV_OPTION_ANALYSIS_INTERVAL_MS set: per-channel peak/RMS in dBFS, DC offset and
+    // clip counts of the last interval as JSON.
+    external fun session_get_levels(handle: Int): String?
+    // Copies the latest spectrum in dBFS into magnitudes (fftSize / 2 + 1 bins), returns the bin count.
+    external fun session_get_spectrum(handle: Int, magnitudes: FloatArray): Int
+    // With SV_OPTION_PREROLL_MS set: saves the buffered audio plus postRollMs of what follows,
+    // postRollMs 0 keeps writing until session_end_commit or session_stop.
+    external fun session_commit(handle: Int, filePath: String, postRollMs: Int): Int
+    external fun session_end_commit(handle: Int): Int
+
+    // Recorded files, through <file>.idx. sample_rate, channel and format describe raw PCM files only.
+    // Fills peaks and rms (0..1) with one column each over durationMs from startMs, 0 for the rest
+    // of the file, returns the column count.
+    external fun file_get_overview(filePath: String, sample_rate: Int, channel: Int, format: Int, startMs: Int,
+                                   durationMs: Int, peaks: FloatArray, rms: FloatArray): Int
+    // Copies interleaved PCM from startMs into pcm, returns the frames copied. Not available for FLAC and Opus.
+    external fun file_read_frames(filePath: String, sample_rate: Int, channel: Int, format: Int, startMs: Int,
+                                  pcm: ByteArray): Int
+
+    // Process-wide backend state kept across sessions. Sets up the backend (engine, builder,
+    // buffers, a warm-up open of the stream) so the next session starts warm; blocks for the
+    // setup, call it off the main thread once RECORD_AUDIO is granted.
+    external fun backend_prewarm(type: Int, sample_rate: Int, channel: Int, format: Int): Int
+    // Created and reused engines, builders and pools plus the cold and warm time to first frame as JSON.
+    external fun backend_get_info(): String
 }
\ No newline at end of file
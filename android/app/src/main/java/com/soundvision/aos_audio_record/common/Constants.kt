@@ -20,6 +20,52 @@ const val SV_AUDIO_THREAD_JOIN_TIMEOUT_MS = 2000L
 
 const val SV_REQUEST_AUDIO_RECORD_PERMISSION_CODE = 10000
 
+// Native recorder options, keep in sync with SV_OPTION in sv_common.h.
+const val SV_OPTION_OUTPUT_TYPE = 0
+const val SV_OPTION_CONTAINER = 1
+const val SV_OPTION_BUFFER_QUEUE_DEPTH = 2
+const val SV_OPTION_OUTPUT_SAMPLE_RATE = 3
+const val SV_OPTION_RESAMPLE_QUALITY = 4
+const val SV_OPTION_PREROLL_MS = 5
+const val SV_OPTION_VAD = 6
+const val SV_OPTION_VAD_THRESHOLD_DB = 7
+const val SV_OPTION_VAD_HANGOVER_MS = 8
+const val SV_OPTION_ANALYSIS_INTERVAL_MS = 9
+const val SV_OPTION_ANALYSIS_FFT_SIZE = 10
+const val SV_OPTION_AUTO_RECOVERY = 11
+const val SV_OPTION_LOW_LATENCY = 12
+const val SV_OPTION_INPUT_DEVICE_ID = 13
+const val SV_OPTION_SEGMENT_SECONDS = 14
+const val SV_OPTION_SEGMENT_KB = 15
+const val SV_OPTION_FILE_INDEX = 16
+const val SV_OPTION_ADAPTIVE_BUFFER = 17
+const val SV_OPTION_MIN_LATENCY_MS = 18
+const val SV_OPTION_MAX_LATENCY_MS = 19
+const val SV_OPTION_OPUS_BITRATE = 20
+
+const val SV_OUTPUT_STDIO = 0
+const val SV_OUTPUT_MMAP = 1
+
+const val SV_CONTAINER_RAW = 0
+const val SV_CONTAINER_WAV = 1
+const val SV_CONTAINER_FLAC = 2
+// Only in builds with libopus, setOption() fails otherwise.
+const val SV_CONTAINER_OPUS = 3
+
+const val SV_RESAMPLE_LOW = 0
+const val SV_RESAMPLE_MEDIUM = 1
+const val SV_RESAMPLE_HIGH = 2
+
+// Capture sample formats, keep in sync with SV_SAMPLE_FORMAT in sv_common.h.
+const val SV_SAMPLE_I16 = 0
+const val SV_SAMPLE_F32 = 1
+const val SV_SAMPLE_I24 = 2
+
+const val SV_THREAD_WRITER = 1
+const val SV_THREAD_STREAM = 2
+const val SV_THREAD_SINK = 3
+const val SV_THREAD_SEGMENT = 4
+
 enum class ErrorCode {
     SV_NO_ERROR,
     SV_INIT_ERROR,
@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2024 声知视界 All Rights Reserved.
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+package com.soundvision.aos_audio_record.common
+
+import java.nio.ByteBuffer
+
+/**
+ * Receives captured audio while a session records, see SVNativeRecorder.session_open_stream.
+ *
+ * Called on a dedicated native thread. [buffer] is a direct buffer over native memory that is
+ * reused once the call returns, so copy whatever has to outlive the call. Only the first [size]
+ * bytes are valid. A gap in [sequence] means audio was dropped because the listener was too slow.
+ */
+interface SVAudioStreamListener {
+    fun onAudioChunk(buffer: ByteBuffer, sequence: Long, size: Int, timestampNs: Long)
+}